@@ -26,4 +26,7 @@
 // Forward-declare the class if compile-time type checking is needed
 @class GMUserFileSystem;
 
+// VFS live metrics segment layout (read-only, no FUSE dependency)
+#include "../DMSAService/VFS/fuse_shm.h"
+
 #endif /* DMSAApp_Bridging_Header_h */
@@ -0,0 +1,118 @@
+import Foundation
+
+/// Reader for the VFS live metrics segment
+/// The service publishes counters into a memory-mapped file (see fuse_shm.h);
+/// this maps it read-only and takes seqlock-consistent snapshots without any XPC call.
+///
+/// Usage:
+/// 1. Keep one reader for the lifetime of a dashboard
+/// 2. Call snapshot() on each refresh; nil means the service is not publishing
+/// 3. Compute rates from the difference between two snapshots
+final class VFSMetricsReader {
+
+    // MARK: - Types
+
+    /// Per-operation counters from one snapshot
+    struct OpStats {
+        let name: String
+        let count: UInt64
+        let errors: UInt64
+        let bytes: UInt64
+        let totalNs: UInt64
+    }
+
+    /// One consistent copy of the segment
+    struct Snapshot {
+        let raw: FuseShmSegment
+
+        /// Publisher process is alive and writing
+        var isLive: Bool { raw.writer_pid != 0 }
+        var isMounted: Bool { raw.is_mounted != 0 }
+        var isIndexReady: Bool { raw.index_ready != 0 }
+        var isExternalOnline: Bool { raw.tiers.1.online != 0 }
+        var updatedAt: Date { Date(timeIntervalSince1970: TimeInterval(raw.updated_ms) / 1000) }
+        var totalOps: UInt64 { raw.total_ops }
+        var openHandles: Int { Int(raw.open_handles) }
+        var callbackPending: Int { Int(raw.cb_pending) }
+        var callbackDropped: UInt64 { raw.cb_dropped }
+        var slowOps: UInt64 { raw.slow_ops }
+        var externalReadsIssued: UInt64 { raw.ext_reads_issued }
+        var externalReadsMerged: UInt64 { raw.ext_reads_merged }
+
+        /// Counters for every op that has run at least once
+        var ops: [OpStats] {
+            var raw = self.raw
+            let count = min(Int(raw.op_count), Int(FUSE_SHM_MAX_OPS))
+            return withUnsafeBytes(of: &raw.ops) { buffer in
+                let entries = buffer.bindMemory(to: FuseShmOpStats.self)
+                return (0..<count).compactMap { i in
+                    var entry = entries[i]
+                    guard entry.count > 0 else { return nil }
+                    let name = withUnsafeBytes(of: &entry.name) { nameBytes in
+                        String(cString: nameBytes.bindMemory(to: CChar.self).baseAddress!)
+                    }
+                    return OpStats(name: name, count: entry.count, errors: entry.errors,
+                                   bytes: entry.bytes, totalNs: entry.total_ns)
+                }
+            }
+        }
+    }
+
+    // MARK: - Properties
+
+    private let url: URL
+    private var segment: UnsafeRawPointer?
+
+    // MARK: - Initialization
+
+    init(url: URL = Constants.Paths.vfsMetrics) {
+        self.url = url
+    }
+
+    deinit {
+        unmap()
+    }
+
+    // MARK: - Reading
+
+    /// Take a consistent snapshot
+    /// - Returns: nil if the segment does not exist, has an unknown layout, or stayed busy
+    func snapshot() -> Snapshot? {
+        guard let base = segment ?? map() else { return nil }
+
+        var out = FuseShmSegment()
+        let result = fuse_shm_read_snapshot(base.assumingMemoryBound(to: FuseShmSegment.self), &out, 100)
+        if result == -1 {
+            // Layout changed or file recreated - remap on the next call
+            unmap()
+            return nil
+        }
+        return result == 0 ? Snapshot(raw: out) : nil
+    }
+
+    // MARK: - Private
+
+    private func map() -> UnsafeRawPointer? {
+        let size = MemoryLayout<FuseShmSegment>.size
+        let fd = open(url.path, O_RDONLY)
+        guard fd >= 0 else { return nil }
+        defer { close(fd) }
+
+        var st = stat()
+        guard fstat(fd, &st) == 0, Int(st.st_size) >= size else { return nil }
+
+        guard let ptr = mmap(nil, size, PROT_READ, MAP_SHARED, fd, 0), ptr != MAP_FAILED else {
+            Logger.shared.warning("VFSMetricsReader: mmap failed for \(url.path)")
+            return nil
+        }
+        segment = UnsafeRawPointer(ptr)
+        return segment
+    }
+
+    private func unmap() {
+        if let segment = segment {
+            munmap(UnsafeMutableRawPointer(mutating: segment), MemoryLayout<FuseShmSegment>.size)
+        }
+        segment = nil
+    }
+}
@@ -76,7 +76,8 @@ enum Constants {
         ".TemporaryItems", ".Trashes", ".vol",
         "*.tmp", "*.temp", "*.swp", "*.swo", "*~",
         "Thumbs.db", "desktop.ini",
-        "*.part", "*.crdownload", "*.download", "*.partial"
+        "*.part", "*.crdownload", "*.download", "*.partial",
+        "*.dmsa_copyup", "*.dmsa_place", "*.dmsa_tee", "*.dmsa_compress"
     ]
 
     /// XPC Service Identifier (unified service)
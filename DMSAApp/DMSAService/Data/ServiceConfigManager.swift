@@ -97,6 +97,12 @@ public struct EvictionConfig: Codable, Sendable {
     /// Whether auto eviction is enabled
     public var autoEnabled: Bool = true
 
+    /// Compress cold, synced files in the local tier before evicting any (nil = off)
+    public var compressColdFiles: Bool?
+
+    /// Minimum age (seconds) before a local file is compressed (nil = 7 days)
+    public var compressMinAge: TimeInterval?
+
     public init() {}
 }
 
@@ -111,6 +117,12 @@ public struct ServiceSyncConfig: Codable, Sendable {
     /// Verify after copy
     public var verifyAfterCopy: Bool = true
 
+    /// Destination blocks read back uncached per verified copy (nil = none)
+    public var verifyReadbackSamples: Int?
+
+    /// Re-read both sides after the sync to verify (nil = off; copies are verified while copying)
+    public var verifyFullReread: Bool?
+
     /// Conflict strategy
     public var conflictStrategy: String = "localWinsWithBackup"
 
@@ -146,6 +158,19 @@ public struct ServiceConfig: Codable, Sendable {
     /// Health check interval (seconds)
     public var healthCheckInterval: TimeInterval = 60
 
+    /// OpenMetrics exporter Unix socket path (nil = exporter off)
+    public var metricsSocketPath: String?
+
+    /// VFS runtime tunables by key (e.g. "max_open_files": 1024); applied on mount and on reload
+    public var vfsTunables: [String: Int64]?
+
+    /// Extra names hidden from VFS directory listings (fnmatch globs, e.g. "*.partial")
+    public var vfsExcludePatterns: [String]?
+
+    /// VFS directories whose new files are written to EXTERNAL as they are written
+    /// (virtual paths, e.g. "/Documents/Invoices"); such files are in sync at close
+    public var vfsWriteThroughDirs: [String]?
+
     public init() {}
 }
 
@@ -229,6 +254,11 @@ actor ServiceConfigManager {
         return config
     }
 
+    /// Re-read the config file (SIGHUP / reloadConfig)
+    func reload() async {
+        await loadConfig()
+    }
+
     func updateConfig(_ newConfig: ServiceConfig) async {
         config = newConfig
         await saveConfig()
@@ -399,7 +399,9 @@ actor ServiceDatabaseManager {
             let storeDirectory = dataDirectory.appendingPathComponent("objectbox")
             try fileManager.createDirectory(at: storeDirectory, withIntermediateDirectories: true)
 
-            store = try Store(directoryPath: storeDirectory.path)
+            store = try StartupTimeline.measure("db", "objectbox_open") {
+                try Store(directoryPath: storeDirectory.path)
+            }
 
             // Get Boxes
             fileEntryBox = store?.box(for: ServiceFileEntry.self)
@@ -417,7 +419,9 @@ actor ServiceDatabaseManager {
             logger.info("Database stats: \(fileCount) file entries, \(historyCount) sync histories, \(statsCount) statistics records")
 
             // Check if migration from JSON is needed
-            await migrateFromJSONIfNeeded()
+            await StartupTimeline.measure("db", "json_migration") {
+                await migrateFromJSONIfNeeded()
+            }
 
         } catch {
             logger.error("ObjectBox initialization failed: \(error)")
@@ -436,6 +440,9 @@ actor ServiceDatabaseManager {
             return
         }
 
+        let loadPhase = StartupTimeline.begin("db", "\(syncPairId.prefix(8)).load_cache")
+        defer { StartupTimeline.end(loadPhase) }
+
         do {
             let query = try fileEntryBox?.query { ServiceFileEntry.syncPairId.isEqual(to: syncPairId) }.build()
             let entries = try query?.find() ?? []
@@ -476,6 +483,18 @@ actor ServiceDatabaseManager {
         }
     }
 
+    /// Mark evicted files externalOnly (one transaction)
+    func markFilesEvicted(virtualPaths: [String], syncPairId: String) {
+        loadCacheForSyncPair(syncPairId)
+        let entries = virtualPaths.compactMap { fileEntryCache[syncPairId]?[$0] }
+        for entry in entries {
+            entry.localPath = nil
+            entry.location = FileLocation.externalOnly.rawValue
+            entry.isDirty = false
+        }
+        saveFileEntries(entries)
+    }
+
     /// Batch write file entries (one transaction per batchSize)
     func saveFileEntries(_ entries: [ServiceFileEntry], batchSize: Int = 10000) {
         guard !entries.isEmpty else { return }
@@ -46,7 +46,7 @@ final class ServiceFSEventsMonitor {
             ".DS_Store", ".Trash", ".Spotlight-V100", ".fseventsd",
             "*.tmp", "*.temp", "*.swp", "*.swo", "*~",
             "*.part", "*.crdownload", "*.download", ".FUSE"
-        ]
+        ] + Constants.internalTempPatterns
     }
 
     // MARK: - Properties
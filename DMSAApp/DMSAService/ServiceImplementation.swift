@@ -26,6 +26,7 @@ final class ServiceImplementation: NSObject, DMSAServiceProtocol {
             await syncManager.setVFSManager(vfsManager)
             // EvictionManager needs both
             await evictionManager.setManagers(vfs: vfsManager, sync: syncManager)
+            await evictionManager.applyServiceConfig(ServiceConfigManager.shared.getConfig().eviction)
             await evictionManager.startAutoEviction()
         }
 
@@ -973,6 +974,8 @@ final class ServiceImplementation: NSObject, DMSAServiceProtocol {
     func reloadConfig() async {
         config = Self.loadConfig()
         await syncManager.updateConfig(config)
+        await vfsManager.reloadTuning()
+        await evictionManager.applyServiceConfig(ServiceConfigManager.shared.getConfig().eviction)
         logger.info("Config reloaded")
     }
 
@@ -1,4 +1,5 @@
 import Foundation
+import CryptoKit
 
 /// File copier - efficiently copies files with progress tracking
 actor FileCopier {
@@ -9,15 +10,26 @@ actor FileCopier {
         /// Whether to preserve file attributes (permissions, timestamps, etc.)
         var preserveAttributes: Bool = true
 
-        /// Whether to verify checksum after copy
+        /// Whether to verify the copy (single pass: the source is hashed from
+        /// the buffers being written, no extra read of either file)
         var verifyAfterCopy: Bool = false
 
         /// Hash algorithm used for verification
         var verifyAlgorithm: FileHasher.HashAlgorithm = .md5
 
+        /// Destination blocks read back past the page cache per verified file (0 = none)
+        var verifySampleBlocks: Int = 0
+
         /// Buffer size
         var bufferSize: Int = 1024 * 1024  // 1MB
 
+        /// Files at least this large are preallocated, copied with
+        /// largeFileBufferSize and checked for fragmentation
+        var largeFileThreshold: Int64 = 32 * 1024 * 1024
+
+        /// I/O size for large files (a multiple of every filesystem's block size)
+        var largeFileBufferSize: Int = 8 * 1024 * 1024
+
         /// Whether to overwrite existing files
         var overwriteExisting: Bool = true
 
@@ -39,6 +51,16 @@ actor FileCopier {
         var totalBytes: Int64 = 0
         var duration: TimeInterval = 0
 
+        /// Large files whose space was reserved up front / in one contiguous run
+        var preallocated: Int = 0
+        var preallocatedContiguous: Int = 0
+
+        /// Large files whose extents were counted, their total extents,
+        /// and how many ended up in more than one
+        var extentsMeasured: Int = 0
+        var totalExtents: Int = 0
+        var fragmented: Int = 0
+
         var successRate: Double {
             let total = succeeded + failed.count
             return total > 0 ? Double(succeeded) / Double(total) : 1.0
@@ -67,79 +89,17 @@ actor FileCopier {
     // MARK: - Public Methods
 
     /// Copy a single file
+    /// - Returns: Checksum of the copied bytes when verifyAfterCopy is set
+    @discardableResult
     func copy(
         from source: URL,
         to destination: URL,
         options: CopyOptions = .default,
         progressHandler: FileProgressHandler? = nil
-    ) async throws {
+    ) async throws -> String? {
         isCancelled = false
-
-        // Verify source file exists
-        guard fileManager.fileExists(atPath: source.path) else {
-            throw CopierError.sourceNotFound(source.path)
-        }
-
-        // Check if destination already exists
-        if fileManager.fileExists(atPath: destination.path) {
-            if options.overwriteExisting {
-                try fileManager.removeItem(at: destination)
-            } else {
-                throw CopierError.destinationExists(destination.path)
-            }
-        }
-
-        // Create destination directory
-        let destDir = destination.deletingLastPathComponent()
-        if !fileManager.fileExists(atPath: destDir.path) {
-            try fileManager.createDirectory(at: destDir, withIntermediateDirectories: true)
-        }
-
-        // Get source file attributes
-        let sourceAttrs = try fileManager.attributesOfItem(atPath: source.path)
-        let fileSize = (sourceAttrs[.size] as? Int64) ?? 0
-
-        // Determine write target
-        let writeTarget = options.atomicWrite
-            ? destination.appendingPathExtension(options.tempSuffix.replacingOccurrences(of: ".", with: ""))
-            : destination
-
-        // Perform copy
-        try await copyFileContents(
-            from: source,
-            to: writeTarget,
-            fileSize: fileSize,
-            bufferSize: options.bufferSize,
-            progressHandler: progressHandler
-        )
-
-        // Atomic write: rename temp file
-        if options.atomicWrite {
-            try fileManager.moveItem(at: writeTarget, to: destination)
-        }
-
-        // Preserve attributes
-        if options.preserveAttributes {
-            try preserveAttributes(from: source, to: destination)
-        }
-
-        // Verify
-        if options.verifyAfterCopy {
-            let hasher = FileHasher()
-
-            let sourceChecksum = try await hasher.hash(file: source, algorithm: options.verifyAlgorithm)
-            let destChecksum = try await hasher.hash(file: destination, algorithm: options.verifyAlgorithm)
-
-            if sourceChecksum != destChecksum {
-                // Delete corrupted file
-                try? fileManager.removeItem(at: destination)
-                throw CopierError.verificationFailed(
-                    path: destination.path,
-                    expected: sourceChecksum,
-                    actual: destChecksum
-                )
-            }
-        }
+        return try await copyFile(from: source, to: destination, options: options,
+                                  progressHandler: progressHandler).checksum
     }
 
     /// Batch copy files
@@ -272,14 +232,95 @@ actor FileCopier {
 
     // MARK: - Private Methods
 
-    /// Copy file contents
+    /// Copy one file: contents, verification, rename into place, attributes
+    private func copyFile(
+        from source: URL,
+        to destination: URL,
+        options: CopyOptions,
+        progressHandler: FileProgressHandler?
+    ) async throws -> CopiedContents {
+        // Verify source file exists
+        guard fileManager.fileExists(atPath: source.path) else {
+            throw CopierError.sourceNotFound(source.path)
+        }
+
+        // Check if destination already exists
+        if fileManager.fileExists(atPath: destination.path) {
+            if options.overwriteExisting {
+                try fileManager.removeItem(at: destination)
+            } else {
+                throw CopierError.destinationExists(destination.path)
+            }
+        }
+
+        // Create destination directory
+        let destDir = destination.deletingLastPathComponent()
+        if !fileManager.fileExists(atPath: destDir.path) {
+            try fileManager.createDirectory(at: destDir, withIntermediateDirectories: true)
+        }
+
+        // Get source file attributes
+        let sourceAttrs = try fileManager.attributesOfItem(atPath: source.path)
+        let fileSize = (sourceAttrs[.size] as? Int64) ?? 0
+
+        // Determine write target
+        let writeTarget = options.atomicWrite
+            ? destination.appendingPathExtension(options.tempSuffix.replacingOccurrences(of: ".", with: ""))
+            : destination
+
+        // Perform copy
+        let copied = try await copyFileContents(
+            from: source,
+            to: writeTarget,
+            fileSize: fileSize,
+            options: options,
+            progressHandler: progressHandler
+        )
+
+        // Verify before the copy replaces anything
+        if options.verifyAfterCopy {
+            do {
+                try verifyCopy(copied, of: source, at: writeTarget, options: options)
+            } catch {
+                try? fileManager.removeItem(at: writeTarget)
+                throw error
+            }
+        }
+
+        // Atomic write: rename temp file
+        if options.atomicWrite {
+            try fileManager.moveItem(at: writeTarget, to: destination)
+        }
+
+        // Preserve attributes
+        if options.preserveAttributes {
+            try preserveAttributes(from: source, to: destination)
+        }
+
+        return copied
+    }
+
+    /// What the copy loop saw, for single-pass verification and layout stats
+    private struct CopiedContents {
+        var checksum: String?
+        var bytes: Int64
+        var blockSize: Int
+        var sourceChanged: Bool
+        var samples: [(offset: Int64, digest: SHA256.Digest)]
+        var preallocation: FusePreallocResult?     // nil if not attempted
+        var extents: Int?                          // nil if not measured
+    }
+
+    /// Copy file contents, hashing the buffers as they are written when verifying.
+    /// Large files get their full size reserved first and are written in large
+    /// aligned chunks, so the destination lands in as few extents as possible.
     private func copyFileContents(
         from source: URL,
         to destination: URL,
         fileSize: Int64,
-        bufferSize: Int,
+        options: CopyOptions,
         progressHandler: FileProgressHandler?
-    ) async throws {
+    ) async throws -> CopiedContents {
         guard let inputHandle = try? FileHandle(forReadingFrom: source) else {
             throw CopierError.cannotOpenSource(source.path)
         }
@@ -292,6 +333,19 @@ actor FileCopier {
         }
         defer { try? outputHandle.close() }
 
+        let isLarge = fileSize >= options.largeFileThreshold
+        let blockSize = isLarge ? max(options.bufferSize, options.largeFileBufferSize) : options.bufferSize
+        let preallocation = isLarge
+            ? FusePreallocResult(UInt32(fuse_wrapper_preallocate(outputHandle.fileDescriptor, fileSize)))
+            : nil
+
+        let identity = options.verifyAfterCopy ? HashCache.identity(of: inputHandle.fileDescriptor, url: source) : nil
+        var digest = options.verifyAfterCopy ? FileHasher.StreamingDigest(algorithm: options.verifyAlgorithm) : nil
+        let sampleOffsets = options.verifyAfterCopy
+            ? Self.sampleOffsets(fileSize: fileSize, blockSize: blockSize, count: options.verifySampleBlocks)
+            : []
+        var samples: [(offset: Int64, digest: SHA256.Digest)] = []
+
         var bytesWritten: Int64 = 0
 
         while true {
@@ -309,10 +363,19 @@ actor FileCopier {
                 }
             }
 
-            let data = inputHandle.readData(ofLength: bufferSize)
+            let data = inputHandle.readData(ofLength: blockSize)
             if data.isEmpty { break }
 
-            outputHandle.write(data)
+            digest?.update(data)
+            if sampleOffsets.contains(bytesWritten) {
+                samples.append((bytesWritten, SHA256.hash(data: data)))
+            }
+
+            do {
+                try outputHandle.write(contentsOf: data)
+            } catch {
+                throw CopierError.writeError(destination.path)
+            }
             bytesWritten += Int64(data.count)
 
             progressHandler?(bytesWritten, fileSize)
@@ -320,6 +383,82 @@ actor FileCopier {
 
         // Sync to disk
         try outputHandle.synchronize()
+
+        // Fragmentation of what was just written (-1: the filesystem cannot tell)
+        let extents = isLarge ? Int(fuse_wrapper_count_extents(outputHandle.fileDescriptor)) : -1
+
+        // A source that changed under the copy may have been copied torn
+        var sourceChanged = false
+        let checksum = digest?.finalize()
+        if let identity = identity, let checksum = checksum {
+            if let after = HashCache.identity(of: inputHandle.fileDescriptor, url: source),
+               HashCache.isSame(identity, after) {
+                HashCache.store(identity, algorithm: options.verifyAlgorithm, checksum: checksum)
+            } else {
+                sourceChanged = true
+            }
+        }
+
+        return CopiedContents(
+            checksum: checksum,
+            bytes: bytesWritten,
+            blockSize: blockSize,
+            sourceChanged: sourceChanged,
+            samples: samples,
+            preallocation: preallocation,
+            extents: extents >= 0 ? extents : nil
+        )
+    }
+
+    /// Single-pass verification: the source did not change while it was read,
+    /// the destination holds every byte, and sampled blocks read back match
+    private func verifyCopy(_ copied: CopiedContents, of source: URL, at target: URL, options: CopyOptions) throws {
+        let expected = copied.checksum ?? ""
+
+        if copied.sourceChanged {
+            logger.warning("Source changed during copy: \(source.path)")
+            throw CopierError.verificationFailed(path: target.path, expected: expected, actual: "source changed")
+        }
+
+        let size = (try? fileManager.attributesOfItem(atPath: target.path))?[.size] as? Int64
+        if size != copied.bytes {
+            throw CopierError.verificationFailed(path: target.path, expected: expected,
+                                                 actual: "size \(size.map { String($0) } ?? "unknown")")
+        }
+
+        guard !copied.samples.isEmpty else { return }
+
+        let fd = open(target.path, O_RDONLY)
+        guard fd >= 0 else { throw CopierError.cannotOpenSource(target.path) }
+        defer { close(fd) }
+        // Read past the unified buffer cache where possible
+        _ = fcntl(fd, F_NOCACHE, 1)
+
+        var buffer = [UInt8](repeating: 0, count: copied.blockSize)
+        for sample in copied.samples {
+            let count = pread(fd, &buffer, buffer.count, off_t(sample.offset))
+            guard count >= 0 else { throw CopierError.cannotOpenSource(target.path) }
+            if SHA256.hash(data: buffer[0..<count]) != sample.digest {
+                logger.error("Readback mismatch at offset \(sample.offset): \(target.path)")
+                throw CopierError.verificationFailed(path: target.path, expected: expected,
+                                                     actual: "block at \(sample.offset)")
+            }
+        }
+    }
+
+    /// Block-aligned offsets to read back: first and last block, the rest random
+    private static func sampleOffsets(fileSize: Int64, blockSize: Int, count: Int) -> Set<Int64> {
+        guard count > 0, fileSize > 0, blockSize > 0 else { return [] }
+        let blocks = (fileSize + Int64(blockSize) - 1) / Int64(blockSize)
+        let target = Int(min(Int64(count), blocks))
+        var offsets: Set<Int64> = [0]
+        if target > 1 {
+            offsets.insert((blocks - 1) * Int64(blockSize))
+        }
+        while offsets.count < target {
+            offsets.insert(Int64.random(in: 0..<blocks) * Int64(blockSize))
+        }
+        return offsets
     }
 
     /// Preserve file attributes
@@ -363,7 +502,7 @@ actor FileCopier {
         progress.currentFile = metadata.fileName
 
         do {
-            try await copy(
+            let copied = try await copyFile(
                 from: sourceURL,
                 to: destURL,
                 options: options
@@ -371,6 +510,27 @@ actor FileCopier {
                 // Progress tracking handled by caller
             }
 
+            switch copied.preallocation {
+            case .some(FUSE_PREALLOC_CONTIGUOUS):
+                result.preallocatedContiguous += 1
+                result.preallocated += 1
+            case .some(FUSE_PREALLOC_ALLOCATED):
+                result.preallocated += 1
+            default:
+                break
+            }
+            if let extents = copied.extents {
+                result.extentsMeasured += 1
+                result.totalExtents += extents
+                if extents > 1 {
+                    result.fragmented += 1
+                    logger.debug("Fragmented copy: \(destination) (\(extents) extents)")
+                }
+                progress.measuredFiles += 1
+                progress.measuredExtents += extents
+                progress.fragmentedFiles += extents > 1 ? 1 : 0
+            }
+
             result.succeeded += 1
             result.totalBytes += metadata.size
             progress.processedFiles += 1
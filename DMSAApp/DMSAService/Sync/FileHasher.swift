@@ -11,6 +11,13 @@ actor FileHasher {
     /// Whether cancelled
     private var isCancelled: Bool = false
 
+    /// Whether to use the content-hash cache
+    private let useCache: Bool
+
+    /// Content-hash cache counters since the last resetCacheStats()
+    private(set) var cacheHits: Int = 0
+    private(set) var cacheMisses: Int = 0
+
     // MARK: - Logger
 
     private let logger = Logger.forService("FileHasher")
@@ -30,6 +37,15 @@ actor FileHasher {
             case .xxhash64: return "xxHash64"
             }
         }
+
+        /// Algorithm id in the content-hash cache (stored on disk, never reuse)
+        var cacheId: Int32 {
+            switch self {
+            case .md5: return 1
+            case .sha256: return 2
+            case .xxhash64: return 3
+            }
+        }
     }
 
     /// Progress callback
@@ -38,8 +54,9 @@ actor FileHasher {
 
     // MARK: - Initialization
 
-    init(bufferSize: Int = 1024 * 1024) {
+    init(bufferSize: Int = 1024 * 1024, useCache: Bool = true) {
         self.bufferSize = bufferSize
+        self.useCache = useCache
     }
 
     // MARK: - Public Methods
@@ -66,14 +83,31 @@ actor FileHasher {
         let attributes = try FileManager.default.attributesOfItem(atPath: file.path)
         let fileSize = (attributes[.size] as? Int64) ?? 0
 
-        switch algorithm {
-        case .md5:
-            return try await hashMD5(fileHandle: fileHandle, fileSize: fileSize, progressHandler: progressHandler)
-        case .sha256:
-            return try await hashSHA256(fileHandle: fileHandle, fileSize: fileSize, progressHandler: progressHandler)
-        case .xxhash64:
-            return try await hashXXHash64(fileHandle: fileHandle, fileSize: fileSize, progressHandler: progressHandler)
+        // Unchanged since it was last hashed: reuse the digest
+        let identity = useCache ? HashCache.identity(of: fileHandle.fileDescriptor, url: file) : nil
+        if let identity = identity {
+            if let checksum = HashCache.lookup(identity, algorithm: algorithm) {
+                cacheHits += 1
+                progressHandler?(fileSize, fileSize)
+                return checksum
+            }
+            cacheMisses += 1
+        }
+
+        let checksum = try await hashContents(
+            fileHandle: fileHandle,
+            fileSize: fileSize,
+            algorithm: algorithm,
+            progressHandler: progressHandler
+        )
+
+        // Only cache a digest of contents that did not change while being read
+        if let identity = identity,
+           let after = HashCache.identity(of: fileHandle.fileDescriptor, url: file),
+           HashCache.isSame(identity, after) {
+            HashCache.store(identity, algorithm: algorithm, checksum: checksum)
         }
+        return checksum
     }
 
     /// Batch calculate file checksums
@@ -177,6 +211,18 @@ actor FileHasher {
         isCancelled = true
     }
 
+    /// Content-hash cache hits and misses since the last reset
+    var cacheStats: (hits: Int, misses: Int) {
+        (cacheHits, cacheMisses)
+    }
+
+    /// Start counting cache use for a new run
+    func resetCacheStats() {
+        cacheHits = 0
+        cacheMisses = 0
+        HashCache.forgetVolumes()
+    }
+
     // MARK: - Private Methods
 
     /// Single file hash (for parallel processing)
@@ -185,114 +231,183 @@ actor FileHasher {
         return try await hash(file: file, algorithm: algorithm)
     }
 
-    /// MD5 hash
-    private func hashMD5(
+    /// Hash the rest of the file through a streaming digest
+    private func hashContents(
         fileHandle: FileHandle,
         fileSize: Int64,
+        algorithm: HashAlgorithm,
         progressHandler: FileProgressHandler?
     ) async throws -> String {
-        var hasher = Insecure.MD5()
+        var digest = StreamingDigest(algorithm: algorithm)
         var bytesRead: Int64 = 0
 
         while true {
             if isCancelled { throw HasherError.cancelled }
 
-            autoreleasepool {
-                let data = fileHandle.readData(ofLength: bufferSize)
-                if !data.isEmpty {
-                    hasher.update(data: data)
-                    bytesRead += Int64(data.count)
-                    progressHandler?(bytesRead, fileSize)
-                }
-            }
+            let data = autoreleasepool { fileHandle.readData(ofLength: bufferSize) }
+            if data.isEmpty { break }
 
-            // Check if end of file reached
-            if fileHandle.offsetInFile >= fileSize {
-                break
-            }
+            digest.update(data)
+            bytesRead += Int64(data.count)
+            progressHandler?(bytesRead, fileSize)
         }
 
-        let digest = hasher.finalize()
-        return digest.map { String(format: "%02x", $0) }.joined()
+        return digest.finalize()
     }
+}
 
-    /// SHA-256 hash
-    private func hashSHA256(
-        fileHandle: FileHandle,
-        fileSize: Int64,
-        progressHandler: FileProgressHandler?
-    ) async throws -> String {
-        var hasher = SHA256()
-        var bytesRead: Int64 = 0
+// MARK: - Streaming Digest
+
+extension FileHasher {
+    /// Incremental digest over a byte stream
+    /// Gives the same checksum as hash(file:) for the same bytes, so a copy can
+    /// hash the buffers it writes instead of reading the file again.
+    struct StreamingDigest {
+        private enum State {
+            case md5(Insecure.MD5)
+            case sha256(SHA256)
+            case xxhash64(UInt64)
+        }
 
-        while true {
-            if isCancelled { throw HasherError.cancelled }
+        // Simplified xxHash64 (fast non-cryptographic hash)
+        private static let prime1: UInt64 = 11400714785074694791
+        private static let prime2: UInt64 = 14029467366897019727
+        private static let prime5: UInt64 = 2870177450012600261
 
-            autoreleasepool {
-                let data = fileHandle.readData(ofLength: bufferSize)
-                if !data.isEmpty {
-                    hasher.update(data: data)
-                    bytesRead += Int64(data.count)
-                    progressHandler?(bytesRead, fileSize)
-                }
+        private var state: State
+
+        init(algorithm: HashAlgorithm) {
+            switch algorithm {
+            case .md5: state = .md5(Insecure.MD5())
+            case .sha256: state = .sha256(SHA256())
+            case .xxhash64: state = .xxhash64(0)
             }
+        }
 
-            if fileHandle.offsetInFile >= fileSize {
-                break
+        mutating func update(_ data: Data) {
+            switch state {
+            case .md5(var hasher):
+                hasher.update(data: data)
+                state = .md5(hasher)
+            case .sha256(var hasher):
+                hasher.update(data: data)
+                state = .sha256(hasher)
+            case .xxhash64(var hash):
+                data.withUnsafeBytes { buffer in
+                    for byte in buffer.bindMemory(to: UInt8.self) {
+                        hash = hash ^ UInt64(byte)
+                        hash = hash &* Self.prime1
+                        hash = (hash << 31) | (hash >> 33)
+                        hash = hash &* Self.prime2
+                    }
+                }
+                state = .xxhash64(hash)
             }
         }
 
-        let digest = hasher.finalize()
-        return digest.map { String(format: "%02x", $0) }.joined()
+        func finalize() -> String {
+            switch state {
+            case .md5(let hasher):
+                return hasher.finalize().map { String(format: "%02x", $0) }.joined()
+            case .sha256(let hasher):
+                return hasher.finalize().map { String(format: "%02x", $0) }.joined()
+            case .xxhash64(var hash):
+                // Final mix
+                hash = hash ^ (hash >> 33)
+                hash = hash &* Self.prime2
+                hash = hash ^ (hash >> 29)
+                hash = hash &* Self.prime5
+                hash = hash ^ (hash >> 32)
+                return String(format: "%016llx", hash)
+            }
+        }
     }
+}
 
-    /// xxHash64 hash (fast non-cryptographic hash)
-    private func hashXXHash64(
-        fileHandle: FileHandle,
-        fileSize: Int64,
-        progressHandler: FileProgressHandler?
-    ) async throws -> String {
-        // Simplified xxHash64 implementation
-        var hash: UInt64 = 0
-        let prime1: UInt64 = 11400714785074694791
-        let prime2: UInt64 = 14029467366897019727
-        let prime5: UInt64 = 2870177450012600261
-
-        var bytesRead: Int64 = 0
+// MARK: - Content-Hash Cache
 
-        while true {
-            if isCancelled { throw HasherError.cancelled }
+/// Content-hash cache - digests keyed by file identity
+/// The table lives in the C layer (fuse_wrapper_hash_cache_*), memory-mapped
+/// and shared by every hasher in the service. A digest is reused only while
+/// volume, inode, size, mtime and ctime are all unchanged.
+enum HashCache {
 
-            let data = fileHandle.readData(ofLength: bufferSize)
-            if data.isEmpty { break }
+    private static let logger = Logger.forService("HashCache")
 
-            bytesRead += Int64(data.count)
+    /// Opened on first use; hashing works uncached if the table is unavailable
+    private static let isOpen: Bool = {
+        let url = Constants.Paths.hashCache
+        try? FileManager.default.createDirectory(at: url.deletingLastPathComponent(),
+                                                 withIntermediateDirectories: true)
+        let result = fuse_wrapper_hash_cache_open(url.path, 0)
+        if result != FUSE_WRAPPER_OK.rawValue {
+            logger.warning("Hash cache unavailable: \(url.path) (\(result))")
+        }
+        return result == FUSE_WRAPPER_OK.rawValue
+    }()
+
+    /// Stable volume ids by st_dev - removable volumes get a new st_dev on each mount
+    private static var volumeIds: [UInt64: UInt64] = [:]
+    private static let volumeIdsLock = NSLock()
+
+    /// Identity of an open file, with st_dev replaced by its volume UUID
+    static func identity(of fd: Int32, url: URL) -> FuseFileIdentity? {
+        var identity = FuseFileIdentity()
+        guard fuse_wrapper_file_identity(fd, &identity) == FUSE_WRAPPER_OK.rawValue else { return nil }
+        identity.dev = volumeId(for: identity.dev, url: url)
+        return identity
+    }
 
-            data.withUnsafeBytes { buffer in
-                let bytes = buffer.bindMemory(to: UInt8.self)
-                for byte in bytes {
-                    hash = hash ^ UInt64(byte)
-                    hash = hash &* prime1
-                    hash = (hash << 31) | (hash >> 33)
-                    hash = hash &* prime2
-                }
-            }
+    static func isSame(_ a: FuseFileIdentity, _ b: FuseFileIdentity) -> Bool {
+        a.dev == b.dev && a.ino == b.ino && a.size == b.size &&
+            a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns
+    }
 
-            progressHandler?(bytesRead, fileSize)
+    static func lookup(_ identity: FuseFileIdentity, algorithm: FileHasher.HashAlgorithm) -> String? {
+        guard isOpen else { return nil }
+        var identity = identity
+        var digest = [UInt8](repeating: 0, count: Int(FUSE_HASH_MAX_DIGEST))
+        let length = fuse_wrapper_hash_cache_lookup(&identity, algorithm.cacheId, &digest, Int32(digest.count))
+        guard length > 0 else { return nil }
+        return digest.prefix(Int(length)).map { String(format: "%02x", $0) }.joined()
+    }
 
-            if fileHandle.offsetInFile >= fileSize {
-                break
-            }
+    static func store(_ identity: FuseFileIdentity, algorithm: FileHasher.HashAlgorithm, checksum: String) {
+        guard isOpen else { return }
+        // Digests are stored as bytes; checksum is lowercase hex from the hashers
+        var bytes: [UInt8] = []
+        var index = checksum.startIndex
+        while index < checksum.endIndex {
+            let next = checksum.index(index, offsetBy: 2, limitedBy: checksum.endIndex) ?? checksum.endIndex
+            guard let byte = UInt8(checksum[index..<next], radix: 16) else { return }
+            bytes.append(byte)
+            index = next
         }
+        guard !bytes.isEmpty, bytes.count <= Int(FUSE_HASH_MAX_DIGEST) else { return }
+
+        var identity = identity
+        fuse_wrapper_hash_cache_store(&identity, algorithm.cacheId, bytes, Int32(bytes.count))
+    }
 
-        // Final mix
-        hash = hash ^ (hash >> 33)
-        hash = hash &* prime2
-        hash = hash ^ (hash >> 29)
-        hash = hash &* prime5
-        hash = hash ^ (hash >> 32)
+    /// Drop the st_dev -> volume mapping (volumes may have been remounted)
+    static func forgetVolumes() {
+        volumeIdsLock.lock()
+        volumeIds.removeAll()
+        volumeIdsLock.unlock()
+    }
+
+    private static func volumeId(for dev: UInt64, url: URL) -> UInt64 {
+        volumeIdsLock.lock()
+        defer { volumeIdsLock.unlock() }
+        if let id = volumeIds[dev] { return id }
 
-        return String(format: "%016llx", hash)
+        var id = dev
+        if let uuid = try? url.resourceValues(forKeys: [.volumeUUIDStringKey]).volumeUUIDString {
+            // FNV-1a of the UUID string
+            id = uuid.utf8.reduce(UInt64(14695981039346656037)) { ($0 ^ UInt64($1)) &* 1099511628211 }
+        }
+        volumeIds[dev] = id
+        return id
     }
 }
 
@@ -338,9 +453,9 @@ extension DirectorySnapshot {
     /// Batch calculate checksums
     mutating func computeChecksums(
         algorithm: FileHasher.HashAlgorithm = .md5,
+        hasher: FileHasher = FileHasher(),
         progressHandler: FileHasher.BatchProgressHandler? = nil
     ) async throws {
-        let hasher = FileHasher()
         let baseURL = URL(fileURLWithPath: rootPath)
 
         // Only calculate checksums for files, skip directories
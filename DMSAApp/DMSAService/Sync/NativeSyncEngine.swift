@@ -13,9 +13,15 @@ class NativeSyncEngine: ObservableObject {
         /// Checksum algorithm
         var checksumAlgorithm: FileHasher.HashAlgorithm = .md5
 
-        /// Verify after copy
+        /// Verify after copy (single pass: hashed while copying, no extra read)
         var verifyAfterCopy: Bool = true
 
+        /// Destination blocks read back uncached per copied file (0 = none)
+        var verifyReadbackSamples: Int = 0
+
+        /// Also re-read and hash source and destination after the sync
+        var verifyFullReread: Bool = false
+
         /// Conflict strategy
         var conflictStrategy: ConflictStrategy = .localWinsWithBackup
 
@@ -153,6 +159,7 @@ class NativeSyncEngine: ObservableObject {
         resetProgressThrottle()
 
         let startTime = Date()
+        await hasher.resetCacheStats()
 
         defer {
             isSyncing = false
@@ -204,6 +211,7 @@ class NativeSyncEngine: ObservableObject {
             if plan.summary.isEmpty {
                 logger.info("No sync needed: \(task.syncPair.id)")
                 progress.setPhase(.completed)
+                await logChecksumCacheStats(syncPairId: task.syncPair.id)
 
                 return SyncResult(
                     planId: plan.id,
@@ -239,10 +247,10 @@ class NativeSyncEngine: ObservableObject {
             // Phase 5: Execute sync
             let copyResult = try await syncPhase(plan: resolvedPlan)
 
-            // Phase 6: Verify (if enabled)
-            var verificationFailures = 0
-            if config.verifyAfterCopy {
-                verificationFailures = try await verifyPhase(plan: resolvedPlan)
+            // Phase 6: Verify - copies were verified while copying; a full re-read is opt-in
+            var verificationFailures = copyResult.verificationFailed.count
+            if config.verifyAfterCopy && config.verifyFullReread {
+                verificationFailures += try await verifyPhase(plan: resolvedPlan)
             }
 
             // Clear state
@@ -251,6 +259,7 @@ class NativeSyncEngine: ObservableObject {
             }
 
             progress.setPhase(.completed)
+            await logChecksumCacheStats(syncPairId: task.syncPair.id)
 
             let result = SyncResult(
                 planId: plan.id,
@@ -436,7 +445,8 @@ class NativeSyncEngine: ObservableObject {
 
         // Calculate source directory checksums
         try await sourceWithChecksum.computeChecksums(
-            algorithm: config.checksumAlgorithm
+            algorithm: config.checksumAlgorithm,
+            hasher: hasher
         ) { [weak self] completed, total, file in
             processedFiles = completed
             self?.progress.checksummedFiles = processedFiles
@@ -451,7 +461,8 @@ class NativeSyncEngine: ObservableObject {
         // Calculate destination directory checksums
         let sourceCount = source.files.values.filter { !$0.isDirectory }.count
         try await destWithChecksum.computeChecksums(
-            algorithm: config.checksumAlgorithm
+            algorithm: config.checksumAlgorithm,
+            hasher: hasher
         ) { [weak self] completed, total, file in
             processedFiles = sourceCount + completed
             self?.progress.checksummedFiles = processedFiles
@@ -463,7 +474,8 @@ class NativeSyncEngine: ObservableObject {
             )
         }
 
-        logger.info("Checksum calculation completed")
+        await updateChecksumCacheStats()
+        logger.info("Checksum calculation completed: \(progress.checksumCacheHits)/\(progress.checksumCacheLookups) from cache")
 
         return (sourceWithChecksum, destWithChecksum)
     }
@@ -581,6 +593,7 @@ class NativeSyncEngine: ObservableObject {
             preserveAttributes: true,
             verifyAfterCopy: config.verifyAfterCopy,
             verifyAlgorithm: config.checksumAlgorithm,
+            verifySampleBlocks: config.verifyReadbackSamples,
             bufferSize: config.bufferSize,
             overwriteExisting: true,
             atomicWrite: true
@@ -621,10 +634,19 @@ class NativeSyncEngine: ObservableObject {
         }
 
         logger.info("Sync execution completed: succeeded \(result.succeeded), failed \(result.failed.count)")
+        logLayoutStats(result)
 
         return result
     }
 
+    /// Report how well large copies avoided fragmentation
+    private func logLayoutStats(_ result: FileCopier.CopyResult) {
+        guard result.preallocated > 0 || result.extentsMeasured > 0 else { return }
+        let avgExtents = result.extentsMeasured > 0
+            ? Double(result.totalExtents) / Double(result.extentsMeasured) : 0
+        logger.info("Copy layout: \(result.preallocated) preallocated (\(result.preallocatedContiguous) contiguous), \(result.extentsMeasured) large files measured, avg \(String(format: "%.1f", avgExtents)) extents, \(result.fragmented) fragmented")
+    }
+
     // MARK: - Lock Management Helpers
 
     /// Extract virtual path from file path
@@ -713,11 +735,28 @@ class NativeSyncEngine: ObservableObject {
             )
         }
 
+        await updateChecksumCacheStats()
         logger.info("Verification completed: \(filesToVerify.count) files, \(failures) failures")
 
         return failures
     }
 
+    /// Copy this run's content-hash cache counters into progress
+    private func updateChecksumCacheStats() async {
+        let stats = await hasher.cacheStats
+        progress.checksumCacheHits = stats.hits
+        progress.checksumCacheLookups = stats.hits + stats.misses
+    }
+
+    /// Log the content-hash cache hit rate for this run
+    private func logChecksumCacheStats(syncPairId: String) async {
+        await updateChecksumCacheStats()
+        let lookups = progress.checksumCacheLookups
+        guard lookups > 0 else { return }
+        let rate = Double(progress.checksumCacheHits) / Double(lookups) * 100
+        logger.info("Checksum cache [\(syncPairId)]: \(progress.checksumCacheHits)/\(lookups) hits (\(String(format: "%.1f", rate))%), \(lookups - progress.checksumCacheHits) files rehashed")
+    }
+
     /// Resume sync from saved state
     private func resumeSync(
         from state: SyncStateManager.SyncState,
@@ -742,6 +781,7 @@ class NativeSyncEngine: ObservableObject {
             preserveAttributes: true,
             verifyAfterCopy: config.verifyAfterCopy,
             verifyAlgorithm: config.checksumAlgorithm,
+            verifySampleBlocks: config.verifyReadbackSamples,
             bufferSize: config.bufferSize,
             overwriteExisting: true,
             atomicWrite: true
@@ -73,6 +73,15 @@ class ServiceSyncProgress: ObservableObject {
     /// Total files to checksum
     @Published var totalFilesToChecksum: Int = 0
 
+    /// Checksums answered by the content-hash cache / looked up in it (this run)
+    @Published var checksumCacheHits: Int = 0
+    @Published var checksumCacheLookups: Int = 0
+
+    /// Large copies whose extents were counted / total extents / those in more than one
+    @Published var measuredFiles: Int = 0
+    @Published var measuredExtents: Int = 0
+    @Published var fragmentedFiles: Int = 0
+
     // MARK: - Verification Progress
 
     /// Verification progress (0.0 - 1.0)
@@ -183,6 +192,11 @@ class ServiceSyncProgress: ObservableObject {
         checksumPhase = nil
         checksummedFiles = 0
         totalFilesToChecksum = 0
+        checksumCacheHits = 0
+        checksumCacheLookups = 0
+        measuredFiles = 0
+        measuredExtents = 0
+        fragmentedFiles = 0
         verificationProgress = nil
         verifiedFiles = 0
         verificationFailures = 0
@@ -73,9 +73,13 @@ actor SyncManager {
             enableChecksum: serviceConfig.sync.enableChecksum,
             checksumAlgorithm: serviceConfig.sync.checksumAlgorithm == "sha256" ? .sha256 : .md5,
             verifyAfterCopy: serviceConfig.sync.verifyAfterCopy,
+            verifyReadbackSamples: serviceConfig.sync.verifyReadbackSamples ?? 0,
+            verifyFullReread: serviceConfig.sync.verifyFullReread ?? false,
             conflictStrategy: ConflictStrategy(rawValue: serviceConfig.sync.conflictStrategy) ?? .localWinsWithBackup,
             enableDelete: serviceConfig.sync.enableDelete,
-            excludePatterns: serviceConfig.sync.excludePatterns.isEmpty ? Constants.defaultExcludePatterns : serviceConfig.sync.excludePatterns,
+            excludePatterns: serviceConfig.sync.excludePatterns.isEmpty
+                ? Constants.defaultExcludePatterns
+                : serviceConfig.sync.excludePatterns + Constants.internalTempPatterns,
             enablePauseResume: true
         )
         syncEngine = NativeSyncEngine(config: engineConfig)
@@ -129,6 +133,9 @@ actor SyncManager {
         // Force save database
         await database.forceSave()
 
+        // Flush the content-hash cache table
+        fuse_wrapper_hash_cache_close()
+
         logger.info("Sync manager shut down")
     }
 
@@ -0,0 +1,67 @@
+import Foundation
+
+/// Startup timeline
+/// Records named phases into the C layer's process-wide timeline, so Swift steps
+/// (preflight, index build, cache load) and C steps (fuse_mount, loop start,
+/// index_ready) land on one time axis.
+///
+/// Usage:
+/// 1. Wrap a step in measure(), or pair begin()/end() across scopes
+/// 2. Call emitSummary() once startup is complete (all pairs mounted)
+enum StartupTimeline {
+
+    private static let logger = Logger.forService("Startup")
+
+    // MARK: - Recording
+
+    /// Start a phase; pass the returned id to end()
+    @discardableResult
+    static func begin(_ category: String, _ name: String) -> Int32 {
+        return fuse_wrapper_timeline_begin(category, name)
+    }
+
+    /// End a phase started with begin()
+    static func end(_ phaseId: Int32) {
+        fuse_wrapper_timeline_end(phaseId)
+    }
+
+    /// Record an instant event
+    static func mark(_ category: String, _ name: String) {
+        fuse_wrapper_timeline_mark(category, name)
+    }
+
+    /// Time a synchronous step
+    static func measure<T>(_ category: String, _ name: String, _ body: () throws -> T) rethrows -> T {
+        let phase = begin(category, name)
+        defer { end(phase) }
+        return try body()
+    }
+
+    /// Time an async step
+    static func measure<T>(_ category: String, _ name: String, _ body: () async throws -> T) async rethrows -> T {
+        let phase = begin(category, name)
+        defer { end(phase) }
+        return try await body()
+    }
+
+    // MARK: - Output
+
+    /// Chrome trace file for the latest startup (open in chrome://tracing or Perfetto)
+    static var traceURL: URL {
+        Constants.Paths.logs.appendingPathComponent("startup-trace.json")
+    }
+
+    /// Log the timeline summary (C layer log) and write the Chrome trace
+    static func emitSummary() {
+        fuse_wrapper_timeline_log_summary()
+
+        var phases = [FuseTimelinePhase](repeating: FuseTimelinePhase(), count: Int(FUSE_TIMELINE_MAX_PHASES))
+        let count = Int(fuse_wrapper_timeline_get(&phases, Int32(phases.count)))
+        let endNs = phases.prefix(count).map { $0.end_ns != 0 ? $0.end_ns : $0.start_ns }.max() ?? 0
+        logger.info("Startup timeline (\(Constants.ServiceVersion.fullVersion)): \(count) events, \(String(format: "%.1f", Double(endNs) / 1e6)) ms")
+
+        if fuse_wrapper_timeline_write_chrome_trace(traceURL.path) == FUSE_WRAPPER_OK.rawValue {
+            logger.info("Startup trace: \(traceURL.path)")
+        }
+    }
+}
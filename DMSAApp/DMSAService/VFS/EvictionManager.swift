@@ -8,6 +8,8 @@ struct EvictionStats: Codable, Sendable {
     var skippedDirty: Int
     var skippedLocked: Int
     var failedSync: Int
+    var compressedCount: Int
+    var compressedSavedSize: Int64
 }
 
 /// Eviction result
@@ -37,6 +39,12 @@ actor EvictionManager {
         var autoEvictionEnabled: Bool = true
         /// Auto check interval (seconds)
         var checkInterval: TimeInterval = 300  // 5 minutes
+        /// Compress cold files in place before deleting any (APFS transparent compression)
+        var compressColdFiles: Bool = false
+        /// Minimum file age (seconds) before a file is compressed
+        var compressMinAge: TimeInterval = 7 * 24 * 3600  // 7 days
+        /// Minimum file size worth compressing
+        var compressMinSize: Int64 = 64 * 1024
     }
 
     private var config = Config()
@@ -46,12 +54,24 @@ actor EvictionManager {
         lastEvictionTime: nil,
         skippedDirty: 0,
         skippedLocked: 0,
-        failedSync: 0
+        failedSync: 0,
+        compressedCount: 0,
+        compressedSavedSize: 0
     )
 
+    /// Bytes saved by compression per sync pair (logical - allocated), as of the last eviction run.
+    /// Expires so that files deleted or rewritten since then cannot hide real usage for long.
+    private var compressedSavings: [String: (bytes: Int64, measuredAt: Date)] = [:]
+    private let compressedSavingsTTL: TimeInterval = 3600
+    /// Local paths that did not compress well; not retried until restart
+    private var incompressiblePaths: Set<String> = []
+
     private weak var vfsManager: VFSManager?
     private weak var syncManager: SyncManager?
 
+    /// fuse_wrapper_evict blocks on EXTERNAL stats; keep it off the cooperative pool
+    private let evictionQueue = DispatchQueue(label: "com.dmsa.eviction", qos: .utility)
+
     private var checkTimer: DispatchSourceTimer?
     private var isRunning = false
 
@@ -70,6 +90,15 @@ actor EvictionManager {
         return config
     }
 
+    /// Apply the service config file's eviction options
+    func applyServiceConfig(_ eviction: EvictionConfig) {
+        config.compressColdFiles = eviction.compressColdFiles ?? false
+        if let minAge = eviction.compressMinAge {
+            config.compressMinAge = minAge
+        }
+        logger.info("Cold file compression: \(config.compressColdFiles ? "on" : "off"), min age \(Int(config.compressMinAge))s")
+    }
+
     func getStats() -> EvictionStats {
         return stats
     }
@@ -138,7 +167,7 @@ actor EvictionManager {
         for mount in mounts {
             // LOCAL file actual usage based on index stats
             let stats = await database.getIndexStats(syncPairId: mount.syncPairId)
-            let localSize = stats.localSize
+            let localSize = stats.localSize - currentCompressedSavings(syncPairId: mount.syncPairId)
             let needsEviction = localSize > config.triggerThreshold
 
             logger.info("Eviction check: syncPair=\(mount.syncPairId), local usage=\(formatBytes(localSize)), cache limit=\(formatBytes(config.triggerThreshold)), needs eviction=\(needsEviction)")
@@ -196,124 +225,140 @@ actor EvictionManager {
 
         logger.info("Found \(candidates.count) candidate files")
 
-        let fm = FileManager.default
-        var processedCount = 0
-
-        for entry in candidates {
-            // Check if target reached (local usage below target)
-            if currentLocalSize <= target {
-                logger.info("Target reached: local usage \(formatBytes(currentLocalSize)) <= \(formatBytes(target))")
-                break
+        // Compressed files occupy their allocated size, not their logical size
+        var compressedAllocated: [String: Int64] = [:]
+        var savings: Int64 = 0
+        if config.compressColdFiles {
+            for entry in candidates {
+                guard let localPath = entry.localPath,
+                      let allocated = compressedAllocatedSize(atPath: localPath) else { continue }
+                compressedAllocated[entry.virtualPath] = allocated
+                savings += max(0, entry.size - allocated)
             }
-
-            // Check per-run limit
-            if processedCount >= config.maxFilesPerRun {
-                logger.info("Per-run max file count limit reached")
-                break
+            currentLocalSize -= savings
+
+            // Pass 1: compress cold files in place; only delete if that is not enough
+            if currentLocalSize > target {
+                let saved = await compressCandidates(candidates, target: target,
+                                                     localSize: &currentLocalSize,
+                                                     allocated: &compressedAllocated)
+                savings += saved
             }
+        }
 
-            // Skip directories
-            if entry.isDirectory { continue }
+        let fm = FileManager.default
+        var records: [ServiceSyncFileRecord] = []
+        var next = candidates.startIndex
+
+        // Select against the usage actually reached so far; files that come back
+        // EBUSY/ESTALE free nothing, so keep going with the next candidates
+        selection: while currentLocalSize > target, next < candidates.endIndex {
+            var selected: [ServiceFileEntry] = []
+            var projectedSize = currentLocalSize
+
+            while next < candidates.endIndex {
+                // Check if target reached (local usage below target)
+                if projectedSize <= target { break }
+
+                // Check per-run limit
+                if evictedFiles.count + selected.count >= config.maxFilesPerRun {
+                    logger.info("Per-run max file count limit reached")
+                    break
+                }
 
-            // Skip dirty files (need sync first)
-            if entry.isDirty {
-                stats.skippedDirty += 1
-                continue
-            }
+                let entry = candidates[next]
+                next += 1
 
-            // Skip locked files
-            if entry.isLocked {
-                stats.skippedLocked += 1
-                continue
-            }
+                // Skip directories
+                if entry.isDirectory { continue }
 
-            // Skip files that are too new
-            let fileAge = Date().timeIntervalSince(entry.accessedAt)
-            if fileAge < config.minFileAge {
-                continue
-            }
-
-            // Ensure file exists in EXTERNAL
-            guard let externalPath = entry.externalPath,
-                  fm.fileExists(atPath: externalPath) else {
-                // Need to sync to EXTERNAL first
-                if let syncManager = syncManager {
-                    do {
-                        try await syncManager.syncFile(virtualPath: entry.virtualPath, syncPairId: entry.syncPairId)
-                        // Skip eviction after sync success, handle in next check
-                        continue
-                    } catch {
-                        stats.failedSync += 1
-                        errors.append("Sync failed: \(entry.virtualPath) - \(error.localizedDescription)")
-                        continue
-                    }
-                } else {
-                    errors.append("SyncManager not set: \(entry.virtualPath)")
+                // Skip dirty files (need sync first)
+                if entry.isDirty {
+                    stats.skippedDirty += 1
                     continue
                 }
-            }
 
-            // Execute eviction (delete local copy)
-            guard let localPath = entry.localPath else { continue }
-
-            do {
-                let fileSize = entry.size
-
-                // Step 1: Lock file to block write/delete during eviction
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_sync_lock(cstr)
+                // Skip locked files
+                if entry.isLocked {
+                    stats.skippedLocked += 1
+                    continue
                 }
 
-                // Step 2: Mark path in FUSE exclude list so IO redirects to EXTERNAL
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_mark_evicting(cstr)
+                // Skip files that are too new
+                let fileAge = Date().timeIntervalSince(entry.accessedAt)
+                if fileAge < config.minFileAge {
+                    continue
                 }
 
-                // Step 3: Delete local copy (FUSE now routes to EXTERNAL for this path)
-                try fm.removeItem(atPath: localPath)
-
-                // Step 4: Update index (location becomes externalOnly)
-                await updateEntryLocation(entry: entry, vfsManager: vfsManager)
-
-                // Step 5: Unmark evicting after deletion complete
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_unmark_evicting(cstr)
+                // Ensure file exists in EXTERNAL
+                guard let externalPath = entry.externalPath,
+                      fm.fileExists(atPath: externalPath) else {
+                    // Need to sync to EXTERNAL first
+                    if let syncManager = syncManager {
+                        do {
+                            try await syncManager.syncFile(virtualPath: entry.virtualPath, syncPairId: entry.syncPairId)
+                            // Skip eviction after sync success, handle in next check
+                            continue
+                        } catch {
+                            stats.failedSync += 1
+                            errors.append("Sync failed: \(entry.virtualPath) - \(error.localizedDescription)")
+                            continue
+                        }
+                    } else {
+                        errors.append("SyncManager not set: \(entry.virtualPath)")
+                        continue
+                    }
                 }
 
-                // Step 6: Unlock file (allow write/delete again)
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_sync_unlock(cstr)
-                }
+                guard entry.localPath != nil else { continue }
+                selected.append(entry)
+                projectedSize -= compressedAllocated[entry.virtualPath] ?? entry.size
+            }
 
-                evictedFiles.append(entry.virtualPath)
-                freedSpace += fileSize
-                currentLocalSize -= fileSize
-                processedCount += 1
+            if selected.isEmpty { break selection }
 
-                // Record eviction success
-                let record = ServiceSyncFileRecord(syncPairId: syncPairId, diskId: "", virtualPath: entry.virtualPath, fileSize: fileSize)
-                record.status = 3  // Eviction success
-                await ServiceDatabaseManager.shared.saveSyncFileRecord(record)
+            // One call per batch: the C core locks, verifies and unlinks each file
+            let outcomes = await evictLocalCopies(selected.map { $0.virtualPath })
 
-                logger.debug("Evicted: \(entry.virtualPath) (\(formatBytes(fileSize)))")
+            for (entry, outcome) in zip(selected, outcomes) {
+                let fileSize = entry.size
+                let record = ServiceSyncFileRecord(syncPairId: syncPairId, diskId: "", virtualPath: entry.virtualPath, fileSize: fileSize)
 
-            } catch {
-                // Unmark and unlock on failure too
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_unmark_evicting(cstr)
-                }
-                entry.virtualPath.withCString { cstr in
-                    fuse_wrapper_sync_unlock(cstr)
+                if outcome.status == 0 {
+                    let allocated = compressedAllocated[entry.virtualPath]
+                    evictedFiles.append(entry.virtualPath)
+                    freedSpace += outcome.freedBytes
+                    currentLocalSize -= allocated ?? fileSize
+                    if let allocated = allocated {
+                        savings -= max(0, fileSize - allocated)
+                    }
+                    record.status = 3  // Eviction success
+                    logger.debug("Evicted: \(entry.virtualPath) (\(formatBytes(fileSize)))")
+                } else {
+                    if outcome.status == -EBUSY {
+                        stats.skippedLocked += 1
+                    }
+                    let reason = String(cString: strerror(-outcome.status))
+                    errors.append("Evict failed: \(entry.virtualPath) - \(reason)")
+                    record.fileSize = 0
+                    record.status = 4  // Eviction failure
+                    record.errorMessage = reason
                 }
+                records.append(record)
+            }
+            if outcomes.isEmpty { break selection }  // Not mounted
+        }
+
+        if currentLocalSize <= target {
+            logger.info("Target reached: local usage \(formatBytes(currentLocalSize)) <= \(formatBytes(target))")
+        }
 
-                errors.append("Delete failed: \(entry.virtualPath) - \(error.localizedDescription)")
+        // Index and history updates: one hop per run, not per file
+        await vfsManager.onFilesEvicted(virtualPaths: evictedFiles, syncPairId: syncPairId)
+        await ServiceDatabaseManager.shared.saveSyncFileRecords(records)
 
-                // Record eviction failure
-                let record = ServiceSyncFileRecord(syncPairId: syncPairId, diskId: "", virtualPath: entry.virtualPath, fileSize: 0)
-                record.status = 4  // Eviction failure
-                record.errorMessage = error.localizedDescription
-                await ServiceDatabaseManager.shared.saveSyncFileRecord(record)
-            }
+        if config.compressColdFiles {
+            compressedSavings[syncPairId] = (bytes: savings, measuredAt: Date())
         }
 
         // Update statistics
@@ -395,6 +440,43 @@ actor EvictionManager {
         return candidates
     }
 
+    /// Evict LOCAL copies through the C core (fuse_wrapper_evict)
+    /// The core stats every file on EXTERNAL, so the call runs on evictionQueue
+    /// rather than holding a cooperative-pool thread for the whole batch.
+    /// - Returns: One outcome per path, in order; empty if not mounted
+    private func evictLocalCopies(_ virtualPaths: [String]) async -> [(status: Int32, freedBytes: Int64)] {
+        guard !virtualPaths.isEmpty else { return [] }
+
+        let logger = self.logger
+        return await withCheckedContinuation { continuation in
+            evictionQueue.async {
+                continuation.resume(returning: Self.evictLocalCopiesBlocking(virtualPaths, logger: logger))
+            }
+        }
+    }
+
+    private static func evictLocalCopiesBlocking(_ virtualPaths: [String], logger: Logger) -> [(status: Int32, freedBytes: Int64)] {
+        let collector = EvictOutcomeCollector()
+        let cStrings = virtualPaths.map { strdup($0) }
+        defer { cStrings.forEach { free($0) } }
+        let pointers = cStrings.map { $0.map { UnsafePointer($0) } }
+
+        let result = pointers.withUnsafeBufferPointer { buffer in
+            fuse_wrapper_evict(buffer.baseAddress, Int32(buffer.count), { results, count, _, context in
+                guard let results = results, let context = context else { return }
+                let collector = Unmanaged<EvictOutcomeCollector>.fromOpaque(context).takeUnretainedValue()
+                for i in 0..<Int(count) {
+                    collector.outcomes.append((status: results[i].status, freedBytes: results[i].freed_bytes))
+                }
+            }, Unmanaged.passUnretained(collector).toOpaque())
+        }
+        if result < 0 {
+            logger.error("fuse_wrapper_evict failed: \(String(cString: fuse_wrapper_error_string(result)))")
+            return []
+        }
+        return collector.outcomes
+    }
+
     /// Update file entry location (eviction: both -> externalOnly)
     private func updateEntryLocation(entry: ServiceFileEntry, vfsManager: VFSManager) async {
         await vfsManager.onFileEvicted(virtualPath: entry.virtualPath, syncPairId: entry.syncPairId)
@@ -425,49 +507,23 @@ actor EvictionManager {
             throw EvictionError.notSynced(virtualPath)
         }
 
-        guard let localPath = entry.localPath else {
+        guard entry.localPath != nil else {
             throw EvictionError.noLocalPath(virtualPath)
         }
 
-        // Step 1: Lock file to block write/delete during eviction
-        virtualPath.withCString { cstr in
-            fuse_wrapper_sync_lock(cstr)
-        }
-
-        // Step 2: Mark path in FUSE exclude list so IO redirects to EXTERNAL
-        virtualPath.withCString { cstr in
-            fuse_wrapper_mark_evicting(cstr)
+        // The C core locks, verifies against EXTERNAL and unlinks in one step
+        guard let outcome = await evictLocalCopies([virtualPath]).first else {
+            throw EvictionError.notMounted(syncPairId)
         }
-
-        // Step 3: Delete local copy
-        do {
-            try FileManager.default.removeItem(atPath: localPath)
-        } catch {
-            // Unmark and unlock on failure
-            virtualPath.withCString { cstr in
-                fuse_wrapper_unmark_evicting(cstr)
-            }
-            virtualPath.withCString { cstr in
-                fuse_wrapper_sync_unlock(cstr)
-            }
-            throw error
+        guard outcome.status == 0 else {
+            throw EvictionError.evictFailed(virtualPath, String(cString: strerror(-outcome.status)))
         }
 
-        // Step 4: Update index
+        // Update index
         await updateEntryLocation(entry: entry, vfsManager: vfsManager)
 
-        // Step 5: Unmark evicting after deletion
-        virtualPath.withCString { cstr in
-            fuse_wrapper_unmark_evicting(cstr)
-        }
-
-        // Step 6: Unlock file (allow write/delete again)
-        virtualPath.withCString { cstr in
-            fuse_wrapper_sync_unlock(cstr)
-        }
-
         stats.evictedCount += 1
-        stats.evictedSize += entry.size
+        stats.evictedSize += outcome.freedBytes
 
         logger.info("Manual eviction: \(virtualPath)")
     }
@@ -511,6 +567,158 @@ actor EvictionManager {
         logger.info("Prefetch complete: \(virtualPath)")
     }
 
+    // MARK: - Cold File Compression
+
+    /// Compression savings still considered current for a sync pair
+    private func currentCompressedSavings(syncPairId: String) -> Int64 {
+        guard config.compressColdFiles, let entry = compressedSavings[syncPairId],
+              Date().timeIntervalSince(entry.measuredAt) < compressedSavingsTTL else {
+            return 0
+        }
+        return entry.bytes
+    }
+
+    /// Compress eligible candidates (oldest first) until local usage reaches target
+    /// - Returns: Bytes saved
+    private func compressCandidates(_ candidates: [ServiceFileEntry], target: Int64,
+                                    localSize: inout Int64, allocated: inout [String: Int64]) async -> Int64 {
+        var saved: Int64 = 0
+        var compressedCount = 0
+
+        for entry in candidates {
+            if localSize <= target || compressedCount >= config.maxFilesPerRun { break }
+            guard !entry.isDirectory, !entry.isDirty, !entry.isLocked,
+                  entry.size >= config.compressMinSize,
+                  allocated[entry.virtualPath] == nil,
+                  Date().timeIntervalSince(entry.accessedAt) >= config.compressMinAge,
+                  let localPath = entry.localPath,
+                  !incompressiblePaths.contains(localPath),
+                  isCompressible(path: localPath) else { continue }
+
+            guard let result = await compressFile(virtualPath: entry.virtualPath, localPath: localPath) else { continue }
+            allocated[entry.virtualPath] = result.allocated
+            saved += result.saved
+            localSize -= result.saved
+            compressedCount += 1
+        }
+
+        if compressedCount > 0 {
+            stats.compressedCount += compressedCount
+            stats.compressedSavedSize += saved
+            logger.info("Compressed \(compressedCount) cold files, saved \(formatBytes(saved))")
+        }
+        return saved
+    }
+
+    /// Rewrite a LOCAL file with APFS transparent compression (decmpfs).
+    /// Reads through the mount stay plain file reads: the kernel decompresses
+    /// 64 KiB chunks on demand and caches them like any other page.
+    /// The copy is made without blocking writers; the swap only happens if the
+    /// file is unchanged, checked under the sync lock together with the rename.
+    /// - Returns: New allocated size and bytes saved, or nil if skipped/not worth it
+    private func compressFile(virtualPath: String, localPath: String) async -> (allocated: Int64, saved: Int64)? {
+        // Open writers keep their descriptor on the old inode; never swap it under them
+        guard fuse_wrapper_is_open_for_write(virtualPath) == 0 else { return nil }
+
+        var before = stat()
+        guard lstat(localPath, &before) == 0, (before.st_mode & S_IFMT) == S_IFREG else { return nil }
+        let beforeAllocated = Int64(before.st_blocks) * 512
+
+        // Hidden, and carries a suffix the C core leaves out of listings
+        let localURL = URL(fileURLWithPath: localPath)
+        let tempPath = localURL.deletingLastPathComponent()
+            .appendingPathComponent("." + localURL.lastPathComponent + ".dmsa_compress").path
+        unlink(tempPath)
+
+        let status: Int32
+        do {
+            status = try await runDitto(["--hfsCompression", localPath, tempPath])
+        } catch {
+            logger.warning("Compress failed to start ditto: \(error.localizedDescription)")
+            return nil
+        }
+
+        var after = stat()
+        guard status == 0, lstat(tempPath, &after) == 0,
+              after.st_size == before.st_size else {
+            logger.warning("Compress failed: \(virtualPath) (ditto status \(status))")
+            unlink(tempPath)
+            return nil
+        }
+
+        let afterAllocated = Int64(after.st_blocks) * 512
+        if afterAllocated > beforeAllocated * 9 / 10 {
+            // Less than 10% saved: not worth the decompression cost on read
+            unlink(tempPath)
+            incompressiblePaths.insert(localPath)
+            return nil
+        }
+
+        // Block writes/truncate and land buffered data for the check and the swap
+        virtualPath.withCString { cstr in
+            fuse_wrapper_sync_lock(cstr)
+        }
+        defer {
+            virtualPath.withCString { cstr in
+                fuse_wrapper_sync_unlock(cstr)
+            }
+        }
+
+        // The file must not have changed (or gained a writer) while ditto ran
+        var current = stat()
+        guard lstat(localPath, &current) == 0,
+              current.st_ino == before.st_ino, current.st_size == before.st_size,
+              current.st_mtimespec.tv_sec == before.st_mtimespec.tv_sec,
+              current.st_mtimespec.tv_nsec == before.st_mtimespec.tv_nsec,
+              fuse_wrapper_is_open_for_write(virtualPath) == 0,
+              rename(tempPath, localPath) == 0 else {
+            unlink(tempPath)
+            return nil
+        }
+
+        logger.debug("Compressed: \(virtualPath) \(formatBytes(beforeAllocated)) -> \(formatBytes(afterAllocated))")
+        return (allocated: afterAllocated, saved: beforeAllocated - afterAllocated)
+    }
+
+    /// Run ditto without blocking the actor while it copies
+    /// - Returns: ditto's exit status
+    private func runDitto(_ arguments: [String]) async throws -> Int32 {
+        try await withCheckedThrowingContinuation { continuation in
+            let process = Process()
+            process.executableURL = URL(fileURLWithPath: "/usr/bin/ditto")
+            process.arguments = arguments
+            process.terminationHandler = { process in
+                continuation.resume(returning: process.terminationStatus)
+            }
+            do {
+                try process.run()
+            } catch {
+                process.terminationHandler = nil
+                continuation.resume(throwing: error)
+            }
+        }
+    }
+
+    /// On-disk size if the file is already compressed (UF_COMPRESSED), nil otherwise
+    private func compressedAllocatedSize(atPath path: String) -> Int64? {
+        var st = stat()
+        guard lstat(path, &st) == 0, (st.st_flags & UInt32(UF_COMPRESSED)) != 0 else { return nil }
+        return Int64(st.st_blocks) * 512
+    }
+
+    /// Formats that are already compressed gain nothing from another pass
+    private func isCompressible(path: String) -> Bool {
+        let ext = (path as NSString).pathExtension.lowercased()
+        return !Self.precompressedExtensions.contains(ext)
+    }
+
+    private static let precompressedExtensions: Set<String> = [
+        "jpg", "jpeg", "heic", "heif", "png", "gif", "webp",
+        "mp4", "m4v", "mov", "mkv", "avi", "mp3", "m4a", "aac", "flac",
+        "zip", "gz", "tgz", "bz2", "xz", "zst", "7z", "rar", "dmg", "pkg",
+        "docx", "xlsx", "pptx", "pages", "numbers", "key", "pdf"
+    ]
+
     // MARK: - Utility Methods
 
     private func getAvailableSpace(at path: String) -> Int64 {
@@ -530,6 +738,11 @@ actor EvictionManager {
     }
 }
 
+/// Gathers fuse_wrapper_evict results from its C callback
+private final class EvictOutcomeCollector {
+    var outcomes: [(status: Int32, freedBytes: Int64)] = []
+}
+
 // MARK: - Error Types
 
 enum EvictionError: Error, LocalizedError {
@@ -541,6 +754,7 @@ enum EvictionError: Error, LocalizedError {
     case noLocalPath(String)
     case noExternalPath(String)
     case notMounted(String)
+    case evictFailed(String, String)
 
     var errorDescription: String? {
         switch self {
@@ -560,6 +774,8 @@ enum EvictionError: Error, LocalizedError {
             return "No external path: \(path)"
         case .notMounted(let id):
             return "Sync pair not mounted: \(id)"
+        case .evictFailed(let path, let reason):
+            return "Eviction failed: \(path) - \(reason)"
         }
     }
 }
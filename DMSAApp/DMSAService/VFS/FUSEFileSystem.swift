@@ -7,6 +7,8 @@ protocol VFSFileSystemDelegate: AnyObject, Sendable {
     func fileDeleted(virtualPath: String, syncPairId: String, isDirectory: Bool)
     func fileCreated(virtualPath: String, syncPairId: String, localPath: String, isDirectory: Bool)
     func fileRenamed(fromPath: String, toPath: String, syncPairId: String, isDirectory: Bool)
+    func filePlaced(virtualPath: String, syncPairId: String)
+    func fileSynced(virtualPath: String, syncPairId: String)
     /// Callback when FUSE event loop exits unexpectedly (not an active unmount)
     func fuseDidExitUnexpectedly(syncPairId: String, exitCode: Int32)
 }
@@ -135,6 +137,15 @@ class FUSEFileSystem {
         // Set up FUSE C layer log file path
         setupCLayerLogging()
 
+        // Publish live metrics for the App and CLI tools
+        setupMetricsSegment()
+
+        // Carry delete tombstones over from the previous service instance
+        restoreHandoffState()
+
+        // Head/tail stubs of evicted files (used when stub_head_size/stub_tail_size are set)
+        setupStubDirectory()
+
         // Set up global callback context
         setupFUSECallbacks()
 
@@ -251,6 +262,41 @@ class FUSEFileSystem {
         logger.info("C layer logging enabled: \(logPath) (debug mode OFF for performance)")
     }
 
+    /// Set up the shared-memory metrics segment (read by the App without XPC)
+    private func setupMetricsSegment() {
+        let metricsURL = Constants.Paths.vfsMetrics
+        try? FileManager.default.createDirectory(at: metricsURL.deletingLastPathComponent(),
+                                                 withIntermediateDirectories: true)
+
+        let result = fuse_wrapper_shm_open(metricsURL.path, 0)
+        if result == FUSE_WRAPPER_OK.rawValue {
+            logger.info("VFS metrics segment: \(metricsURL.path)")
+        } else {
+            logger.warning("VFS metrics segment unavailable: \(metricsURL.path) (\(result))")
+        }
+    }
+
+    /// Restore delete tombstones saved by the previous instance's unmount
+    private func restoreHandoffState() {
+        let handoffURL = Constants.Paths.vfsHandoff(syncPairId: syncPairId)
+        let pending = StartupTimeline.measure("vfs", "\(syncPairId.prefix(8)).handoff_restore") {
+            fuse_wrapper_handoff_restore(handoffURL.path, localDir, externalDir)
+        }
+        if pending > 0 {
+            logger.info("Restored \(pending) pending deletes from previous instance")
+        } else if pending < 0 {
+            logger.warning("Ignored handoff state: \(handoffURL.path) (\(pending))")
+        }
+    }
+
+    /// Point partial residency stubs at this sync pair's stub directory
+    private func setupStubDirectory() {
+        let stubURL = Constants.Paths.vfsStubs(syncPairId: syncPairId)
+        if fuse_wrapper_set_stub_dir(stubURL.path) != FUSE_WRAPPER_OK.rawValue {
+            logger.warning("Stub directory unavailable: \(stubURL.path)")
+        }
+    }
+
     /// Set up FUSE callbacks
     private func setupFUSECallbacks() {
         // Save self reference to global variable for C callbacks
@@ -285,6 +331,16 @@ class FUSEFileSystem {
             let tp = String(cString: to)
             FUSEFileSystemContext.shared.fileSystem?.notifyFileRenamed(fromPath: fp, toPath: tp, isDirectory: isDirectory != 0)
         }
+        callbacks.on_file_placed = { (virtualPath) in
+            guard let vpath = virtualPath else { return }
+            let vp = String(cString: vpath)
+            FUSEFileSystemContext.shared.fileSystem?.notifyFilePlaced(virtualPath: vp)
+        }
+        callbacks.on_file_synced = { (virtualPath) in
+            guard let vpath = virtualPath else { return }
+            let vp = String(cString: vpath)
+            FUSEFileSystemContext.shared.fileSystem?.notifyFileSynced(virtualPath: vp)
+        }
         fuse_wrapper_set_callbacks(&callbacks)
 
         logger.info("FUSE callbacks registered")
@@ -347,9 +403,20 @@ class FUSEFileSystem {
         // Flush any buffered logs before unmount
         fuse_wrapper_flush_logs()
 
+        // Save delete tombstones for the next instance (unmount clears them)
+        let handoffURL = Constants.Paths.vfsHandoff(syncPairId: syncPairId)
+        let saved = fuse_wrapper_handoff_save(handoffURL.path)
+        if saved > 0 {
+            logger.info("Saved \(saved) pending deletes for restart: \(handoffURL.path)")
+        }
+
         // Call C wrapper to unmount
         fuse_wrapper_unmount()
 
+        // Final metrics snapshot; readers see the writer as stopped
+        fuse_wrapper_shm_close()
+        fuse_wrapper_metrics_stop()
+
         // Wait for FUSE thread to exit
         fuseThread?.cancel()
         fuseThread = nil
@@ -406,6 +473,133 @@ class FUSEFileSystem {
         return fuse_wrapper_is_index_ready() != 0
     }
 
+    // MARK: - Diagnostics
+
+    /// Enable/disable mutex contention profiling in the C layer
+    /// Results appear in dumpDiagnostics() and in the exit diagnostics
+    func setLockProfiling(_ enabled: Bool) {
+        fuse_wrapper_set_lock_profiling(enabled ? 1 : 0)
+        logger.info("Lock profiling: \(enabled ? "enabled" : "disabled")")
+    }
+
+    /// Reset lock contention counters (e.g. before a measurement window)
+    func resetLockStats() {
+        fuse_wrapper_reset_lock_stats()
+    }
+
+    /// Ops slower than this are logged with a per-phase breakdown (0 disables)
+    func setSlowOpThreshold(milliseconds: UInt32) {
+        fuse_wrapper_set_slow_op_threshold_ms(milliseconds)
+    }
+
+    /// Write counters, lock contention, hot paths, clients and slow ops to the C layer log
+    func dumpDiagnostics() {
+        fuse_wrapper_dump_diagnostics()
+    }
+
+    /// Serve OpenMetrics text on a Unix socket (curl --unix-socket PATH http://localhost/metrics)
+    @discardableResult
+    func startMetricsExporter(socketPath: String) -> Bool {
+        let result = fuse_wrapper_metrics_start(socketPath)
+        if result == FUSE_WRAPPER_OK.rawValue {
+            logger.info("OpenMetrics exporter: \(socketPath)")
+            return true
+        }
+        logger.warning("OpenMetrics exporter failed to start on \(socketPath) (\(result))")
+        return false
+    }
+
+    /// Stop the OpenMetrics exporter and remove its socket
+    func stopMetricsExporter() {
+        fuse_wrapper_metrics_stop()
+    }
+
+    /// Enable/disable the hot path profiler (off by default; every op takes its lock)
+    /// hotPaths() stays empty until it is enabled
+    func setHotTracking(_ enabled: Bool) {
+        fuse_wrapper_set_hot_tracking(enabled ? 1 : 0)
+    }
+
+    /// Heaviest virtual paths (or parent directories) by FUSE operation count
+    func hotPaths(directories: Bool = false, limit: Int = 10) -> [(path: String, ops: UInt64, bytes: UInt64, latencyMs: Double)] {
+        let capacity = max(0, min(limit, Int(FUSE_HOT_TOP_K)))
+        guard capacity > 0 else { return [] }
+
+        var entries = [FuseHotEntry](repeating: FuseHotEntry(), count: capacity)
+        let kind = directories ? FUSE_HOT_DIRS : FUSE_HOT_PATHS
+        let count = Int(fuse_wrapper_get_hot_paths(kind, FUSE_HOT_BY_OPS, &entries, Int32(capacity)))
+
+        return entries.prefix(count).map { entry in
+            var pathTuple = entry.path
+            let path = withUnsafePointer(to: &pathTuple) {
+                $0.withMemoryRebound(to: CChar.self, capacity: MemoryLayout.size(ofValue: pathTuple)) {
+                    String(cString: $0)
+                }
+            }
+            return (path, entry.ops, entry.bytes, Double(entry.latency_ns) / 1_000_000)
+        }
+    }
+
+    // MARK: - Client QoS
+
+    /// Assign a QoS class to processes matching a name glob (e.g. "mdworker*")
+    /// Background/bulk clients share a few op slots; bulk clients cannot trigger copy-ups
+    @discardableResult
+    func setQoSRule(processPattern: String, qos: FuseQosClass) -> Bool {
+        let result = fuse_wrapper_set_qos_rule(processPattern, qos)
+        if result != FUSE_WRAPPER_OK.rawValue {
+            logger.warning("QoS rule rejected: \(processPattern)")
+            return false
+        }
+        return true
+    }
+
+    /// Set concurrent op slots shared by background/bulk clients
+    func setBackgroundSlots(_ slots: Int) {
+        fuse_wrapper_set_background_slots(Int32(slots))
+    }
+
+    // MARK: - Runtime Tuning
+
+    /// Set a C layer tunable by config key (e.g. "max_open_files"); applies without remount
+    @discardableResult
+    func setTunable(_ name: String, value: Int64) -> Bool {
+        let id = fuse_wrapper_tunable_from_name(name)
+        guard id >= 0, fuse_wrapper_set_tunable(FuseTunable(rawValue: UInt32(id)), value) == FUSE_WRAPPER_OK.rawValue else {
+            logger.warning("Tunable rejected: \(name)=\(value)")
+            return false
+        }
+        return true
+    }
+
+    /// Current value of every tunable, keyed by config key
+    func tunables() -> [String: Int64] {
+        var values: [String: Int64] = [:]
+        for id in 0..<FUSE_TUNABLE_COUNT.rawValue {
+            var info = FuseTunableInfo()
+            if fuse_wrapper_get_tunable_info(FuseTunable(rawValue: id), &info) == FUSE_WRAPPER_OK.rawValue {
+                values[String(cString: info.name)] = info.value
+            }
+        }
+        return values
+    }
+
+    /// Replace the extra readdir exclude patterns (fnmatch globs on entry names)
+    func setExcludePatterns(_ patterns: [String]) {
+        let cStrings = patterns.map { strdup($0) }
+        defer { cStrings.forEach { free($0) } }
+        let pointers = cStrings.map { UnsafePointer($0) }
+        fuse_wrapper_set_exclude_patterns(pointers, Int32(pointers.count))
+    }
+
+    /// Replace the write-through directories (virtual paths); new files under them reach EXTERNAL as they are written
+    func setWriteThroughDirs(_ dirs: [String]) {
+        let cStrings = dirs.map { strdup($0) }
+        defer { cStrings.forEach { free($0) } }
+        let pointers = cStrings.map { UnsafePointer($0) }
+        fuse_wrapper_set_write_through_dirs(pointers, Int32(pointers.count))
+    }
+
     // MARK: - Sync Lock API
 
     /// Lock file for sync (blocks write/truncate/delete during sync)
@@ -486,6 +680,16 @@ class FUSEFileSystem {
         delegate?.fileRenamed(fromPath: fromPath, toPath: toPath, syncPairId: syncPairId, isDirectory: isDirectory)
     }
 
+    /// Notify file placed on EXTERNAL (placement policy)
+    func notifyFilePlaced(virtualPath: String) {
+        delegate?.filePlaced(virtualPath: virtualPath, syncPairId: syncPairId)
+    }
+
+    /// Notify file mirrored to EXTERNAL while written (write-through directory)
+    func notifyFileSynced(virtualPath: String) {
+        delegate?.fileSynced(virtualPath: virtualPath, syncPairId: syncPairId)
+    }
+
     /// Check if file should be excluded
     func shouldExclude(name: String) -> Bool {
         let excludePatterns = [
@@ -496,7 +700,7 @@ class FUSEFileSystem {
             ".TemporaryItems",
             "._*",
             ".FUSE"
-        ]
+        ] + Constants.internalTempPatterns
 
         for pattern in excludePatterns {
             if matchPattern(pattern, name: name) {
@@ -59,6 +59,11 @@ actor VFSManager {
         }
 
         let fm = FileManager.default
+        let phasePrefix = "\(syncPairId.prefix(8))."
+
+        // Steps 0-4 on the startup timeline; ending is idempotent, the defer covers early throws
+        let preparePhase = StartupTimeline.begin("vfs", phasePrefix + "prepare")
+        defer { StartupTimeline.end(preparePhase) }
 
         // ============================================================
         // Step 0: Check and clean up existing FUSE mount
@@ -156,6 +161,8 @@ actor VFSManager {
             logger.warning("No EXTERNAL_DIR configured, using local storage only")
         }
 
+        StartupTimeline.end(preparePhase)
+
         // ============================================================
         // Step 5: Create and execute FUSE mount
         // ============================================================
@@ -170,7 +177,17 @@ actor VFSManager {
         )
 
         // Execute mount
-        try await fuseFS.mount(at: targetDir)
+        try await StartupTimeline.measure("vfs", phasePrefix + "fuse_mount") {
+            try await fuseFS.mount(at: targetDir)
+        }
+
+        // Optional OpenMetrics exporter for local collectors
+        if let socketPath = await configManager.getConfig().metricsSocketPath {
+            fuseFS.startMetricsExporter(socketPath: socketPath)
+        }
+
+        // Runtime tuning from config (re-applied on reload)
+        await applyTuning(to: fuseFS)
 
         // ============================================================
         // Step 6: Protect LOCAL_DIR (prevent direct user access)
@@ -188,6 +205,7 @@ actor VFSManager {
         logger.info("  externalDir?.isEmpty: \(externalDir?.isEmpty ?? true)")
         logger.flush()  // Ensure logs are flushed to disk
 
+        let protectPhase = StartupTimeline.begin("vfs", phasePrefix + "protect_dirs")
         logger.info("[1/2] Starting LOCAL_DIR protection...")
         logger.flush()
         protectBackendDir(localDir)
@@ -213,6 +231,7 @@ actor VFSManager {
             logger.info("[2/2] Skipped: externalDir is nil (disk not connected)")
             logger.flush()
         }
+        StartupTimeline.end(protectPhase)
 
         // Record mount point
         let mountPoint = VFSMountPoint(
@@ -240,7 +259,9 @@ actor VFSManager {
         await ServiceStateManager.shared.setState(.indexing)
 
         // Build file index and persist
-        await buildIndex(for: syncPairId)
+        await StartupTimeline.measure("vfs", phasePrefix + "build_index") {
+            await buildIndex(for: syncPairId)
+        }
 
         // ============================================================
         // Step 8: Mark index ready, open VFS access
@@ -419,6 +440,32 @@ actor VFSManager {
         return await database.getEvictableFiles(syncPairId: syncPairId)
     }
 
+    /// Re-read service config and apply VFS tunables to all mounts without remounting
+    func reloadTuning() async {
+        await configManager.reload()
+        for mountPoint in mountPoints.values {
+            if let fuseFS = mountPoint.fuseFileSystem {
+                await applyTuning(to: fuseFS)
+            }
+        }
+    }
+
+    private func applyTuning(to fuseFS: FUSEFileSystem) async {
+        let config = await configManager.getConfig()
+        for (name, value) in config.vfsTunables ?? [:] {
+            fuseFS.setTunable(name, value: value)
+        }
+        if let patterns = config.vfsExcludePatterns {
+            fuseFS.setExcludePatterns(patterns)
+        }
+        if let dirs = config.vfsWriteThroughDirs {
+            fuseFS.setWriteThroughDirs(dirs)
+        }
+        if config.vfsTunables != nil || config.vfsExcludePatterns != nil || config.vfsWriteThroughDirs != nil {
+            logger.info("VFS tuning applied: \(fuseFS.tunables().sorted { $0.key < $1.key }.map { "\($0.key)=\($0.value)" }.joined(separator: ", "))")
+        }
+    }
+
     private func buildIndex(for syncPairId: String) async {
         guard let mountPoint = mountPoints[syncPairId] else { return }
 
@@ -814,6 +861,54 @@ actor VFSManager {
         }
     }
 
+    /// Evict files: both -> externalOnly, one database transaction for the batch
+    func onFilesEvicted(virtualPaths: [String], syncPairId: String) async {
+        guard !virtualPaths.isEmpty else { return }
+        await database.markFilesEvicted(virtualPaths: virtualPaths, syncPairId: syncPairId)
+        logger.debug("Files evicted: \(virtualPaths.count) (both -> externalOnly)")
+    }
+
+    /// New file moved to EXTERNAL by the placement policy: localOnly -> externalOnly
+    /// The EXTERNAL copy is the only one, so there is nothing left to sync
+    func onFilePlaced(virtualPath: String, syncPairId: String) async {
+        await syncManager?.clearFileDirty(virtualPath: virtualPath, syncPairId: syncPairId)
+
+        guard let entry = await database.getFileEntry(virtualPath: virtualPath, syncPairId: syncPairId) else { return }
+        let externalPath = mountPoints[syncPairId]?.externalDir.map {
+            ($0 as NSString).appendingPathComponent(String(virtualPath.dropFirst()))
+        }
+        entry.localPath = nil
+        entry.externalPath = externalPath
+        entry.location = FileLocation.externalOnly.rawValue
+        entry.isDirty = false
+        if let path = externalPath, let attrs = try? FileManager.default.attributesOfItem(atPath: path) {
+            entry.size = attrs[.size] as? Int64 ?? entry.size
+            entry.modifiedAt = attrs[.modificationDate] as? Date ?? entry.modifiedAt
+        }
+        await database.saveFileEntry(entry)
+        logger.info("File placed on EXTERNAL: \(virtualPath) (\(entry.size) bytes)")
+    }
+
+    /// File mirrored to EXTERNAL while written (write-through): localOnly -> both, clean
+    func onFileSynced(virtualPath: String, syncPairId: String) async {
+        await syncManager?.clearFileDirty(virtualPath: virtualPath, syncPairId: syncPairId)
+
+        guard let entry = await database.getFileEntry(virtualPath: virtualPath, syncPairId: syncPairId),
+              let mountPoint = mountPoints[syncPairId] else { return }
+        let relativePath = String(virtualPath.dropFirst())
+        let localPath = (mountPoint.localDir as NSString).appendingPathComponent(relativePath)
+        entry.localPath = localPath
+        entry.externalPath = mountPoint.externalDir.map { ($0 as NSString).appendingPathComponent(relativePath) }
+        entry.location = FileLocation.both.rawValue
+        entry.isDirty = false
+        if let attrs = try? FileManager.default.attributesOfItem(atPath: localPath) {
+            entry.size = attrs[.size] as? Int64 ?? entry.size
+            entry.modifiedAt = attrs[.modificationDate] as? Date ?? entry.modifiedAt
+        }
+        await database.saveFileEntry(entry)
+        logger.debug("File written through to EXTERNAL: \(virtualPath) (\(entry.size) bytes)")
+    }
+
     func onFileCreated(virtualPath: String, syncPairId: String, localPath: String, isDirectory: Bool = false) async {
         // Fast creation - minimal work in hot path
         var entry = ServiceFileEntry(virtualPath: virtualPath, syncPairId: syncPairId)
@@ -1271,6 +1366,18 @@ extension VFSManager: VFSFileSystemDelegate {
         }
     }
 
+    nonisolated func filePlaced(virtualPath: String, syncPairId: String) {
+        Task {
+            await onFilePlaced(virtualPath: virtualPath, syncPairId: syncPairId)
+        }
+    }
+
+    nonisolated func fileSynced(virtualPath: String, syncPairId: String) {
+        Task {
+            await onFileSynced(virtualPath: virtualPath, syncPairId: syncPairId)
+        }
+    }
+
     nonisolated func fuseDidExitUnexpectedly(syncPairId: String, exitCode: Int32) {
         Task {
             await handleUnexpectedFUSEExit(syncPairId: syncPairId)
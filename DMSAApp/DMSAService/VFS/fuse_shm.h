@@ -0,0 +1,187 @@
+/*
+ * fuse_shm.h
+ * DMSA - Shared-memory diagnostics segment layout
+ *
+ * The service publishes live VFS metrics into a memory-mapped file
+ * (ServiceData/vfs_metrics.shm). The app and command-line tools map it
+ * read-only and take consistent snapshots without any XPC round trip.
+ *
+ * This header has no FUSE dependency so readers can include it on its own.
+ *
+ * Consistency: single writer, seqlock. The writer makes seq odd, updates
+ * the body, then makes it even again. Readers copy the segment and retry
+ * if seq was odd or changed during the copy (fuse_shm_read_snapshot).
+ *
+ * Versioning: readers must check magic and version. Fields are only ever
+ * appended; a layout change that moves fields bumps FUSE_SHM_VERSION.
+ */
+
+#ifndef FUSE_SHM_H
+#define FUSE_SHM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FUSE_SHM_MAGIC          0x414D5344u  // "DMSA" little-endian
+#define FUSE_SHM_VERSION        2
+#define FUSE_SHM_FILE_NAME      "vfs_metrics.shm"
+
+#define FUSE_SHM_MAX_OPS        32      // >= FUSE_OP_COUNT
+#define FUSE_SHM_MAX_LOCKS      32      // >= FUSE_LOCK_COUNT
+#define FUSE_SHM_MAX_PHASES     8       // >= FUSE_PHASE_COUNT
+#define FUSE_SHM_HIST_BUCKETS   24      // log2(us) latency buckets
+#define FUSE_SHM_NAME_LEN       24
+
+// Tier index for FuseShmSegment.tiers[]
+enum {
+    FUSE_SHM_TIER_LOCAL = 0,
+    FUSE_SHM_TIER_EXTERNAL = 1,
+    FUSE_SHM_TIER_COUNT = 2
+};
+
+/**
+ * Per-operation counters
+ * hist[0] counts ops under 1us; hist[i] counts ops in [2^(i-1), 2^i) us;
+ * the last bucket also takes everything slower.
+ */
+typedef struct {
+    char name[FUSE_SHM_NAME_LEN];
+    uint64_t count;
+    uint64_t errors;
+    uint64_t bytes;
+    uint64_t total_ns;
+    uint64_t hist[FUSE_SHM_HIST_BUCKETS];
+} FuseShmOpStats;
+
+/**
+ * Per-lock contention counters (only advance while lock profiling is on)
+ */
+typedef struct {
+    char name[FUSE_SHM_NAME_LEN];
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ns;
+    uint64_t max_wait_ns;
+} FuseShmLockStats;
+
+/**
+ * Per-tier health: ops that touched the tier, how many of those failed,
+ * and the time spent resolving paths on it
+ */
+typedef struct {
+    int32_t online;             // External: directory set and not marked offline
+    int32_t _pad;
+    uint64_t ops;
+    uint64_t errors;
+    uint64_t resolve_ns;
+    uint64_t last_error_ms;     // Wall clock (ms since epoch), 0 if none
+} FuseShmTierStats;
+
+/**
+ * Segment layout (fixed size, mapped at offset 0 of the file)
+ */
+typedef struct {
+    // Header - written once when the segment is created
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                  // sizeof(FuseShmSegment) of the writer
+    uint32_t publish_interval_ms;
+    int32_t writer_pid;
+    uint32_t op_count;              // Valid entries in ops[]
+    uint32_t lock_count;            // Valid entries in locks[]
+    uint32_t phase_count;           // Valid entries in slow_phase_ns[]
+
+    // Seqlock - odd while the writer is updating the body
+    volatile uint64_t seq;
+
+    // Body
+    uint64_t publish_count;
+    uint64_t updated_ms;            // Wall clock (ms since epoch) of this snapshot
+    uint64_t started_ms;            // Wall clock when the segment was opened
+
+    int32_t is_mounted;
+    int32_t is_loop_running;
+    int32_t index_ready;
+    int32_t readonly;
+    int32_t open_handles;
+    int32_t last_signal;
+
+    uint64_t total_ops;
+    uint64_t last_op_time;          // Unix time of the last op
+
+    uint64_t cb_queued;
+    uint64_t cb_processed;
+    uint64_t cb_dropped;
+    int32_t cb_pending;
+    int32_t cb_capacity;
+
+    int32_t evicting;
+    int32_t pending_delete;
+    int32_t syncing_files;
+    int32_t background_inflight;
+    int32_t background_slots;
+    int32_t clients;
+
+    uint32_t slow_op_threshold_ms;
+    int32_t lock_profiling;
+    uint64_t slow_ops;
+    uint64_t slow_phase_ns[FUSE_SHM_MAX_PHASES];
+
+    FuseShmTierStats tiers[FUSE_SHM_TIER_COUNT];
+    FuseShmOpStats ops[FUSE_SHM_MAX_OPS];
+    FuseShmLockStats locks[FUSE_SHM_MAX_LOCKS];
+
+    uint64_t local_hits;            // Ops served by LOCAL without touching EXTERNAL
+    uint64_t local_misses;          // Ops that had to go to EXTERNAL
+
+    uint64_t ext_reads_issued;      // EXTERNAL preads sent to the drive
+    uint64_t ext_reads_merged;      // EXTERNAL preads served by another one's read
+    uint64_t ext_timeouts;          // EXTERNAL calls abandoned after external_timeout_ms
+    uint32_t ext_read_window_us;    // Current read coalescing window
+    int32_t ext_queued;             // EXTERNAL calls waiting for the executor
+
+    uint64_t hash_lookups;          // Content-hash cache lookups / hits since it was opened
+    uint64_t hash_hits;
+    uint32_t hash_entries;
+    uint32_t hash_capacity;         // 0 when no table is open
+} FuseShmSegment;
+
+/**
+ * Take a consistent copy of a mapped segment.
+ *
+ * @param seg Mapped segment (read-only mapping is fine)
+ * @param out Snapshot destination
+ * @param max_retries Copies to attempt while the writer is active
+ * @return 0 on success, -1 if the header is invalid, -2 if no stable copy was obtained
+ */
+static inline int fuse_shm_read_snapshot(const FuseShmSegment *seg, FuseShmSegment *out, int max_retries) {
+    if (!seg || !out) return -1;
+    // A newer writer may have appended fields; the known prefix is still valid
+    if (seg->magic != FUSE_SHM_MAGIC || seg->version != FUSE_SHM_VERSION ||
+        seg->size < sizeof(FuseShmSegment)) {
+        return -1;
+    }
+
+    for (int i = 0; i < max_retries; i++) {
+        uint64_t s1 = seg->seq;
+        if (s1 & 1) continue;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        memcpy(out, (const void *)seg, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (seg->seq == s1) {
+            out->seq = s1;
+            return 0;
+        }
+    }
+    return -2;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* FUSE_SHM_H */
@@ -28,9 +28,153 @@
 #include <libgen.h>
 #include <signal.h>
 #include <sys/mount.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <libproc.h>
+#include <fnmatch.h>
 
 #include "fuse_wrapper.h"
 
+// ============================================================
+// Per-operation context - thread-local state of the op being served
+// ============================================================
+// Set up by the tracing layer (op_trace_begin) for each FUSE request. Handlers
+// and helpers add phase time to it; the tracer turns it into client accounting
+// and slow-op records when the request completes.
+
+typedef struct {
+    FuseOpType op;
+    pid_t pid;
+    FuseQosClass qos;
+    int holds_background_slot;
+    int copyup_denied;
+    int tier;                       // FuseTier bits touched by this op
+    int external_error;             // -EIO once an EXTERNAL call timed out in this op
+    uint64_t phase_ns[FUSE_PHASE_COUNT];
+    FuseClientStats *client;        // Table slot the op is accounted to
+    // Last classified client on this thread (skips the table lookup on repeat
+    // until the name is due to be re-resolved)
+    pid_t cached_pid;
+    uint32_t cached_gen;
+    uint64_t cached_until;          // Unix time the cached class expires (CLIENT_NAME_TTL)
+    FuseQosClass cached_qos;
+    FuseClientStats *cached_client;
+} OpContext;
+
+static __thread OpContext t_op;
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Charge time since t0 to a phase of the current op
+static inline void phase_add(FusePhase phase, uint64_t t0) {
+    t_op.phase_ns[phase] += monotonic_ns() - t0;
+}
+
+// ============================================================
+// Lock contention profiling - instrumented mutex wrapper
+// ============================================================
+// All global mutexes are taken through DMSA_LOCK(). An uncontended trylock
+// costs nothing extra (plus a counter bump when profiling); only contended
+// acquisitions read the clock, and that wait is charged to the current op.
+#define LOCK_PROFILE_SITES 16  // Distinct waiting call sites tracked per lock
+
+typedef struct {
+    const char * volatile site;     // __func__ of the waiter (static storage)
+    volatile uint64_t waits;
+    volatile uint64_t wait_ns;
+} LockSiteProfile;
+
+typedef struct {
+    volatile uint64_t acquisitions;
+    volatile uint64_t contended;
+    volatile uint64_t wait_ns;
+    volatile uint64_t max_wait_ns;
+    LockSiteProfile sites[LOCK_PROFILE_SITES];
+} LockProfile;
+
+static LockProfile g_lock_profiles[FUSE_LOCK_COUNT];
+static volatile int g_lock_profiling = 0;
+
+static const char *g_lock_names[FUSE_LOCK_COUNT] = {
+    "g_log_mutex",
+    "g_evicting",
+    "g_open_mutex",
+    "g_state",
+    "g_callback_queue",
+    "g_pending_delete",
+    "g_syncing_files",
+    "g_hot",
+    "g_clients",
+    "g_slow_ops",
+    "g_shm",
+    "g_metrics",
+    "g_timeline",
+    "g_exclude",
+    "g_handles",
+    "g_cache_policy",
+    "g_flight",
+    "g_ext_io",
+    "g_stubs",
+    "g_tee_dirs",
+    "g_hash_cache"
+};
+
+static void lock_profile_record_wait(LockProfile *lp, const char *site, uint64_t waited) {
+    __sync_fetch_and_add(&lp->contended, 1);
+    __sync_fetch_and_add(&lp->wait_ns, waited);
+
+    uint64_t prev = lp->max_wait_ns;
+    while (waited > prev && !__sync_bool_compare_and_swap(&lp->max_wait_ns, prev, waited)) {
+        prev = lp->max_wait_ns;
+    }
+
+    // Find or claim the slot for this call site (sites are never removed)
+    for (int i = 0; i < LOCK_PROFILE_SITES; i++) {
+        const char *cur = lp->sites[i].site;
+        if (!cur && __sync_bool_compare_and_swap(&lp->sites[i].site, NULL, site)) {
+            cur = site;
+        } else if (!cur) {
+            cur = lp->sites[i].site;
+        }
+        if (cur == site) {
+            __sync_fetch_and_add(&lp->sites[i].waits, 1);
+            __sync_fetch_and_add(&lp->sites[i].wait_ns, waited);
+            return;
+        }
+    }
+}
+
+static inline void dmsa_mutex_lock(pthread_mutex_t *mutex, FuseLockId id, const char *site) {
+    int profiling = g_lock_profiling;
+    if (profiling) {
+        __sync_fetch_and_add(&g_lock_profiles[id].acquisitions, 1);
+    }
+
+    if (pthread_mutex_trylock(mutex) == 0) {
+        return;
+    }
+
+    // Contended: the wait is charged to the current op's lock phase
+    uint64_t t0 = monotonic_ns();
+    pthread_mutex_lock(mutex);
+    uint64_t waited = monotonic_ns() - t0;
+    t_op.phase_ns[FUSE_PHASE_LOCK_WAIT] += waited;
+
+    if (profiling) {
+        lock_profile_record_wait(&g_lock_profiles[id], site, waited);
+    }
+}
+
+#define DMSA_LOCK(mutex, id) dmsa_mutex_lock((mutex), (id), __func__)
+
 // ============================================================
 // Logging macros with file output support - optimized for performance
 // ============================================================
@@ -97,7 +241,7 @@ static void log_write_buffered(const char *msg, size_t len) {
 
 // Set log file path (call before mount)
 void fuse_wrapper_set_log_path(const char *path) {
-    pthread_mutex_lock(&g_log_mutex);
+    DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG);
 
     // Flush existing buffer before closing
     flush_log_buffer_locked();
@@ -123,7 +267,7 @@ void fuse_wrapper_set_log_path(const char *path) {
 
 void fuse_wrapper_set_debug(int enabled) {
     g_fuse_debug = enabled;
-    pthread_mutex_lock(&g_log_mutex);
+    DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG);
     FILE *f = get_log_file();
     fprintf(f, LOG_PREFIX "INFO: Debug logging %s\n", enabled ? "ENABLED" : "DISABLED");
     if (g_log_file) fflush(g_log_file);
@@ -132,7 +276,7 @@ void fuse_wrapper_set_debug(int enabled) {
 
 // Flush logs explicitly (call before unmount or on important events)
 void fuse_wrapper_flush_logs(void) {
-    pthread_mutex_lock(&g_log_mutex);
+    DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG);
     flush_log_buffer_locked();
     pthread_mutex_unlock(&g_log_mutex);
 }
@@ -144,7 +288,7 @@ void fuse_wrapper_flush_logs(void) {
         int _log_len = snprintf(_log_buf, sizeof(_log_buf), \
             LOG_PREFIX "DEBUG: " fmt "\n", ##__VA_ARGS__); \
         if (_log_len > 0) { \
-            pthread_mutex_lock(&g_log_mutex); \
+            DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG); \
             log_write_buffered(_log_buf, (size_t)_log_len); \
             pthread_mutex_unlock(&g_log_mutex); \
         } \
@@ -157,7 +301,7 @@ void fuse_wrapper_flush_logs(void) {
     int _log_len = snprintf(_log_buf, sizeof(_log_buf), \
         LOG_PREFIX "INFO: " fmt "\n", ##__VA_ARGS__); \
     if (_log_len > 0) { \
-        pthread_mutex_lock(&g_log_mutex); \
+        DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG); \
         log_write_buffered(_log_buf, (size_t)_log_len); \
         pthread_mutex_unlock(&g_log_mutex); \
     } \
@@ -165,7 +309,7 @@ void fuse_wrapper_flush_logs(void) {
 
 // LOG_WARN - immediate flush for warnings
 #define LOG_WARN(fmt, ...) do { \
-    pthread_mutex_lock(&g_log_mutex); \
+    DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG); \
     flush_log_buffer_locked(); \
     FILE *_f = get_log_file(); \
     fprintf(_f, LOG_PREFIX "WARN: " fmt "\n", ##__VA_ARGS__); \
@@ -175,7 +319,7 @@ void fuse_wrapper_flush_logs(void) {
 
 // LOG_ERROR - immediate flush for errors
 #define LOG_ERROR(fmt, ...) do { \
-    pthread_mutex_lock(&g_log_mutex); \
+    DMSA_LOCK(&g_log_mutex, FUSE_LOCK_LOG); \
     flush_log_buffer_locked(); \
     FILE *_f = get_log_file(); \
     fprintf(_f, LOG_PREFIX "ERROR: " fmt "\n", ##__VA_ARGS__); \
@@ -239,6 +383,30 @@ static inline void track_operation(void) {
 
 // Forward declaration for collect_exit_diagnostics (defined after g_state)
 static void collect_exit_diagnostics(const char *mount_path, int fuse_result, int saved_errno);
+static void log_lock_stats(void);
+static void log_hot_stats(void);
+static void log_client_stats(void);
+static void log_slow_op_stats(void);
+static void log_tunables(void);
+static void log_stub_stats(void);
+static void log_place_stats(void);
+static void log_tee_stats(void);
+static void log_hash_cache_stats(void);
+static uint64_t wall_clock_ms(void);
+static void flush_path_buffers(const char *path);
+struct FuseHandle;
+static void cache_policy_release(struct FuseHandle *h);
+static void tee_write_locked(struct FuseHandle *h, const char *buf, size_t size, off_t offset);
+struct TeeStream;
+struct ExtIoRequest;
+static struct TeeStream* tee_stream_new(int fd, int place);
+static int tee_submit(struct TeeStream *ts, struct ExtIoRequest *req);
+static int tee_queue_write(struct TeeStream *ts, const char *buf, size_t size, off_t offset);
+static int tee_queue_truncate(struct TeeStream *ts, off_t size);
+static void tee_throttle(struct TeeStream *ts);
+static int tee_wait(struct TeeStream *ts);
+static int tee_error(struct TeeStream *ts);
+static void tee_stream_release(struct TeeStream *ts);
 
 // ============================================================
 // Eviction exclude list - paths being evicted skip LOCAL, go to EXTERNAL
@@ -255,7 +423,7 @@ static struct {
 };
 
 static int is_evicting(const char *virtual_path) {
-    pthread_mutex_lock(&g_evicting.lock);
+    DMSA_LOCK(&g_evicting.lock, FUSE_LOCK_EVICTING);
     for (int i = 0; i < g_evicting.count; i++) {
         if (g_evicting.paths[i] && strcmp(g_evicting.paths[i], virtual_path) == 0) {
             pthread_mutex_unlock(&g_evicting.lock);
@@ -266,21 +434,31 @@ static int is_evicting(const char *virtual_path) {
     return 0;
 }
 
-void fuse_wrapper_mark_evicting(const char *virtual_path) {
-    if (!virtual_path) return;
-    pthread_mutex_lock(&g_evicting.lock);
+// Add to the exclude list; -1 if it is full
+static int evicting_add(const char *virtual_path) {
+    int res = 0;
+    DMSA_LOCK(&g_evicting.lock, FUSE_LOCK_EVICTING);
     if (g_evicting.count < MAX_EVICTING) {
         g_evicting.paths[g_evicting.count++] = strdup(virtual_path);
         LOG_DEBUG("Mark evicting: %s (count=%d)", virtual_path, g_evicting.count);
     } else {
         LOG_WARN("Eviction exclude list full (%d), cannot add: %s", MAX_EVICTING, virtual_path);
+        res = -1;
     }
     pthread_mutex_unlock(&g_evicting.lock);
+    return res;
+}
+
+void fuse_wrapper_mark_evicting(const char *virtual_path) {
+    if (!virtual_path) return;
+    // The LOCAL copy is about to be deleted; land any buffered writes first
+    flush_path_buffers(virtual_path);
+    evicting_add(virtual_path);
 }
 
 void fuse_wrapper_unmark_evicting(const char *virtual_path) {
     if (!virtual_path) return;
-    pthread_mutex_lock(&g_evicting.lock);
+    DMSA_LOCK(&g_evicting.lock, FUSE_LOCK_EVICTING);
     for (int i = 0; i < g_evicting.count; i++) {
         if (g_evicting.paths[i] && strcmp(g_evicting.paths[i], virtual_path) == 0) {
             free(g_evicting.paths[i]);
@@ -296,7 +474,7 @@ void fuse_wrapper_unmark_evicting(const char *virtual_path) {
 }
 
 void fuse_wrapper_clear_evicting(void) {
-    pthread_mutex_lock(&g_evicting.lock);
+    DMSA_LOCK(&g_evicting.lock, FUSE_LOCK_EVICTING);
     for (int i = 0; i < g_evicting.count; i++) {
         free(g_evicting.paths[i]);
         g_evicting.paths[i] = NULL;
@@ -309,15 +487,17 @@ void fuse_wrapper_clear_evicting(void) {
 // ============================================================
 // Concurrent open file limiter - prevents FUSE resource exhaustion
 // ============================================================
-#define MAX_CONCURRENT_OPENS 256
+#define DEFAULT_MAX_CONCURRENT_OPENS 256
 static volatile int g_open_count = 0;
+static volatile int g_max_open_files = DEFAULT_MAX_CONCURRENT_OPENS;  // FUSE_TUNABLE_MAX_OPEN_FILES
 static pthread_mutex_t g_open_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static int acquire_open_slot(void) {
-    pthread_mutex_lock(&g_open_mutex);
-    if (g_open_count >= MAX_CONCURRENT_OPENS) {
+    DMSA_LOCK(&g_open_mutex, FUSE_LOCK_OPEN);
+    int limit = g_max_open_files;
+    if (g_open_count >= limit) {
         pthread_mutex_unlock(&g_open_mutex);
-        LOG_WARN("Max concurrent opens reached (%d), returning EMFILE", MAX_CONCURRENT_OPENS);
+        LOG_WARN("Max concurrent opens reached (%d), returning EMFILE", limit);
         return -1;
     }
     g_open_count++;
@@ -326,7 +506,7 @@ static int acquire_open_slot(void) {
 }
 
 static void release_open_slot(void) {
-    pthread_mutex_lock(&g_open_mutex);
+    DMSA_LOCK(&g_open_mutex, FUSE_LOCK_OPEN);
     if (g_open_count > 0) {
         g_open_count--;
     }
@@ -397,20 +577,406 @@ static FuseCallbacks g_callbacks = {
     .on_file_deleted = NULL,
     .on_file_written = NULL,
     .on_file_read = NULL,
-    .on_file_renamed = NULL
+    .on_file_renamed = NULL,
+    .on_file_placed = NULL,
+    .on_file_synced = NULL
+};
+
+// ============================================================
+// Open file handles - fi->fh points to a FuseHandle
+// ============================================================
+// Handles opened for writing carry a write-behind buffer: sequential small
+// writes are coalesced and reach LOCAL as one pwrite when the buffer fills,
+// the next write is not contiguous, or on flush/fsync/release. Writable
+// handles are registered in g_handles so path-based operations (getattr,
+// read through any handle, truncate, sync lock, eviction) flush them first
+// and never observe stale data. A hashed count of dirty handles per path
+// lets those operations skip g_handles.lock when their path has none.
+#define DEFAULT_WRITE_BUFFER_SIZE (64 * 1024)
+#define DIRTY_PATH_BUCKETS 1024
+
+// Placement of a new file (see "Placement policy")
+enum {
+    PLACE_NONE = 0,                 // Not a candidate
+    PLACE_CANDIDATE,                // Created here; may move to EXTERNAL as it grows
+    PLACE_STARTING,                 // Claimed by a write; the worker is creating the EXTERNAL temp
+    PLACE_MIGRATING,                // Prefix being copied; writes below `placed` are mirrored
+    PLACE_SWITCHING,                // Caught up; every write is mirrored until the switch
+    PLACE_EXTERNAL,                 // fd is the EXTERNAL file, the LOCAL copy is gone
+    PLACE_FAILED                    // Migration abandoned; the file stays LOCAL
+};
+
+typedef struct FuseHandle {
+    int fd;
+    int writable;
+    int external;                   // fd is on EXTERNAL; reads go through the executor
+    dev_t dev;                      // Backing file identity (0/0 if fstat failed)
+    ino_t ino;
+    int stub_fd;                    // Partial residency stub serving head/tail reads (-1 if none)
+    off_t stub_head;                // File bytes [0, stub_head) are in the stub
+    off_t stub_tail;                // File bytes [size - stub_tail, size) follow them
+    char *backing_path;             // EXTERNAL file to open (fd = -1) on the first uncovered read
+    char *path;                     // Virtual path, kept current across renames (changed
+                                    // under both g_handles.lock and lock)
+    pthread_mutex_t lock;           // Guards the buffer fields below
+    char *buf;                      // Allocated on the first buffered write
+    size_t buf_capacity;
+    size_t buf_len;
+    off_t buf_offset;               // File offset of buf[0]
+    uint32_t dirty_bucket;          // g_handles.dirty_paths slot counted while buf_len > 0
+    int deferred_error;             // Failed flush not yet reported (-errno)
+    off_t size;                     // Backing size at open (cache policy)
+    off_t read_next;                // Offset following the last read
+    uint64_t seq_bytes;             // Bytes read sequentially up to read_next
+    int nocache;                    // Backing fd is in nocache mode
+    int streamed;                   // Read as a stream; remembered for the next open
+    int place;                      // PLACE_* state
+    int place_fd;                   // EXTERNAL temp (place_io's) while migrating, then the retired LOCAL fd
+    struct TeeStream *place_io;     // Ordered EXTERNAL writes from the first mirror write on; owns the
+                                    // EXTERNAL fd, which is fd itself once placed
+    off_t placed;                   // File bytes [0, placed) are on EXTERNAL
+    off_t place_copy_end;           // End of the chunk the worker is copying (0 if none)
+    int place_raced;                // A write or truncate hit that chunk; it is copied again
+    int place_shrunk;               // LOCAL truncated while migrating; the temp may be longer
+    char *place_tmp;                // EXTERNAL temp path
+    int place_running;              // Migration worker alive
+    int place_orphaned;             // Released while the worker ran; it finishes the release
+    struct TeeStream *tee;          // Write-through copy on EXTERNAL (NULL if none)
+    int pins;                       // Users outside g_handles.lock; close waits (g_handles.lock)
+    struct FuseHandle *prev;        // g_handles list (writable handles only)
+    struct FuseHandle *next;
+} FuseHandle;
+
+static struct {
+    FuseHandle *head;
+    volatile int dirty;             // Handles holding unflushed data
+    volatile int dirty_paths[DIRTY_PATH_BUCKETS];   // The same, by hash of path (unlocked fast-path check)
+    volatile uint64_t buffered_writes;
+    volatile uint64_t flushes;
+    pthread_cond_t unpinned;        // Some handle's pins dropped to 0
+    pthread_mutex_t lock;
+} g_handles = {
+    .head = NULL,
+    .dirty = 0,
+    .buffered_writes = 0,
+    .flushes = 0,
+    .unpinned = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static volatile int g_write_buffer_size = DEFAULT_WRITE_BUFFER_SIZE;  // FUSE_TUNABLE_WRITE_BUFFER_SIZE
+
+#define FUSE_HANDLE(fi) ((FuseHandle *)(uintptr_t)(fi)->fh)
+
+static uint32_t dirty_path_bucket(const char *path) {
+    uint32_t hash = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)path; *p; p++) {
+        hash ^= *p;
+        hash *= 16777619u;
+    }
+    return hash % DIRTY_PATH_BUCKETS;
+}
+
+// The buffer went from empty to holding data, or back (h->lock held)
+static void handle_mark_dirty_locked(FuseHandle *h) {
+    h->dirty_bucket = dirty_path_bucket(h->path);
+    __sync_fetch_and_add(&g_handles.dirty_paths[h->dirty_bucket], 1);
+    __sync_fetch_and_add(&g_handles.dirty, 1);
+}
+
+static void handle_mark_clean_locked(FuseHandle *h) {
+    __sync_fetch_and_sub(&g_handles.dirty_paths[h->dirty_bucket], 1);
+    __sync_fetch_and_sub(&g_handles.dirty, 1);
+}
+
+static FuseHandle* handle_new(int fd, const char *path, int writable) {
+    FuseHandle *h = calloc(1, sizeof(FuseHandle));
+    if (!h) return NULL;
+    h->path = strdup(path);
+    if (!h->path) {
+        free(h);
+        return NULL;
+    }
+    h->fd = fd;
+    h->writable = writable;
+    h->stub_fd = -1;
+    h->place_fd = -1;
+    pthread_mutex_init(&h->lock, NULL);
+
+    if (writable) {
+        DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+        h->next = g_handles.head;
+        if (g_handles.head) g_handles.head->prev = h;
+        g_handles.head = h;
+        pthread_mutex_unlock(&g_handles.lock);
+    }
+    return h;
+}
+
+// pwrite to the backing file (h->lock held). While the file migrates to
+// EXTERNAL, the part of the write EXTERNAL already has is queued there too;
+// if that fails the migration is abandoned and the file stays LOCAL. Once
+// placed, the write is only queued (the caller waits in place_wait).
+static ssize_t handle_pwrite_locked(FuseHandle *h, const char *buf, size_t size, off_t offset) {
+    if (h->place == PLACE_EXTERNAL) {
+        int res = tee_queue_write(h->place_io, buf, size, offset);
+        if (res != 0) {
+            errno = res == -ETIMEDOUT ? EIO : -res;
+            return -1;
+        }
+        return (ssize_t)size;
+    }
+    ssize_t n = pwrite(h->fd, buf, size, offset);
+    if (n > 0 && h->tee) tee_write_locked(h, buf, (size_t)n, offset);
+    if (n > 0 && h->place == PLACE_MIGRATING && offset < h->place_copy_end && offset + n > h->placed) {
+        h->place_raced = 1;
+    }
+    if (n > 0 && (h->place == PLACE_SWITCHING || (h->place == PLACE_MIGRATING && offset < h->placed))) {
+        size_t mirror = h->place == PLACE_SWITCHING || (size_t)(h->placed - offset) >= (size_t)n
+            ? (size_t)n : (size_t)(h->placed - offset);
+        // A failure shows up as place_io's error; the worker then keeps the file LOCAL
+        tee_queue_write(h->place_io, buf, mirror, offset);
+    }
+    return n;
+}
+
+// Write out the buffer (called with h->lock held); returns 0 or -errno
+static int handle_flush_locked(FuseHandle *h) {
+    if (h->buf_len == 0) return 0;
+
+    uint64_t t0 = monotonic_ns();
+    size_t done = 0;
+    int res = 0;
+    while (done < h->buf_len) {
+        ssize_t n = handle_pwrite_locked(h, h->buf + done, h->buf_len - done, h->buf_offset + (off_t)done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            res = n < 0 ? -errno : -EIO;
+            break;
+        }
+        done += (size_t)n;
+    }
+    phase_add(FUSE_PHASE_BACKEND, t0);
+
+    if (res != 0) {
+        LOG_WARN("write buffer flush failed: %s, %zu bytes at %lld, errno=%d",
+                 h->path, h->buf_len - done, (long long)(h->buf_offset + (off_t)done), -res);
+    }
+    // The data is dropped either way; the error is what reaches the app
+    h->buf_len = 0;
+    handle_mark_clean_locked(h);
+    __sync_fetch_and_add(&g_handles.flushes, 1);
+    return res;
+}
+
+// Flush and report any error left by an earlier flush
+static int handle_flush(FuseHandle *h) {
+    if (!h->writable) return 0;
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int res = handle_flush_locked(h);
+    if (res == 0) res = h->deferred_error;
+    h->deferred_error = 0;
+    pthread_mutex_unlock(&h->lock);
+    return res;
+}
+
+// Done with a handle found under g_handles.lock and used after dropping it
+static void handle_unpin(FuseHandle *h) {
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    if (--h->pins == 0) pthread_cond_broadcast(&g_handles.unpinned);
+    pthread_mutex_unlock(&g_handles.lock);
+}
+
+// Unregister, flush, close and free (release path)
+static int handle_close(FuseHandle *h) {
+    if (h->writable) {
+        DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+        if (h->prev) h->prev->next = h->next;
+        else g_handles.head = h->next;
+        if (h->next) h->next->prev = h->prev;
+        while (h->pins > 0) pthread_cond_wait(&g_handles.unpinned, &g_handles.lock);
+        pthread_mutex_unlock(&g_handles.lock);
+    }
+
+    int res = handle_flush(h);
+    cache_policy_release(h);
+    uint64_t t0 = monotonic_ns();
+    // A placed handle's fd belongs to place_io
+    if (h->fd >= 0 && h->place != PLACE_EXTERNAL) close(h->fd);
+    if (h->stub_fd >= 0) close(h->stub_fd);
+    if (h->place_fd >= 0) close(h->place_fd);
+    if (h->place_io) tee_stream_release(h->place_io);
+    phase_add(FUSE_PHASE_BACKEND, t0);
+
+    pthread_mutex_destroy(&h->lock);
+    if (h->buf) free(h->buf);
+    free(h->backing_path);
+    free(h->place_tmp);
+    free(h->path);
+    free(h);
+    return res;
+}
+
+// Buffer or write one chunk; returns bytes accepted or -errno
+static int handle_write(FuseHandle *h, const char *buf, size_t size, off_t offset) {
+    size_t capacity = h->writable ? (size_t)g_write_buffer_size : 0;
+
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int res = h->deferred_error;
+    h->deferred_error = 0;
+    // From the switch on, every write waits for EXTERNAL (place_wait); nothing is left buffered
+    if (h->place == PLACE_SWITCHING || h->place == PLACE_EXTERNAL) capacity = 0;
+
+    // Not contiguous with the buffered run, or would overflow it
+    if (res == 0 && h->buf_len > 0 &&
+        (offset != h->buf_offset + (off_t)h->buf_len || h->buf_len + size > h->buf_capacity)) {
+        res = handle_flush_locked(h);
+    }
+
+    if (res == 0 && size < capacity) {
+        if (h->buf_len == 0 && h->buf_capacity != capacity) {
+            free(h->buf);
+            h->buf = malloc(capacity);
+            h->buf_capacity = h->buf ? capacity : 0;
+        }
+        if (h->buf && h->buf_len + size <= h->buf_capacity) {
+            if (h->buf_len == 0) {
+                h->buf_offset = offset;
+                handle_mark_dirty_locked(h);
+            }
+            memcpy(h->buf + h->buf_len, buf, size);
+            h->buf_len += size;
+            __sync_fetch_and_add(&g_handles.buffered_writes, 1);
+            if (h->buf_len == h->buf_capacity) {
+                res = handle_flush_locked(h);
+            }
+            pthread_mutex_unlock(&h->lock);
+            return res ? res : (int)size;
+        }
+    }
+
+    if (res == 0) {
+        uint64_t t0 = monotonic_ns();
+        ssize_t n = handle_pwrite_locked(h, buf, size, offset);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        res = n < 0 ? -errno : (int)n;
+    }
+    pthread_mutex_unlock(&h->lock);
+    return res;
+}
+
+// Is path the same as prefix, or inside it when prefix is a directory?
+static int path_in_subtree(const char *path, const char *prefix, size_t prefix_len) {
+    return strncmp(path, prefix, prefix_len) == 0 &&
+           (path[prefix_len] == '\0' || path[prefix_len] == '/');
+}
+
+// Flush buffered writes on every handle of path
+static void flush_path_buffers(const char *path) {
+    if (g_handles.dirty == 0 || !path) return;
+    if (g_handles.dirty_paths[dirty_path_bucket(path)] == 0) return;
+
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h; h = h->next) {
+        if (strcmp(h->path, path) != 0) continue;
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        int res = handle_flush_locked(h);
+        if (res != 0 && h->deferred_error == 0) h->deferred_error = res;
+        pthread_mutex_unlock(&h->lock);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+}
+
+int fuse_wrapper_is_open_for_write(const char *virtual_path) {
+    if (!virtual_path) return 0;
+    int open_for_write = 0;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h; h = h->next) {
+        if (strcmp(h->path, virtual_path) == 0) {
+            open_for_write = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+    return open_for_write;
+}
+
+static void log_write_buffer_stats(void) {
+    LOG_INFO("Write buffer: size=%d, dirty handles=%d, buffered writes=%llu, flushes=%llu",
+             g_write_buffer_size, g_handles.dirty,
+             (unsigned long long)g_handles.buffered_writes,
+             (unsigned long long)g_handles.flushes);
+}
+
+// Keep handle paths current after a rename (file or directory)
+static void handles_rename(const char *from, const char *to) {
+    size_t from_len = strlen(from);
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h; h = h->next) {
+        if (!path_in_subtree(h->path, from, from_len)) continue;
+        size_t rest = strlen(h->path + from_len);
+        char *renamed = malloc(strlen(to) + rest + 1);
+        if (!renamed) continue;
+        memcpy(renamed, to, strlen(to));
+        memcpy(renamed + strlen(to), h->path + from_len, rest + 1);
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        // Buffered data now belongs to the new path
+        if (h->buf_len > 0) {
+            handle_mark_clean_locked(h);
+            free(h->path);
+            h->path = renamed;
+            handle_mark_dirty_locked(h);
+        } else {
+            free(h->path);
+            h->path = renamed;
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+}
+
+// ============================================================
+// Runtime-adjustable readdir limit and exclude patterns
+// ============================================================
+#define DEFAULT_READDIR_MAX_ENTRIES 8192
+#define MAX_EXCLUDE_PATTERNS 64
+
+static volatile int g_readdir_max_entries = DEFAULT_READDIR_MAX_ENTRIES;  // FUSE_TUNABLE_READDIR_MAX_ENTRIES
+
+// fnmatch patterns hidden from readdir in addition to the built-in names
+static struct {
+    char *patterns[MAX_EXCLUDE_PATTERNS];
+    volatile int count;
+    pthread_mutex_t lock;
+} g_exclude = {
+    .count = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
 };
 
+static int exclude_patterns_match(const char *name) {
+    if (g_exclude.count == 0) return 0;  // Common case: no lock
+    int matched = 0;
+    DMSA_LOCK(&g_exclude.lock, FUSE_LOCK_EXCLUDE);
+    for (int i = 0; i < g_exclude.count && !matched; i++) {
+        matched = fnmatch(g_exclude.patterns[i], name, 0) == 0;
+    }
+    pthread_mutex_unlock(&g_exclude.lock);
+    return matched;
+}
+
 // ============================================================
 // Async callback queue - dispatch callbacks without blocking FUSE
 // ============================================================
-#define CALLBACK_QUEUE_SIZE 4096
+#define CALLBACK_QUEUE_SIZE 4096     // Default capacity (FUSE_TUNABLE_CALLBACK_QUEUE_SIZE)
 
 typedef enum {
     CB_TYPE_CREATED,
     CB_TYPE_DELETED,
     CB_TYPE_WRITTEN,
     CB_TYPE_READ,
-    CB_TYPE_RENAMED
+    CB_TYPE_RENAMED,
+    CB_TYPE_PLACED,
+    CB_TYPE_SYNCED
 } CallbackType;
 
 typedef struct {
@@ -421,7 +987,8 @@ typedef struct {
 } CallbackItem;
 
 static struct {
-    CallbackItem items[CALLBACK_QUEUE_SIZE];
+    CallbackItem *items;            // Ring of capacity slots, allocated on first use
+    volatile int capacity;
     volatile int head;
     volatile int tail;
     pthread_mutex_t lock;
@@ -429,6 +996,8 @@ static struct {
     pthread_t thread;
     volatile int running;
 } g_callback_queue = {
+    .items = NULL,
+    .capacity = CALLBACK_QUEUE_SIZE,
     .head = 0,
     .tail = 0,
     .lock = PTHREAD_MUTEX_INITIALIZER,
@@ -437,6 +1006,12 @@ static struct {
     .running = 0
 };
 
+// Items waiting for the worker (unlocked read; approximate while a resize runs)
+static int callback_queue_pending(void) {
+    int capacity = g_callback_queue.capacity;
+    return (g_callback_queue.head - g_callback_queue.tail + capacity) % capacity;
+}
+
 // Callback statistics for diagnostics
 static volatile uint64_t g_cb_queued = 0;
 static volatile uint64_t g_cb_processed = 0;
@@ -459,7 +1034,7 @@ static struct {
 
 // Add a path to pending delete set (called before delete)
 static void pending_delete_add(const char *path) {
-    pthread_mutex_lock(&g_pending_delete.lock);
+    DMSA_LOCK(&g_pending_delete.lock, FUSE_LOCK_PENDING_DELETE);
 
     // Check if already exists
     for (int i = 0; i < g_pending_delete.count; i++) {
@@ -484,7 +1059,7 @@ static void pending_delete_add(const char *path) {
 // Check if a full path is pending delete (for readdir filtering)
 // Returns 1 if the given full path (e.g. "/foo/bar") is pending delete
 static int pending_delete_contains(const char *full_path) {
-    pthread_mutex_lock(&g_pending_delete.lock);
+    DMSA_LOCK(&g_pending_delete.lock, FUSE_LOCK_PENDING_DELETE);
     for (int i = 0; i < g_pending_delete.count; i++) {
         if (g_pending_delete.paths[i] && strcmp(g_pending_delete.paths[i], full_path) == 0) {
             pthread_mutex_unlock(&g_pending_delete.lock);
@@ -497,7 +1072,7 @@ static int pending_delete_contains(const char *full_path) {
 
 // Remove a path from pending delete set (called after successful external delete or timeout)
 static void pending_delete_remove(const char *path) {
-    pthread_mutex_lock(&g_pending_delete.lock);
+    DMSA_LOCK(&g_pending_delete.lock, FUSE_LOCK_PENDING_DELETE);
     for (int i = 0; i < g_pending_delete.count; i++) {
         if (g_pending_delete.paths[i] && strcmp(g_pending_delete.paths[i], path) == 0) {
             free(g_pending_delete.paths[i]);
@@ -512,7 +1087,7 @@ static void pending_delete_remove(const char *path) {
 
 // Clear all pending deletes (called on unmount)
 static void pending_delete_clear(void) {
-    pthread_mutex_lock(&g_pending_delete.lock);
+    DMSA_LOCK(&g_pending_delete.lock, FUSE_LOCK_PENDING_DELETE);
     for (int i = 0; i < g_pending_delete.count; i++) {
         free(g_pending_delete.paths[i]);
         g_pending_delete.paths[i] = NULL;
@@ -538,7 +1113,7 @@ static struct {
 
 // Add a path to syncing files set (blocks write/delete during sync)
 static void syncing_files_add(const char *path) {
-    pthread_mutex_lock(&g_syncing_files.lock);
+    DMSA_LOCK(&g_syncing_files.lock, FUSE_LOCK_SYNCING_FILES);
 
     // Check if already exists
     for (int i = 0; i < g_syncing_files.count; i++) {
@@ -564,7 +1139,8 @@ static void syncing_files_add(const char *path) {
 
 // Check if a path is currently syncing (blocks write/truncate/delete)
 static int syncing_files_contains(const char *path) {
-    pthread_mutex_lock(&g_syncing_files.lock);
+    if (g_syncing_files.count == 0) return 0;
+    DMSA_LOCK(&g_syncing_files.lock, FUSE_LOCK_SYNCING_FILES);
     for (int i = 0; i < g_syncing_files.count; i++) {
         if (g_syncing_files.paths[i] && strcmp(g_syncing_files.paths[i], path) == 0) {
             pthread_mutex_unlock(&g_syncing_files.lock);
@@ -577,7 +1153,7 @@ static int syncing_files_contains(const char *path) {
 
 // Remove a path from syncing files set (sync completed)
 static void syncing_files_remove(const char *path) {
-    pthread_mutex_lock(&g_syncing_files.lock);
+    DMSA_LOCK(&g_syncing_files.lock, FUSE_LOCK_SYNCING_FILES);
     for (int i = 0; i < g_syncing_files.count; i++) {
         if (g_syncing_files.paths[i] && strcmp(g_syncing_files.paths[i], path) == 0) {
             free(g_syncing_files.paths[i]);
@@ -593,7 +1169,7 @@ static void syncing_files_remove(const char *path) {
 
 // Clear all syncing files (called on unmount)
 static void syncing_files_clear(void) {
-    pthread_mutex_lock(&g_syncing_files.lock);
+    DMSA_LOCK(&g_syncing_files.lock, FUSE_LOCK_SYNCING_FILES);
     for (int i = 0; i < g_syncing_files.count; i++) {
         free(g_syncing_files.paths[i]);
         g_syncing_files.paths[i] = NULL;
@@ -609,6 +1185,8 @@ static void syncing_files_clear(void) {
 void fuse_wrapper_sync_lock(const char *path) {
     if (path) {
         syncing_files_add(path);
+        // The sync reads LOCAL directly, so it must see buffered writes
+        flush_path_buffers(path);
     }
 }
 
@@ -631,7 +1209,7 @@ static void* callback_worker(void *arg) {
         CallbackItem item;
         int has_item = 0;
 
-        pthread_mutex_lock(&g_callback_queue.lock);
+        DMSA_LOCK(&g_callback_queue.lock, FUSE_LOCK_CALLBACK_QUEUE);
 
         // Wait for items or shutdown
         while (g_callback_queue.head == g_callback_queue.tail && g_callback_queue.running) {
@@ -644,7 +1222,7 @@ static void* callback_worker(void *arg) {
 
         if (g_callback_queue.head != g_callback_queue.tail) {
             item = g_callback_queue.items[g_callback_queue.tail];
-            g_callback_queue.tail = (g_callback_queue.tail + 1) % CALLBACK_QUEUE_SIZE;
+            g_callback_queue.tail = (g_callback_queue.tail + 1) % g_callback_queue.capacity;
             has_item = 1;
         }
 
@@ -678,6 +1256,16 @@ static void* callback_worker(void *arg) {
                         g_callbacks.on_file_renamed(item.path, item.path2, item.is_directory);
                     }
                     break;
+                case CB_TYPE_PLACED:
+                    if (g_callbacks.on_file_placed) {
+                        g_callbacks.on_file_placed(item.path);
+                    }
+                    break;
+                case CB_TYPE_SYNCED:
+                    if (g_callbacks.on_file_synced) {
+                        g_callbacks.on_file_synced(item.path);
+                    }
+                    break;
             }
             __sync_fetch_and_add(&g_cb_processed, 1);
         }
@@ -690,12 +1278,23 @@ static void* callback_worker(void *arg) {
 
 // Queue a callback for async processing (returns immediately, never blocks FUSE)
 static void queue_callback(CallbackType type, const char *path, const char *path2, int is_dir) {
-    pthread_mutex_lock(&g_callback_queue.lock);
+    uint64_t t0 = monotonic_ns();
+    uint64_t lock_wait_before = t_op.phase_ns[FUSE_PHASE_LOCK_WAIT];
+    DMSA_LOCK(&g_callback_queue.lock, FUSE_LOCK_CALLBACK_QUEUE);
+
+    if (!g_callback_queue.items) {
+        g_callback_queue.items = calloc((size_t)g_callback_queue.capacity, sizeof(CallbackItem));
+        if (!g_callback_queue.items) {
+            __sync_fetch_and_add(&g_cb_dropped, 1);
+            pthread_mutex_unlock(&g_callback_queue.lock);
+            return;
+        }
+    }
 
-    int next_head = (g_callback_queue.head + 1) % CALLBACK_QUEUE_SIZE;
+    int next_head = (g_callback_queue.head + 1) % g_callback_queue.capacity;
     if (next_head == g_callback_queue.tail) {
         // Queue full - drop oldest item to make room (avoid blocking)
-        g_callback_queue.tail = (g_callback_queue.tail + 1) % CALLBACK_QUEUE_SIZE;
+        g_callback_queue.tail = (g_callback_queue.tail + 1) % g_callback_queue.capacity;
         __sync_fetch_and_add(&g_cb_dropped, 1);
         if (g_cb_dropped % 100 == 1) {
             LOG_WARN("Callback queue overflow! dropped=%llu", (unsigned long long)g_cb_dropped);
@@ -723,6 +1322,10 @@ static void queue_callback(CallbackType type, const char *path, const char *path
 
     pthread_cond_signal(&g_callback_queue.cond);
     pthread_mutex_unlock(&g_callback_queue.lock);
+
+    // Queue lock wait is already in the lock phase; charge only the rest here
+    phase_add(FUSE_PHASE_CALLBACK, t0);
+    t_op.phase_ns[FUSE_PHASE_CALLBACK] -= t_op.phase_ns[FUSE_PHASE_LOCK_WAIT] - lock_wait_before;
 }
 
 // Start callback worker thread
@@ -748,7 +1351,7 @@ static void stop_callback_worker(void) {
 
     g_callback_queue.running = 0;
 
-    pthread_mutex_lock(&g_callback_queue.lock);
+    DMSA_LOCK(&g_callback_queue.lock, FUSE_LOCK_CALLBACK_QUEUE);
     pthread_cond_signal(&g_callback_queue.cond);
     pthread_mutex_unlock(&g_callback_queue.lock);
 
@@ -762,12 +1365,14 @@ static void stop_callback_worker(void) {
 void fuse_wrapper_set_callbacks(const FuseCallbacks *callbacks) {
     if (callbacks) {
         g_callbacks = *callbacks;
-        LOG_INFO("Callbacks registered: created=%p, deleted=%p, written=%p, read=%p, renamed=%p",
+        LOG_INFO("Callbacks registered: created=%p, deleted=%p, written=%p, read=%p, renamed=%p, placed=%p, synced=%p",
                  (void*)g_callbacks.on_file_created,
                  (void*)g_callbacks.on_file_deleted,
                  (void*)g_callbacks.on_file_written,
                  (void*)g_callbacks.on_file_read,
-                 (void*)g_callbacks.on_file_renamed);
+                 (void*)g_callbacks.on_file_renamed,
+                 (void*)g_callbacks.on_file_placed,
+                 (void*)g_callbacks.on_file_synced);
     } else {
         memset(&g_callbacks, 0, sizeof(g_callbacks));
         LOG_INFO("Callbacks cleared");
@@ -804,1673 +1409,6988 @@ void fuse_wrapper_set_callbacks(const FuseCallbacks *callbacks) {
         LOG_DEBUG("CB queued: renamed %s -> %s (dir=%d)", from, to, is_dir); \
     } while(0)
 
+// Written file now lives on EXTERNAL only (placement policy); replaces WRITTEN
+#define NOTIFY_FILE_PLACED(vpath) \
+    do { \
+        queue_callback(CB_TYPE_PLACED, vpath, NULL, 0); \
+        LOG_DEBUG("CB queued: placed %s", vpath); \
+    } while(0)
+
+// Written file was mirrored to EXTERNAL by write-through; replaces WRITTEN
+#define NOTIFY_FILE_SYNCED(vpath) \
+    do { \
+        queue_callback(CB_TYPE_SYNCED, vpath, NULL, 0); \
+        LOG_DEBUG("CB queued: synced %s", vpath); \
+    } while(0)
+
 // ============================================================
-// Helper functions
+// Hot path profiler - Space-Saving heavy hitters per path/directory
 // ============================================================
+// One sketch per (kind, metric). Each keeps FUSE_HOT_TOP_K counters; a key not
+// in the sketch replaces the minimum counter and inherits its weight as error,
+// so memory stays bounded no matter how many distinct paths are touched.
 
-// Index not ready check macro - blocks non-root directory access
-// When index is not ready, returns EBUSY (device busy), telling apps to retry later
-#define CHECK_INDEX_READY_FOR_PATH(path) \
-    do { \
-        if (!g_state.index_ready && strcmp(path, "/") != 0) { \
-            LOG_DEBUG("Index not ready, blocking access: %s", path); \
-            return -EBUSY; \
-        } \
-    } while (0)
+typedef struct {
+    char *key;                    // strdup'd path (NULL if slot unused)
+    uint32_t hash;                // FNV-1a of key, compared before strcmp
+    uint64_t weight;
+    uint64_t error;
+    uint64_t ops;
+    uint64_t bytes;
+    uint64_t latency_ns;
+    uint64_t op_mask;
+} HotCounter;
 
-// Index not ready check - for all operations except root directory
-#define CHECK_INDEX_READY() \
-    do { \
-        if (!g_state.index_ready) { \
-            LOG_DEBUG("Index not ready, blocking operation"); \
-            return -EBUSY; \
-        } \
-    } while (0)
+typedef struct {
+    HotCounter counters[FUSE_HOT_TOP_K];
+    int count;
+} HotSketch;
 
-// Collect detailed exit diagnostics (implementation after g_state is defined)
-static void collect_exit_diagnostics(const char *mount_path, int fuse_result, int saved_errno) {
-    LOG_INFO("========== FUSE EXIT DIAGNOSTICS ==========");
+static struct {
+    HotSketch sketches[FUSE_HOT_KIND_COUNT][FUSE_HOT_METRIC_COUNT];
+    pthread_mutex_t lock;
+} g_hot = {
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    // Basic exit info
-    LOG_INFO("Exit code: %d, errno: %d (%s)", fuse_result, saved_errno, strerror(saved_errno));
+// Off by default: while on, every op updates the sketches under g_hot.lock
+static volatile int g_hot_tracking = 0;
 
-    // Signal info
-    if (g_last_signal != 0) {
-        LOG_WARN("Exit signal: %d (%s)", (int)g_last_signal, strsignal((int)g_last_signal));
-    } else {
-        LOG_INFO("Exit signal: none");
+static inline uint32_t hot_hash(const char *key) {
+    uint32_t h = 2166136261u;
+    for (const unsigned char *p = (const unsigned char *)key; *p; p++) {
+        h ^= *p;
+        h *= 16777619u;
     }
+    return h;
+}
 
-    // Operation stats
-    LOG_INFO("Total ops since mount: %llu", (unsigned long long)g_total_ops);
-    if (g_last_op_time > 0) {
-        time_t now = time(NULL);
-        LOG_INFO("Last op: %lld seconds ago", (long long)(now - g_last_op_time));
+// Add weight to key (called with g_hot.lock held)
+static void hot_sketch_update(HotSketch *sk, const char *key, uint32_t hash, uint64_t weight,
+                              FuseOpType op, uint64_t bytes, uint64_t latency_ns) {
+    HotCounter *c = NULL;
+    HotCounter *min = NULL;
+
+    // Single pass: find the key or the minimum counter to replace
+    for (int i = 0; i < sk->count; i++) {
+        HotCounter *cur = &sk->counters[i];
+        if (cur->hash == hash && strcmp(cur->key, key) == 0) {
+            c = cur;
+            break;
+        }
+        if (!min || cur->weight < min->weight) {
+            min = cur;
+        }
     }
 
-    // Callback queue stats
-    LOG_INFO("Callback queue: queued=%llu, processed=%llu, dropped=%llu, pending=%d",
-             (unsigned long long)g_cb_queued,
-             (unsigned long long)g_cb_processed,
-             (unsigned long long)g_cb_dropped,
-             (int)((g_callback_queue.head - g_callback_queue.tail + CALLBACK_QUEUE_SIZE) % CALLBACK_QUEUE_SIZE));
+    if (!c) {
+        char *dup = strdup(key);
+        if (!dup) return;
 
-    // macFUSE device state
-    int macfuse_devs = check_macfuse_device();
-    LOG_INFO("macFUSE devices in /dev: %d", macfuse_devs);
+        if (sk->count < FUSE_HOT_TOP_K) {
+            c = &sk->counters[sk->count++];
+            memset(c, 0, sizeof(*c));
+        } else {
+            // Replace minimum: its weight becomes the new key's error bound
+            c = min;
+            free(c->key);
+            uint64_t floor_weight = c->weight;
+            memset(c, 0, sizeof(*c));
+            c->weight = floor_weight;
+            c->error = floor_weight;
+        }
+        c->key = dup;
+        c->hash = hash;
+    }
 
-    // Mount point state
-    struct stat mp_stat;
-    if (stat(mount_path, &mp_stat) != 0) {
-        LOG_WARN("Mount point stat failed: %s (errno=%d %s)", mount_path, errno, strerror(errno));
-    } else {
-        LOG_INFO("Mount point exists: mode=0x%x, uid=%d, gid=%d",
-                 mp_stat.st_mode, mp_stat.st_uid, mp_stat.st_gid);
+    c->weight += weight;
+    c->ops++;
+    c->bytes += bytes;
+    c->latency_ns += latency_ns;
+    c->op_mask |= (1ULL << op);
+}
+
+// Parent directory of a virtual path ("/a/b" -> "/a", "/a" -> "/")
+static void hot_parent_dir(const char *path, char *out, size_t out_size) {
+    const char *slash = strrchr(path, '/');
+    size_t len = slash ? (size_t)(slash - path) : 0;
+    if (len == 0) {
+        strncpy(out, "/", out_size);
+        return;
     }
+    if (len >= out_size) len = out_size - 1;
+    memcpy(out, path, len);
+    out[len] = '\0';
+}
 
-    // Filesystem type at mount point
-    struct statfs fs_stat;
-    if (statfs(mount_path, &fs_stat) == 0) {
-        LOG_INFO("Filesystem type: %s, flags=0x%x", fs_stat.f_fstypename, fs_stat.f_flags);
+// Record one completed operation
+static void hot_record(FuseOpType op, const char *path, uint64_t bytes, uint64_t latency_ns) {
+    if (!path) return;
+
+    // readdir/mkdir/rmdir act on the directory itself; everything else on its parent
+    char dir[1024];
+    if (op == FUSE_OP_READDIR || op == FUSE_OP_MKDIR || op == FUSE_OP_RMDIR) {
+        strncpy(dir, path, sizeof(dir) - 1);
+        dir[sizeof(dir) - 1] = '\0';
     } else {
-        LOG_WARN("statfs failed: errno=%d (%s)", errno, strerror(errno));
+        hot_parent_dir(path, dir, sizeof(dir));
     }
 
-    // Check FUSE channel state
-    if (g_state.chan) {
-        LOG_INFO("FUSE channel: valid");
-    } else {
-        LOG_WARN("FUSE channel: NULL");
+    const char *keys[FUSE_HOT_KIND_COUNT] = { path, dir };
+    uint32_t hashes[FUSE_HOT_KIND_COUNT] = { hot_hash(path), hot_hash(dir) };
+    uint64_t weights[FUSE_HOT_METRIC_COUNT] = { 1, bytes, latency_ns };
+
+    DMSA_LOCK(&g_hot.lock, FUSE_LOCK_HOT);
+    for (int kind = 0; kind < FUSE_HOT_KIND_COUNT; kind++) {
+        for (int metric = 0; metric < FUSE_HOT_METRIC_COUNT; metric++) {
+            // Zero-weight events (e.g. bytes for getattr) would only churn the sketch
+            if (weights[metric] == 0) continue;
+            hot_sketch_update(&g_hot.sketches[kind][metric], keys[kind], hashes[kind],
+                              weights[metric], op, bytes, latency_ns);
+        }
     }
+    pthread_mutex_unlock(&g_hot.lock);
+}
 
-    // Interpret common errno values
-    switch (saved_errno) {
-        case ENODEV:  // 19
-            LOG_WARN("ENODEV: macFUSE kernel module may have been unloaded or device disconnected");
-            break;
-        case ENOTCONN:  // 57
-            LOG_WARN("ENOTCONN: FUSE connection lost (kernel-userspace channel broken)");
-            break;
-        case EINTR:  // 4
-            LOG_INFO("EINTR: Interrupted by signal");
-            break;
-        case EIO:  // 5
-            LOG_WARN("EIO: I/O error on FUSE device");
-            break;
-        case ENOENT:  // 2
-            LOG_WARN("ENOENT: Mount point or device no longer exists");
-            break;
-        default:
-            if (saved_errno != 0) {
-                LOG_INFO("errno %d: %s", saved_errno, strerror(saved_errno));
+static void hot_reset_locked(void) {
+    for (int kind = 0; kind < FUSE_HOT_KIND_COUNT; kind++) {
+        for (int metric = 0; metric < FUSE_HOT_METRIC_COUNT; metric++) {
+            HotSketch *sk = &g_hot.sketches[kind][metric];
+            for (int i = 0; i < sk->count; i++) {
+                free(sk->counters[i].key);
+                sk->counters[i].key = NULL;
             }
-            break;
+            sk->count = 0;
+        }
     }
-
-    LOG_INFO("========== END DIAGNOSTICS ==========");
 }
 
-// Join paths
-static char* join_path(const char *base, const char *path) {
-    if (!base || !path) return NULL;
-
-    // Skip leading / from path
-    while (*path == '/') path++;
-
-    size_t base_len = strlen(base);
-    size_t path_len = strlen(path);
+// ============================================================
+// Per-client accounting and QoS classes
+// ============================================================
+// Each traced op is attributed to the calling pid (fuse_get_context()). The
+// process name is resolved once per client and matched against QoS rules:
+// BACKGROUND/BULK clients share a few concurrent op slots, BULK clients also
+// may not trigger copy-ups that would pull EXTERNAL files into LOCAL.
 
-    // Remove trailing / from base
-    while (base_len > 0 && base[base_len - 1] == '/') {
-        base_len--;
-    }
+#define CLIENT_NAME_TTL 60          // Re-resolve process name after idle (pid reuse)
+#define DEFAULT_BACKGROUND_SLOTS 4
 
-    char *result = malloc(base_len + 1 + path_len + 1);
-    if (!result) return NULL;
+typedef struct {
+    char pattern[64];
+    FuseQosClass qos;
+} QosRule;
 
-    memcpy(result, base, base_len);
-    result[base_len] = '/';
-    strcpy(result + base_len + 1, path);
+static struct {
+    FuseClientStats clients[FUSE_MAX_CLIENTS];
+    int count;
+    QosRule rules[FUSE_MAX_QOS_RULES];
+    int rule_count;
+    uint32_t rules_gen;             // Bumped on rule change, invalidates thread caches
+    int background_slots;
+    int background_inflight;
+    pthread_cond_t background_cond;
+    pthread_mutex_t lock;
+} g_clients = {
+    .rules = {
+        { "mds",            FUSE_QOS_BULK },        // Spotlight
+        { "mds_stores",     FUSE_QOS_BULK },
+        { "mdworker*",      FUSE_QOS_BULK },
+        { "mdsync",         FUSE_QOS_BULK },
+        { "backupd*",       FUSE_QOS_BULK },        // Time Machine
+        { "photoanalysisd", FUSE_QOS_BACKGROUND },
+        { "mediaanalysisd", FUSE_QOS_BACKGROUND },
+    },
+    .rule_count = 7,
+    .rules_gen = 1,
+    .background_slots = DEFAULT_BACKGROUND_SLOTS,
+    .background_inflight = 0,
+    .background_cond = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    return result;
+static void client_resolve_name(pid_t pid, char *name, size_t size) {
+    if (pid == 0) {
+        strncpy(name, "kernel", size);
+        return;
+    }
+    if (proc_name(pid, name, (uint32_t)size) <= 0) {
+        snprintf(name, size, "pid-%d", (int)pid);
+    }
 }
 
-// Get local path
-static char* get_local_path(const char *virtual_path) {
-    return join_path(g_state.local_dir, virtual_path);
+// First matching rule wins (called with g_clients.lock held)
+static FuseQosClass qos_classify_locked(const char *name) {
+    for (int i = 0; i < g_clients.rule_count; i++) {
+        if (fnmatch(g_clients.rules[i].pattern, name, 0) == 0) {
+            return g_clients.rules[i].qos;
+        }
+    }
+    return FUSE_QOS_INTERACTIVE;
 }
 
-// Get external path
-static char* get_external_path(const char *virtual_path) {
-    if (!g_state.external_dir || g_state.external_offline) {
-        return NULL;
+static FuseClientStats* client_find_locked(pid_t pid) {
+    for (int i = 0; i < g_clients.count; i++) {
+        if (g_clients.clients[i].pid == pid) {
+            return &g_clients.clients[i];
+        }
     }
-    return join_path(g_state.external_dir, virtual_path);
+    return NULL;
 }
 
-// Resolve actual path (prefer local, then external)
-// If path is in eviction exclude list, skip LOCAL and go directly to EXTERNAL
-static char* resolve_actual_path(const char *virtual_path) {
-    int evicting = is_evicting(virtual_path);
-
-    if (!evicting) {
-        char *local = get_local_path(virtual_path);
-        if (local) {
-            struct stat st;
-            if (stat(local, &st) == 0) {
-                return local;
+// Insert a client, recycling the least recently seen slot when full
+static FuseClientStats* client_insert_locked(pid_t pid, const char *name) {
+    FuseClientStats *c;
+    if (g_clients.count < FUSE_MAX_CLIENTS) {
+        c = &g_clients.clients[g_clients.count++];
+    } else {
+        c = &g_clients.clients[0];
+        for (int i = 1; i < FUSE_MAX_CLIENTS; i++) {
+            if (g_clients.clients[i].last_seen < c->last_seen) {
+                c = &g_clients.clients[i];
             }
-            free(local);
         }
     }
+    memset(c, 0, sizeof(*c));
+    c->pid = pid;
+    snprintf(c->name, sizeof(c->name), "%s", name);
+    c->qos = qos_classify_locked(c->name);
+    c->last_seen = (uint64_t)time(NULL);
+    return c;
+}
 
-    char *external = get_external_path(virtual_path);
-    if (external) {
-        struct stat st;
-        if (stat(external, &st) == 0) {
-            return external;
-        }
-        free(external);
-    }
+// Remember the classification on this thread until the entry is due for re-resolution
+static void client_cache(pid_t pid, FuseClientStats *c, uint32_t gen) {
+    t_op.client = c;
+    t_op.cached_pid = pid;
+    t_op.cached_gen = gen;
+    t_op.cached_until = c->last_seen + CLIENT_NAME_TTL;
+    t_op.cached_qos = c->qos;
+    t_op.cached_client = c;
+}
 
-    return NULL;
+// Look up (or register) the calling client and return its QoS class.
+// Also sets t_op.client, the slot client_op_end() accounts the op to.
+static FuseQosClass client_classify(pid_t pid) {
+    uint64_t now = (uint64_t)time(NULL);
+    // A reused pid must not keep the previous process's class past the TTL
+    if (t_op.cached_pid == pid && t_op.cached_gen == g_clients.rules_gen && now < t_op.cached_until) {
+        t_op.client = t_op.cached_client;
+        return t_op.cached_qos;
+    }
+
+    FuseQosClass qos;
+
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    FuseClientStats *c = client_find_locked(pid);
+    if (c && now - c->last_seen < CLIENT_NAME_TTL) {
+        qos = c->qos;
+        client_cache(pid, c, g_clients.rules_gen);
+        pthread_mutex_unlock(&g_clients.lock);
+        return qos;
+    }
+    pthread_mutex_unlock(&g_clients.lock);
+
+    // New or stale client: resolve the name outside the lock (it is a syscall)
+    char name[64];
+    client_resolve_name(pid, name, sizeof(name));
+
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    c = client_find_locked(pid);
+    if (!c) {
+        c = client_insert_locked(pid, name);
+        LOG_DEBUG("New client: pid=%d name=%s qos=%d", (int)pid, c->name, c->qos);
+    } else if (strcmp(c->name, name) != 0) {
+        // pid was reused by another process
+        FuseClientStats fresh;
+        memset(&fresh, 0, sizeof(fresh));
+        fresh.pid = pid;
+        snprintf(fresh.name, sizeof(fresh.name), "%s", name);
+        fresh.qos = qos_classify_locked(fresh.name);
+        *c = fresh;
+    }
+    c->last_seen = now;
+    qos = c->qos;
+    client_cache(pid, c, g_clients.rules_gen);
+    pthread_mutex_unlock(&g_clients.lock);
+    return qos;
 }
 
-// Fix ownership of a file/directory to the mount owner (user)
-static void fix_ownership(const char *path) {
-    if (g_state.owner_uid != 0 || g_state.owner_gid != 0) {
-        lchown(path, g_state.owner_uid, g_state.owner_gid);
+// Wait for a background op slot (BACKGROUND/BULK clients only)
+static void qos_acquire_background_slot(void) {
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    if (g_clients.background_inflight >= g_clients.background_slots) {
+        uint64_t t0 = monotonic_ns();
+        while (g_clients.background_inflight >= g_clients.background_slots) {
+            pthread_cond_wait(&g_clients.background_cond, &g_clients.lock);
+        }
+        phase_add(FUSE_PHASE_THROTTLE, t0);
     }
+    g_clients.background_inflight++;
+    pthread_mutex_unlock(&g_clients.lock);
+    t_op.holds_background_slot = 1;
 }
 
-// Ensure parent directory exists
-static int ensure_parent_directory(const char *path) {
-    char *path_copy = strdup(path);
-    if (!path_copy) return -ENOMEM;
+// Begin-of-op: attribute to client, apply QoS admission
+static void client_op_begin(FuseOpType op) {
+    struct fuse_context *ctx = fuse_get_context();
+    pid_t pid = ctx ? ctx->pid : 0;
+    // Outside fuse_loop (test hooks) there is no requester; attribute to ourselves
+    if (pid == 0 && !g_fuse_loop_running) {
+        pid = getpid();
+    }
 
-    char *parent = dirname(path_copy);
+    t_op.op = op;
+    t_op.pid = pid;
+    t_op.holds_background_slot = 0;
+    t_op.copyup_denied = 0;
+    t_op.tier = FUSE_TIER_NONE;
+    t_op.external_error = 0;
+    memset(t_op.phase_ns, 0, sizeof(t_op.phase_ns));
+    t_op.qos = client_classify(pid);
 
-    struct stat st;
-    if (stat(parent, &st) == 0) {
-        free(path_copy);
-        return 0;  // Parent directory already exists
+    // release only frees resources and must never queue behind other ops
+    if (t_op.qos != FUSE_QOS_INTERACTIVE && op != FUSE_OP_RELEASE) {
+        qos_acquire_background_slot();
     }
+}
 
-    // Recursively create
-    int result = 0;
-    char *p = path_copy;
-
-    // Skip leading /
-    if (*p == '/') p++;
+// End-of-op: release QoS slot and account the op to its client.
+// Counters are updated with atomics so interactive ops never take g_clients.lock.
+static void client_op_end(int res, uint64_t bytes, uint64_t latency_ns) {
+    if (t_op.holds_background_slot) {
+        DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+        g_clients.background_inflight--;
+        pthread_cond_signal(&g_clients.background_cond);
+        pthread_mutex_unlock(&g_clients.lock);
+        t_op.holds_background_slot = 0;
+    }
+
+    // Slots are never freed, only recycled; skip if another pid took this one
+    FuseClientStats *c = t_op.client;
+    if (!c || c->pid != t_op.pid) return;
+    __sync_fetch_and_add(&c->ops, 1);
+    if (res < 0) __sync_fetch_and_add(&c->errors, 1);
+    if (bytes) __sync_fetch_and_add(&c->bytes, bytes);
+    __sync_fetch_and_add(&c->latency_ns, latency_ns);
+    if (t_op.phase_ns[FUSE_PHASE_THROTTLE] > 0) {
+        __sync_fetch_and_add(&c->throttled, 1);
+        __sync_fetch_and_add(&c->throttle_wait_ns, t_op.phase_ns[FUSE_PHASE_THROTTLE]);
+    }
+    if (t_op.copyup_denied) __sync_fetch_and_add(&c->copyups_denied, 1);
+}
 
-    while (*p) {
-        if (*p == '/') {
-            *p = '\0';
-            if (strlen(path_copy) > 0 && stat(path_copy, &st) != 0) {
-                if (mkdir(path_copy, 0755) != 0 && errno != EEXIST) {
-                    result = -errno;
-                    break;
-                }
-                fix_ownership(path_copy);
-            }
-            *p = '/';
-        }
-        p++;
+// BULK clients (indexers, backup agents) may not pull EXTERNAL files into LOCAL;
+// otherwise a crawler touching an archive would fill LOCAL and evict the working set
+static int qos_deny_copy_up(const char *path) {
+    if (t_op.qos != FUSE_QOS_BULK) {
+        return 0;
     }
-
-    free(path_copy);
-    return result;
+    t_op.copyup_denied = 1;
+    LOG_DEBUG("Copy-up denied for bulk client pid=%d: %s", (int)t_op.pid, path);
+    return 1;
 }
 
-// Check if file should be excluded
-static int should_exclude(const char *name) {
-    if (!name) return 1;
+// ============================================================
+// Slow operation detector - per-phase breakdown of ops over a threshold
+// ============================================================
 
-    const char *exclude_patterns[] = {
-        ".DS_Store",
-        ".Spotlight-V100",
-        ".Trashes",
-        ".fseventsd",
-        ".TemporaryItems",
-        ".FUSE",
-        NULL
-    };
+#define DEFAULT_SLOW_OP_THRESHOLD_MS 1000
+#define SLOW_OP_LOG_PER_SEC 10      // Slow-op log lines per second before suppressing
 
-    for (int i = 0; exclude_patterns[i]; i++) {
-        if (strcmp(name, exclude_patterns[i]) == 0) {
-            return 1;
-        }
+static struct {
+    FuseSlowOp ring[FUSE_SLOW_OP_RING_SIZE];
+    int head;                       // Next write position
+    int count;
+    FuseSlowOpStats stats;
+    time_t log_window;              // Second the rate limit counts against
+    int log_window_count;
+    uint64_t log_window_suppressed;
+    pthread_mutex_t lock;
+} g_slow_ops = {
+    .stats = { .threshold_ms = DEFAULT_SLOW_OP_THRESHOLD_MS },
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static const char *g_phase_names[FUSE_PHASE_COUNT] = {
+    "lock_wait", "throttle", "resolve_local", "resolve_external",
+    "copy_up", "backend", "callback", "other"
+};
+
+static const char* tier_name(int tier) {
+    switch (tier) {
+        case FUSE_TIER_LOCAL: return "local";
+        case FUSE_TIER_EXTERNAL: return "external";
+        case FUSE_TIER_LOCAL | FUSE_TIER_EXTERNAL: return "both";
+        default: return "none";
     }
+}
 
-    // Check for ._ prefixed files
-    if (strncmp(name, "._", 2) == 0) {
-        return 1;
+// Record an op that exceeded the threshold (op name resolved by the caller)
+static void slow_op_record(const char *op_name, const char *path, int res, uint64_t total_ns) {
+    uint64_t attributed = 0;
+    for (int i = 0; i < FUSE_PHASE_OTHER; i++) {
+        attributed += t_op.phase_ns[i];
+    }
+    t_op.phase_ns[FUSE_PHASE_OTHER] = total_ns > attributed ? total_ns - attributed : 0;
+
+    int dominant = 0;
+    for (int i = 1; i < FUSE_PHASE_COUNT; i++) {
+        if (t_op.phase_ns[i] > t_op.phase_ns[dominant]) dominant = i;
+    }
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+
+    DMSA_LOCK(&g_slow_ops.lock, FUSE_LOCK_SLOW_OPS);
+    FuseSlowOp *rec = &g_slow_ops.ring[g_slow_ops.head];
+    g_slow_ops.head = (g_slow_ops.head + 1) % FUSE_SLOW_OP_RING_SIZE;
+    if (g_slow_ops.count < FUSE_SLOW_OP_RING_SIZE) g_slow_ops.count++;
+
+    rec->timestamp_ms = (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_usec / 1000;
+    rec->op = t_op.op;
+    rec->result = res;
+    rec->tier = t_op.tier;
+    rec->pid = t_op.pid;
+    rec->total_ns = total_ns;
+    memcpy(rec->phase_ns, t_op.phase_ns, sizeof(rec->phase_ns));
+    snprintf(rec->path, sizeof(rec->path), "%s", path ? path : "");
+
+    g_slow_ops.stats.slow_ops++;
+    g_slow_ops.stats.dominant[dominant]++;
+    for (int i = 0; i < FUSE_PHASE_COUNT; i++) {
+        g_slow_ops.stats.phase_ns[i] += t_op.phase_ns[i];
+    }
+
+    // Rate limit: at most SLOW_OP_LOG_PER_SEC lines per second
+    int should_log = 0;
+    uint64_t suppressed = 0;
+    if (now.tv_sec != g_slow_ops.log_window) {
+        suppressed = g_slow_ops.log_window_suppressed;
+        g_slow_ops.log_window = now.tv_sec;
+        g_slow_ops.log_window_count = 0;
+        g_slow_ops.log_window_suppressed = 0;
+    }
+    if (g_slow_ops.log_window_count < SLOW_OP_LOG_PER_SEC) {
+        g_slow_ops.log_window_count++;
+        should_log = 1;
+    } else {
+        g_slow_ops.log_window_suppressed++;
+        g_slow_ops.stats.logs_suppressed++;
+    }
+    pthread_mutex_unlock(&g_slow_ops.lock);
+
+    if (suppressed > 0) {
+        LOG_WARN("SLOW_OP: %llu slow ops not logged (rate limit)", (unsigned long long)suppressed);
+    }
+    if (should_log) {
+        const uint64_t *ph = t_op.phase_ns;
+        LOG_WARN("SLOW_OP op=%s total=%.1fms res=%d tier=%s pid=%d dominant=%s path=%s "
+                 "lock_wait=%.1f throttle=%.1f resolve_local=%.1f resolve_external=%.1f "
+                 "copy_up=%.1f backend=%.1f callback=%.1f other=%.1f",
+                 op_name, (double)total_ns / 1e6, res, tier_name(t_op.tier), (int)t_op.pid,
+                 g_phase_names[dominant], path ? path : "",
+                 ph[FUSE_PHASE_LOCK_WAIT] / 1e6, ph[FUSE_PHASE_THROTTLE] / 1e6,
+                 ph[FUSE_PHASE_RESOLVE_LOCAL] / 1e6, ph[FUSE_PHASE_RESOLVE_EXTERNAL] / 1e6,
+                 ph[FUSE_PHASE_COPY_UP] / 1e6, ph[FUSE_PHASE_BACKEND] / 1e6,
+                 ph[FUSE_PHASE_CALLBACK] / 1e6, ph[FUSE_PHASE_OTHER] / 1e6);
     }
+}
 
-    return 0;
+static void slow_ops_reset(void) {
+    DMSA_LOCK(&g_slow_ops.lock, FUSE_LOCK_SLOW_OPS);
+    uint32_t threshold_ms = g_slow_ops.stats.threshold_ms;
+    memset(&g_slow_ops.stats, 0, sizeof(g_slow_ops.stats));
+    g_slow_ops.stats.threshold_ms = threshold_ms;
+    g_slow_ops.head = 0;
+    g_slow_ops.count = 0;
+    g_slow_ops.log_window = 0;
+    g_slow_ops.log_window_count = 0;
+    g_slow_ops.log_window_suppressed = 0;
+    pthread_mutex_unlock(&g_slow_ops.lock);
 }
 
 // ============================================================
-// FUSE callback functions
+// Per-open cache policy - direct_io / keep_cache / backing nocache
 // ============================================================
+// Chosen in dmsa_open from file size, tier and how the path was read last time:
+// - Large read-only files on EXTERNAL (or any large file last read as a stream)
+//   get F_NOCACHE on the backing fd so the backing page cache is not filled.
+//   With stream_min_size set they also open with direct_io, bypassing the FUSE
+//   page cache; that is opt-in because macFUSE cannot mmap a direct_io handle
+//   (QuickLook, AVFoundation and disk images mmap exactly these files)
+// - A handle on a large file that turns out to be read sequentially switches
+//   its backing fd to nocache mid-stream and marks the path as streamed
+// - Otherwise, a file whose backing inode, size and mtime match the generation
+//   recorded at its last release reopens with keep_cache (cached pages stay valid)
+#define DEFAULT_STREAM_MIN_SIZE 0                   // direct_io off
+#define NOCACHE_MIN_SIZE (256LL * 1024 * 1024)      // Stream size when stream_min_size is 0
+#define STREAM_DETECT_BYTES (8 * 1024 * 1024)   // Sequential bytes before a handle counts as streaming
+#define CACHE_GEN_SLOTS 1024                    // Direct-mapped by path hash
+
+#ifdef __APPLE__
+#define STAT_MTIME_NS(st) ((int64_t)(st)->st_mtimespec.tv_sec * 1000000000LL + (st)->st_mtimespec.tv_nsec)
+#else
+#define STAT_MTIME_NS(st) ((int64_t)(st)->st_mtim.tv_sec * 1000000000LL + (st)->st_mtim.tv_nsec)
+#endif
 
-// getattr: get file attributes
-static int root_getattr_logged = 0;  // Avoid log flooding
-static int index_not_ready_logged = 0;  // Avoid index-not-ready log flooding
-
-static int dmsa_getattr(const char *path, struct stat *stbuf) {
-    track_operation();
-    int depth_err = check_path_depth(path);
-    if (depth_err) return depth_err;
+typedef struct {
+    uint32_t hash;                  // hot_hash(virtual path), 0 = empty
+    int streamed;                   // Last handle read the file as a stream
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+} CacheGeneration;
 
-    LOG_DEBUG("getattr: %s", path);
+static struct {
+    CacheGeneration slots[CACHE_GEN_SLOTS];
+    volatile uint64_t keep_cache_opens;
+    volatile uint64_t nocache_opens;      // Backing fd opened nocache (with or without direct_io)
+    volatile uint64_t direct_io_opens;
+    volatile uint64_t nocache_switches;   // Handles switched to nocache by stream detection
+    pthread_mutex_t lock;
+} g_cache_policy = {
+    .keep_cache_opens = 0,
+    .nocache_opens = 0,
+    .direct_io_opens = 0,
+    .nocache_switches = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    memset(stbuf, 0, sizeof(struct stat));
+static volatile int64_t g_stream_min_size = DEFAULT_STREAM_MIN_SIZE;  // FUSE_TUNABLE_STREAM_MIN_SIZE
 
-    // Root directory special handling - allow access even when index is not ready
-    if (strcmp(path, "/") == 0) {
-        stbuf->st_mode = S_IFDIR | 0755;
-        stbuf->st_nlink = 2;
-        stbuf->st_uid = g_state.owner_uid;
-        stbuf->st_gid = g_state.owner_gid;
-        stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+// Keep the backing file's pages out of the page cache
+static void backing_set_nocache(int fd) {
+#ifdef F_NOCACHE
+    fcntl(fd, F_NOCACHE, 1);
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_NOREUSE);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
 
-        // Log on first root directory access
-        if (!root_getattr_logged) {
-            LOG_INFO("getattr(/): returning uid=%d, gid=%d, mode=0755",
-                     g_state.owner_uid, g_state.owner_gid);
-            root_getattr_logged = 1;
-        }
-        return 0;
-    }
+static int is_stream_size(off_t size) {
+    int64_t min = g_stream_min_size;
+    return (int64_t)size >= (min > 0 ? min : NOCACHE_MIN_SIZE);
+}
 
-    // Block non-root directory access when index is not ready
-    if (!g_state.index_ready) {
-        if (!index_not_ready_logged) {
-            LOG_INFO("Index not ready, blocking file access (returning EBUSY)");
-            index_not_ready_logged = 1;
+// Pick the cache mode for a freshly opened handle
+static void cache_policy_open(FuseHandle *h, int from_external, struct fuse_file_info *fi) {
+    struct stat st;
+    if (fstat(h->fd, &st) != 0) return;
+    h->size = st.st_size;
+    h->dev = st.st_dev;
+    h->ino = st.st_ino;
+
+    uint32_t hash = hot_hash(h->path);
+    DMSA_LOCK(&g_cache_policy.lock, FUSE_LOCK_CACHE_POLICY);
+    CacheGeneration *g = &g_cache_policy.slots[hash % CACHE_GEN_SLOTS];
+    int known = g->hash == hash && g->dev == st.st_dev && g->ino == st.st_ino;
+    int unchanged = known && g->size == st.st_size && g->mtime_ns == STAT_MTIME_NS(&st);
+    int streamed = known && g->streamed;
+    pthread_mutex_unlock(&g_cache_policy.lock);
+
+    if (!h->writable && is_stream_size(st.st_size) && (from_external || streamed)) {
+        backing_set_nocache(h->fd);
+        h->nocache = 1;
+        __sync_fetch_and_add(&g_cache_policy.nocache_opens, 1);
+        if (g_stream_min_size > 0) {
+            fi->direct_io = 1;
+            __sync_fetch_and_add(&g_cache_policy.direct_io_opens, 1);
         }
-        return -EBUSY;
+        LOG_DEBUG("open: %s nocache (direct_io=%d, size=%lld, external=%d, streamed=%d)",
+                  h->path, (int)fi->direct_io, (long long)st.st_size, from_external, streamed);
+    } else if (unchanged) {
+        fi->keep_cache = 1;
+        __sync_fetch_and_add(&g_cache_policy.keep_cache_opens, 1);
     }
+}
 
-    char *actual_path = resolve_actual_path(path);
-    if (!actual_path) {
-        LOG_DEBUG("getattr: ENOENT for %s", path);
-        return -ENOENT;
+// Track sequential reads; a large file read as a stream stops filling the backing cache.
+// Called without h->lock: concurrent reads on one handle can only skew the heuristic.
+static void cache_policy_note_read(FuseHandle *h, off_t offset, size_t bytes) {
+    if (offset == h->read_next) {
+        h->seq_bytes += bytes;
+    } else {
+        h->seq_bytes = bytes;
     }
+    h->read_next = offset + (off_t)bytes;
 
-    int res = stat(actual_path, stbuf);
-    if (res == -1) {
-        int err = errno;
-        LOG_WARN("getattr: stat failed for %s (actual=%s): errno=%d (%s)", path, actual_path, err, strerror(err));
-        free(actual_path);
-        return -err;
+    if (h->seq_bytes >= STREAM_DETECT_BYTES && is_stream_size(h->size)) {
+        h->streamed = 1;
+        if (!h->nocache) {
+            h->nocache = 1;
+            backing_set_nocache(h->fd);
+            __sync_fetch_and_add(&g_cache_policy.nocache_switches, 1);
+            LOG_DEBUG("read: %s is streaming, backing fd switched to nocache", h->path);
+        }
     }
-    free(actual_path);
-
-    // Always report files as owned by the mount owner
-    stbuf->st_uid = g_state.owner_uid;
-    stbuf->st_gid = g_state.owner_gid;
+}
 
-    // Normalize permissions: VFS files should be readable by owner
-    // Underlying files might have restrictive permissions (e.g., 600 from old system)
-    // but VFS should present them with standard permissions
-    if (S_ISDIR(stbuf->st_mode)) {
-        // Directories: rwxr-xr-x (755)
-        stbuf->st_mode = S_IFDIR | 0755;
-    } else {
-        // Files: rw-r--r-- (644) - preserve execute bit if present
-        mode_t exec_bit = stbuf->st_mode & S_IXUSR;
-        stbuf->st_mode = S_IFREG | 0644 | exec_bit;
-    }
+// Record the generation the kernel cache now holds (release, after the final flush)
+static void cache_policy_release(FuseHandle *h) {
+    struct stat st;
+    if (fstat(h->fd, &st) != 0) return;
+
+    uint32_t hash = hot_hash(h->path);
+    DMSA_LOCK(&g_cache_policy.lock, FUSE_LOCK_CACHE_POLICY);
+    CacheGeneration *g = &g_cache_policy.slots[hash % CACHE_GEN_SLOTS];
+    g->hash = hash;
+    g->streamed = h->streamed;
+    g->dev = st.st_dev;
+    g->ino = st.st_ino;
+    g->size = st.st_size;
+    g->mtime_ns = STAT_MTIME_NS(&st);
+    pthread_mutex_unlock(&g_cache_policy.lock);
+}
 
-    return 0;
+static void log_cache_policy_stats(void) {
+    LOG_INFO("Cache policy: stream_min_size=%lld, keep_cache opens=%llu, nocache opens=%llu, "
+             "direct_io opens=%llu, nocache switches=%llu",
+             (long long)g_stream_min_size,
+             (unsigned long long)g_cache_policy.keep_cache_opens,
+             (unsigned long long)g_cache_policy.nocache_opens,
+             (unsigned long long)g_cache_policy.direct_io_opens,
+             (unsigned long long)g_cache_policy.nocache_switches);
 }
 
-// readdir: read directory contents (smart merge LOCAL + EXTERNAL)
-// NOTE: We pass NULL for stat in filler() - this is the standard approach:
-//   - Only return entry names, no file attributes
-//   - Applications (ls, etc.) will call getattr() separately for each entry
-//   - This avoids symlink resolution during readdir, preventing deadlocks
-//   - Combined with fuse_loop_mt(), handles symlinks pointing back to VFS
-static int dmsa_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
-                        off_t offset, struct fuse_file_info *fi) {
-    track_operation();
-    (void) offset;
-    (void) fi;
+// ============================================================
+// Single-flight - concurrent identical backend operations share one execution
+// ============================================================
+// Keyed by (operation class, virtual path). The first caller (leader) runs the
+// operation; callers arriving while it is in flight wait and take its result
+// instead of repeating the work. The call record lives on the leader's stack,
+// so the uncontended path costs one hash, two lock round trips and no allocation.
+// The leader waits for its followers to copy the result before returning.
+#define FLIGHT_BUCKETS 64
 
-    int depth_err = check_path_depth(path);
-    if (depth_err) return depth_err;
+typedef enum {
+    FLIGHT_RESOLVE = 0,             // resolve_actual_path: stats on LOCAL then EXTERNAL
+    FLIGHT_COPY_UP,                 // copy_up: EXTERNAL -> LOCAL promotion
+    FLIGHT_CLASS_COUNT
+} FlightClass;
+
+static const char *g_flight_class_names[FLIGHT_CLASS_COUNT] = { "resolve", "copy_up" };
+
+typedef struct FlightCall {
+    FlightClass op_class;
+    uint32_t hash;
+    const char *key;                // Leader's virtual path
+    int followers;                  // Waiting for, or still copying, the result
+    int done;
+    int result;                     // 0 or -errno
+    char *value;                    // Result path (only materialized if followers joined)
+    uint8_t tier;                   // Leader's FUSE_TIER_* bits, credited to followers
+    struct FlightCall *next;
+} FlightCall;
 
-    LOG_DEBUG("readdir: %s", path);
+static struct {
+    FlightCall *buckets[FLIGHT_BUCKETS];
+    volatile uint64_t led[FLIGHT_CLASS_COUNT];
+    volatile uint64_t shared[FLIGHT_CLASS_COUNT];
+    pthread_cond_t cond;            // Broadcast on completion and on the last follower leaving
+    pthread_mutex_t lock;
+} g_flight = {
+    .buckets = {NULL},
+    .cond = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    // Block directory reads when index is not ready (including root)
-    // Note: Root must also be blocked since Finder will try to list contents
-    if (!g_state.index_ready) {
-        // Allow root directory access but return empty listing
-        if (strcmp(path, "/") == 0) {
-            filler(buf, ".", NULL, 0);
-            filler(buf, "..", NULL, 0);
-            // Return no files, so Finder sees an empty directory
-            return 0;
+// Join an in-flight call, or register call as the leader.
+// Returns NULL if the caller leads, else the completed call to read (then flight_leave).
+static FlightCall* flight_join(FlightCall *call, FlightClass op_class, const char *key) {
+    memset(call, 0, sizeof(*call));
+    call->op_class = op_class;
+    call->hash = hot_hash(key);
+    call->key = key;
+
+    FlightCall **bucket = &g_flight.buckets[call->hash % FLIGHT_BUCKETS];
+    DMSA_LOCK(&g_flight.lock, FUSE_LOCK_FLIGHT);
+    for (FlightCall *c = *bucket; c; c = c->next) {
+        if (c->op_class == op_class && c->hash == call->hash && strcmp(c->key, key) == 0) {
+            c->followers++;
+            uint64_t t0 = monotonic_ns();
+            while (!c->done) {
+                pthread_cond_wait(&g_flight.cond, &g_flight.lock);
+            }
+            phase_add(op_class == FLIGHT_COPY_UP ? FUSE_PHASE_COPY_UP :
+                      (c->tier & FUSE_TIER_EXTERNAL) ? FUSE_PHASE_RESOLVE_EXTERNAL : FUSE_PHASE_RESOLVE_LOCAL, t0);
+            pthread_mutex_unlock(&g_flight.lock);
+            __sync_fetch_and_add(&g_flight.shared[op_class], 1);
+            t_op.tier |= c->tier;
+            return c;
         }
-        return -EBUSY;
     }
+    call->next = *bucket;
+    *bucket = call;
+    pthread_mutex_unlock(&g_flight.lock);
+    __sync_fetch_and_add(&g_flight.led[op_class], 1);
+    return NULL;
+}
 
-    // Add . and ..
-    filler(buf, ".", NULL, 0);
-    filler(buf, "..", NULL, 0);
+// Follower is done reading the leader's result
+static void flight_leave(FlightCall *call) {
+    DMSA_LOCK(&g_flight.lock, FUSE_LOCK_FLIGHT);
+    if (--call->followers == 0) {
+        pthread_cond_broadcast(&g_flight.cond);
+    }
+    pthread_mutex_unlock(&g_flight.lock);
+}
 
-    // Heap-allocated deduplication table (supports larger directories)
-    #define MAX_READDIR_ENTRIES 8192
-    char **seen_names = calloc(MAX_READDIR_ENTRIES, sizeof(char*));
-    if (!seen_names) {
-        LOG_ERROR("readdir: failed to allocate seen_names table");
-        return -ENOMEM;
+// Publish the leader's result, then wait until every follower has read it
+static void flight_complete(FlightCall *call, int result, const char *value) {
+    DMSA_LOCK(&g_flight.lock, FUSE_LOCK_FLIGHT);
+    FlightCall **pp = &g_flight.buckets[call->hash % FLIGHT_BUCKETS];
+    while (*pp && *pp != call) pp = &(*pp)->next;
+    if (*pp) *pp = call->next;
+
+    call->result = result;
+    call->tier = t_op.tier;
+    if (call->followers > 0 && value) {
+        call->value = strdup(value);
+        if (!call->value) call->result = -ENOMEM;
+    }
+    call->done = 1;
+    if (call->followers > 0) {
+        pthread_cond_broadcast(&g_flight.cond);
+        while (call->followers > 0) {
+            pthread_cond_wait(&g_flight.cond, &g_flight.lock);
+        }
     }
-    int seen_count = 0;
+    pthread_mutex_unlock(&g_flight.lock);
+    if (call->value) free(call->value);
+}
 
-    // Helper buffer for building full virtual paths
-    char full_vpath[2048];
-    int path_is_root = (strcmp(path, "/") == 0);
-
-    // Read from local directory
-    char *local = get_local_path(path);
-    if (local) {
-        DIR *dp = opendir(local);
-        if (dp) {
-            struct dirent *de;
-            while ((de = readdir(dp)) != NULL) {
-                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-                    continue;
-                }
-                if (should_exclude(de->d_name)) {
-                    continue;
-                }
-
-                // Build full virtual path for pending delete check
-                if (path_is_root) {
-                    snprintf(full_vpath, sizeof(full_vpath), "/%s", de->d_name);
-                } else {
-                    snprintf(full_vpath, sizeof(full_vpath), "%s/%s", path, de->d_name);
-                }
-
-                // Skip if in pending delete set
-                if (pending_delete_contains(full_vpath)) {
-                    continue;
-                }
+static void log_flight_stats(void) {
+    for (int i = 0; i < FLIGHT_CLASS_COUNT; i++) {
+        LOG_INFO("Single-flight %-8s led=%llu shared=%llu", g_flight_class_names[i],
+                 (unsigned long long)g_flight.led[i], (unsigned long long)g_flight.shared[i]);
+    }
+}
 
-                // Check if already added
-                int found = 0;
-                for (int i = 0; i < seen_count; i++) {
-                    if (seen_names[i] && strcmp(seen_names[i], de->d_name) == 0) {
-                        found = 1;
-                        break;
-                    }
-                }
+// ============================================================
+// External I/O executor - bounded, prioritized, abandonable EXTERNAL syscalls
+// ============================================================
+// The high-level libfuse API replies when the handler returns, so a FUSE
+// worker always waits for its request. What the executor changes is what it
+// waits on: EXTERNAL stats and reads run on a small pool, at most
+// external_io_depth at a time (a slow drive does better with a short queue),
+// foreground clients ahead of BACKGROUND/BULK ones. A worker that waits longer
+// than external_timeout_ms gives up with EIO; the syscall finishes (or stays
+// stuck on a hung drive) in the pool, and the FUSE thread goes back to serving
+// LOCAL requests instead of wedging the mount. Results are copied out of
+// executor-owned buffers, so an abandoned request never writes into a buffer
+// libfuse has reused.
+#define EXT_IO_THREADS 8
+#define DEFAULT_EXT_IO_DEPTH 4
+#define DEFAULT_EXT_IO_TIMEOUT_MS 15000
+
+// Read coalescing: a queued EXTERNAL pread absorbs later preads of the same
+// file whose range overlaps or touches its own, up to EXT_IO_MERGE_MAX_BYTES,
+// and one backend read serves them all. A read waits for company at most
+// 1/8 of the measured read latency (capped), and not at all when reads are
+// fast enough that a seek is not worth saving.
+#define EXT_IO_MERGE_MAX_BYTES (1024 * 1024)
+#define EXT_IO_MERGE_MIN_LATENCY_NS 500000ULL    // Below this, no window
+#define EXT_IO_MERGE_WINDOW_MAX_NS 2000000ULL
 
-                if (!found && seen_count < MAX_READDIR_ENTRIES) {
-                    seen_names[seen_count++] = strdup(de->d_name);
-                    filler(buf, de->d_name, NULL, 0);
-                }
-            }
-            closedir(dp);
-        }
-        free(local);
-    }
+typedef enum {
+    EXT_IO_STAT = 0,
+    EXT_IO_PREAD,
+    EXT_IO_PWRITE,                  // Async; completion callback owns the request
+    EXT_IO_FTRUNCATE,               // Async; length in offset
+    EXT_IO_CALL                     // Async; runs `run` (multi-step jobs: create, publish)
+} ExtIoKind;
 
-    // Read from external directory (if online)
-    char *external = get_external_path(path);
-    if (external) {
-        DIR *dp = opendir(external);
-        if (dp) {
-            struct dirent *de;
-            while ((de = readdir(dp)) != NULL) {
-                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
-                    continue;
-                }
-                if (should_exclude(de->d_name)) {
-                    continue;
-                }
+typedef enum {
+    EXT_IO_QUEUED = 0,
+    EXT_IO_RUNNING,
+    EXT_IO_DONE
+} ExtIoState;
+
+typedef struct ExtIoRequest {
+    ExtIoKind kind;
+    ExtIoState state;
+    int abandoned;                  // Submitter timed out; the worker frees the request
+    int stalled;                    // Abandoned while inside a syscall (counted in g_ext_io.stalled)
+    char *path;                     // EXT_IO_STAT, EXT_IO_CALL
+    int fd;                         // EXT_IO_PREAD: own dup (outlives the handle if abandoned);
+                                    // EXT_IO_PWRITE/FTRUNCATE/CALL: the stream's
+    dev_t dev;                      // EXT_IO_PREAD file identity for coalescing (0/0 = never merge)
+    ino_t ino;
+    size_t size;
+    off_t offset;
+    off_t span_offset;              // Range actually read, covering all followers
+    size_t span_size;
+    uint64_t queued_ns;
+    char *data;                     // EXT_IO_PREAD result, EXT_IO_PWRITE payload
+    struct stat st;                 // EXT_IO_STAT result, EXT_IO_CALL argument
+    ssize_t result;                 // >= 0 or -errno
+    struct ExtIoRequest *leader;    // Set on a follower: served by leader's read, never queued
+    struct ExtIoRequest *followers; // Set on a leader; linked through next_follower
+    struct ExtIoRequest *next_follower;
+    struct ExtIoRequest *next;
+    // Async requests: nobody waits; called under g_ext_io.lock when the
+    // request has run, and responsible for freeing it
+    void (*complete)(struct ExtIoRequest *req);
+    ssize_t (*run)(struct ExtIoRequest *req);   // EXT_IO_CALL: returns the result
+    struct TeeStream *stream;
+} ExtIoRequest;
 
-                // Build full virtual path for pending delete check
-                if (path_is_root) {
-                    snprintf(full_vpath, sizeof(full_vpath), "/%s", de->d_name);
-                } else {
-                    snprintf(full_vpath, sizeof(full_vpath), "%s/%s", path, de->d_name);
-                }
+static struct {
+    ExtIoRequest *head[2];          // [0] foreground, [1] BACKGROUND/BULK
+    ExtIoRequest *tail[2];
+    int threads;                    // Workers started (lazily, on first submit)
+    int queued;
+    int running;                    // Requests inside a syscall
+    int stalled;                    // Of those, abandoned by their submitter
+    volatile uint64_t submitted;
+    volatile uint64_t timeouts;
+    volatile uint64_t reads_issued; // Backend preads
+    volatile uint64_t reads_merged; // Preads served by another request's backend read
+    volatile uint64_t read_ewma_ns; // Backend pread latency, EWMA 1/8
+    pthread_cond_t work;            // Queue non-empty or a depth slot freed
+    pthread_cond_t done;            // Some request completed
+    pthread_mutex_t lock;
+} g_ext_io = {
+    .head = {NULL, NULL},
+    .tail = {NULL, NULL},
+    .work = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-                // Skip if in pending delete set (important: hides EXTERNAL files that couldn't be deleted)
-                if (pending_delete_contains(full_vpath)) {
-                    continue;
-                }
+static volatile int g_ext_io_depth = DEFAULT_EXT_IO_DEPTH;            // FUSE_TUNABLE_EXTERNAL_IO_DEPTH (0 = bypass)
+static volatile int g_ext_io_timeout_ms = DEFAULT_EXT_IO_TIMEOUT_MS;  // FUSE_TUNABLE_EXTERNAL_TIMEOUT_MS (0 = wait forever)
 
-                // Check if already added
-                int found = 0;
-                for (int i = 0; i < seen_count; i++) {
-                    if (seen_names[i] && strcmp(seen_names[i], de->d_name) == 0) {
-                        found = 1;
-                        break;
-                    }
-                }
+// Workers' concurrency limit. At depth 0 new calls run inline, but whatever
+// was queued before the switch (reads, tee writes) must still drain.
+static int ext_io_worker_depth(void) {
+    return g_ext_io_depth > 0 ? g_ext_io_depth : EXT_IO_THREADS;
+}
 
-                if (!found && seen_count < MAX_READDIR_ENTRIES) {
-                    seen_names[seen_count++] = strdup(de->d_name);
-                    filler(buf, de->d_name, NULL, 0);
-                }
-            }
-            closedir(dp);
+// Deadline external_timeout_ms from now; returns the timeout (<= 0: none, wait forever)
+static int ext_io_deadline(struct timespec *deadline) {
+    int timeout_ms = g_ext_io_timeout_ms;
+    if (timeout_ms > 0) {
+        clock_gettime(CLOCK_REALTIME, deadline);
+        deadline->tv_sec += timeout_ms / 1000;
+        deadline->tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline->tv_nsec >= 1000000000L) {
+            deadline->tv_sec++;
+            deadline->tv_nsec -= 1000000000L;
         }
-        free(external);
-    }
-
-    // Cleanup heap-allocated table
-    for (int i = 0; i < seen_count; i++) {
-        free(seen_names[i]);
     }
-    free(seen_names);
-
-    return 0;
+    return timeout_ms;
 }
 
-// open: open file
-static int dmsa_open(const char *path, struct fuse_file_info *fi) {
-    track_operation();
-    int depth_err = check_path_depth(path);
-    if (depth_err) return depth_err;
-
-    LOG_DEBUG("open: %s, flags=%d", path, fi->flags);
+static void ext_io_free(ExtIoRequest *req) {
+    if (req->kind == EXT_IO_PREAD && req->fd >= 0) close(req->fd);
+    if (req->path) free(req->path);
+    if (req->data) free(req->data);
+    free(req);
+}
 
-    // Block file open when index is not ready
-    CHECK_INDEX_READY();
+// Current coalescing window
+static uint64_t ext_io_merge_window_ns(void) {
+    uint64_t ewma = __sync_fetch_and_add(&g_ext_io.read_ewma_ns, 0);
+    if (ewma < EXT_IO_MERGE_MIN_LATENCY_NS) return 0;
+    return ewma / 8 < EXT_IO_MERGE_WINDOW_MAX_NS ? ewma / 8 : EXT_IO_MERGE_WINDOW_MAX_NS;
+}
 
-    // Limit concurrent open files to prevent FUSE resource exhaustion
-    if (acquire_open_slot() < 0) {
-        return -EMFILE;
+// Copy a member's slice out of a merged read
+static void ext_io_fan_out(ExtIoRequest *member, const char *span, ssize_t n, off_t span_offset) {
+    if (n < 0) {
+        member->result = n;
+        return;
     }
+    off_t avail = span_offset + (off_t)n - member->offset;
+    if (avail <= 0) {
+        member->result = 0;
+        return;
+    }
+    size_t len = (size_t)avail < member->size ? (size_t)avail : member->size;
+    memcpy(member->data, span + (member->offset - span_offset), len);
+    member->result = (ssize_t)len;
+}
 
-    char *actual_path = resolve_actual_path(path);
-
-    if (!actual_path) {
-        // File doesn't exist, check if in create mode
-        if ((fi->flags & O_CREAT) || (fi->flags & O_WRONLY) || (fi->flags & O_RDWR)) {
-            actual_path = get_local_path(path);
-            if (!actual_path) {
-                return -ENOENT;
-            }
-
-            // Ensure parent directory exists
-            int res = ensure_parent_directory(actual_path);
-            if (res != 0) {
-                free(actual_path);
-                return res;
+// Run a dequeued request; followers can no longer be added (state is RUNNING)
+static void ext_io_execute(ExtIoRequest *req) {
+    if (req->kind == EXT_IO_STAT) {
+        req->result = stat(req->path, &req->st) == 0 ? 0 : -errno;
+        return;
+    }
+    if (req->kind == EXT_IO_FTRUNCATE) {
+        req->result = ftruncate(req->fd, req->offset) == 0 ? 0 : -errno;
+        return;
+    }
+    if (req->kind == EXT_IO_CALL) {
+        req->result = req->run(req);
+        return;
+    }
+    if (req->kind == EXT_IO_PWRITE) {
+        size_t done = 0;
+        req->result = 0;
+        while (done < req->size) {
+            ssize_t n = pwrite(req->fd, req->data + done, req->size - done, req->offset + (off_t)done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                req->result = n < 0 ? -errno : -EIO;
+                return;
             }
+            done += (size_t)n;
+        }
+        req->result = (ssize_t)done;
+        return;
+    }
 
-            // Create empty file
-            int fd = open(actual_path, O_CREAT | O_WRONLY, 0644);
-            if (fd == -1) {
-                int err = errno;
-                free(actual_path);
-                return -err;
-            }
-            close(fd);
-            fix_ownership(actual_path);
-        } else {
-            return -ENOENT;
+    uint64_t t0 = monotonic_ns();
+    if (!req->followers) {
+        ssize_t n = pread(req->fd, req->data, req->size, req->offset);
+        req->result = n < 0 ? -errno : n;
+    } else {
+        char *span = malloc(req->span_size);
+        ssize_t n = span ? pread(req->fd, span, req->span_size, req->span_offset) : -1;
+        if (n < 0) n = span ? -errno : -ENOMEM;
+        ext_io_fan_out(req, span, n, req->span_offset);
+        for (ExtIoRequest *f = req->followers; f; f = f->next_follower) {
+            ext_io_fan_out(f, span, n, req->span_offset);
         }
+        free(span);
     }
+    uint64_t elapsed = monotonic_ns() - t0;
+    // Workers run this without g_ext_io.lock; retry if another one got in between
+    uint64_t ewma = __sync_fetch_and_add(&g_ext_io.read_ewma_ns, 0);
+    while (!__sync_bool_compare_and_swap(&g_ext_io.read_ewma_ns, ewma, (ewma * 7 + elapsed) / 8)) {
+        ewma = __sync_fetch_and_add(&g_ext_io.read_ewma_ns, 0);
+    }
+    __sync_fetch_and_add(&g_ext_io.reads_issued, 1);
+}
 
-    // If write mode and actual path is external, copy to local first
-    char *local = get_local_path(path);
-    if (local && ((fi->flags & O_WRONLY) || (fi->flags & O_RDWR))) {
-        if (strcmp(actual_path, local) != 0) {
-            // Actual path is external, copy to local
-            ensure_parent_directory(local);
-
-            // Simple file copy
-            int src_fd = open(actual_path, O_RDONLY);
-            if (src_fd != -1) {
-                int dst_fd = open(local, O_CREAT | O_WRONLY | O_TRUNC, 0644);
-                if (dst_fd != -1) {
-                    char copy_buf[8192];
-                    ssize_t bytes;
-                    while ((bytes = read(src_fd, copy_buf, sizeof(copy_buf))) > 0) {
-                        write(dst_fd, copy_buf, bytes);
-                    }
-                    close(dst_fd);
-                }
-                close(src_fd);
+static void* ext_io_worker(void *arg) {
+    (void)arg;
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    for (;;) {
+        // Stalled calls no longer count against the depth; their threads are lost until they return
+        while ((!g_ext_io.head[0] && !g_ext_io.head[1]) ||
+               g_ext_io.running - g_ext_io.stalled >= ext_io_worker_depth()) {
+            pthread_cond_wait(&g_ext_io.work, &g_ext_io.lock);
+        }
+        int q = g_ext_io.head[0] ? 0 : 1;
+        ExtIoRequest *req = g_ext_io.head[q];
+
+        // Give neighbours of a fresh read a chance to merge in
+        if (req->kind == EXT_IO_PREAD && (req->dev | req->ino)) {
+            uint64_t due = req->queued_ns + ext_io_merge_window_ns();
+            uint64_t now = monotonic_ns();
+            if (now < due) {
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+                uint64_t ns = (uint64_t)deadline.tv_nsec + (due - now);
+                deadline.tv_sec += (time_t)(ns / 1000000000ULL);
+                deadline.tv_nsec = (long)(ns % 1000000000ULL);
+                pthread_cond_timedwait(&g_ext_io.work, &g_ext_io.lock, &deadline);
+                continue;
             }
+        }
 
-            // Use local path
-            free(actual_path);
-            actual_path = local;
-            local = NULL;
+        g_ext_io.head[q] = req->next;
+        if (!g_ext_io.head[q]) g_ext_io.tail[q] = NULL;
+        g_ext_io.queued--;
+        g_ext_io.running++;
+        req->state = EXT_IO_RUNNING;
+        pthread_mutex_unlock(&g_ext_io.lock);
+
+        ext_io_execute(req);
+
+        DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+        g_ext_io.running--;
+        if (req->stalled) g_ext_io.stalled--;
+        ExtIoRequest *f = req->followers;
+        while (f) {
+            ExtIoRequest *next = f->next_follower;
+            f->state = EXT_IO_DONE;
+            if (f->abandoned) ext_io_free(f);
+            f = next;
         }
+        req->state = EXT_IO_DONE;
+        if (req->complete) req->complete(req);
+        else if (req->abandoned) ext_io_free(req);
+        pthread_cond_broadcast(&g_ext_io.done);
+        pthread_cond_signal(&g_ext_io.work);
     }
+    return NULL;
+}
 
-    // Try to open file
-    int fd = open(actual_path, fi->flags);
-    if (fd == -1) {
-        int err = errno;
-        LOG_WARN("open: failed for %s (actual=%s, flags=%d): errno=%d (%s)", path, actual_path, fi->flags, err, strerror(err));
-        free(actual_path);
-        if (local) free(local);
-        release_open_slot();  // Release the slot on failure
-        return -err;
+// Attach a pread to a queued read of the same file it overlaps or touches
+static int ext_io_try_merge(ExtIoRequest *req, int q) {
+    if (req->kind != EXT_IO_PREAD || !(req->dev | req->ino)) return 0;
+    for (ExtIoRequest *l = g_ext_io.head[q]; l; l = l->next) {
+        if (l->kind != EXT_IO_PREAD || l->dev != req->dev || l->ino != req->ino) continue;
+        off_t start = l->span_offset;
+        off_t end = l->span_offset + (off_t)l->span_size;
+        off_t req_end = req->offset + (off_t)req->size;
+        if (req->offset > end || req_end < start) continue;
+        off_t new_start = req->offset < start ? req->offset : start;
+        off_t new_end = req_end > end ? req_end : end;
+        if (new_end - new_start > EXT_IO_MERGE_MAX_BYTES) continue;
+
+        l->span_offset = new_start;
+        l->span_size = (size_t)(new_end - new_start);
+        req->leader = l;
+        req->next_follower = l->followers;
+        l->followers = req;
+        g_ext_io.reads_merged++;
+        return 1;
     }
-
-    fi->fh = fd;
-
-    free(actual_path);
-    if (local) free(local);
-
     return 0;
 }
 
-// read: read file contents
-static int dmsa_read(const char *path, char *buf, size_t size, off_t offset,
-                     struct fuse_file_info *fi) {
-    track_operation();
-    LOG_DEBUG("read: %s, size=%zu, offset=%lld", path, size, offset);
-
-    int fd = fi->fh;
-    if (fd <= 0) {
-        return -EBADF;
+// Start the pool on first use (g_ext_io.lock held); returns the worker count
+static int ext_io_start_locked(void) {
+    while (g_ext_io.threads < EXT_IO_THREADS) {
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, ext_io_worker, NULL) != 0) break;
+        pthread_detach(tid);
+        g_ext_io.threads++;
     }
+    return g_ext_io.threads;
+}
 
-    int res = pread(fd, buf, size, offset);
-    if (res == -1) {
-        return -errno;
+// Hand a request to the workers (g_ext_io.lock held)
+static void ext_io_enqueue_locked(ExtIoRequest *req, int q) {
+    g_ext_io.submitted++;
+    req->span_offset = req->offset;
+    req->span_size = req->size;
+    if (!ext_io_try_merge(req, q)) {
+        req->queued_ns = monotonic_ns();
+        if (g_ext_io.tail[q]) g_ext_io.tail[q]->next = req;
+        else g_ext_io.head[q] = req;
+        g_ext_io.tail[q] = req;
+        g_ext_io.queued++;
+        pthread_cond_signal(&g_ext_io.work);
     }
-
-    return res;
 }
 
-// write: write file contents
-static int dmsa_write(const char *path, const char *buf, size_t size, off_t offset,
-                      struct fuse_file_info *fi) {
-    track_operation();
-    LOG_DEBUG("write: %s, size=%zu, offset=%lld", path, size, offset);
+// Queue a request and wait for it.
+// Returns 1 when done (the caller reads and frees it), 0 on timeout (the
+// request now belongs to the executor and must not be touched).
+static int ext_io_wait(ExtIoRequest *req) {
+    int q = t_op.qos == FUSE_QOS_INTERACTIVE ? 0 : 1;
+
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    if (ext_io_start_locked() == 0) {
+        // No pool: run inline rather than fail
+        pthread_mutex_unlock(&g_ext_io.lock);
+        ext_io_execute(req);
+        return 1;
+    }
+    ext_io_enqueue_locked(req, q);
 
-    if (g_state.readonly) {
-        return -EROFS;
+    struct timespec deadline;
+    int timeout_ms = ext_io_deadline(&deadline);
+    while (req->state != EXT_IO_DONE) {
+        if (timeout_ms <= 0) {
+            pthread_cond_wait(&g_ext_io.done, &g_ext_io.lock);
+        } else if (pthread_cond_timedwait(&g_ext_io.done, &g_ext_io.lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
     }
 
-    // Block write if file is being synced
-    if (syncing_files_contains(path)) {
-        LOG_DEBUG("write blocked: %s is syncing", path);
-        return -EBUSY;
+    if (req->state == EXT_IO_DONE) {
+        pthread_mutex_unlock(&g_ext_io.lock);
+        return 1;
     }
 
-    int fd = fi->fh;
-    if (fd <= 0) {
-        // If no fh, try writing directly to local file
-        char *local = get_local_path(path);
-        if (!local) {
-            return -ENOENT;
+    g_ext_io.timeouts++;
+    if (req->state == EXT_IO_QUEUED && !req->leader && !req->followers) {
+        ExtIoRequest **pp = &g_ext_io.head[q];
+        ExtIoRequest *prev = NULL;
+        while (*pp != req) {
+            prev = *pp;
+            pp = &(*pp)->next;
         }
+        *pp = req->next;
+        if (g_ext_io.tail[q] == req) g_ext_io.tail[q] = prev;
+        g_ext_io.queued--;
+        pthread_mutex_unlock(&g_ext_io.lock);
+        LOG_WARN("External I/O timed out in queue after %d ms (%s)", timeout_ms,
+                 req->kind == EXT_IO_STAT ? req->path : "pread");
+        ext_io_free(req);
+    } else if (req->state == EXT_IO_QUEUED) {
+        // Merged: the shared read still has to run for the others
+        req->abandoned = 1;
+        pthread_mutex_unlock(&g_ext_io.lock);
+        LOG_WARN("External I/O timed out in queue after %d ms (merged pread)", timeout_ms);
+    } else {
+        req->abandoned = 1;
+        req->stalled = 1;
+        g_ext_io.stalled++;
+        int stalled = g_ext_io.stalled;
+        pthread_cond_signal(&g_ext_io.work);
+        pthread_mutex_unlock(&g_ext_io.lock);
+        LOG_WARN("External I/O not answering after %d ms, abandoned (%d stalled)", timeout_ms, stalled);
+    }
+    return 0;
+}
 
-        ensure_parent_directory(local);
-
-        fd = open(local, O_WRONLY | O_CREAT, 0644);
-        free(local);
+// stat() on EXTERNAL; 0 or -errno (-EIO on timeout)
+static int ext_stat(const char *path, struct stat *st) {
+    if (g_ext_io_depth == 0) {
+        return stat(path, st) == 0 ? 0 : -errno;
+    }
 
-        if (fd == -1) {
-            return -errno;
-        }
+    ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+    if (!req) return -ENOMEM;
+    req->kind = EXT_IO_STAT;
+    req->path = strdup(path);
+    if (!req->path) {
+        free(req);
+        return -ENOMEM;
+    }
 
-        int res = pwrite(fd, buf, size, offset);
-        int err = errno;
-        close(fd);
+    if (!ext_io_wait(req)) return t_op.external_error = -EIO;
+    int res = (int)req->result;
+    if (res == 0) *st = req->st;
+    ext_io_free(req);
+    return res;
+}
 
-        if (res == -1) {
-            return -err;
-        }
-        return res;
+// pread() on an EXTERNAL file; bytes read or -errno (-EIO on timeout)
+static ssize_t ext_pread(const FuseHandle *h, char *buf, size_t size, off_t offset) {
+    if (g_ext_io_depth == 0) {
+        ssize_t n = pread(h->fd, buf, size, offset);
+        return n < 0 ? -errno : n;
     }
 
-    int res = pwrite(fd, buf, size, offset);
-    if (res == -1) {
-        return -errno;
+    ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+    if (!req) return -ENOMEM;
+    req->kind = EXT_IO_PREAD;
+    // A timed-out read (or a merged read led by it) may run after release
+    // closed h->fd and the number was reused; read through a private dup
+    req->fd = dup(h->fd);
+    if (req->fd < 0) {
+        int err = errno;
+        free(req);
+        return -err;
+    }
+    req->dev = h->dev;
+    req->ino = h->ino;
+    req->size = size;
+    req->offset = offset;
+    req->data = malloc(size ? size : 1);
+    if (!req->data) {
+        ext_io_free(req);
+        return -ENOMEM;
     }
 
+    if (!ext_io_wait(req)) return t_op.external_error = -EIO;
+    ssize_t res = req->result;
+    if (res > 0) memcpy(buf, req->data, (size_t)res);
+    ext_io_free(req);
     return res;
 }
 
-// release: close file
-static int dmsa_release(const char *path, struct fuse_file_info *fi) {
-    LOG_DEBUG("release: %s", path);
+static void log_ext_io_stats(void) {
+    LOG_INFO("External I/O: depth=%d, timeout=%d ms, threads=%d, queued=%d, running=%d, stalled=%d, "
+             "submitted=%llu, timeouts=%llu",
+             g_ext_io_depth, g_ext_io_timeout_ms, g_ext_io.threads, g_ext_io.queued,
+             g_ext_io.running, g_ext_io.stalled,
+             (unsigned long long)g_ext_io.submitted, (unsigned long long)g_ext_io.timeouts);
+    LOG_INFO("External reads: issued=%llu, merged=%llu, latency=%.1f us, window=%.1f us",
+             (unsigned long long)g_ext_io.reads_issued, (unsigned long long)g_ext_io.reads_merged,
+             (double)__sync_fetch_and_add(&g_ext_io.read_ewma_ns, 0) / 1000.0,
+             (double)ext_io_merge_window_ns() / 1000.0);
+}
 
-    if (fi->fh > 0) {
-        close(fi->fh);
-    }
+// ============================================================
+// Helper functions
+// ============================================================
 
-    // Release concurrent open slot
-    release_open_slot();
+// Index not ready check macro - blocks non-root directory access
+// When index is not ready, returns EBUSY (device busy), telling apps to retry later
+#define CHECK_INDEX_READY_FOR_PATH(path) \
+    do { \
+        if (!g_state.index_ready && strcmp(path, "/") != 0) { \
+            LOG_DEBUG("Index not ready, blocking access: %s", path); \
+            return -EBUSY; \
+        } \
+    } while (0)
 
-    // Notify Swift layer if file was written (check flags)
-    // fi->flags contains open flags: O_WRONLY, O_RDWR indicate write
-    if ((fi->flags & O_WRONLY) || (fi->flags & O_RDWR)) {
-        NOTIFY_FILE_WRITTEN(path);
+// Index not ready check - for all operations except root directory
+#define CHECK_INDEX_READY() \
+    do { \
+        if (!g_state.index_ready) { \
+            LOG_DEBUG("Index not ready, blocking operation"); \
+            return -EBUSY; \
+        } \
+    } while (0)
+
+// Collect detailed exit diagnostics (implementation after g_state is defined)
+static void collect_exit_diagnostics(const char *mount_path, int fuse_result, int saved_errno) {
+    LOG_INFO("========== FUSE EXIT DIAGNOSTICS ==========");
+
+    // Basic exit info
+    LOG_INFO("Exit code: %d, errno: %d (%s)", fuse_result, saved_errno, strerror(saved_errno));
+
+    // Signal info
+    if (g_last_signal != 0) {
+        LOG_WARN("Exit signal: %d (%s)", (int)g_last_signal, strsignal((int)g_last_signal));
+    } else {
+        LOG_INFO("Exit signal: none");
     }
 
-    return 0;
-}
+    // Operation stats
+    LOG_INFO("Total ops since mount: %llu", (unsigned long long)g_total_ops);
+    if (g_last_op_time > 0) {
+        time_t now = time(NULL);
+        LOG_INFO("Last op: %lld seconds ago", (long long)(now - g_last_op_time));
+    }
 
-// create: create file
-static int dmsa_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
-    LOG_DEBUG("create: %s, mode=%o", path, mode);
+    // Callback queue stats
+    LOG_INFO("Callback queue: queued=%llu, processed=%llu, dropped=%llu, pending=%d",
+             (unsigned long long)g_cb_queued,
+             (unsigned long long)g_cb_processed,
+             (unsigned long long)g_cb_dropped,
+             callback_queue_pending());
+
+    // Lock contention (only populated when profiling is enabled)
+    log_lock_stats();
+
+    // Heaviest paths/directories and clients since mount
+    log_hot_stats();
+    log_client_stats();
+    log_slow_op_stats();
+    log_write_buffer_stats();
+    log_cache_policy_stats();
+    log_flight_stats();
+    log_ext_io_stats();
+    log_stub_stats();
+    log_place_stats();
+    log_tee_stats();
+    log_hash_cache_stats();
+    log_tunables();
 
-    // Block file creation when index is not ready
-    CHECK_INDEX_READY();
+    // macFUSE device state
+    int macfuse_devs = check_macfuse_device();
+    LOG_INFO("macFUSE devices in /dev: %d", macfuse_devs);
 
-    if (g_state.readonly) {
-        return -EROFS;
+    // Mount point state
+    struct stat mp_stat;
+    if (stat(mount_path, &mp_stat) != 0) {
+        LOG_WARN("Mount point stat failed: %s (errno=%d %s)", mount_path, errno, strerror(errno));
+    } else {
+        LOG_INFO("Mount point exists: mode=0x%x, uid=%d, gid=%d",
+                 mp_stat.st_mode, mp_stat.st_uid, mp_stat.st_gid);
     }
 
-    char *local = get_local_path(path);
-    if (!local) {
-        return -ENOMEM;
+    // Filesystem type at mount point
+    struct statfs fs_stat;
+    if (statfs(mount_path, &fs_stat) == 0) {
+        LOG_INFO("Filesystem type: %s, flags=0x%x", fs_stat.f_fstypename, fs_stat.f_flags);
+    } else {
+        LOG_WARN("statfs failed: errno=%d (%s)", errno, strerror(errno));
     }
 
-    int res = ensure_parent_directory(local);
-    if (res != 0) {
-        free(local);
-        return res;
+    // Check FUSE channel state
+    if (g_state.chan) {
+        LOG_INFO("FUSE channel: valid");
+    } else {
+        LOG_WARN("FUSE channel: NULL");
+    }
+
+    // Interpret common errno values
+    switch (saved_errno) {
+        case ENODEV:  // 19
+            LOG_WARN("ENODEV: macFUSE kernel module may have been unloaded or device disconnected");
+            break;
+        case ENOTCONN:  // 57
+            LOG_WARN("ENOTCONN: FUSE connection lost (kernel-userspace channel broken)");
+            break;
+        case EINTR:  // 4
+            LOG_INFO("EINTR: Interrupted by signal");
+            break;
+        case EIO:  // 5
+            LOG_WARN("EIO: I/O error on FUSE device");
+            break;
+        case ENOENT:  // 2
+            LOG_WARN("ENOENT: Mount point or device no longer exists");
+            break;
+        default:
+            if (saved_errno != 0) {
+                LOG_INFO("errno %d: %s", saved_errno, strerror(saved_errno));
+            }
+            break;
     }
 
-    int fd = open(local, O_CREAT | O_WRONLY | O_TRUNC, mode);
+    LOG_INFO("========== END DIAGNOSTICS ==========");
+}
 
-    if (fd == -1) {
-        int err = errno;
-        free(local);
-        return -err;
+// Join paths
+static char* join_path(const char *base, const char *path) {
+    if (!base || !path) return NULL;
+
+    // Skip leading / from path
+    while (*path == '/') path++;
+
+    size_t base_len = strlen(base);
+    size_t path_len = strlen(path);
+
+    // Remove trailing / from base
+    while (base_len > 0 && base[base_len - 1] == '/') {
+        base_len--;
     }
 
-    fix_ownership(local);
+    char *result = malloc(base_len + 1 + path_len + 1);
+    if (!result) return NULL;
 
-    // Notify Swift layer - file created
-    NOTIFY_FILE_CREATED(path, local, 0);
+    memcpy(result, base, base_len);
+    result[base_len] = '/';
+    strcpy(result + base_len + 1, path);
 
-    free(local);
+    return result;
+}
 
-    fi->fh = fd;
-    return 0;
+// Get local path
+static char* get_local_path(const char *virtual_path) {
+    return join_path(g_state.local_dir, virtual_path);
 }
 
-// unlink: delete file
-// Order: 1. Add to pending delete 2. Notify Swift 3. Delete LOCAL 4. Delete EXTERNAL 5. Remove from pending
-static int dmsa_unlink(const char *path) {
-    LOG_DEBUG("unlink: %s", path);
+// Get external path
+static char* get_external_path(const char *virtual_path) {
+    if (!g_state.external_dir || g_state.external_offline) {
+        return NULL;
+    }
+    return join_path(g_state.external_dir, virtual_path);
+}
 
-    if (g_state.readonly) {
-        return -EROFS;
+// Resolve actual path (prefer local, then external)
+// If path is in eviction exclude list, skip LOCAL and go directly to EXTERNAL
+static char* resolve_tiers(const char *virtual_path) {
+    int evicting = is_evicting(virtual_path);
+
+    if (!evicting) {
+        char *local = get_local_path(virtual_path);
+        if (local) {
+            struct stat st;
+            uint64_t t0 = monotonic_ns();
+            int found = (stat(local, &st) == 0);
+            phase_add(FUSE_PHASE_RESOLVE_LOCAL, t0);
+            t_op.tier |= FUSE_TIER_LOCAL;
+            if (found) {
+                return local;
+            }
+            free(local);
+        }
     }
 
-    // Block delete if file is being synced
-    if (syncing_files_contains(path)) {
-        LOG_DEBUG("unlink blocked: %s is syncing", path);
-        return -EBUSY;
+    char *external = get_external_path(virtual_path);
+    if (external) {
+        struct stat st;
+        uint64_t t0 = monotonic_ns();
+        int found = (ext_stat(external, &st) == 0);
+        phase_add(FUSE_PHASE_RESOLVE_EXTERNAL, t0);
+        t_op.tier |= FUSE_TIER_EXTERNAL;
+        if (found) {
+            return external;
+        }
+        free(external);
     }
 
-    // Step 1: Add to pending delete set (hides from readdir immediately)
-    pending_delete_add(path);
+    return NULL;
+}
 
-    // Step 2: Notify Swift layer (async, updates memory cache + DB)
-    NOTIFY_FILE_DELETED(path, 0);
+// resolve_tiers, shared with concurrent resolves of the same path (single-flight)
+static char* resolve_actual_path(const char *virtual_path) {
+    FlightCall call;
+    FlightCall *joined = flight_join(&call, FLIGHT_RESOLVE, virtual_path);
+    if (joined) {
+        char *shared = joined->value ? strdup(joined->value) : NULL;
+        if (joined->result) t_op.external_error = joined->result;
+        flight_leave(joined);
+        return shared;
+    }
+
+    char *actual = resolve_tiers(virtual_path);
+    flight_complete(&call, t_op.external_error, actual);
+    return actual;
+}
+
+// Errno for a failed resolve: the file is missing, or EXTERNAL did not answer
+static inline int resolve_errno(void) {
+    return t_op.external_error ? t_op.external_error : -ENOENT;
+}
+
+// Fix ownership of a file/directory to the mount owner (user)
+static void fix_ownership(const char *path) {
+    if (g_state.owner_uid != 0 || g_state.owner_gid != 0) {
+        lchown(path, g_state.owner_uid, g_state.owner_gid);
+    }
+}
 
+// Ensure parent directory exists
+static int ensure_parent_directory(const char *path) {
+    char *path_copy = strdup(path);
+    if (!path_copy) return -ENOMEM;
+
+    char *parent = dirname(path_copy);
+
+    struct stat st;
+    if (stat(parent, &st) == 0) {
+        free(path_copy);
+        return 0;  // Parent directory already exists
+    }
+
+    // Recursively create
     int result = 0;
-    int external_deleted = 0;
+    char *p = path_copy;
 
-    // Step 3: Delete local copy
-    char *local = get_local_path(path);
-    if (local) {
-        if (unlink(local) == -1 && errno != ENOENT) {
-            result = -errno;
-            LOG_WARN("unlink local failed: %s, errno=%d", local, errno);
+    // Skip leading /
+    if (*p == '/') p++;
+
+    while (*p) {
+        if (*p == '/') {
+            *p = '\0';
+            if (strlen(path_copy) > 0 && stat(path_copy, &st) != 0) {
+                if (mkdir(path_copy, 0755) != 0 && errno != EEXIST) {
+                    result = -errno;
+                    break;
+                }
+                fix_ownership(path_copy);
+            }
+            *p = '/';
+        }
+        p++;
+    }
+
+    free(path_copy);
+    return result;
+}
+
+#define COPY_UP_SUFFIX ".dmsa_copyup"
+#define PLACE_SUFFIX ".dmsa_place"
+#define TEE_SUFFIX ".dmsa_tee"
+#define COMPRESS_SUFFIX ".dmsa_compress"    // EvictionManager's in-place compression copy
+
+// Copy an EXTERNAL file into LOCAL (promotion before a write, truncate or rename).
+// The copy is written to a temp name and renamed into place, so LOCAL never
+// holds a partial file that resolve would prefer over EXTERNAL. Concurrent
+// copy-ups of the same path share one copy (single-flight).
+static int copy_up(const char *virtual_path, const char *external, const char *local) {
+    FlightCall call;
+    FlightCall *joined = flight_join(&call, FLIGHT_COPY_UP, virtual_path);
+    if (joined) {
+        int shared = joined->result;
+        flight_leave(joined);
+        return shared;
+    }
+
+    uint64_t t0 = monotonic_ns();
+    int res = 0;
+    struct stat st;
+    char *tmp = NULL;
+    int src_fd = -1;
+    int dst_fd = -1;
+
+    // An earlier leader may have finished just before we registered
+    if (stat(local, &st) == 0) goto done;
+
+    src_fd = open(external, O_RDONLY);
+    if (src_fd == -1 || fstat(src_fd, &st) != 0) {
+        res = -errno;
+        goto done;
+    }
+    t_op.tier |= FUSE_TIER_EXTERNAL | FUSE_TIER_LOCAL;
+
+    res = ensure_parent_directory(local);
+    if (res != 0) goto done;
+
+    size_t len = strlen(local);
+    tmp = malloc(len + sizeof(COPY_UP_SUFFIX));
+    if (!tmp) {
+        res = -ENOMEM;
+        goto done;
+    }
+    memcpy(tmp, local, len);
+    memcpy(tmp + len, COPY_UP_SUFFIX, sizeof(COPY_UP_SUFFIX));
+
+    dst_fd = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, st.st_mode & 07777);
+    if (dst_fd == -1) {
+        res = -errno;
+        goto done;
+    }
+
+    char copy_buf[65536];
+    ssize_t bytes;
+    while (res == 0 && (bytes = read(src_fd, copy_buf, sizeof(copy_buf))) != 0) {
+        if (bytes < 0) {
+            if (errno != EINTR) res = -errno;
+            continue;
+        }
+        for (ssize_t off = 0; off < bytes; ) {
+            ssize_t n = write(dst_fd, copy_buf + off, (size_t)(bytes - off));
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                res = -errno;
+                break;
+            }
+            off += n;
         }
-        free(local);
     }
+    if (close(dst_fd) != 0 && res == 0) res = -errno;
+    dst_fd = -1;
+
+    if (res == 0) {
+        fix_ownership(tmp);
+        if (rename(tmp, local) != 0) res = -errno;
+    }
+    if (res != 0) {
+        LOG_WARN("copy_up: %s failed: errno=%d (%s)", virtual_path, -res, strerror(-res));
+        unlink(tmp);
+    }
+
+done:
+    if (dst_fd != -1) close(dst_fd);
+    if (src_fd != -1) close(src_fd);
+    if (tmp) free(tmp);
+    phase_add(FUSE_PHASE_COPY_UP, t0);
+    flight_complete(&call, res, NULL);
+    return res;
+}
+
+// Check if file should be excluded
+static int should_exclude(const char *name) {
+    if (!name) return 1;
+
+    const char *exclude_patterns[] = {
+        ".DS_Store",
+        ".Spotlight-V100",
+        ".Trashes",
+        ".fseventsd",
+        ".TemporaryItems",
+        ".FUSE",
+        NULL
+    };
+
+    for (int i = 0; exclude_patterns[i]; i++) {
+        if (strcmp(name, exclude_patterns[i]) == 0) {
+            return 1;
+        }
+    }
+
+    // Check for ._ prefixed files
+    if (strncmp(name, "._", 2) == 0) {
+        return 1;
+    }
+
+    // In-progress copy-ups, placements, write-through copies and compressions
+    static const char *const temp_suffixes[] = { COPY_UP_SUFFIX, PLACE_SUFFIX, TEE_SUFFIX, COMPRESS_SUFFIX };
+    size_t name_len = strlen(name);
+    for (size_t i = 0; i < sizeof(temp_suffixes) / sizeof(temp_suffixes[0]); i++) {
+        size_t suffix_len = strlen(temp_suffixes[i]);
+        if (name_len > suffix_len && strcmp(name + name_len - suffix_len, temp_suffixes[i]) == 0) {
+            return 1;
+        }
+    }
+
+    return exclude_patterns_match(name);
+}
+
+// ============================================================
+// File layout - preallocation and extent counting
+// ============================================================
+// A large file appended buffer by buffer on a drive that other writers
+// share gets its allocations interleaved with theirs, and streaming reads
+// of it later seek between the pieces. Reserving the full size up front
+// lets the filesystem pick one run; extent counts show how well it did.
+
+#define EXTENT_COUNT_LIMIT 100000
+
+static int file_preallocate(int fd, int64_t size) {
+    if (fd < 0 || size <= 0) return FUSE_PREALLOC_NONE;
+#ifdef __APPLE__
+    fstore_t store = {
+        .fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL,
+        .fst_posmode = F_PEOFPOSMODE,
+        .fst_offset = 0,
+        .fst_length = (off_t)size,
+    };
+    if (fcntl(fd, F_PREALLOCATE, &store) == 0) return FUSE_PREALLOC_CONTIGUOUS;
+    store.fst_flags = F_ALLOCATEALL;
+    if (fcntl(fd, F_PREALLOCATE, &store) == 0) return FUSE_PREALLOC_ALLOCATED;
+    return FUSE_PREALLOC_NONE;
+#else
+    return FUSE_PREALLOC_NONE;
+#endif
+}
+
+static int file_count_extents(int fd) {
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) return -1;
+    if (st.st_size == 0) return 0;
+#ifdef __APPLE__
+    // Walk file offsets; runs that continue on the device are one extent
+    int extents = 0;
+    off_t device_end = -1;
+    for (off_t off = 0; off < st.st_size && extents < EXTENT_COUNT_LIMIT; ) {
+        struct log2phys l2p = {
+            .l2p_flags = 0,
+            .l2p_contigbytes = st.st_size - off,
+            .l2p_devoffset = off,
+        };
+        if (fcntl(fd, F_LOG2PHYS_EXT, &l2p) != 0 || l2p.l2p_contigbytes <= 0) {
+            return extents > 0 ? extents : -1;
+        }
+        if (l2p.l2p_devoffset != device_end) extents++;
+        device_end = l2p.l2p_devoffset + l2p.l2p_contigbytes;
+        off += l2p.l2p_contigbytes;
+    }
+    return extents;
+#else
+    return -1;
+#endif
+}
+
+// ============================================================
+// Placement policy - large new files are written to EXTERNAL
+// ============================================================
+// A file created through the mount starts on LOCAL like any other. Once a
+// write takes it past placement_max_local_size, or LOCAL free space falls
+// below placement_min_local_free, a worker creates an EXTERNAL temp and
+// copies what has been written so far while the app keeps writing (the part
+// of a write below the copied mark goes to both tiers). When the copy
+// catches up, the temp is renamed into place, the LOCAL copy is unlinked and
+// the handle carries on against EXTERNAL, so a large download is not written
+// to LOCAL first and evicted later. The write that triggers it only flips the
+// state; the worker does the copy without g_handles.lock and takes h->lock
+// only between chunks and for the final fd swap. Release does not wait: a
+// handle closed mid-migration is finished by the worker, which sends
+// on_file_placed (or on_file_written if it fell back to LOCAL).
+//
+// No EXTERNAL call runs under a lock or on a FUSE thread: mirror writes, and
+// once placed the handle's own writes, truncates and fsyncs, go in order
+// through the handle's place_io stream on the EXTERNAL I/O executor (see
+// "Write-through"). From the switch on, a write returns once EXTERNAL has it,
+// waiting up to external_timeout_ms unlocked (place_wait); after a failure
+// or timeout the placed file answers EIO.
+//
+// Only the creating handle migrates, and it stays the only writer: another
+// open for write gets EBUSY meanwhile. Any failure (EXTERNAL offline, a
+// write error, the file unlinked or replaced) leaves the file on LOCAL.
+#define PLACE_CHUNK (1024 * 1024)
+#define PLACE_FREE_REFRESH_NS 1000000000ULL
+
+static volatile int64_t g_place_max_local_size = 0;     // FUSE_TUNABLE_PLACEMENT_MAX_LOCAL_SIZE
+static volatile int64_t g_place_min_local_free = 0;     // FUSE_TUNABLE_PLACEMENT_MIN_LOCAL_FREE
+
+static struct {
+    volatile int64_t local_free;        // LOCAL free bytes at local_free_ns
+    volatile uint64_t local_free_ns;
+    volatile uint64_t running;          // Workers alive
+    volatile uint64_t started;
+    volatile uint64_t placed;
+    volatile uint64_t failed;
+    volatile uint64_t copied_bytes;     // Prefix bytes copied by the workers
+} g_place = {
+    .local_free = INT64_MAX,
+    .local_free_ns = 0,
+    .running = 0,
+    .started = 0,
+    .placed = 0,
+    .failed = 0,
+    .copied_bytes = 0
+};
+
+static int place_enabled(void) {
+    return g_place_max_local_size > 0 || g_place_min_local_free > 0;
+}
+
+// LOCAL free bytes, sampled at most once a second (INT64_MAX if unknown)
+static int64_t place_local_free(void) {
+    uint64_t now = monotonic_ns();
+    if (g_place.local_free_ns == 0 || now - g_place.local_free_ns >= PLACE_FREE_REFRESH_NS) {
+        struct statvfs sv;
+        g_place.local_free = statvfs(g_state.local_dir, &sv) == 0
+            ? (int64_t)sv.f_bavail * (int64_t)sv.f_frsize : INT64_MAX;
+        g_place.local_free_ns = now;
+    }
+    return g_place.local_free;
+}
+
+// Placement state of the file at path (PLACE_STARTING..PLACE_EXTERNAL if a
+// handle has it in flight, PLACE_NONE otherwise)
+static int place_state_of(const char *path) {
+    int state = PLACE_NONE;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h && state == PLACE_NONE; h = h->next) {
+        if (strcmp(h->path, path) != 0) continue;
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        if (h->place >= PLACE_STARTING && h->place <= PLACE_EXTERNAL) state = h->place;
+        pthread_mutex_unlock(&h->lock);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+    return state;
+}
+
+// Snapshot of h->path, which renames update under g_handles.lock
+static char* place_path_dup(FuseHandle *h) {
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    char *path = strdup(h->path);
+    pthread_mutex_unlock(&g_handles.lock);
+    return path;
+}
+
+// Give up on the migration; the file stays on LOCAL. `published` is the
+// EXTERNAL path if the temp was already renamed there. The temp's fd stays
+// with place_io, which may still be writing to it, until release.
+static void place_abort(FuseHandle *h, int err, const char *published) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    h->place_fd = -1;
+    h->place = PLACE_FAILED;
+    LOG_WARN("placement: %s stays on LOCAL: errno=%d (%s)", h->path, -err, strerror(-err));
+    pthread_mutex_unlock(&h->lock);
+
+    if (h->place_tmp) {
+        if (published) rename(published, h->place_tmp);
+        unlink(h->place_tmp);
+    }
+    __sync_fetch_and_add(&g_place.failed, 1);
+}
+
+// Create the EXTERNAL temp and move the handle to PLACE_MIGRATING; returns 0 or -errno
+static int place_open_temp(FuseHandle *h) {
+    char *path = place_path_dup(h);
+    char *external = path ? get_external_path(path) : NULL;
+    free(path);
+    if (!external) return -ENOENT;
+
+    char *tmp = malloc(strlen(external) + sizeof(PLACE_SUFFIX));
+    if (tmp) {
+        strcpy(tmp, external);
+        strcat(tmp, PLACE_SUFFIX);
+    }
+    free(external);
+    if (!tmp) return -ENOMEM;
+
+    struct stat st;
+    int fd = -1;
+    int res = ensure_parent_directory(tmp);
+    if (res == 0 && fstat(h->fd, &st) != 0) res = -errno;
+    if (res == 0 && (fd = open(tmp, O_CREAT | O_RDWR | O_TRUNC, st.st_mode & 07777)) == -1) res = -errno;
+    if (res != 0) {
+        free(tmp);
+        return res;
+    }
+    fix_ownership(tmp);
+    struct TeeStream *io = tee_stream_new(fd, 1);
+    if (!io) {
+        close(fd);
+        unlink(tmp);
+        free(tmp);
+        return -ENOMEM;
+    }
+    // Reserve what is already written; the writer usually has more to come
+    int prealloc = file_preallocate(fd, st.st_size);
+
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    h->place_io = io;
+    h->place_fd = fd;
+    h->place_tmp = tmp;
+    h->placed = 0;
+    h->place_shrunk = 0;
+    h->place = PLACE_MIGRATING;
+    LOG_INFO("placement: moving %s to EXTERNAL (%lld bytes written, prealloc=%d)",
+             h->path, (long long)st.st_size, prealloc);
+    pthread_mutex_unlock(&h->lock);
+    return 0;
+}
+
+// Copy LOCAL [placed, size) to the temp a chunk at a time, without h->lock.
+// A write or truncate that lands on the chunk in flight sets place_raced and
+// the chunk is copied again. Once caught up the handle moves to
+// PLACE_SWITCHING, after which every write is mirrored in full.
+static int place_catch_up(FuseHandle *h, char *buf) {
+    for (;;) {
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        struct stat st;
+        int res = h->place != PLACE_MIGRATING ? -EIO : fstat(h->fd, &st) != 0 ? -errno : 0;
+        if (res == 0) res = tee_error(h->place_io);  // A mirror write failed
+        off_t from = h->placed;
+        off_t to = res == 0 && st.st_size - from > PLACE_CHUNK ? from + PLACE_CHUNK : res == 0 ? st.st_size : from;
+        // After a truncate the temp may hold a stale tail, and mirror writes
+        // queued before it may still land there: cut it behind them first.
+        // Writes at or past `placed` are not mirrored, so nothing is lost.
+        int trim = res == 0 && h->place_shrunk;
+        if (trim) {
+            h->place_shrunk = 0;
+            res = tee_queue_truncate(h->place_io, from);
+            to = from;
+        } else if (res == 0 && from >= to) {
+            // Caught up: mirror everything from here on, buffered writes first
+            h->place = PLACE_SWITCHING;
+            int flushed = handle_flush_locked(h);
+            if (flushed != 0 && h->deferred_error == 0) h->deferred_error = flushed;
+        }
+        h->place_copy_end = from < to ? to : 0;
+        h->place_raced = 0;
+        pthread_mutex_unlock(&h->lock);
+        if (res != 0) return res;
+        if (trim) {
+            if ((res = tee_wait(h->place_io)) != 0) return res;
+            continue;
+        }
+        if (from >= to) return 0;
+
+        for (off_t off = from; off < to; ) {
+            ssize_t n = pread(h->fd, buf, (size_t)(to - off), off);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) return -errno;
+            if (n == 0) break;  // Truncated meanwhile; place_raced is set
+            for (ssize_t done = 0; done < n; ) {
+                ssize_t w = pwrite(h->place_fd, buf + done, (size_t)(n - done), off + done);
+                if (w < 0 && errno == EINTR) continue;
+                if (w < 0) return -errno;
+                done += w;
+            }
+            off += n;
+        }
+
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        if (!h->place_raced && h->placed == from) {
+            h->placed = to;
+            __sync_fetch_and_add(&g_place.copied_bytes, (uint64_t)(to - from));
+        }
+        h->place_copy_end = 0;
+        pthread_mutex_unlock(&h->lock);
+    }
+}
+
+// Publish the temp as the EXTERNAL file and move the handle onto it. The
+// EXTERNAL I/O runs unlocked; h->lock is held only to recheck the file and
+// swap the fds. Mirror writes still in flight at the swap are waited for by
+// their writers (place_wait), which get EXTERNAL's answer.
+static void place_switch(FuseHandle *h) {
+    char *path = place_path_dup(h);
+    char *local = path ? get_local_path(path) : NULL;
+    char *external = path ? get_external_path(path) : NULL;
+    int res = !local || !external ? -ENOENT : 0;
+    // The LOCAL copy goes next; EXTERNAL must hold the data first
+    struct stat est;
+    if (res == 0) res = tee_wait(h->place_io);
+    if (res == 0 && fsync(h->place_fd) != 0) res = -errno;
+    if (res == 0 && fstat(h->place_fd, &est) != 0) res = -errno;
+    if (res == 0) res = ensure_parent_directory(external);
+    if (res == 0 && rename(h->place_tmp, external) != 0) res = -errno;
+    int published = res == 0;
+
+    if (res == 0) {
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        struct stat st, lst;
+        if (h->place != PLACE_SWITCHING || strcmp(h->path, path) != 0) {
+            res = -EIO;  // Renamed meanwhile
+        } else if (tee_error(h->place_io) != 0) {
+            res = -EIO;  // A mirror write failed
+        } else if (fstat(h->fd, &st) != 0) {
+            res = -errno;
+        } else if (lstat(local, &lst) != 0 || lst.st_dev != st.st_dev || lst.st_ino != st.st_ino) {
+            res = -ENOENT;  // Unlinked or replaced while migrating
+        } else if (unlink(local) != 0) {
+            res = -errno;  // LOCAL would still win resolve
+        } else {
+            // Reads in flight may still use the LOCAL fd; it is closed at release
+            int local_fd = h->fd;
+            h->fd = h->place_fd;
+            h->place_fd = local_fd;
+            h->external = 1;
+            h->dev = est.st_dev;
+            h->ino = est.st_ino;
+            h->place = PLACE_EXTERNAL;
+            __sync_fetch_and_add(&g_place.placed, 1);
+            LOG_INFO("placement: %s moved to EXTERNAL at %lld bytes", h->path, (long long)st.st_size);
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+
+    if (res != 0) place_abort(h, res, published ? external : NULL);
+    free(path);
+    free(local);
+    free(external);
+}
+
+// The worker outlives the app's release: a handle released while it ran is
+// closed here once the migration is done or abandoned
+static void place_worker_exit(FuseHandle *h) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    h->place_running = 0;
+    int orphaned = h->place_orphaned;
+    int placed = h->place == PLACE_EXTERNAL;
+    pthread_mutex_unlock(&h->lock);
+    if (!orphaned) {
+        __sync_fetch_and_sub(&g_place.running, 1);
+        return;
+    }
+
+    char *path = place_path_dup(h);
+    if (handle_close(h) != 0) {
+        LOG_WARN("release: buffered data for %s was not fully written", path ? path : "?");
+    }
+    if (path) {
+        if (placed) {
+            NOTIFY_FILE_PLACED(path);
+        } else {
+            NOTIFY_FILE_WRITTEN(path);
+        }
+        free(path);
+    }
+    __sync_fetch_and_sub(&g_place.running, 1);
+}
+
+static void* place_worker(void *arg) {
+    FuseHandle *h = arg;
+    char *buf = malloc(PLACE_CHUNK);
+
+    int res = buf ? place_open_temp(h) : -ENOMEM;
+    if (res != 0) {
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        h->place = PLACE_FAILED;
+        LOG_WARN("placement: cannot create EXTERNAL temp for %s: errno=%d (%s)", h->path, -res, strerror(-res));
+        pthread_mutex_unlock(&h->lock);
+        __sync_fetch_and_add(&g_place.failed, 1);
+    } else if ((res = place_catch_up(h, buf)) != 0) {
+        place_abort(h, res, NULL);
+    } else {
+        place_switch(h);
+    }
+    free(buf);
+    place_worker_exit(h);
+    return NULL;
+}
+
+// Called after a successful write on a handle that created its file:
+// start moving it to EXTERNAL once it has outgrown LOCAL. Only the state
+// change happens here; the worker does all of the EXTERNAL I/O.
+static void place_maybe_start(FuseHandle *h, const char *path, off_t end) {
+    int64_t max_size = g_place_max_local_size;
+    int64_t min_free = g_place_min_local_free;
+    if (!(max_size > 0 && end >= max_size) &&
+        !(min_free > 0 && place_local_free() < min_free)) {
+        return;
+    }
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int candidate = h->place == PLACE_CANDIDATE;
+    pthread_mutex_unlock(&h->lock);
+    if (!candidate) return;
+    if (g_state.readonly || syncing_files_contains(path)) return;
+    char *external = get_external_path(path);
+    if (!external) return;  // Offline; still a candidate, retried on the next write
+    free(external);
+
+    // Claim the handle first so a concurrent write on it backs off
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int claimed = h->place == PLACE_CANDIDATE;
+    if (claimed) h->place = PLACE_STARTING;
+    pthread_mutex_unlock(&h->lock);
+    if (!claimed) return;
+
+    // Another writer would keep writing to the LOCAL copy after the switch
+    int shared = 0;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *o = g_handles.head; o; o = o->next) {
+        if (o != h && strcmp(o->path, h->path) == 0) {
+            shared = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    if (shared) {
+        h->place = PLACE_CANDIDATE;
+    } else {
+        pthread_t tid;
+        h->place_running = 1;
+        __sync_fetch_and_add(&g_place.running, 1);
+        if (pthread_create(&tid, NULL, place_worker, h) == 0) {
+            pthread_detach(tid);
+            __sync_fetch_and_add(&g_place.started, 1);
+        } else {
+            h->place_running = 0;
+            __sync_fetch_and_sub(&g_place.running, 1);
+            h->place = PLACE_FAILED;
+            __sync_fetch_and_add(&g_place.failed, 1);
+            LOG_WARN("placement: cannot start worker for %s", h->path);
+        }
+    }
+    pthread_mutex_unlock(&h->lock);
+}
+
+// Release of a handle whose migration is still running: flush it and leave
+// the close to the worker (h must not be touched once it has it). Returns 1
+// if the worker took the handle.
+static int place_release(FuseHandle *h, const char *path) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int running = h->place_running;
+    pthread_mutex_unlock(&h->lock);
+    if (!running) return 0;
+
+    if (handle_flush(h) != 0) {
+        LOG_WARN("release: buffered data for %s was not fully written", path);
+    }
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    running = h->place_running;
+    if (running) h->place_orphaned = 1;
+    pthread_mutex_unlock(&h->lock);
+    return running;
+}
+
+// After a write or truncate: from the switch on, wait (unlocked) for what
+// the handle queued to EXTERNAL. Returns 0, or -errno once the file is on
+// EXTERNAL and that failed; before the switch LOCAL still has the data and
+// the worker abandons the migration instead.
+static int place_wait(FuseHandle *h) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    struct TeeStream *io = h->place == PLACE_SWITCHING || h->place == PLACE_EXTERNAL ? h->place_io : NULL;
+    pthread_mutex_unlock(&h->lock);
+    if (!io) return 0;
+
+    int res = tee_wait(io);
+    if (res == 0) return 0;
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int placed = h->place == PLACE_EXTERNAL;
+    pthread_mutex_unlock(&h->lock);
+    if (!placed) return 0;
+    return res == -ETIMEDOUT ? (t_op.external_error = -EIO) : res;
+}
+
+// Before a write: keep a migrating or placed handle within TEE_MAX_PENDING of the drive
+static void place_throttle(FuseHandle *h) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    struct TeeStream *io = h->place >= PLACE_MIGRATING && h->place <= PLACE_EXTERNAL ? h->place_io : NULL;
+    pthread_mutex_unlock(&h->lock);
+    if (io) tee_throttle(io);
+}
+
+// Executor job: fsync a placed file
+static ssize_t place_fsync_run(ExtIoRequest *req) {
+    return fsync(req->fd) == 0 ? 0 : -errno;
+}
+
+// fsync through the executor if h is placed. Returns 1 and sets *res if it was.
+static int place_fsync(FuseHandle *h, int *res) {
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    int placed = h->place == PLACE_EXTERNAL;
+    int queued = 0;
+    if (placed) {
+        ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+        if (req) {
+            req->kind = EXT_IO_CALL;
+            req->run = place_fsync_run;
+            tee_submit(h->place_io, req);
+            queued = 1;
+        }
+    }
+    pthread_mutex_unlock(&h->lock);
+    if (placed) *res = queued ? place_wait(h) : -ENOMEM;
+    return placed;
+}
+
+// Truncate through a migrating or placed handle instead of the path.
+// Returns 1 and sets *res if a handle took it. The handle is pinned, so
+// g_handles.lock is not held while EXTERNAL is truncated.
+static int place_truncate(const char *path, off_t size, int *res) {
+    FuseHandle *h = NULL;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *o = g_handles.head; o && !h; o = o->next) {
+        if (strcmp(o->path, path) != 0) continue;
+        DMSA_LOCK(&o->lock, FUSE_LOCK_HANDLES);
+        if (o->place >= PLACE_MIGRATING && o->place <= PLACE_EXTERNAL) h = o;
+        pthread_mutex_unlock(&o->lock);
+    }
+    if (h) h->pins++;
+    pthread_mutex_unlock(&g_handles.lock);
+    if (!h) return 0;
+
+    int handled = 1;
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    if (h->place == PLACE_EXTERNAL) {
+        tee_queue_truncate(h->place_io, size);  // place_wait reports a failure
+        *res = 0;
+    } else if (h->place == PLACE_MIGRATING || h->place == PLACE_SWITCHING) {
+        *res = ftruncate(h->fd, size) == 0 ? 0 : -errno;
+        if (*res == 0 && h->place == PLACE_MIGRATING) {
+            // The worker copies anything past the new end again and
+            // drops the temp's stale tail
+            if (size < h->place_copy_end) h->place_raced = 1;
+            if (h->placed > size) h->placed = size;
+            h->place_shrunk = 1;
+        } else if (*res == 0) {
+            tee_queue_truncate(h->place_io, size);  // Mirrored like a write
+        }
+    } else {
+        handled = 0;  // Fell back to LOCAL meanwhile
+    }
+    pthread_mutex_unlock(&h->lock);
+    if (handled && *res == 0) *res = place_wait(h);
+    handle_unpin(h);
+    return handled;
+}
+
+static void log_place_stats(void) {
+    LOG_INFO("Placement: max_local_size=%lld, min_local_free=%lld, running=%llu, started=%llu, "
+             "placed=%llu, failed=%llu, copied=%llu MB",
+             (long long)g_place_max_local_size, (long long)g_place_min_local_free,
+             (unsigned long long)g_place.running, (unsigned long long)g_place.started,
+             (unsigned long long)g_place.placed, (unsigned long long)g_place.failed,
+             (unsigned long long)(g_place.copied_bytes / (1024 * 1024)));
+}
+
+// ============================================================
+// Write-through (tee) mode - new data reaches EXTERNAL as it is written
+// ============================================================
+// Files under a write-through directory that are written from scratch
+// (created, or opened with O_TRUNC) get a second copy on EXTERNAL built
+// while the app writes: every pwrite that lands on LOCAL is also queued, in
+// order, as an async write to "<external>.dmsa_tee" on the EXTERNAL I/O
+// executor (background queue, one request in flight per file). The temp is
+// created by the first request of the stream, and at release a last request
+// gives the copy LOCAL's size, mode and mtime, fsyncs it and renames it into
+// place; release waits for the queue up to external_timeout_ms, so no
+// EXTERNAL call runs on a FUSE thread. Swift then gets on_file_synced
+// instead of file_written - no debounced sync re-reads the file.
+//
+// Queued data is bounded per file; a writer that gets ahead of the drive by
+// more than TEE_MAX_PENDING waits (up to external_timeout_ms). A failed or
+// timed-out write, a second writer, or an unlink drops the copy and the file
+// goes through the normal sync path. Closing the temp, and removing a dropped
+// one, is a last executor job of the stream as well.
+#define MAX_TEE_DIRS 64
+#define TEE_MAX_PENDING (8 * 1024 * 1024)
+
+static struct {
+    char *dirs[MAX_TEE_DIRS];       // Virtual directory paths, no trailing '/'
+    volatile int count;
+    pthread_mutex_t lock;
+} g_tee_dirs = {
+    .count = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+// A placement handle's EXTERNAL writes use the same ordered stream (place
+// set, no temp of its own: the placement worker owns the temp's name).
+typedef struct TeeStream {
+    // All fields are guarded by g_ext_io.lock
+    int fd;                         // EXTERNAL temp
+    char *tmp;
+    int place;                      // A placement handle's stream (foreground queue)
+    ExtIoRequest *head;             // In order, not yet handed to the executor
+    ExtIoRequest *tail;
+    int inflight;                   // One request of this stream is in the executor
+    size_t pending_bytes;           // Queued + in flight
+    uint64_t submitted;             // Requests accepted
+    uint64_t completed;             // Of those, run or dropped (tee_wait)
+    int error;                      // First failure (-errno); later requests are dropped
+    int published;                  // The publish request renamed the temp into place
+    int abandoned;                  // Release stopped waiting; the last completion frees it
+} TeeStream;
+
+static struct {
+    volatile uint64_t started;
+    volatile uint64_t synced;
+    volatile uint64_t failed;
+    volatile uint64_t bytes;        // Bytes written to EXTERNAL copies
+    volatile uint64_t throttled;    // Writes that waited for the drive
+} g_tee = {0};
+
+static int tee_dir_match(const char *path) {
+    if (g_tee_dirs.count == 0) return 0;  // Common case: no lock
+    int matched = 0;
+    DMSA_LOCK(&g_tee_dirs.lock, FUSE_LOCK_TEE);
+    for (int i = 0; i < g_tee_dirs.count && !matched; i++) {
+        matched = path_in_subtree(path, g_tee_dirs.dirs[i], strlen(g_tee_dirs.dirs[i]));
+    }
+    pthread_mutex_unlock(&g_tee_dirs.lock);
+    return matched;
+}
+
+static const char* tee_label(const TeeStream *ts) {
+    return ts->place ? "placement" : "write-through";
+}
+
+static TeeStream* tee_stream_new(int fd, int place) {
+    TeeStream *ts = calloc(1, sizeof(TeeStream));
+    if (!ts) return NULL;
+    ts->fd = fd;
+    ts->place = place;
+    return ts;
+}
+
+// Executor job: close a finished stream's fd and remove its temp (path)
+static ssize_t tee_cleanup_run(ExtIoRequest *req) {
+    if (req->fd >= 0) close(req->fd);
+    if (req->path) unlink(req->path);
+    return 0;
+}
+
+// Free a stream nothing is in flight for (g_ext_io.lock held). Closing and
+// unlinking on EXTERNAL can block too, so that is queued to the executor.
+static void tee_stream_free_locked(TeeStream *ts) {
+    if (ts->fd >= 0 || ts->tmp) {
+        ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+        if (req && ext_io_start_locked() > 0) {
+            req->kind = EXT_IO_CALL;
+            req->run = tee_cleanup_run;
+            req->fd = ts->fd;
+            req->path = ts->tmp;  // Freed with the request
+            req->complete = ext_io_free;
+            ext_io_enqueue_locked(req, 1);
+        } else {
+            // No request or no pool: better a stall here than a leaked fd
+            free(req);
+            if (ts->fd >= 0) close(ts->fd);
+            if (ts->tmp) unlink(ts->tmp);
+            free(ts->tmp);
+        }
+    }
+    free(ts);
+}
+
+// Executor job: create the temp (path) with mode st.st_mode; returns the fd
+static ssize_t tee_create_run(ExtIoRequest *req) {
+    int res = ensure_parent_directory(req->path);
+    if (res != 0) return res;
+    int fd = open(req->path, O_CREAT | O_WRONLY | O_TRUNC, req->st.st_mode & 07777);
+    if (fd == -1) return -errno;
+    fix_ownership(req->path);
+    return fd;
+}
+
+// Executor job: give the temp LOCAL's size, mode and mtime (st), make it
+// durable and rename it to path
+static ssize_t tee_publish_run(ExtIoRequest *req) {
+    if (ftruncate(req->fd, req->st.st_size) != 0) return -errno;
+    if (fchmod(req->fd, req->st.st_mode & 07777) != 0) return -errno;
+    int64_t mtime_ns = STAT_MTIME_NS(&req->st);
+    struct timespec times[2] = {
+        { .tv_sec = 0, .tv_nsec = UTIME_OMIT },
+        { .tv_sec = (time_t)(mtime_ns / 1000000000LL), .tv_nsec = (long)(mtime_ns % 1000000000LL) }
+    };
+    if (futimens(req->fd, times) != 0) return -errno;
+    if (fsync(req->fd) != 0) return -errno;
+    int res = ensure_parent_directory(req->path);
+    if (res != 0) return res;
+    return rename(req->stream->tmp, req->path) == 0 ? 0 : -errno;
+}
+
+// Drop requests not yet handed to the executor (g_ext_io.lock held)
+static void tee_drop_queued_locked(TeeStream *ts) {
+    while (ts->head) {
+        ExtIoRequest *req = ts->head;
+        ts->head = req->next;
+        ts->pending_bytes -= req->size;
+        ts->completed++;
+        ext_io_free(req);
+    }
+    ts->tail = NULL;
+}
+
+// Executor completion (g_ext_io.lock held): record the result, start the next write
+static void tee_complete_locked(ExtIoRequest *req) {
+    TeeStream *ts = req->stream;
+    if (req->result < 0 && ts->error == 0) {
+        ts->error = (int)req->result;
+        LOG_WARN("%s: EXTERNAL write failed: %s errno=%d", tee_label(ts),
+                 ts->tmp ? ts->tmp : "placed file", (int)-req->result);
+    } else if (req->kind == EXT_IO_PWRITE && req->result > 0 && !ts->place) {
+        g_tee.bytes += (uint64_t)req->result;
+    } else if (req->kind == EXT_IO_CALL && req->run == tee_create_run && req->result >= 0) {
+        ts->fd = (int)req->result;
+    } else if (req->kind == EXT_IO_CALL && req->run == tee_publish_run && req->result == 0) {
+        free(ts->tmp);
+        ts->tmp = NULL;  // Published; nothing to unlink
+        ts->published = 1;
+    }
+    ts->pending_bytes -= req->size;
+    ts->completed++;
+    ts->inflight = 0;
+    ext_io_free(req);
+
+    if (ts->error != 0 || ts->abandoned) {
+        tee_drop_queued_locked(ts);
+    } else if (ts->head) {
+        ExtIoRequest *next = ts->head;
+        ts->head = next->next;
+        if (!ts->head) ts->tail = NULL;
+        next->next = NULL;
+        next->fd = ts->fd;  // Known once the create request has run
+        ts->inflight = 1;
+        ext_io_start_locked();  // The first write may have run inline, before any pool
+        ext_io_enqueue_locked(next, ts->place ? 0 : 1);
+    }
+    if (ts->abandoned && !ts->inflight) tee_stream_free_locked(ts);
+}
+
+// Before a write: keep a fast writer within TEE_MAX_PENDING of the drive.
+// Called with no locks held; waits up to external_timeout_ms, then drops the copy.
+static void tee_throttle(TeeStream *ts) {
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    if (ts->error == 0 && ts->pending_bytes >= TEE_MAX_PENDING) {
+        if (!ts->place) g_tee.throttled++;
+        struct timespec deadline;
+        int timeout_ms = ext_io_deadline(&deadline);
+        while (ts->error == 0 && ts->pending_bytes >= TEE_MAX_PENDING) {
+            if (timeout_ms <= 0) {
+                pthread_cond_wait(&g_ext_io.done, &g_ext_io.lock);
+            } else if (pthread_cond_timedwait(&g_ext_io.done, &g_ext_io.lock, &deadline) == ETIMEDOUT) {
+                ts->error = -ETIMEDOUT;
+                LOG_WARN("%s: EXTERNAL fell %zu bytes behind for %d ms, dropping %s", tee_label(ts),
+                         ts->pending_bytes, timeout_ms, ts->tmp ? ts->tmp : "placed file");
+                tee_drop_queued_locked(ts);
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&g_ext_io.lock);
+}
+
+// Queue a write or truncate for the stream, in order after the earlier ones
+// (h->lock held, which serializes the stream's submitters). Returns the
+// stream's error (0 while it is healthy); a failed stream drops req.
+static int tee_submit(TeeStream *ts, ExtIoRequest *req) {
+    req->stream = ts;
+    req->complete = tee_complete_locked;
+
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    int res = ts->error;
+    if (res != 0) {
+        pthread_mutex_unlock(&g_ext_io.lock);
+        ext_io_free(req);
+        return res;
+    }
+
+    ts->pending_bytes += req->size;
+    ts->submitted++;
+    if (ts->inflight) {
+        if (ts->tail) ts->tail->next = req;
+        else ts->head = req;
+        ts->tail = req;
+        pthread_mutex_unlock(&g_ext_io.lock);
+        return 0;
+    }
+    ts->inflight = 1;
+    req->fd = ts->fd;
+    if (g_ext_io_depth > 0 && ext_io_start_locked() > 0) {
+        ext_io_enqueue_locked(req, ts->place ? 0 : 1);
+        pthread_mutex_unlock(&g_ext_io.lock);
+        return 0;
+    }
+
+    // No executor: write inline, still in order (nothing else is in flight)
+    pthread_mutex_unlock(&g_ext_io.lock);
+    ext_io_execute(req);
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    tee_complete_locked(req);
+    res = ts->error;
+    pthread_cond_broadcast(&g_ext_io.done);
+    pthread_mutex_unlock(&g_ext_io.lock);
+    return res;
+}
+
+// Queue a copy of a write (h->lock held); returns the stream's error
+static int tee_queue_write(TeeStream *ts, const char *buf, size_t size, off_t offset) {
+    ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+    char *data = req ? malloc(size) : NULL;
+    if (!data) {
+        free(req);
+        DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+        if (ts->error == 0) ts->error = -ENOMEM;
+        int res = ts->error;
+        pthread_mutex_unlock(&g_ext_io.lock);
+        return res;
+    }
+    memcpy(data, buf, size);
+    req->kind = EXT_IO_PWRITE;
+    req->data = data;
+    req->size = size;
+    req->offset = offset;
+    return tee_submit(ts, req);
+}
+
+// Queue a truncate (h->lock held); returns the stream's error
+static int tee_queue_truncate(TeeStream *ts, off_t size) {
+    ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+    if (!req) {
+        DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+        if (ts->error == 0) ts->error = -ENOMEM;
+        int res = ts->error;
+        pthread_mutex_unlock(&g_ext_io.lock);
+        return res;
+    }
+    req->kind = EXT_IO_FTRUNCATE;
+    req->offset = size;
+    return tee_submit(ts, req);
+}
+
+// Wait up to external_timeout_ms for the requests submitted so far. Returns
+// the stream's error; -ETIMEDOUT if the drive did not answer, after which
+// the stream takes no more. Called with no locks held.
+static int tee_wait(TeeStream *ts) {
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    uint64_t target = ts->submitted;
+    struct timespec deadline;
+    int timeout_ms = ext_io_deadline(&deadline);
+    while (ts->error == 0 && ts->completed < target) {
+        if (timeout_ms <= 0) {
+            pthread_cond_wait(&g_ext_io.done, &g_ext_io.lock);
+        } else if (pthread_cond_timedwait(&g_ext_io.done, &g_ext_io.lock, &deadline) == ETIMEDOUT) {
+            ts->error = -ETIMEDOUT;
+            LOG_WARN("%s: EXTERNAL not answering after %d ms, dropping %s", tee_label(ts),
+                     timeout_ms, ts->tmp ? ts->tmp : "placed file");
+            tee_drop_queued_locked(ts);
+            break;
+        }
+    }
+    int res = ts->error;
+    pthread_mutex_unlock(&g_ext_io.lock);
+    return res;
+}
+
+// The stream's error, without waiting
+static int tee_error(TeeStream *ts) {
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    int res = ts->error;
+    pthread_mutex_unlock(&g_ext_io.lock);
+    return res;
+}
+
+// The owner is done with the stream: drop what has not started; one still
+// in flight is freed by its completion
+static void tee_stream_release(TeeStream *ts) {
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    tee_drop_queued_locked(ts);
+    ts->abandoned = 1;
+    if (!ts->inflight) tee_stream_free_locked(ts);
+    pthread_mutex_unlock(&g_ext_io.lock);
+}
+
+// Mirror a LOCAL pwrite (h->lock held)
+static void tee_write_locked(FuseHandle *h, const char *buf, size_t size, off_t offset) {
+    tee_queue_write(h->tee, buf, size, offset);
+}
+
+// Mark every write-through copy of path as stale (another writer, unlink)
+static void tee_invalidate(const char *path, const FuseHandle *except, int err) {
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h; h = h->next) {
+        if (h == except || !h->tee || strcmp(h->path, path) != 0) continue;
+        DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+        if (h->tee->error == 0) h->tee->error = err;
+        pthread_mutex_unlock(&g_ext_io.lock);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+}
+
+// Start a write-through copy for a handle that writes its file from scratch.
+// The temp is created by the stream's first request, so nothing here waits
+// for EXTERNAL.
+static void tee_open(FuseHandle *h, const char *path) {
+    if (!tee_dir_match(path) || g_state.readonly) return;
+
+    // A file with another writer cannot be mirrored from this handle alone
+    int shared = 0;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *o = g_handles.head; o; o = o->next) {
+        if (o != h && strcmp(o->path, path) == 0) {
+            shared = 1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+    char *external = shared ? NULL : get_external_path(path);
+    if (!external) return;
+
+    TeeStream *ts = tee_stream_new(-1, 0);
+    ExtIoRequest *req = calloc(1, sizeof(ExtIoRequest));
+    char *tmp = malloc(strlen(external) + sizeof(TEE_SUFFIX));
+    int res = ts && req && tmp ? 0 : -ENOMEM;
+    if (res == 0) {
+        strcpy(tmp, external);
+        strcat(tmp, TEE_SUFFIX);
+        if (!(req->path = strdup(tmp))) res = -ENOMEM;
+    }
+    if (res == 0 && fstat(h->fd, &req->st) != 0) res = -errno;
+    free(external);
+
+    if (res != 0) {
+        LOG_WARN("write-through: cannot start EXTERNAL copy for %s: errno=%d (%s)", path, -res, strerror(-res));
+        __sync_fetch_and_add(&g_tee.failed, 1);
+        if (req) ext_io_free(req);
+        free(tmp);
+        free(ts);
+        return;
+    }
+    ts->tmp = tmp;
+    req->kind = EXT_IO_CALL;
+    req->run = tee_create_run;
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    h->tee = ts;
+    tee_submit(ts, req);
+    pthread_mutex_unlock(&h->lock);
+    __sync_fetch_and_add(&g_tee.started, 1);
+}
+
+// Truncate the write-through copies of path along with LOCAL
+static void tee_truncate(const char *path, off_t size) {
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    for (FuseHandle *h = g_handles.head; h; h = h->next) {
+        if (!h->tee || strcmp(h->path, path) != 0) continue;
+        DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+        tee_queue_truncate(h->tee, size);
+        pthread_mutex_unlock(&h->lock);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+}
+
+// Release: queue the publish behind the stream's writes and wait for all of
+// it, up to external_timeout_ms.
+// Returns 1 if EXTERNAL now matches LOCAL, 0 if the file needs a normal sync.
+static int tee_finish(FuseHandle *h) {
+    TeeStream *ts = h->tee;
+    if (!ts) return 0;
+
+    // Buffered writes go out (and are mirrored) first
+    int res = handle_flush(h);
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    h->tee = NULL;
+    pthread_mutex_unlock(&h->lock);
+
+    char *local = NULL;
+    char *external = NULL;
+    DMSA_LOCK(&g_handles.lock, FUSE_LOCK_HANDLES);
+    if (res == 0) {
+        local = get_local_path(h->path);
+        external = get_external_path(h->path);
+    }
+    pthread_mutex_unlock(&g_handles.lock);
+
+    // Publish with the same size, mode and mtime as LOCAL
+    ExtIoRequest *req = NULL;
+    struct stat st, lst;
+    if (res == 0 && (!local || !external)) res = -ENOENT;
+    if (res == 0 && fstat(h->fd, &st) != 0) res = -errno;
+    if (res == 0 && (lstat(local, &lst) != 0 || lst.st_dev != st.st_dev || lst.st_ino != st.st_ino)) {
+        res = -ENOENT;  // Unlinked or replaced meanwhile
+    }
+    if (res == 0 && !(req = calloc(1, sizeof(ExtIoRequest)))) res = -ENOMEM;
+    if (res == 0) {
+        req->kind = EXT_IO_CALL;
+        req->run = tee_publish_run;
+        req->path = external;
+        req->st = st;
+        external = NULL;
+        tee_submit(ts, req);  // Dropped if the stream already failed
+    }
+    free(local);
+    free(external);
+
+    DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+    struct timespec deadline;
+    int timeout_ms = ext_io_deadline(&deadline);
+    while (ts->inflight || ts->head) {
+        if (timeout_ms <= 0) {
+            pthread_cond_wait(&g_ext_io.done, &g_ext_io.lock);
+        } else if (pthread_cond_timedwait(&g_ext_io.done, &g_ext_io.lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    if (ts->inflight || ts->head) {
+        // The drive is not answering; the last completion frees the stream
+        tee_drop_queued_locked(ts);
+        ts->abandoned = 1;
+        if (!ts->inflight) tee_stream_free_locked(ts);
+        pthread_mutex_unlock(&g_ext_io.lock);
+        __sync_fetch_and_add(&g_tee.failed, 1);
+        LOG_WARN("write-through: %s not published after %d ms, leaving it to sync", h->path, timeout_ms);
+        return 0;
+    }
+    if (res == 0) res = ts->error;
+    if (res == 0 && !ts->published) res = -EIO;
+    tee_stream_free_locked(ts);
+    pthread_mutex_unlock(&g_ext_io.lock);
+
+    if (res == 0) {
+        __sync_fetch_and_add(&g_tee.synced, 1);
+    } else {
+        __sync_fetch_and_add(&g_tee.failed, 1);
+        LOG_WARN("write-through: %s left to sync: errno=%d (%s)", h->path, -res, strerror(-res));
+    }
+    return res == 0;
+}
+
+static void log_tee_stats(void) {
+    LOG_INFO("Write-through: dirs=%d, started=%llu, synced=%llu, failed=%llu, throttled=%llu, written=%llu MB",
+             g_tee_dirs.count, (unsigned long long)g_tee.started, (unsigned long long)g_tee.synced,
+             (unsigned long long)g_tee.failed, (unsigned long long)g_tee.throttled,
+             (unsigned long long)(g_tee.bytes / (1024 * 1024)));
+}
+
+// ============================================================
+// Partial residency - LOCAL stubs holding the head/tail of evicted files
+// ============================================================
+// When a large file is evicted, its first stub_head_size and last
+// stub_tail_size bytes are kept in a stub under the stub directory (set by
+// the service, outside LOCAL so sync and scans never see it). A read-only
+// open of the EXTERNAL file whose stub still matches (size and mtime)
+// serves reads inside those ranges from the stub, and opens EXTERNAL only
+// on the first read outside them. Previews, thumbnails and `file` then
+// cost the drive a stat and nothing else.
+//
+// Stub layout: head bytes, tail bytes, StubTrailer.
+
+#define STUB_MAGIC 0x42545344u          // "DSTB" little-endian
+#define STUB_VERSION 1
+#define STUB_TMP_SUFFIX ".tmp"
+#define STUB_COPY_BUF_SIZE 65536
+#define DEFAULT_STUB_MIN_SIZE (8LL * 1024 * 1024)
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t size;                   // EXTERNAL size the stub was cut for
+    int64_t mtime_ns;               // EXTERNAL mtime
+    int64_t head;
+    int64_t tail;
+} StubTrailer;
+
+static struct {
+    char *dir;                      // NULL = partial residency off
+    volatile uint64_t created;
+    volatile uint64_t opens;        // Opens served from a stub
+    volatile uint64_t backing_opens;// Of those, EXTERNAL opened later for an uncovered read
+    volatile uint64_t hits;         // Reads served from a stub
+    volatile uint64_t stale;        // Stubs dropped because EXTERNAL changed
+    pthread_mutex_t lock;           // Guards dir
+} g_stubs = {
+    .dir = NULL,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static volatile int64_t g_stub_head_size = 0;                       // FUSE_TUNABLE_STUB_HEAD_SIZE
+static volatile int64_t g_stub_tail_size = 0;                       // FUSE_TUNABLE_STUB_TAIL_SIZE
+static volatile int64_t g_stub_min_size = DEFAULT_STUB_MIN_SIZE;    // FUSE_TUNABLE_STUB_MIN_SIZE
+
+// Stub path for a virtual path; NULL when partial residency is off
+static char* stub_path(const char *virtual_path) {
+    DMSA_LOCK(&g_stubs.lock, FUSE_LOCK_STUBS);
+    char *path = g_stubs.dir ? join_path(g_stubs.dir, virtual_path) : NULL;
+    pthread_mutex_unlock(&g_stubs.lock);
+    return path;
+}
+
+// Append [offset, offset + len) of src to dst; 0 or -errno
+static int stub_copy_range(int src, int dst, off_t offset, int64_t len, char *buf, size_t buf_size) {
+    while (len > 0) {
+        size_t chunk = (size_t)len < buf_size ? (size_t)len : buf_size;
+        ssize_t n = pread(src, buf, chunk, offset);
+        if (n < 0) return -errno;
+        if (n == 0) return -EIO;  // LOCAL shorter than it was a moment ago
+        for (ssize_t done = 0; done < n; ) {
+            ssize_t w = write(dst, buf + done, (size_t)(n - done));
+            if (w < 0) return -errno;
+            done += w;
+        }
+        offset += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// Cut a stub from the LOCAL copy about to be evicted.
+// Returns the stub's allocated bytes (0 if none was made) or -errno.
+static int64_t stub_create(const char *virtual_path, const char *local, const struct stat *est) {
+    int64_t head = g_stub_head_size;
+    int64_t tail = g_stub_tail_size;
+    if ((head <= 0 && tail <= 0) || est->st_size < g_stub_min_size || head + tail >= est->st_size) {
+        return 0;
+    }
+    char *path = stub_path(virtual_path);
+    if (!path) return 0;
+
+    int64_t res = 0;
+    int src = -1, dst = -1;
+    char *buf = NULL;
+    size_t len = strlen(path);
+    char *tmp = malloc(len + sizeof(STUB_TMP_SUFFIX));
+    if (!tmp) {
+        free(path);
+        return -ENOMEM;
+    }
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, STUB_TMP_SUFFIX, sizeof(STUB_TMP_SUFFIX));
+
+    if ((res = ensure_parent_directory(path)) != 0) goto done;
+    src = open(local, O_RDONLY);
+    dst = open(tmp, O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    buf = malloc(STUB_COPY_BUF_SIZE);
+    if (src < 0 || dst < 0 || !buf) {
+        res = buf ? -errno : -ENOMEM;
+        goto done;
+    }
+
+    StubTrailer trailer = {
+        .magic = STUB_MAGIC,
+        .version = STUB_VERSION,
+        .size = est->st_size,
+        .mtime_ns = STAT_MTIME_NS(est),
+        .head = head,
+        .tail = tail
+    };
+    if ((res = stub_copy_range(src, dst, 0, head, buf, STUB_COPY_BUF_SIZE)) != 0 ||
+        (res = stub_copy_range(src, dst, est->st_size - tail, tail, buf, STUB_COPY_BUF_SIZE)) != 0) {
+        goto done;
+    }
+    if (write(dst, &trailer, sizeof(trailer)) != (ssize_t)sizeof(trailer)) {
+        res = -EIO;
+        goto done;
+    }
+
+    struct stat sst;
+    res = fstat(dst, &sst) == 0 ? (int64_t)sst.st_blocks * 512 : 0;
+    if (close(dst) != 0 || rename(tmp, path) != 0) {
+        dst = -1;
+        res = -errno;
+        goto done;
+    }
+    dst = -1;
+    __sync_fetch_and_add(&g_stubs.created, 1);
+    LOG_DEBUG("stub: kept %lld+%lld bytes of %s", (long long)head, (long long)tail, virtual_path);
+
+done:
+    if (src >= 0) close(src);
+    if (dst >= 0) close(dst);
+    if (res < 0) unlink(tmp);
+    free(buf);
+    free(tmp);
+    free(path);
+    return res;
+}
+
+// Open the stub for an EXTERNAL file if it still matches it; fd or -1
+static int stub_open(const char *virtual_path, const struct stat *est, StubTrailer *out) {
+    char *path = stub_path(virtual_path);
+    if (!path) return -1;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        free(path);
+        return -1;
+    }
+    struct stat sst;
+    StubTrailer t;
+    int valid = fstat(fd, &sst) == 0 && sst.st_size >= (off_t)sizeof(t) &&
+                pread(fd, &t, sizeof(t), sst.st_size - (off_t)sizeof(t)) == (ssize_t)sizeof(t) &&
+                t.magic == STUB_MAGIC && t.version == STUB_VERSION &&
+                t.head >= 0 && t.tail >= 0 &&
+                sst.st_size == t.head + t.tail + (off_t)sizeof(t) &&
+                t.size == est->st_size && t.mtime_ns == STAT_MTIME_NS(est);
+    if (!valid) {
+        // EXTERNAL changed since eviction; the stub can never be used again
+        close(fd);
+        unlink(path);
+        __sync_fetch_and_add(&g_stubs.stale, 1);
+        free(path);
+        return -1;
+    }
+    free(path);
+    *out = t;
+    return fd;
+}
+
+// Serve a read from the stub; bytes read, or -1 if the range is not covered
+static int stub_read(FuseHandle *h, char *buf, size_t size, off_t offset) {
+    if (offset >= h->size) return 0;
+    size_t n = (off_t)size < h->size - offset ? size : (size_t)(h->size - offset);
+    off_t tail_start = h->size - h->stub_tail;
+    off_t at;
+    if (offset + (off_t)n <= h->stub_head) {
+        at = offset;
+    } else if (offset >= tail_start) {
+        at = h->stub_head + (offset - tail_start);
+    } else {
+        return -1;
+    }
+    if (pread(h->stub_fd, buf, n, at) != (ssize_t)n) return -1;  // Damaged stub: use EXTERNAL
+    __sync_fetch_and_add(&g_stubs.hits, 1);
+    return (int)n;
+}
+
+// Open EXTERNAL for a stub-served handle on its first uncovered read; 0 or -errno
+static int handle_open_backing(FuseHandle *h) {
+    int res = 0;
+    DMSA_LOCK(&h->lock, FUSE_LOCK_HANDLES);
+    if (h->fd < 0) {
+        int fd = open(h->backing_path, O_RDONLY);
+        if (fd < 0) {
+            res = -errno;
+        } else {
+            struct stat st;
+            if (fstat(fd, &st) == 0) {
+                h->dev = st.st_dev;
+                h->ino = st.st_ino;
+            }
+            h->fd = fd;
+            __sync_fetch_and_add(&g_stubs.backing_opens, 1);
+        }
+    }
+    pthread_mutex_unlock(&h->lock);
+    return res;
+}
+
+// Keep stubs in step with the namespace (best effort)
+static void stub_remove(const char *virtual_path, int is_directory) {
+    char *path = stub_path(virtual_path);
+    if (!path) return;
+    if (is_directory) rmdir(path);
+    else unlink(path);
+    free(path);
+}
+
+static void stub_rename(const char *from, const char *to) {
+    char *src = stub_path(from);
+    char *dst = stub_path(to);
+    if (src && dst && access(src, F_OK) == 0 && ensure_parent_directory(dst) == 0) {
+        rename(src, dst);
+    }
+    free(src);
+    free(dst);
+}
+
+static void log_stub_stats(void) {
+    LOG_INFO("Stubs: head=%lld, tail=%lld, min_size=%lld, created=%llu, opens=%llu, "
+             "backing opens=%llu, hits=%llu, stale=%llu",
+             (long long)g_stub_head_size, (long long)g_stub_tail_size, (long long)g_stub_min_size,
+             (unsigned long long)g_stubs.created, (unsigned long long)g_stubs.opens,
+             (unsigned long long)g_stubs.backing_opens, (unsigned long long)g_stubs.hits,
+             (unsigned long long)g_stubs.stale);
+}
+
+// ============================================================
+// Content-hash cache - persistent digests keyed by file identity
+// ============================================================
+// File layout (native endianness, same machine only): a HASH_CACHE_HEADER_SIZE
+// header, then capacity fixed-size slots. The file is mapped shared, so
+// entries persist without explicit saves; every slot carries a check value
+// and a slot torn by a crash reads as empty.
+//
+// An entry lives within HASH_CACHE_PROBE slots of its home, which is hashed
+// from (dev, ino) alone so a changed file overwrites its own stale entry. A
+// full window replaces its oldest entry. The table doubles at 3/4 load, by
+// rewriting it into a new file, until max_entries.
+
+#define HASH_CACHE_MAGIC        0x43484D44u     // "DMHC" little-endian
+#define HASH_CACHE_VERSION      1
+#define HASH_CACHE_HEADER_SIZE  64
+#define HASH_CACHE_MIN_SLOTS    16384
+#define HASH_CACHE_PROBE        8
+#define HASH_CACHE_RACY_NS      (2LL * 1000000000LL)   // FAT/exFAT mtime granularity
+#define DEFAULT_HASH_CACHE_MAX_ENTRIES (1u << 20)
+
+#ifdef __APPLE__
+#define STAT_CTIME_NS(st) ((int64_t)(st)->st_ctimespec.tv_sec * 1000000000LL + (st)->st_ctimespec.tv_nsec)
+#else
+#define STAT_CTIME_NS(st) ((int64_t)(st)->st_ctim.tv_sec * 1000000000LL + (st)->st_ctim.tv_nsec)
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;
+    uint32_t capacity;              // Power of two
+    uint32_t entries;               // Approximate after a crash
+    uint32_t _pad;
+    uint64_t created_ms;
+} HashCacheHeader;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint32_t stored_min;            // Minutes since epoch, picks the entry to replace
+    uint8_t algorithm;              // 0 = empty
+    uint8_t digest_len;
+    uint16_t check;                 // hash_cache_check() of the rest of the slot
+    uint8_t digest[FUSE_HASH_MAX_DIGEST];
+} HashCacheSlot;
+
+_Static_assert(sizeof(HashCacheHeader) <= HASH_CACHE_HEADER_SIZE, "HashCacheHeader too large");
+_Static_assert(sizeof(HashCacheSlot) == 80, "HashCacheSlot must not have padding");
+
+static struct {
+    char *path;
+    int fd;
+    HashCacheHeader *header;        // Start of the mapping, NULL when closed
+    HashCacheSlot *slots;
+    size_t map_size;
+    uint32_t max_entries;
+    FuseHashCacheStats stats;       // entries/capacity mirror the header (read unlocked by shm)
+    pthread_mutex_t lock;
+} g_hash_cache = {
+    .path = NULL,
+    .fd = -1,
+    .header = NULL,
+    .slots = NULL,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
+
+static uint16_t hash_cache_check(const HashCacheSlot *s) {
+    HashCacheSlot copy = *s;
+    copy.check = 0;
+    const uint8_t *p = (const uint8_t *)&copy;
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < sizeof(copy); i++) {
+        h ^= p[i];
+        h *= 16777619u;
+    }
+    return (uint16_t)(h ^ (h >> 16));
+}
+
+static int hash_cache_slot_valid(const HashCacheSlot *s) {
+    return s->algorithm != 0 && s->digest_len <= FUSE_HASH_MAX_DIGEST && s->check == hash_cache_check(s);
+}
+
+static uint32_t hash_cache_home(uint64_t dev, uint64_t ino, uint32_t capacity) {
+    uint64_t h = dev * 0x9E3779B97F4A7C15ULL ^ ino;
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return (uint32_t)h & (capacity - 1);
+}
+
+// Slot for (dev, ino, algorithm): the file's current entry, else an empty
+// slot, else the oldest one in the window (*replaced = 1)
+static HashCacheSlot* hash_cache_find_slot(HashCacheSlot *slots, uint32_t capacity, uint64_t dev,
+                                           uint64_t ino, uint8_t algorithm, int *replaced) {
+    uint32_t home = hash_cache_home(dev, ino, capacity);
+    HashCacheSlot *empty = NULL;
+    HashCacheSlot *oldest = NULL;
+    for (uint32_t i = 0; i < HASH_CACHE_PROBE; i++) {
+        HashCacheSlot *s = &slots[(home + i) & (capacity - 1)];
+        if (!hash_cache_slot_valid(s)) {
+            if (!empty) empty = s;
+            continue;
+        }
+        if (s->dev == dev && s->ino == ino && s->algorithm == algorithm) {
+            *replaced = 0;
+            return s;
+        }
+        if (!oldest || s->stored_min < oldest->stored_min) oldest = s;
+    }
+    *replaced = empty == NULL;
+    return empty ? empty : oldest;
+}
+
+// Size the file for capacity slots and map it; a new table is written when
+// init is set (ftruncate zero-fills, so every slot starts empty)
+static HashCacheHeader* hash_cache_map(int fd, uint32_t capacity, int init, size_t *map_size) {
+    size_t size = HASH_CACHE_HEADER_SIZE + (size_t)capacity * sizeof(HashCacheSlot);
+    if (init && (ftruncate(fd, 0) != 0 || ftruncate(fd, (off_t)size) != 0)) return NULL;
+
+    void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) return NULL;
+    HashCacheHeader *header = base;
+    if (init) {
+        header->magic = HASH_CACHE_MAGIC;
+        header->version = HASH_CACHE_VERSION;
+        header->slot_size = sizeof(HashCacheSlot);
+        header->capacity = capacity;
+        header->entries = 0;
+        header->created_ms = wall_clock_ms();
+    }
+    *map_size = size;
+    return header;
+}
+
+static void hash_cache_unmap_locked(void) {
+    if (g_hash_cache.header) {
+        msync(g_hash_cache.header, g_hash_cache.map_size, MS_ASYNC);
+        munmap(g_hash_cache.header, g_hash_cache.map_size);
+    }
+    if (g_hash_cache.fd >= 0) close(g_hash_cache.fd);
+    g_hash_cache.header = NULL;
+    g_hash_cache.slots = NULL;
+    g_hash_cache.fd = -1;
+    g_hash_cache.stats.entries = 0;
+    g_hash_cache.stats.capacity = 0;
+}
+
+// Double the table into a new file and swap it in. On failure the current
+// table stays and stops growing.
+static void hash_cache_grow_locked(void) {
+    uint32_t old_capacity = g_hash_cache.header->capacity;
+    uint32_t capacity = old_capacity * 2;
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", g_hash_cache.path);
+
+    size_t map_size = 0;
+    HashCacheHeader *header = NULL;
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0) header = hash_cache_map(fd, capacity, 1, &map_size);
+    if (!header) {
+        LOG_ERROR("Hash cache: cannot grow to %u entries, errno=%d (%s)", capacity, errno, strerror(errno));
+        if (fd >= 0) close(fd);
+        unlink(tmp_path);
+        g_hash_cache.max_entries = old_capacity;
+        return;
+    }
+
+    HashCacheSlot *slots = (HashCacheSlot *)((char *)header + HASH_CACHE_HEADER_SIZE);
+    uint32_t entries = 0;
+    for (uint32_t i = 0; i < old_capacity; i++) {
+        const HashCacheSlot *s = &g_hash_cache.slots[i];
+        if (!hash_cache_slot_valid(s)) continue;
+        int replaced;
+        HashCacheSlot *dst = hash_cache_find_slot(slots, capacity, s->dev, s->ino, s->algorithm, &replaced);
+        if (!replaced) entries++;
+        *dst = *s;
+    }
+    header->entries = entries;
+
+    if (msync(header, map_size, MS_SYNC) != 0 || rename(tmp_path, g_hash_cache.path) != 0) {
+        LOG_ERROR("Hash cache: cannot replace %s, errno=%d (%s)", g_hash_cache.path, errno, strerror(errno));
+        munmap(header, map_size);
+        close(fd);
+        unlink(tmp_path);
+        g_hash_cache.max_entries = old_capacity;
+        return;
+    }
+
+    hash_cache_unmap_locked();
+    g_hash_cache.fd = fd;
+    g_hash_cache.header = header;
+    g_hash_cache.slots = slots;
+    g_hash_cache.map_size = map_size;
+    g_hash_cache.stats.entries = entries;
+    g_hash_cache.stats.capacity = capacity;
+    LOG_INFO("Hash cache grown: %u -> %u slots, %u entries", old_capacity, capacity, entries);
+}
+
+static void log_hash_cache_stats(void) {
+    LOG_INFO("Hash cache: entries=%u/%u, lookups=%llu, hits=%llu, stores=%llu, racy=%llu, replaced=%llu",
+             g_hash_cache.stats.entries, g_hash_cache.stats.capacity,
+             (unsigned long long)g_hash_cache.stats.lookups, (unsigned long long)g_hash_cache.stats.hits,
+             (unsigned long long)g_hash_cache.stats.stores, (unsigned long long)g_hash_cache.stats.racy,
+             (unsigned long long)g_hash_cache.stats.replaced);
+}
+
+// ============================================================
+// FUSE callback functions
+// ============================================================
+
+// getattr: get file attributes
+static int root_getattr_logged = 0;  // Avoid log flooding
+static int index_not_ready_logged = 0;  // Avoid index-not-ready log flooding
+
+static int dmsa_getattr(const char *path, struct stat *stbuf) {
+    track_operation();
+    int depth_err = check_path_depth(path);
+    if (depth_err) return depth_err;
+
+    LOG_DEBUG("getattr: %s", path);
+
+    memset(stbuf, 0, sizeof(struct stat));
+
+    // Root directory special handling - allow access even when index is not ready
+    if (strcmp(path, "/") == 0) {
+        stbuf->st_mode = S_IFDIR | 0755;
+        stbuf->st_nlink = 2;
+        stbuf->st_uid = g_state.owner_uid;
+        stbuf->st_gid = g_state.owner_gid;
+        stbuf->st_atime = stbuf->st_mtime = stbuf->st_ctime = time(NULL);
+
+        // Log on first root directory access
+        if (!root_getattr_logged) {
+            LOG_INFO("getattr(/): returning uid=%d, gid=%d, mode=0755",
+                     g_state.owner_uid, g_state.owner_gid);
+            root_getattr_logged = 1;
+        }
+        return 0;
+    }
+
+    // Block non-root directory access when index is not ready
+    if (!g_state.index_ready) {
+        if (!index_not_ready_logged) {
+            LOG_INFO("Index not ready, blocking file access (returning EBUSY)");
+            index_not_ready_logged = 1;
+        }
+        return -EBUSY;
+    }
+
+    char *actual_path = resolve_actual_path(path);
+    if (!actual_path) {
+        LOG_DEBUG("getattr: ENOENT for %s", path);
+        return resolve_errno();
+    }
+
+    // Size and mtime must include writes still held in a handle buffer
+    flush_path_buffers(path);
+
+    uint64_t t0 = monotonic_ns();
+    int res = stat(actual_path, stbuf);
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    if (res == -1) {
+        int err = errno;
+        LOG_WARN("getattr: stat failed for %s (actual=%s): errno=%d (%s)", path, actual_path, err, strerror(err));
+        free(actual_path);
+        return -err;
+    }
+    free(actual_path);
+
+    // Always report files as owned by the mount owner
+    stbuf->st_uid = g_state.owner_uid;
+    stbuf->st_gid = g_state.owner_gid;
+
+    // Normalize permissions: VFS files should be readable by owner
+    // Underlying files might have restrictive permissions (e.g., 600 from old system)
+    // but VFS should present them with standard permissions
+    if (S_ISDIR(stbuf->st_mode)) {
+        // Directories: rwxr-xr-x (755)
+        stbuf->st_mode = S_IFDIR | 0755;
+    } else {
+        // Files: rw-r--r-- (644) - preserve execute bit if present
+        mode_t exec_bit = stbuf->st_mode & S_IXUSR;
+        stbuf->st_mode = S_IFREG | 0644 | exec_bit;
+    }
+
+    return 0;
+}
+
+// readdir: read directory contents (smart merge LOCAL + EXTERNAL)
+// NOTE: We pass NULL for stat in filler() - this is the standard approach:
+//   - Only return entry names, no file attributes
+//   - Applications (ls, etc.) will call getattr() separately for each entry
+//   - This avoids symlink resolution during readdir, preventing deadlocks
+//   - Combined with fuse_loop_mt(), handles symlinks pointing back to VFS
+static int dmsa_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                        off_t offset, struct fuse_file_info *fi) {
+    track_operation();
+    (void) offset;
+    (void) fi;
+
+    int depth_err = check_path_depth(path);
+    if (depth_err) return depth_err;
+
+    LOG_DEBUG("readdir: %s", path);
+
+    // Block directory reads when index is not ready (including root)
+    // Note: Root must also be blocked since Finder will try to list contents
+    if (!g_state.index_ready) {
+        // Allow root directory access but return empty listing
+        if (strcmp(path, "/") == 0) {
+            filler(buf, ".", NULL, 0);
+            filler(buf, "..", NULL, 0);
+            // Return no files, so Finder sees an empty directory
+            return 0;
+        }
+        return -EBUSY;
+    }
+
+    // Add . and ..
+    filler(buf, ".", NULL, 0);
+    filler(buf, "..", NULL, 0);
+
+    // Heap-allocated deduplication table (supports larger directories)
+    int max_entries = g_readdir_max_entries;
+    char **seen_names = calloc((size_t)max_entries, sizeof(char*));
+    if (!seen_names) {
+        LOG_ERROR("readdir: failed to allocate seen_names table");
+        return -ENOMEM;
+    }
+    int seen_count = 0;
+
+    // Helper buffer for building full virtual paths
+    char full_vpath[2048];
+    int path_is_root = (strcmp(path, "/") == 0);
+
+    // Read from local directory
+    char *local = get_local_path(path);
+    if (local) {
+        uint64_t t0 = monotonic_ns();
+        DIR *dp = opendir(local);
+        phase_add(FUSE_PHASE_RESOLVE_LOCAL, t0);
+        t_op.tier |= FUSE_TIER_LOCAL;
+        if (dp) {
+            t0 = monotonic_ns();
+            struct dirent *de;
+            while ((de = readdir(dp)) != NULL) {
+                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+                    continue;
+                }
+                if (should_exclude(de->d_name)) {
+                    continue;
+                }
+
+                // Build full virtual path for pending delete check
+                if (path_is_root) {
+                    snprintf(full_vpath, sizeof(full_vpath), "/%s", de->d_name);
+                } else {
+                    snprintf(full_vpath, sizeof(full_vpath), "%s/%s", path, de->d_name);
+                }
+
+                // Skip if in pending delete set
+                if (pending_delete_contains(full_vpath)) {
+                    continue;
+                }
+
+                // Check if already added
+                int found = 0;
+                for (int i = 0; i < seen_count; i++) {
+                    if (seen_names[i] && strcmp(seen_names[i], de->d_name) == 0) {
+                        found = 1;
+                        break;
+                    }
+                }
+
+                if (!found && seen_count < max_entries) {
+                    seen_names[seen_count++] = strdup(de->d_name);
+                    filler(buf, de->d_name, NULL, 0);
+                }
+            }
+            closedir(dp);
+            phase_add(FUSE_PHASE_BACKEND, t0);
+        }
+        free(local);
+    }
+
+    // Read from external directory (if online)
+    char *external = get_external_path(path);
+    if (external) {
+        uint64_t t0 = monotonic_ns();
+        DIR *dp = opendir(external);
+        phase_add(FUSE_PHASE_RESOLVE_EXTERNAL, t0);
+        t_op.tier |= FUSE_TIER_EXTERNAL;
+        if (dp) {
+            t0 = monotonic_ns();
+            struct dirent *de;
+            while ((de = readdir(dp)) != NULL) {
+                if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+                    continue;
+                }
+                if (should_exclude(de->d_name)) {
+                    continue;
+                }
+
+                // Build full virtual path for pending delete check
+                if (path_is_root) {
+                    snprintf(full_vpath, sizeof(full_vpath), "/%s", de->d_name);
+                } else {
+                    snprintf(full_vpath, sizeof(full_vpath), "%s/%s", path, de->d_name);
+                }
+
+                // Skip if in pending delete set (important: hides EXTERNAL files that couldn't be deleted)
+                if (pending_delete_contains(full_vpath)) {
+                    continue;
+                }
+
+                // Check if already added
+                int found = 0;
+                for (int i = 0; i < seen_count; i++) {
+                    if (seen_names[i] && strcmp(seen_names[i], de->d_name) == 0) {
+                        found = 1;
+                        break;
+                    }
+                }
+
+                if (!found && seen_count < max_entries) {
+                    seen_names[seen_count++] = strdup(de->d_name);
+                    filler(buf, de->d_name, NULL, 0);
+                }
+            }
+            closedir(dp);
+            phase_add(FUSE_PHASE_BACKEND, t0);
+        }
+        free(external);
+    }
+
+    // Cleanup heap-allocated table
+    for (int i = 0; i < seen_count; i++) {
+        free(seen_names[i]);
+    }
+    free(seen_names);
+
+    return 0;
+}
+
+// open: open file
+static int dmsa_open(const char *path, struct fuse_file_info *fi) {
+    track_operation();
+    int depth_err = check_path_depth(path);
+    if (depth_err) return depth_err;
+
+    LOG_DEBUG("open: %s, flags=%d", path, fi->flags);
+
+    // Block file open when index is not ready
+    CHECK_INDEX_READY();
+
+    // A file its creator is moving to EXTERNAL keeps a single writer
+    if ((fi->flags & (O_WRONLY | O_RDWR)) && place_state_of(path) != PLACE_NONE) {
+        return -EBUSY;
+    }
+
+    // Limit concurrent open files to prevent FUSE resource exhaustion
+    if (acquire_open_slot() < 0) {
+        return -EMFILE;
+    }
+
+    char *actual_path = resolve_actual_path(path);
+
+    // Never create a LOCAL file over an EXTERNAL one that just did not answer
+    if (!actual_path && t_op.external_error) {
+        release_open_slot();
+        return t_op.external_error;
+    }
+
+    if (!actual_path) {
+        // File doesn't exist, check if in create mode
+        if ((fi->flags & O_CREAT) || (fi->flags & O_WRONLY) || (fi->flags & O_RDWR)) {
+            actual_path = get_local_path(path);
+            if (!actual_path) {
+                return -ENOENT;
+            }
+
+            // Ensure parent directory exists
+            int res = ensure_parent_directory(actual_path);
+            if (res != 0) {
+                free(actual_path);
+                return res;
+            }
+
+            // Create empty file
+            int fd = open(actual_path, O_CREAT | O_WRONLY, 0644);
+            if (fd == -1) {
+                int err = errno;
+                free(actual_path);
+                return -err;
+            }
+            close(fd);
+            fix_ownership(actual_path);
+        } else {
+            return -ENOENT;
+        }
+    }
+
+    // If write mode and actual path is external, copy to local first
+    char *local = get_local_path(path);
+    if (local && ((fi->flags & O_WRONLY) || (fi->flags & O_RDWR))) {
+        if (strcmp(actual_path, local) != 0) {
+            // A copy-up now would be unlinked by the eviction in progress
+            if (is_evicting(path)) {
+                free(actual_path);
+                free(local);
+                release_open_slot();
+                return -EBUSY;
+            }
+
+            if (qos_deny_copy_up(path)) {
+                free(actual_path);
+                free(local);
+                release_open_slot();
+                return -EACCES;
+            }
+
+            // Actual path is external, copy to local
+            int res = copy_up(path, actual_path, local);
+            if (res != 0) {
+                free(actual_path);
+                free(local);
+                release_open_slot();
+                return res;
+            }
+
+            // Use local path
+            free(actual_path);
+            actual_path = local;
+            local = NULL;
+        }
+    }
+
+    // O_TRUNC must not race with data still buffered on another handle
+    if (fi->flags & O_TRUNC) {
+        flush_path_buffers(path);
+    }
+
+    int from_external = local && strcmp(actual_path, local) != 0;
+
+    // Evicted with a stub: serve head/tail locally, open EXTERNAL only if needed
+    if (from_external && (fi->flags & O_ACCMODE) == O_RDONLY) {
+        struct stat est;
+        StubTrailer stub;
+        int stub_fd = ext_stat(actual_path, &est) == 0 ? stub_open(path, &est, &stub) : -1;
+        if (stub_fd >= 0) {
+            FuseHandle *h = handle_new(-1, path, 0);
+            if (h) {
+                h->external = 1;
+                h->size = est.st_size;
+                h->stub_fd = stub_fd;
+                h->stub_head = stub.head;
+                h->stub_tail = stub.tail;
+                h->backing_path = actual_path;
+                __sync_fetch_and_add(&g_stubs.opens, 1);
+                free(local);
+                fi->fh = (uint64_t)(uintptr_t)h;
+                return 0;
+            }
+            close(stub_fd);
+        }
+    }
+
+    // Try to open file
+    uint64_t t0 = monotonic_ns();
+    int fd = open(actual_path, fi->flags);
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    if (fd == -1) {
+        int err = errno;
+        LOG_WARN("open: failed for %s (actual=%s, flags=%d): errno=%d (%s)", path, actual_path, fi->flags, err, strerror(err));
+        free(actual_path);
+        if (local) free(local);
+        release_open_slot();  // Release the slot on failure
+        return -err;
+    }
+
+    FuseHandle *h = handle_new(fd, path, (fi->flags & (O_WRONLY | O_RDWR)) != 0);
+    free(actual_path);
+    if (local) free(local);
+    if (!h) {
+        close(fd);
+        release_open_slot();
+        return -ENOMEM;
+    }
+    h->external = from_external;
+    cache_policy_open(h, from_external, fi);
+    if (h->writable) {
+        // Another writer makes existing write-through copies incomplete
+        tee_invalidate(path, h, -EBUSY);
+        if ((fi->flags & O_TRUNC) && !from_external) tee_open(h, path);
+    }
+
+    fi->fh = (uint64_t)(uintptr_t)h;
+    return 0;
+}
+
+// read: read file contents
+static int dmsa_read(const char *path, char *buf, size_t size, off_t offset,
+                     struct fuse_file_info *fi) {
+    track_operation();
+    LOG_DEBUG("read: %s, size=%zu, offset=%lld", path, size, offset);
+
+    FuseHandle *h = FUSE_HANDLE(fi);
+    if (!h) {
+        return -EBADF;
+    }
+
+    // Read-your-writes: buffered data from any handle on this file lands first
+    flush_path_buffers(path);
+
+    uint64_t t0 = monotonic_ns();
+    int res;
+    if (h->stub_fd >= 0) {
+        res = stub_read(h, buf, size, offset);
+        if (res >= 0) {
+            phase_add(FUSE_PHASE_BACKEND, t0);
+            return res;
+        }
+        if (h->fd < 0 && (res = handle_open_backing(h)) != 0) {
+            phase_add(FUSE_PHASE_BACKEND, t0);
+            return res;
+        }
+    }
+    if (h->external) {
+        res = (int)ext_pread(h, buf, size, offset);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        if (res < 0) return res;
+    } else {
+        res = pread(h->fd, buf, size, offset);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        if (res == -1) return -errno;
+    }
+    cache_policy_note_read(h, offset, (size_t)res);
+
+    return res;
+}
+
+// write: write file contents
+static int dmsa_write(const char *path, const char *buf, size_t size, off_t offset,
+                      struct fuse_file_info *fi) {
+    track_operation();
+    LOG_DEBUG("write: %s, size=%zu, offset=%lld", path, size, offset);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // Block write if file is being synced
+    if (syncing_files_contains(path)) {
+        LOG_DEBUG("write blocked: %s is syncing", path);
+        return -EBUSY;
+    }
+
+    FuseHandle *h = FUSE_HANDLE(fi);
+    if (!h) {
+        // If no fh, try writing directly to local file
+        char *local = get_local_path(path);
+        if (!local) {
+            return -ENOENT;
+        }
+
+        ensure_parent_directory(local);
+
+        int fd = open(local, O_WRONLY | O_CREAT, 0644);
+        free(local);
+
+        if (fd == -1) {
+            return -errno;
+        }
+
+        int res = pwrite(fd, buf, size, offset);
+        int err = errno;
+        close(fd);
+
+        if (res == -1) {
+            return -err;
+        }
+        return res;
+    }
+
+    if (h->tee) tee_throttle(h->tee);
+    place_throttle(h);
+    int res = handle_write(h, buf, size, offset);
+    if (res > 0) {
+        int err = place_wait(h);
+        if (err != 0) return err;
+        place_maybe_start(h, path, offset + res);
+    }
+    return res;
+}
+
+// flush: called on every close() of a descriptor; surface buffered-write errors here
+static int dmsa_flush(const char *path, struct fuse_file_info *fi) {
+    LOG_DEBUG("flush: %s", path);
+
+    FuseHandle *h = FUSE_HANDLE(fi);
+    if (!h) {
+        return 0;
+    }
+    return handle_flush(h);
+}
+
+// fsync: write out the buffer, then sync the LOCAL file (or the placed EXTERNAL one)
+static int dmsa_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    LOG_DEBUG("fsync: %s, datasync=%d", path, datasync);
+
+    FuseHandle *h = FUSE_HANDLE(fi);
+    if (!h) {
+        return -EBADF;
+    }
+
+    int res = handle_flush(h);
+    if (res != 0) {
+        return res;
+    }
+
+    uint64_t t0 = monotonic_ns();
+    if (!place_fsync(h, &res)) {
+        res = fsync(h->fd) == -1 ? -errno : 0;
+    }
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    return res;
+}
+
+// release: close file
+static int dmsa_release(const char *path, struct fuse_file_info *fi) {
+    LOG_DEBUG("release: %s", path);
+
+    FuseHandle *h = FUSE_HANDLE(fi);
+    int placed = 0;
+    int synced = 0;
+    if (h && place_release(h, path)) {
+        // The placement worker closes it and sends the notification
+        fi->fh = 0;
+        release_open_slot();
+        return 0;
+    }
+    if (h) {
+        placed = h->place == PLACE_EXTERNAL;
+        synced = tee_finish(h);
+        // Release cannot report errors to the app; flush already did
+        if (handle_close(h) != 0) {
+            LOG_WARN("release: buffered data for %s was not fully written", path);
+        }
+        fi->fh = 0;
+    }
+
+    // Release concurrent open slot
+    release_open_slot();
+
+    // Notify Swift layer if file was written (check flags)
+    // fi->flags contains open flags: O_WRONLY, O_RDWR indicate write
+    if (placed) {
+        NOTIFY_FILE_PLACED(path);
+    } else if (synced) {
+        NOTIFY_FILE_SYNCED(path);
+    } else if ((fi->flags & O_WRONLY) || (fi->flags & O_RDWR)) {
+        NOTIFY_FILE_WRITTEN(path);
+    }
+
+    return 0;
+}
+
+// create: create file
+static int dmsa_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    LOG_DEBUG("create: %s, mode=%o", path, mode);
+
+    // Block file creation when index is not ready
+    CHECK_INDEX_READY();
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *local = get_local_path(path);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    int res = ensure_parent_directory(local);
+    if (res != 0) {
+        free(local);
+        return res;
+    }
+
+    // A placement candidate's fd must be readable for the prefix copy
+    int placing = place_enabled();
+    uint64_t t0 = monotonic_ns();
+    int fd = open(local, O_CREAT | (placing ? O_RDWR : O_WRONLY) | O_TRUNC, mode);
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    t_op.tier |= FUSE_TIER_LOCAL;
+
+    if (fd == -1) {
+        int err = errno;
+        free(local);
+        return -err;
+    }
+
+    fix_ownership(local);
+
+    // Notify Swift layer - file created
+    NOTIFY_FILE_CREATED(path, local, 0);
+
+    free(local);
+
+    FuseHandle *h = handle_new(fd, path, 1);
+    if (!h) {
+        close(fd);
+        return -ENOMEM;
+    }
+    tee_invalidate(path, h, -EBUSY);
+    tee_open(h, path);
+    if (placing && !h->tee) h->place = PLACE_CANDIDATE;
+    fi->fh = (uint64_t)(uintptr_t)h;
+    return 0;
+}
+
+// unlink: delete file
+// Order: 1. Add to pending delete 2. Notify Swift 3. Delete LOCAL 4. Delete EXTERNAL 5. Remove from pending
+static int dmsa_unlink(const char *path) {
+    LOG_DEBUG("unlink: %s", path);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // Block delete if file is being synced
+    if (syncing_files_contains(path)) {
+        LOG_DEBUG("unlink blocked: %s is syncing", path);
+        return -EBUSY;
+    }
+
+    // Step 1: Add to pending delete set (hides from readdir immediately)
+    pending_delete_add(path);
+
+    // Step 2: Notify Swift layer (async, updates memory cache + DB)
+    NOTIFY_FILE_DELETED(path, 0);
+
+    int result = 0;
+    int external_deleted = 0;
+
+    // Step 3: Delete local copy
+    char *local = get_local_path(path);
+    if (local) {
+        uint64_t t0 = monotonic_ns();
+        int local_res = unlink(local);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        t_op.tier |= FUSE_TIER_LOCAL;
+        if (local_res == -1 && errno != ENOENT) {
+            result = -errno;
+            LOG_WARN("unlink local failed: %s, errno=%d", local, errno);
+        }
+        free(local);
+    }
+
+    // Step 4: Delete external copy (best effort)
+    char *external = get_external_path(path);
+    if (external) {
+        uint64_t t0 = monotonic_ns();
+        int external_res = unlink(external);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        t_op.tier |= FUSE_TIER_EXTERNAL;
+        if (external_res == 0 || errno == ENOENT) {
+            external_deleted = 1;
+        } else {
+            LOG_DEBUG("unlink external failed: %s, errno=%d (will stay in pending)", external, errno);
+        }
+        free(external);
+    } else {
+        external_deleted = 1;  // No external path means nothing to delete
+    }
+
+    // Step 5: Remove from pending delete if external was deleted successfully
+    // If external delete failed, keep in pending so readdir continues to hide it
+    if (external_deleted) {
+        pending_delete_remove(path);
+    }
+    stub_remove(path, 0);
+
+    return result;
+}
+
+// mkdir: create directory
+static int dmsa_mkdir(const char *path, mode_t mode) {
+    LOG_DEBUG("mkdir: %s, mode=%o", path, mode);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *local = get_local_path(path);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    int res = ensure_parent_directory(local);
+    if (res != 0) {
+        free(local);
+        return res;
+    }
+
+    uint64_t t0 = monotonic_ns();
+    res = mkdir(local, mode);
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    t_op.tier |= FUSE_TIER_LOCAL;
+
+    if (res == -1) {
+        int err = errno;
+        free(local);
+        return -err;
+    }
+
+    fix_ownership(local);
+
+    // Notify Swift layer - directory created
+    NOTIFY_FILE_CREATED(path, local, 1);
+
+    free(local);
+
+    return 0;
+}
+
+// rmdir: remove directory
+// Order: 1. Add to pending delete 2. Notify Swift 3. Delete LOCAL 4. Delete EXTERNAL 5. Remove from pending
+static int dmsa_rmdir(const char *path) {
+    LOG_DEBUG("rmdir: %s", path);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // Block delete if directory is being synced
+    if (syncing_files_contains(path)) {
+        LOG_DEBUG("rmdir blocked: %s is syncing", path);
+        return -EBUSY;
+    }
+
+    // Step 1: Add to pending delete set (hides from readdir immediately)
+    pending_delete_add(path);
+
+    // Step 2: Notify Swift layer (async, updates memory cache + DB)
+    NOTIFY_FILE_DELETED(path, 1);
+
+    int result = 0;
+    int external_deleted = 0;
+
+    // Step 3: Delete local copy
+    char *local = get_local_path(path);
+    if (local) {
+        uint64_t t0 = monotonic_ns();
+        int local_res = rmdir(local);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        t_op.tier |= FUSE_TIER_LOCAL;
+        if (local_res == -1 && errno != ENOENT) {
+            result = -errno;
+            LOG_WARN("rmdir local failed: %s, errno=%d", local, errno);
+        }
+        free(local);
+    }
+
+    // Step 4: Delete external copy (best effort)
+    char *external = get_external_path(path);
+    if (external) {
+        uint64_t t0 = monotonic_ns();
+        int external_res = rmdir(external);
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        t_op.tier |= FUSE_TIER_EXTERNAL;
+        if (external_res == 0 || errno == ENOENT) {
+            external_deleted = 1;
+        } else {
+            LOG_DEBUG("rmdir external failed: %s, errno=%d (will stay in pending)", external, errno);
+        }
+        free(external);
+    } else {
+        external_deleted = 1;  // No external path means nothing to delete
+    }
+
+    // Step 5: Remove from pending delete if external was deleted successfully
+    if (external_deleted) {
+        pending_delete_remove(path);
+    }
+
+    return result;
+}
+
+// rename: rename file/directory
+static int dmsa_rename(const char *from, const char *to) {
+    LOG_DEBUG("rename: %s -> %s", from, to);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // A copy-up would leave the open EXTERNAL handle writing to the old copy,
+    // and a switch in progress publishes under the old name
+    int place = place_state_of(from);
+    if (place == PLACE_SWITCHING || place == PLACE_EXTERNAL) {
+        return -EBUSY;
+    }
+
+    char *local_from = get_local_path(from);
+    char *local_to = get_local_path(to);
+
+    if (!local_from || !local_to) {
+        if (local_from) free(local_from);
+        if (local_to) free(local_to);
+        return -ENOMEM;
+    }
+
+    int res = ensure_parent_directory(local_to);
+    if (res != 0) {
+        free(local_from);
+        free(local_to);
+        return res;
+    }
+
+    // If source file is in external directory, copy to local first
+    struct stat st;
+    if (stat(local_from, &st) != 0) {
+        char *external_from = get_external_path(from);
+        if (external_from && stat(external_from, &st) == 0) {
+            if (qos_deny_copy_up(from)) {
+                free(external_from);
+                free(local_from);
+                free(local_to);
+                return -EACCES;
+            }
+
+            // Copy external file to local
+            res = copy_up(from, external_from, local_from);
+            free(external_from);
+            if (res != 0) {
+                free(local_from);
+                free(local_to);
+                return res;
+            }
+        } else {
+            if (external_from) free(external_from);
+            free(local_from);
+            free(local_to);
+            return -ENOENT;
+        }
+    }
+
+    uint64_t t0 = monotonic_ns();
+    res = rename(local_from, local_to);
+    int err = errno;
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    t_op.tier |= FUSE_TIER_LOCAL;
+
+    free(local_from);
+    free(local_to);
+
+    if (res == -1) {
+        return -err;
+    }
+
+    // Also rename in external directory (if online)
+    char *external_from = get_external_path(from);
+    char *external_to = get_external_path(to);
+    if (external_from && external_to) {
+        // Ensure external target directory exists
+        char *ext_to_copy = strdup(external_to);
+        if (ext_to_copy) {
+            char *parent = dirname(ext_to_copy);
+            mkdir(parent, 0755);  // Ignore errors
+            free(ext_to_copy);
+        }
+        t0 = monotonic_ns();
+        rename(external_from, external_to);  // Ignore errors
+        phase_add(FUSE_PHASE_BACKEND, t0);
+        t_op.tier |= FUSE_TIER_EXTERNAL;
+    }
+    if (external_from) free(external_from);
+    if (external_to) free(external_to);
+
+    // Notify Swift layer - file renamed (check if directory via stat on 'to')
+    struct stat to_st;
+    char *local_to_check = get_local_path(to);
+    int is_dir = 0;
+    if (local_to_check) {
+        if (stat(local_to_check, &to_st) == 0) {
+            is_dir = S_ISDIR(to_st.st_mode);
+        }
+        free(local_to_check);
+    }
+    handles_rename(from, to);
+    stub_rename(from, to);
+    NOTIFY_FILE_RENAMED(from, to, is_dir);
+
+    return 0;
+}
+
+// truncate: truncate file
+static int dmsa_truncate(const char *path, off_t size) {
+    LOG_DEBUG("truncate: %s, size=%lld", path, size);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // Block truncate if file is being synced
+    if (syncing_files_contains(path)) {
+        LOG_DEBUG("truncate blocked: %s is syncing", path);
+        return -EBUSY;
+    }
+
+    // Buffered writes predate the truncate and must not land after it
+    flush_path_buffers(path);
+
+    int res;
+    if (place_truncate(path, size, &res)) {
+        return res;
+    }
+
+    char *local = get_local_path(path);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    // If not in local, copy from external
+    struct stat st;
+    if (stat(local, &st) != 0) {
+        char *external = get_external_path(path);
+        if (external && stat(external, &st) == 0) {
+            if (qos_deny_copy_up(path)) {
+                free(external);
+                free(local);
+                return -EACCES;
+            }
+
+            int copy_res = copy_up(path, external, local);
+            free(external);
+            if (copy_res != 0) {
+                free(local);
+                return copy_res;
+            }
+        } else if (external) {
+            free(external);
+        }
+    }
+
+    uint64_t t0 = monotonic_ns();
+    res = truncate(local, size);
+    int err = errno;
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    t_op.tier |= FUSE_TIER_LOCAL;
+    free(local);
+
+    if (res == -1) {
+        return -err;
+    }
+    tee_truncate(path, size);
+
+    return 0;
+}
+
+// chmod: change permissions
+static int dmsa_chmod(const char *path, mode_t mode) {
+    LOG_DEBUG("chmod: %s, mode=%o", path, mode);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    uint64_t t0 = monotonic_ns();
+    int res = chmod(actual, mode);
+    int err = errno;
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    free(actual);
+
+    if (res == -1) {
+        // VFS presents normalized permissions to users (644/755).
+        // The underlying file's actual permissions don't matter since Service runs as root.
+        // Ignore permission errors to allow Finder copy operations (ditto uses fchmod).
+        if (err == EPERM || err == EACCES) {
+            LOG_INFO("chmod: %s mode=%o -> EPERM/EACCES ignored", path, mode);
+            return 0;
+        }
+        LOG_WARN("chmod failed: %s, mode=%o, errno=%d (%s)", path, mode, err, strerror(err));
+        return -err;
+    }
+
+    return 0;
+}
+
+// chown: change owner
+static int dmsa_chown(const char *path, uid_t uid, gid_t gid) {
+    LOG_DEBUG("chown: %s, uid=%d, gid=%d", path, uid, gid);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    uint64_t t0 = monotonic_ns();
+    int res = lchown(actual, uid, gid);
+    int err = errno;
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    free(actual);
+
+    if (res == -1) {
+        // VFS presents all files as owned by the mount point owner.
+        // The underlying file's actual owner doesn't matter since Service runs as root.
+        // Ignore permission errors to allow Finder copy operations (ditto uses fchown).
+        if (err == EPERM || err == EACCES) {
+            LOG_INFO("chown: %s uid=%d gid=%d -> EPERM/EACCES ignored", path, uid, gid);
+            return 0;
+        }
+        LOG_WARN("chown failed: %s, uid=%d, gid=%d, errno=%d (%s)", path, uid, gid, err, strerror(err));
+        return -err;
+    }
+
+    return 0;
+}
+
+// utimens: modify timestamps
+static int dmsa_utimens(const char *path, const struct timespec ts[2]) {
+    LOG_DEBUG("utimens: %s", path);
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    // Use utimensat (macOS 10.13+)
+    uint64_t t0 = monotonic_ns();
+    int res = utimensat(AT_FDCWD, actual, ts, AT_SYMLINK_NOFOLLOW);
+    int err = errno;
+    phase_add(FUSE_PHASE_BACKEND, t0);
+    free(actual);
+
+    if (res == -1) {
+        // Timestamp modification failure shouldn't block file copy operations.
+        // Ignore permission errors to allow Finder copy operations.
+        if (err == EPERM || err == EACCES) {
+            LOG_INFO("utimens: %s -> EPERM/EACCES ignored", path);
+            return 0;
+        }
+        LOG_WARN("utimens failed: %s, errno=%d (%s)", path, err, strerror(err));
+        return -err;
+    }
+
+    return 0;
+}
+
+// statfs: filesystem statistics
+static int dmsa_statfs(const char *path, struct statvfs *stbuf) {
+    LOG_DEBUG("statfs: %s", path);
+    (void)path;
+
+    // Use local directory statistics
+    int res = statvfs(g_state.local_dir, stbuf);
+    if (res == -1) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+// readlink: read symbolic link
+static int dmsa_readlink(const char *path, char *buf, size_t size) {
+    int depth_err = check_path_depth(path);
+    if (depth_err) return depth_err;
+
+    LOG_DEBUG("readlink: %s", path);
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    ssize_t res = readlink(actual, buf, size - 1);
+    free(actual);
+
+    if (res == -1) {
+        return -errno;
+    }
+
+    buf[res] = '\0';
+    return 0;
+}
+
+// symlink: create symbolic link
+static int dmsa_symlink(const char *target, const char *linkpath) {
+    LOG_DEBUG("symlink: %s -> %s", linkpath, target);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *local = get_local_path(linkpath);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    ensure_parent_directory(local);
+
+    int res = symlink(target, local);
+
+    if (res == -1) {
+        int err = errno;
+        free(local);
+        return -err;
+    }
+
+    fix_ownership(local);
+    free(local);
+
+    return 0;
+}
+
+// access: check access permissions
+static int dmsa_access(const char *path, int mask) {
+    LOG_DEBUG("access: %s, mask=%d", path, mask);
+
+    // Root directory: always allow
+    if (strcmp(path, "/") == 0) {
+        return 0;
+    }
+
+    // Check if file exists
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+    free(actual);
+
+    // VFS presents all files as owned by user with full permissions (mode 0644/0755)
+    // Since Service runs as root and handles actual file I/O, we always grant access
+    // to existing files. The underlying file permissions don't matter to VFS users.
+    //
+    // This fixes "permission denied" errors in Finder when copying files that have
+    // restrictive permissions (e.g., 600) on the underlying storage.
+    return 0;
+}
+
+// getxattr: get extended attributes (macOS version)
+static int dmsa_getxattr(const char *path, const char *name, char *value, size_t size, uint32_t position) {
+    LOG_DEBUG("getxattr: %s, name=%s", path, name);
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    ssize_t res = getxattr(actual, name, value, size, position, XATTR_NOFOLLOW);
+    free(actual);
+
+    if (res == -1) {
+        int err = errno;
+        // For permission errors on underlying storage, report "no such attribute"
+        // This allows Finder to proceed with copy operations
+        if (err == EPERM || err == EACCES) {
+            return -ENOATTR;
+        }
+        return -err;
+    }
+
+    return (int)res;
+}
+
+// setxattr: set extended attributes (macOS version)
+static int dmsa_setxattr(const char *path, const char *name, const char *value,
+                         size_t size, int flags, uint32_t position) {
+    LOG_DEBUG("setxattr: %s, name=%s, size=%zu", path, name, size);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    // For Apple security-related xattrs that can't be set normally, fake success.
+    // These include: com.apple.macl (MAC label), com.apple.provenance,
+    // com.apple.quarantine, etc. The kernel or security framework manages these.
+    // Returning success allows cp/Finder copy to proceed without errors.
+    if (strncmp(name, "com.apple.", 10) == 0) {
+        // Try to set it, but ignore all errors for com.apple.* attrs
+        char *local = get_local_path(path);
+        if (local) {
+            int res = setxattr(local, name, value, size, position, flags | XATTR_NOFOLLOW);
+            if (res == -1) {
+                LOG_DEBUG("setxattr: %s name=%s -> ignored (com.apple.* attr)", path, name);
+            }
+            free(local);
+        }
+        return 0;  // Always return success for com.apple.* attributes
+    }
+
+    char *local = get_local_path(path);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    int res = setxattr(local, name, value, size, position, flags | XATTR_NOFOLLOW);
+    int err = errno;
+    free(local);
+
+    if (res == -1) {
+        // Extended attribute setting failure shouldn't block file copy operations.
+        // Ignore permission errors to allow Finder copy operations (ditto sets xattrs).
+        if (err == EPERM || err == EACCES || err == EINVAL) {
+            LOG_DEBUG("setxattr: %s name=%s -> error %d ignored", path, name, err);
+            return 0;
+        }
+        LOG_WARN("setxattr failed: %s, name=%s, errno=%d (%s)", path, name, err, strerror(err));
+        return -err;
+    }
+
+    return 0;
+}
+
+// listxattr: list extended attributes
+static int dmsa_listxattr(const char *path, char *list, size_t size) {
+    LOG_DEBUG("listxattr: %s", path);
+
+    char *actual = resolve_actual_path(path);
+    if (!actual) {
+        return resolve_errno();
+    }
+
+    ssize_t res = listxattr(actual, list, size, XATTR_NOFOLLOW);
+    free(actual);
+
+    if (res == -1) {
+        int err = errno;
+        // For permission errors on underlying storage, report empty xattr list
+        // This allows Finder to proceed with copy operations
+        if (err == EPERM || err == EACCES) {
+            return 0;  // Empty list
+        }
+        return -err;
+    }
+
+    return (int)res;
+}
+
+// removexattr: remove extended attributes
+static int dmsa_removexattr(const char *path, const char *name) {
+    LOG_DEBUG("removexattr: %s, name=%s", path, name);
+
+    if (g_state.readonly) {
+        return -EROFS;
+    }
+
+    char *local = get_local_path(path);
+    if (!local) {
+        return -ENOMEM;
+    }
+
+    int res = removexattr(local, name, XATTR_NOFOLLOW);
+    free(local);
+
+    if (res == -1) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+// ============================================================
+// Live op statistics - per-op and per-tier counters for the shm segment
+// ============================================================
+// Updated lock-free by the tracer on every op; the shm publisher copies them
+// out periodically. Readers derive rates from deltas between snapshots.
+
+typedef struct {
+    volatile uint64_t count;
+    volatile uint64_t errors;
+    volatile uint64_t bytes;
+    volatile uint64_t total_ns;
+    volatile uint64_t hist[FUSE_SHM_HIST_BUCKETS];
+} OpStats;
+
+typedef struct {
+    volatile uint64_t ops;
+    volatile uint64_t errors;
+    volatile uint64_t resolve_ns;
+    volatile uint64_t last_error_ms;
+} TierStats;
+
+static OpStats g_op_stats[FUSE_OP_COUNT];
+static TierStats g_tier_stats[FUSE_SHM_TIER_COUNT];
+static volatile uint64_t g_local_hits = 0;
+static volatile uint64_t g_local_misses = 0;
+
+// log2(us) bucket: 0 for < 1us, i for [2^(i-1), 2^i) us, capped at the last bucket
+static inline int latency_bucket(uint64_t ns) {
+    uint64_t us = ns / 1000;
+    if (us == 0) return 0;
+    int b = 64 - __builtin_clzll(us);
+    return b < FUSE_SHM_HIST_BUCKETS ? b : FUSE_SHM_HIST_BUCKETS - 1;
+}
+
+static void tier_stats_record(TierStats *ts, int failed, uint64_t resolve_ns) {
+    __sync_fetch_and_add(&ts->ops, 1);
+    if (resolve_ns) __sync_fetch_and_add(&ts->resolve_ns, resolve_ns);
+    if (failed) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        __sync_fetch_and_add(&ts->errors, 1);
+        ts->last_error_ms = (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+    }
+}
+
+static void op_stats_record(FuseOpType op, int res, uint64_t bytes, uint64_t elapsed) {
+    OpStats *st = &g_op_stats[op];
+    __sync_fetch_and_add(&st->count, 1);
+    __sync_fetch_and_add(&st->total_ns, elapsed);
+    __sync_fetch_and_add(&st->hist[latency_bucket(elapsed)], 1);
+    if (bytes) __sync_fetch_and_add(&st->bytes, bytes);
+    if (res < 0) __sync_fetch_and_add(&st->errors, 1);
+
+    // LOCAL caches EXTERNAL: an op that never touched EXTERNAL is a hit.
+    // readdir always merges both tiers, so it says nothing about the cache.
+    if (t_op.tier != FUSE_TIER_NONE && op != FUSE_OP_READDIR) {
+        if (t_op.tier & FUSE_TIER_EXTERNAL) __sync_fetch_and_add(&g_local_misses, 1);
+        else __sync_fetch_and_add(&g_local_hits, 1);
+    }
+
+    // Tier health ignores ENOENT, which is a normal lookup miss
+    int failed = (res < 0 && res != -ENOENT);
+    if (t_op.tier & FUSE_TIER_LOCAL) {
+        tier_stats_record(&g_tier_stats[FUSE_SHM_TIER_LOCAL], failed,
+                          t_op.phase_ns[FUSE_PHASE_RESOLVE_LOCAL]);
+    }
+    if (t_op.tier & FUSE_TIER_EXTERNAL) {
+        tier_stats_record(&g_tier_stats[FUSE_SHM_TIER_EXTERNAL], failed,
+                          t_op.phase_ns[FUSE_PHASE_RESOLVE_EXTERNAL]);
+    }
+}
+
+static void op_stats_reset(void) {
+    memset((void *)g_op_stats, 0, sizeof(g_op_stats));
+    memset((void *)g_tier_stats, 0, sizeof(g_tier_stats));
+    g_local_hits = 0;
+    g_local_misses = 0;
+}
+
+// ============================================================
+// Per-operation tracing - wraps each handler for timing and hot path stats
+// ============================================================
+
+static const char *g_op_names[FUSE_OP_COUNT] = {
+    "getattr", "readdir", "open", "read", "write", "release", "create",
+    "unlink", "mkdir", "rmdir", "rename", "truncate", "chmod", "chown",
+    "utimens", "statfs", "readlink", "symlink", "access", "getxattr",
+    "setxattr", "listxattr", "removexattr", "flush", "fsync"
+};
+
+static inline uint64_t op_trace_begin(FuseOpType op, const char *path) {
+    uint64_t t0 = monotonic_ns();
+    client_op_begin(op);
+    return t0;
+}
+
+static void op_trace_end(FuseOpType op, const char *path, int res, uint64_t t0) {
+    uint64_t elapsed = monotonic_ns() - t0;
+    // read/write return the byte count on success
+    uint64_t bytes = ((op == FUSE_OP_READ || op == FUSE_OP_WRITE) && res > 0) ? (uint64_t)res : 0;
+
+    client_op_end(res, bytes, elapsed);
+    op_stats_record(op, res, bytes, elapsed);
+
+    uint32_t threshold_ms = g_slow_ops.stats.threshold_ms;
+    if (threshold_ms > 0 && elapsed >= (uint64_t)threshold_ms * 1000000ULL) {
+        slow_op_record(g_op_names[op], path, res, elapsed);
+    }
+
+    if (g_hot_tracking) {
+        hot_record(op, path, bytes, elapsed);
+    }
+}
+
+#define TRACED(op, path, call) do { \
+    uint64_t _t0 = op_trace_begin((op), (path)); \
+    int _res = (call); \
+    op_trace_end((op), (path), _res, _t0); \
+    return _res; \
+} while (0)
+
+static int traced_getattr(const char *path, struct stat *stbuf) {
+    TRACED(FUSE_OP_GETATTR, path, dmsa_getattr(path, stbuf));
+}
+
+static int traced_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                          off_t offset, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_READDIR, path, dmsa_readdir(path, buf, filler, offset, fi));
+}
+
+static int traced_open(const char *path, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_OPEN, path, dmsa_open(path, fi));
+}
+
+static int traced_read(const char *path, char *buf, size_t size, off_t offset,
+                       struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_READ, path, dmsa_read(path, buf, size, offset, fi));
+}
+
+static int traced_write(const char *path, const char *buf, size_t size, off_t offset,
+                        struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_WRITE, path, dmsa_write(path, buf, size, offset, fi));
+}
+
+static int traced_release(const char *path, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_RELEASE, path, dmsa_release(path, fi));
+}
+
+static int traced_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_CREATE, path, dmsa_create(path, mode, fi));
+}
+
+static int traced_unlink(const char *path) {
+    TRACED(FUSE_OP_UNLINK, path, dmsa_unlink(path));
+}
+
+static int traced_mkdir(const char *path, mode_t mode) {
+    TRACED(FUSE_OP_MKDIR, path, dmsa_mkdir(path, mode));
+}
+
+static int traced_rmdir(const char *path) {
+    TRACED(FUSE_OP_RMDIR, path, dmsa_rmdir(path));
+}
+
+static int traced_rename(const char *from, const char *to) {
+    TRACED(FUSE_OP_RENAME, from, dmsa_rename(from, to));
+}
+
+static int traced_truncate(const char *path, off_t size) {
+    TRACED(FUSE_OP_TRUNCATE, path, dmsa_truncate(path, size));
+}
+
+static int traced_chmod(const char *path, mode_t mode) {
+    TRACED(FUSE_OP_CHMOD, path, dmsa_chmod(path, mode));
+}
+
+static int traced_chown(const char *path, uid_t uid, gid_t gid) {
+    TRACED(FUSE_OP_CHOWN, path, dmsa_chown(path, uid, gid));
+}
+
+static int traced_utimens(const char *path, const struct timespec ts[2]) {
+    TRACED(FUSE_OP_UTIMENS, path, dmsa_utimens(path, ts));
+}
+
+static int traced_statfs(const char *path, struct statvfs *stbuf) {
+    TRACED(FUSE_OP_STATFS, path, dmsa_statfs(path, stbuf));
+}
+
+static int traced_readlink(const char *path, char *buf, size_t size) {
+    TRACED(FUSE_OP_READLINK, path, dmsa_readlink(path, buf, size));
+}
+
+static int traced_symlink(const char *target, const char *linkpath) {
+    TRACED(FUSE_OP_SYMLINK, linkpath, dmsa_symlink(target, linkpath));
+}
+
+static int traced_access(const char *path, int mask) {
+    TRACED(FUSE_OP_ACCESS, path, dmsa_access(path, mask));
+}
+
+static int traced_getxattr(const char *path, const char *name, char *value, size_t size,
+                           uint32_t position) {
+    TRACED(FUSE_OP_GETXATTR, path, dmsa_getxattr(path, name, value, size, position));
+}
+
+static int traced_setxattr(const char *path, const char *name, const char *value,
+                           size_t size, int flags, uint32_t position) {
+    TRACED(FUSE_OP_SETXATTR, path, dmsa_setxattr(path, name, value, size, flags, position));
+}
+
+static int traced_listxattr(const char *path, char *list, size_t size) {
+    TRACED(FUSE_OP_LISTXATTR, path, dmsa_listxattr(path, list, size));
+}
+
+static int traced_removexattr(const char *path, const char *name) {
+    TRACED(FUSE_OP_REMOVEXATTR, path, dmsa_removexattr(path, name));
+}
+
+static int traced_flush(const char *path, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_FLUSH, path, dmsa_flush(path, fi));
+}
+
+static int traced_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    TRACED(FUSE_OP_FSYNC, path, dmsa_fsync(path, datasync, fi));
+}
+
+// ============================================================
+// FUSE operations table
+// ============================================================
+static struct fuse_operations dmsa_oper = {
+    .getattr     = traced_getattr,
+    .readdir     = traced_readdir,
+    .open        = traced_open,
+    .read        = traced_read,
+    .write       = traced_write,
+    .release     = traced_release,
+    .create      = traced_create,
+    .unlink      = traced_unlink,
+    .mkdir       = traced_mkdir,
+    .rmdir       = traced_rmdir,
+    .rename      = traced_rename,
+    .truncate    = traced_truncate,
+    .chmod       = traced_chmod,
+    .chown       = traced_chown,
+    .utimens     = traced_utimens,
+    .statfs      = traced_statfs,
+    .readlink    = traced_readlink,
+    .symlink     = traced_symlink,
+    .access      = traced_access,
+    .getxattr    = traced_getxattr,
+    .setxattr    = traced_setxattr,
+    .listxattr   = traced_listxattr,
+    .removexattr = traced_removexattr,
+    .flush       = traced_flush,
+    .fsync       = traced_fsync,
+};
+
+// ============================================================
+// Public API implementation
+// ============================================================
+
+int fuse_wrapper_mount(const char *mount_path, const char *local_dir, const char *external_dir) {
+    if (!mount_path || !local_dir) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+
+    int phase = fuse_wrapper_timeline_begin("fuse", "mount.prepare");
+
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+
+    if (g_state.is_mounted) {
+        pthread_mutex_unlock(&g_state.lock);
+        fuse_wrapper_timeline_end(phase);
+        return FUSE_WRAPPER_ERR_ALREADY_MOUNTED;
+    }
+
+    // Save paths
+    g_state.mount_path = strdup(mount_path);
+    g_state.local_dir = strdup(local_dir);
+    g_state.external_dir = external_dir ? strdup(external_dir) : NULL;
+    g_state.external_offline = (external_dir == NULL);
+
+    // Extract user uid/gid from mount point path
+    // Mount point is typically /Users/{username}/... format
+    // We need to get the owner of the user directory
+    struct stat parent_stat;
+    char *parent_path = strdup(mount_path);
+    // Try to get mount point parent directory owner
+    char *last_slash = strrchr(parent_path, '/');
+    if (last_slash && last_slash != parent_path) {
+        *last_slash = '\0';
+        if (stat(parent_path, &parent_stat) == 0) {
+            g_state.owner_uid = parent_stat.st_uid;
+            g_state.owner_gid = parent_stat.st_gid;
+            LOG_INFO("Got owner from parent dir: uid=%d, gid=%d", g_state.owner_uid, g_state.owner_gid);
+        } else {
+            // Fall back to local_dir owner
+            struct stat local_stat;
+            if (stat(local_dir, &local_stat) == 0) {
+                g_state.owner_uid = local_stat.st_uid;
+                g_state.owner_gid = local_stat.st_gid;
+                LOG_INFO("Got owner from local dir: uid=%d, gid=%d", g_state.owner_uid, g_state.owner_gid);
+            }
+        }
+    }
+    free(parent_path);
+
+    pthread_mutex_unlock(&g_state.lock);
+
+    LOG_INFO("Mounting FUSE filesystem:");
+    LOG_INFO("  Mount point: %s", mount_path);
+    LOG_INFO("  Local dir: %s", local_dir);
+    LOG_INFO("  External dir: %s", external_dir ? external_dir : "(offline)");
+
+    // Build FUSE arguments - using simpler parameter set
+    char *mount_path_copy = strdup(mount_path);
+    char *volname = basename(mount_path_copy);
+
+    char volname_opt[256];
+    snprintf(volname_opt, sizeof(volname_opt), "volname=%s", volname);
+
+    // Build mount options
+    // auto_xattr: let kernel handle xattr via AppleDouble (._ files), bypassing our callbacks
+    //             This allows fcopyfile() to work properly for cp/Finder copy operations
+    // local: indicates local filesystem (enables Finder features)
+    // entry_timeout/attr_timeout/negative_timeout: cache directory entries and attributes
+    //             Reduces kernel<->userspace round trips under heavy load
+    // daemon_timeout=0: disable idle timeout (prevent FUSE from exiting when idle)
+    // Note: We still implement setxattr/getxattr callbacks for non-Apple xattrs
+    char mount_opts[1024];
+    snprintf(mount_opts, sizeof(mount_opts),
+             "%s,allow_other,default_permissions,auto_xattr,local,"
+             "daemon_timeout=0,entry_timeout=1,attr_timeout=1,negative_timeout=1",
+             volname_opt);
+
+    LOG_INFO("Mount options: %s", mount_opts);
+
+    // Use fuse_mount + fuse_new + fuse_loop instead of fuse_main
+    // This avoids some internal issues with fuse_main
+
+    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+
+    // Add mount options
+    if (fuse_opt_add_arg(&args, "dmsa") == -1 ||
+        fuse_opt_add_arg(&args, "-o") == -1 ||
+        fuse_opt_add_arg(&args, mount_opts) == -1) {
+        LOG_ERROR("fuse_opt_add_arg failed");
+        free(mount_path_copy);
+        fuse_opt_free_args(&args);
+        fuse_wrapper_timeline_end(phase);
+        return FUSE_WRAPPER_ERR_MOUNT_FAILED;
+    }
+    fuse_wrapper_timeline_end(phase);
+
+    LOG_INFO("Calling fuse_mount...");
+
+    // Mount
+    phase = fuse_wrapper_timeline_begin("fuse", "mount.fuse_mount");
+    g_state.chan = fuse_mount(mount_path, &args);
+    fuse_wrapper_timeline_end(phase);
+    if (!g_state.chan) {
+        LOG_ERROR("fuse_mount failed! errno=%d (%s)", errno, strerror(errno));
+        free(mount_path_copy);
+        fuse_opt_free_args(&args);
+
+        DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+        free(g_state.mount_path);
+        free(g_state.local_dir);
+        if (g_state.external_dir) free(g_state.external_dir);
+        g_state.mount_path = NULL;
+        g_state.local_dir = NULL;
+        g_state.external_dir = NULL;
+        pthread_mutex_unlock(&g_state.lock);
+
+        return FUSE_WRAPPER_ERR_FUSE_MOUNT_FAILED;
+    }
+
+    LOG_INFO("fuse_mount succeeded, calling fuse_new...");
+
+    // Create FUSE instance
+    phase = fuse_wrapper_timeline_begin("fuse", "mount.fuse_new");
+    g_state.fuse = fuse_new(g_state.chan, &args, &dmsa_oper, sizeof(dmsa_oper), NULL);
+    fuse_wrapper_timeline_end(phase);
+    fuse_opt_free_args(&args);
+
+    if (!g_state.fuse) {
+        LOG_ERROR("fuse_new failed! errno=%d (%s)", errno, strerror(errno));
+        fuse_unmount(mount_path, g_state.chan);
+        free(mount_path_copy);
+
+        DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+        g_state.chan = NULL;
+        free(g_state.mount_path);
+        free(g_state.local_dir);
+        if (g_state.external_dir) free(g_state.external_dir);
+        g_state.mount_path = NULL;
+        g_state.local_dir = NULL;
+        g_state.external_dir = NULL;
+        pthread_mutex_unlock(&g_state.lock);
+
+        return FUSE_WRAPPER_ERR_FUSE_NEW_FAILED;
+    }
+
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    g_state.is_mounted = 1;
+    pthread_mutex_unlock(&g_state.lock);
+
+    LOG_INFO("FUSE mount successful! Starting event loop...");
+    LOG_INFO("  File owner UID: %d, GID: %d", g_state.owner_uid, g_state.owner_gid);
+
+    free(mount_path_copy);
+
+    // Install signal handlers for exit diagnostics
+    phase = fuse_wrapper_timeline_begin("fuse", "mount.start_loop");
+    g_last_signal = 0;
+    g_total_ops = 0;
+    g_last_op_time = time(NULL);
+    fuse_wrapper_reset_hot_stats();
+    fuse_wrapper_reset_client_stats();
+    slow_ops_reset();
+    op_stats_reset();
+    install_signal_handlers();
+
+    // Start async callback worker thread
+    start_callback_worker();
+
+    // Pre-loop diagnostics
+    LOG_INFO("FUSE pre-loop state:");
+    LOG_INFO("  macFUSE devices: %d", check_macfuse_device());
+    LOG_INFO("  Channel: %s", g_state.chan ? "valid" : "NULL");
+    LOG_INFO("  Async callback queue: enabled (size=%d)", g_callback_queue.capacity);
+
+    // Mark loop as running
+    g_fuse_loop_running = 1;
+    fuse_wrapper_timeline_end(phase);
+    fuse_wrapper_timeline_mark("fuse", "loop_running");
+
+    // Run FUSE event loop in MULTI-THREADED mode
+    // Critical for handling symlinks pointing back to VFS mount point
+    // Single-threaded mode deadlocks when readdir encounters such symlinks
+    LOG_INFO("Starting fuse_loop_mt (multi-threaded)...");
+    int result = fuse_loop_mt(g_state.fuse);
+    int saved_errno = errno;
+
+    // Mark loop as stopped
+    g_fuse_loop_running = 0;
+
+    // Stop callback worker thread
+    stop_callback_worker();
+
+    // ---- Comprehensive post-exit diagnostics ----
+    collect_exit_diagnostics(mount_path, result, saved_errno);
+
+    // Cleanup
+    fuse_destroy(g_state.fuse);
+    fuse_unmount(mount_path, g_state.chan);
+
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+
+    free(g_state.mount_path);
+    free(g_state.local_dir);
+    if (g_state.external_dir) free(g_state.external_dir);
+
+    g_state.mount_path = NULL;
+    g_state.local_dir = NULL;
+    g_state.external_dir = NULL;
+    g_state.is_mounted = 0;
+    g_state.fuse = NULL;
+    g_state.chan = NULL;
+
+    pthread_mutex_unlock(&g_state.lock);
+
+    LOG_INFO("FUSE cleanup complete");
+
+    return result == 0 ? FUSE_WRAPPER_OK : FUSE_WRAPPER_ERR_MOUNT_FAILED;
+}
+
+int fuse_wrapper_unmount(void) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+
+    if (!g_state.is_mounted || !g_state.mount_path) {
+        pthread_mutex_unlock(&g_state.lock);
+        return FUSE_WRAPPER_ERR_NOT_MOUNTED;
+    }
+
+    char *mount_path = strdup(g_state.mount_path);
+    pthread_mutex_unlock(&g_state.lock);
+
+    LOG_INFO("Unmounting FUSE: %s", mount_path);
+
+    // Clear pending delete set
+    pending_delete_clear();
+
+    // Clear syncing files set
+    syncing_files_clear();
 
-    // Step 4: Delete external copy (best effort)
-    char *external = get_external_path(path);
-    if (external) {
-        if (unlink(external) == 0 || errno == ENOENT) {
-            external_deleted = 1;
-        } else {
-            LOG_DEBUG("unlink external failed: %s, errno=%d (will stay in pending)", external, errno);
-        }
-        free(external);
-    } else {
-        external_deleted = 1;  // No external path means nothing to delete
-    }
+    // Use umount command to unmount
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "/sbin/umount '%s'", mount_path);
+    int result = system(cmd);
 
-    // Step 5: Remove from pending delete if external was deleted successfully
-    // If external delete failed, keep in pending so readdir continues to hide it
-    if (external_deleted) {
-        pending_delete_remove(path);
-    }
+    free(mount_path);
 
-    return result;
+    return result == 0 ? FUSE_WRAPPER_OK : FUSE_WRAPPER_ERR_MOUNT_FAILED;
 }
 
-// mkdir: create directory
-static int dmsa_mkdir(const char *path, mode_t mode) {
-    LOG_DEBUG("mkdir: %s, mode=%o", path, mode);
+int fuse_wrapper_is_mounted(void) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    int result = g_state.is_mounted;
+    pthread_mutex_unlock(&g_state.lock);
+    return result;
+}
 
-    if (g_state.readonly) {
-        return -EROFS;
-    }
+void fuse_wrapper_update_external_dir(const char *external_dir) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
 
-    char *local = get_local_path(path);
-    if (!local) {
-        return -ENOMEM;
+    if (g_state.external_dir) {
+        free(g_state.external_dir);
     }
 
-    int res = ensure_parent_directory(local);
-    if (res != 0) {
-        free(local);
-        return res;
-    }
+    g_state.external_dir = external_dir ? strdup(external_dir) : NULL;
+    g_state.external_offline = (external_dir == NULL);
 
-    res = mkdir(local, mode);
+    pthread_mutex_unlock(&g_state.lock);
 
-    if (res == -1) {
-        int err = errno;
-        free(local);
-        return -err;
-    }
+    LOG_INFO("External dir updated: %s", external_dir ? external_dir : "(offline)");
+}
 
-    fix_ownership(local);
+void fuse_wrapper_set_external_offline(bool offline) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    g_state.external_offline = offline;
+    pthread_mutex_unlock(&g_state.lock);
 
-    // Notify Swift layer - directory created
-    NOTIFY_FILE_CREATED(path, local, 1);
+    LOG_INFO("External storage state: %s", offline ? "offline" : "online");
+}
 
-    free(local);
+void fuse_wrapper_set_readonly(bool readonly) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    g_state.readonly = readonly;
+    pthread_mutex_unlock(&g_state.lock);
 
-    return 0;
+    LOG_INFO("Read-only mode: %s", readonly ? "yes" : "no");
 }
 
-// rmdir: remove directory
-// Order: 1. Add to pending delete 2. Notify Swift 3. Delete LOCAL 4. Delete EXTERNAL 5. Remove from pending
-static int dmsa_rmdir(const char *path) {
-    LOG_DEBUG("rmdir: %s", path);
+void fuse_wrapper_set_index_ready(bool ready) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    int was_ready = g_state.index_ready;
+    g_state.index_ready = ready;
+    pthread_mutex_unlock(&g_state.lock);
 
-    if (g_state.readonly) {
-        return -EROFS;
+    // Reset log flag to allow printing on next state change
+    if (ready && !was_ready) {
+        index_not_ready_logged = 0;
+        fuse_wrapper_timeline_mark("fuse", "index_ready");
+        LOG_INFO("*** Index ready, VFS access open ***");
+    } else if (!ready && was_ready) {
+        LOG_INFO("Index marked not ready, VFS blocking access");
     }
+}
 
-    // Block delete if directory is being synced
-    if (syncing_files_contains(path)) {
-        LOG_DEBUG("rmdir blocked: %s is syncing", path);
-        return -EBUSY;
+int fuse_wrapper_is_index_ready(void) {
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    int result = g_state.index_ready;
+    pthread_mutex_unlock(&g_state.lock);
+    return result;
+}
+
+const char* fuse_wrapper_error_string(int error) {
+    switch (error) {
+        case FUSE_WRAPPER_OK:
+            return "Success";
+        case FUSE_WRAPPER_ERR_INVALID_ARG:
+            return "Invalid argument";
+        case FUSE_WRAPPER_ERR_ALREADY_MOUNTED:
+            return "Already mounted";
+        case FUSE_WRAPPER_ERR_NOT_MOUNTED:
+            return "Not mounted";
+        case FUSE_WRAPPER_ERR_MOUNT_FAILED:
+            return "Mount failed";
+        case FUSE_WRAPPER_ERR_FUSE_NEW_FAILED:
+            return "fuse_new failed";
+        case FUSE_WRAPPER_ERR_FUSE_MOUNT_FAILED:
+            return "fuse_mount failed";
+        default:
+            return "Unknown error";
     }
+}
 
-    // Step 1: Add to pending delete set (hides from readdir immediately)
-    pending_delete_add(path);
+// ============================================================
+// Diagnostics API implementation
+// ============================================================
 
-    // Step 2: Notify Swift layer (async, updates memory cache + DB)
-    NOTIFY_FILE_DELETED(path, 1);
+void fuse_wrapper_get_diagnostics(FuseDiagnostics *diag) {
+    if (!diag) return;
 
-    int result = 0;
-    int external_deleted = 0;
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
 
-    // Step 3: Delete local copy
-    char *local = get_local_path(path);
-    if (local) {
-        if (rmdir(local) == -1 && errno != ENOENT) {
-            result = -errno;
-            LOG_WARN("rmdir local failed: %s, errno=%d", local, errno);
-        }
-        free(local);
-    }
+    diag->is_mounted = g_state.is_mounted;
+    diag->is_loop_running = g_fuse_loop_running;
+    diag->channel_fd = g_state.chan ? 1 : -1;  // 1 means valid channel, -1 means NULL
+    diag->total_ops = g_total_ops;
+    diag->last_op_time = g_last_op_time;
+    diag->last_signal = (int)g_last_signal;
 
-    // Step 4: Delete external copy (best effort)
-    char *external = get_external_path(path);
-    if (external) {
-        if (rmdir(external) == 0 || errno == ENOENT) {
-            external_deleted = 1;
-        } else {
-            LOG_DEBUG("rmdir external failed: %s, errno=%d (will stay in pending)", external, errno);
-        }
-        free(external);
-    } else {
-        external_deleted = 1;  // No external path means nothing to delete
-    }
+    pthread_mutex_unlock(&g_state.lock);
 
-    // Step 5: Remove from pending delete if external was deleted successfully
-    if (external_deleted) {
-        pending_delete_remove(path);
-    }
+    // Callback queue statistics
+    diag->cb_queued = g_cb_queued;
+    diag->cb_processed = g_cb_processed;
+    diag->cb_dropped = g_cb_dropped;
+    diag->cb_pending = callback_queue_pending();
 
-    return result;
+    // Check macFUSE device count (outside lock to avoid blocking)
+    diag->macfuse_dev_count = check_macfuse_device();
 }
 
-// rename: rename file/directory
-static int dmsa_rename(const char *from, const char *to) {
-    LOG_DEBUG("rename: %s -> %s", from, to);
-
-    if (g_state.readonly) {
-        return -EROFS;
-    }
+int fuse_wrapper_is_loop_running(void) {
+    return g_fuse_loop_running;
+}
 
-    char *local_from = get_local_path(from);
-    char *local_to = get_local_path(to);
+// ============================================================
+// Lock contention profiling API implementation
+// ============================================================
 
-    if (!local_from || !local_to) {
-        if (local_from) free(local_from);
-        if (local_to) free(local_to);
-        return -ENOMEM;
-    }
+void fuse_wrapper_set_lock_profiling(int enabled) {
+    g_lock_profiling = enabled ? 1 : 0;
+    LOG_INFO("Lock profiling %s", enabled ? "ENABLED" : "DISABLED");
+}
 
-    int res = ensure_parent_directory(local_to);
-    if (res != 0) {
-        free(local_from);
-        free(local_to);
-        return res;
+void fuse_wrapper_reset_lock_stats(void) {
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        LockProfile *lp = &g_lock_profiles[id];
+        lp->acquisitions = 0;
+        lp->contended = 0;
+        lp->wait_ns = 0;
+        lp->max_wait_ns = 0;
+        // Keep site names (slots are claimed once), zero their counters
+        for (int i = 0; i < LOCK_PROFILE_SITES; i++) {
+            lp->sites[i].waits = 0;
+            lp->sites[i].wait_ns = 0;
+        }
     }
+}
 
-    // If source file is in external directory, copy to local first
-    struct stat st;
-    if (stat(local_from, &st) != 0) {
-        char *external_from = get_external_path(from);
-        if (external_from && stat(external_from, &st) == 0) {
-            // Copy external file to local
-            int src_fd = open(external_from, O_RDONLY);
-            if (src_fd != -1) {
-                ensure_parent_directory(local_from);
-                int dst_fd = open(local_from, O_CREAT | O_WRONLY | O_TRUNC, st.st_mode);
-                if (dst_fd != -1) {
-                    char copy_buf[8192];
-                    ssize_t bytes;
-                    while ((bytes = read(src_fd, copy_buf, sizeof(copy_buf))) > 0) {
-                        write(dst_fd, copy_buf, bytes);
-                    }
-                    close(dst_fd);
-                    fix_ownership(local_from);
-                }
-                close(src_fd);
+// Copy one lock's counters, keeping the FUSE_LOCK_TOP_SITES sites with most wait time
+static void fill_lock_stats(FuseLockId id, FuseLockStats *out) {
+    LockProfile *lp = &g_lock_profiles[id];
+
+    memset(out, 0, sizeof(*out));
+    strncpy(out->name, g_lock_names[id], sizeof(out->name) - 1);
+    out->acquisitions = lp->acquisitions;
+    out->contended = lp->contended;
+    out->total_wait_ns = lp->wait_ns;
+    out->max_wait_ns = lp->max_wait_ns;
+
+    for (int i = 0; i < LOCK_PROFILE_SITES; i++) {
+        const char *site = lp->sites[i].site;
+        uint64_t wait_ns = lp->sites[i].wait_ns;
+        if (!site || lp->sites[i].waits == 0) continue;
+
+        // Insertion into the small sorted top list
+        for (int k = 0; k < FUSE_LOCK_TOP_SITES; k++) {
+            if (out->top_sites[k].site[0] == '\0' || wait_ns > out->top_sites[k].wait_ns) {
+                memmove(&out->top_sites[k + 1], &out->top_sites[k],
+                        (FUSE_LOCK_TOP_SITES - k - 1) * sizeof(out->top_sites[0]));
+                strncpy(out->top_sites[k].site, site, sizeof(out->top_sites[k].site) - 1);
+                out->top_sites[k].site[sizeof(out->top_sites[k].site) - 1] = '\0';
+                out->top_sites[k].waits = lp->sites[i].waits;
+                out->top_sites[k].wait_ns = wait_ns;
+                break;
             }
-            free(external_from);
-        } else {
-            if (external_from) free(external_from);
-            free(local_from);
-            free(local_to);
-            return -ENOENT;
         }
     }
+}
 
-    res = rename(local_from, local_to);
-    int err = errno;
+void fuse_wrapper_get_diagnostics_ex(FuseDiagnosticsEx *diag) {
+    if (!diag) return;
 
-    free(local_from);
-    free(local_to);
+    fuse_wrapper_get_diagnostics(&diag->base);
+    diag->lock_profiling = g_lock_profiling;
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        fill_lock_stats((FuseLockId)id, &diag->locks[id]);
+    }
+}
 
-    if (res == -1) {
-        return -err;
+// Log the lock contention table (shared by exit diagnostics and on-demand dump)
+static void log_lock_stats(void) {
+    if (!g_lock_profiling) {
+        LOG_INFO("Lock profiling: disabled");
+        return;
     }
 
-    // Also rename in external directory (if online)
-    char *external_from = get_external_path(from);
-    char *external_to = get_external_path(to);
-    if (external_from && external_to) {
-        // Ensure external target directory exists
-        char *ext_to_copy = strdup(external_to);
-        if (ext_to_copy) {
-            char *parent = dirname(ext_to_copy);
-            mkdir(parent, 0755);  // Ignore errors
-            free(ext_to_copy);
+    LOG_INFO("Lock contention (acquisitions / contended / total wait / max wait):");
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        FuseLockStats st;
+        fill_lock_stats((FuseLockId)id, &st);
+        LOG_INFO("  %-18s acq=%llu contended=%llu wait=%.3fms max=%.3fms",
+                 st.name,
+                 (unsigned long long)st.acquisitions,
+                 (unsigned long long)st.contended,
+                 (double)st.total_wait_ns / 1e6,
+                 (double)st.max_wait_ns / 1e6);
+        for (int k = 0; k < FUSE_LOCK_TOP_SITES && st.top_sites[k].site[0]; k++) {
+            LOG_INFO("      waiter %-24s waits=%llu wait=%.3fms",
+                     st.top_sites[k].site,
+                     (unsigned long long)st.top_sites[k].waits,
+                     (double)st.top_sites[k].wait_ns / 1e6);
         }
-        rename(external_from, external_to);  // Ignore errors
     }
-    if (external_from) free(external_from);
-    if (external_to) free(external_to);
+}
 
-    // Notify Swift layer - file renamed (check if directory via stat on 'to')
-    struct stat to_st;
-    char *local_to_check = get_local_path(to);
-    int is_dir = 0;
-    if (local_to_check) {
-        if (stat(local_to_check, &to_st) == 0) {
-            is_dir = S_ISDIR(to_st.st_mode);
-        }
-        free(local_to_check);
+void fuse_wrapper_dump_diagnostics(void) {
+    FuseDiagnostics diag;
+    fuse_wrapper_get_diagnostics(&diag);
+
+    LOG_INFO("========== FUSE DIAGNOSTICS DUMP ==========");
+    LOG_INFO("Mounted: %d, loop running: %d, channel: %s, macFUSE devices: %d",
+             diag.is_mounted, diag.is_loop_running,
+             diag.channel_fd >= 0 ? "valid" : "NULL", diag.macfuse_dev_count);
+    LOG_INFO("Total ops: %llu, last op: %lld seconds ago, open handles: %d",
+             (unsigned long long)diag.total_ops,
+             (long long)(time(NULL) - (time_t)diag.last_op_time), g_open_count);
+    LOG_INFO("Callback queue: queued=%llu, processed=%llu, dropped=%llu, pending=%d",
+             (unsigned long long)diag.cb_queued,
+             (unsigned long long)diag.cb_processed,
+             (unsigned long long)diag.cb_dropped,
+             diag.cb_pending);
+    log_lock_stats();
+    log_hot_stats();
+    log_client_stats();
+    log_slow_op_stats();
+    log_write_buffer_stats();
+    log_cache_policy_stats();
+    log_flight_stats();
+    log_ext_io_stats();
+    log_stub_stats();
+    log_place_stats();
+    log_tee_stats();
+    log_hash_cache_stats();
+    log_tunables();
+    LOG_INFO("========== END DIAGNOSTICS DUMP ==========");
+    fuse_wrapper_flush_logs();
+}
+
+// ============================================================
+// Hot path profiler API implementation
+// ============================================================
+
+void fuse_wrapper_set_hot_tracking(int enabled) {
+    g_hot_tracking = enabled ? 1 : 0;
+    LOG_INFO("Hot path tracking %s", enabled ? "ENABLED" : "DISABLED");
+}
+
+void fuse_wrapper_reset_hot_stats(void) {
+    DMSA_LOCK(&g_hot.lock, FUSE_LOCK_HOT);
+    hot_reset_locked();
+    pthread_mutex_unlock(&g_hot.lock);
+}
+
+static int hot_entry_cmp(const void *a, const void *b) {
+    const FuseHotEntry *ea = a;
+    const FuseHotEntry *eb = b;
+    if (ea->weight == eb->weight) return 0;
+    return ea->weight < eb->weight ? 1 : -1;
+}
+
+int fuse_wrapper_get_hot_paths(FuseHotKind kind, FuseHotMetric metric, FuseHotEntry *out, int max) {
+    if (!out || max <= 0 || kind < 0 || kind >= FUSE_HOT_KIND_COUNT ||
+        metric < 0 || metric >= FUSE_HOT_METRIC_COUNT) {
+        return 0;
     }
-    NOTIFY_FILE_RENAMED(from, to, is_dir);
 
-    return 0;
+    // Copy the whole sketch under the lock, sort outside it
+    FuseHotEntry *all = calloc(FUSE_HOT_TOP_K, sizeof(FuseHotEntry));
+    if (!all) return 0;
+
+    DMSA_LOCK(&g_hot.lock, FUSE_LOCK_HOT);
+    HotSketch *sk = &g_hot.sketches[kind][metric];
+    int n = sk->count;
+    for (int i = 0; i < n; i++) {
+        const HotCounter *c = &sk->counters[i];
+        strncpy(all[i].path, c->key, sizeof(all[i].path) - 1);
+        all[i].weight = c->weight;
+        all[i].error = c->error;
+        all[i].ops = c->ops;
+        all[i].bytes = c->bytes;
+        all[i].latency_ns = c->latency_ns;
+        all[i].op_mask = c->op_mask;
+    }
+    pthread_mutex_unlock(&g_hot.lock);
+
+    qsort(all, (size_t)n, sizeof(FuseHotEntry), hot_entry_cmp);
+    if (n > max) n = max;
+    memcpy(out, all, (size_t)n * sizeof(FuseHotEntry));
+    free(all);
+    return n;
+}
+
+const char* fuse_wrapper_op_name(FuseOpType op) {
+    if (op < 0 || op >= FUSE_OP_COUNT) return "unknown";
+    return g_op_names[op];
 }
 
-// truncate: truncate file
-static int dmsa_truncate(const char *path, off_t size) {
-    LOG_DEBUG("truncate: %s, size=%lld", path, size);
+// Log the top entries of every sketch (shared by exit diagnostics and on-demand dump)
+#define HOT_LOG_TOP 10
+static void log_hot_stats(void) {
+    static const char *kind_names[FUSE_HOT_KIND_COUNT] = { "paths", "dirs" };
+    static const char *metric_names[FUSE_HOT_METRIC_COUNT] = { "ops", "bytes", "latency" };
 
-    if (g_state.readonly) {
-        return -EROFS;
+    if (!g_hot_tracking) {
+        LOG_INFO("Hot path tracking: disabled");
+        return;
     }
 
-    // Block truncate if file is being synced
-    if (syncing_files_contains(path)) {
-        LOG_DEBUG("truncate blocked: %s is syncing", path);
-        return -EBUSY;
+    FuseHotEntry *top = calloc(HOT_LOG_TOP, sizeof(FuseHotEntry));
+    if (!top) return;
+
+    for (int kind = 0; kind < FUSE_HOT_KIND_COUNT; kind++) {
+        for (int metric = 0; metric < FUSE_HOT_METRIC_COUNT; metric++) {
+            int n = fuse_wrapper_get_hot_paths((FuseHotKind)kind, (FuseHotMetric)metric, top, HOT_LOG_TOP);
+            if (n == 0) continue;
+            LOG_INFO("Hot %s by %s:", kind_names[kind], metric_names[metric]);
+            for (int i = 0; i < n; i++) {
+                LOG_INFO("  %2d. %s ops=%llu bytes=%llu time=%.1fms (err<=%llu)",
+                         i + 1, top[i].path,
+                         (unsigned long long)top[i].ops,
+                         (unsigned long long)top[i].bytes,
+                         (double)top[i].latency_ns / 1e6,
+                         (unsigned long long)top[i].error);
+            }
+        }
     }
+    free(top);
+}
 
-    char *local = get_local_path(path);
-    if (!local) {
-        return -ENOMEM;
+// ============================================================
+// Per-client accounting and QoS API implementation
+// ============================================================
+
+// Re-apply rules to known clients and invalidate per-thread caches (lock held)
+static void qos_reclassify_locked(void) {
+    for (int i = 0; i < g_clients.count; i++) {
+        g_clients.clients[i].qos = qos_classify_locked(g_clients.clients[i].name);
     }
+    g_clients.rules_gen++;
+}
 
-    // If not in local, copy from external
-    struct stat st;
-    if (stat(local, &st) != 0) {
-        char *external = get_external_path(path);
-        if (external && stat(external, &st) == 0) {
-            ensure_parent_directory(local);
-
-            int src_fd = open(external, O_RDONLY);
-            if (src_fd != -1) {
-                int dst_fd = open(local, O_CREAT | O_WRONLY | O_TRUNC, st.st_mode);
-                if (dst_fd != -1) {
-                    char copy_buf[8192];
-                    ssize_t bytes;
-                    while ((bytes = read(src_fd, copy_buf, sizeof(copy_buf))) > 0) {
-                        write(dst_fd, copy_buf, bytes);
-                    }
-                    close(dst_fd);
-                }
-                close(src_fd);
-            }
-            free(external);
+int fuse_wrapper_set_qos_rule(const char *process_pattern, FuseQosClass qos) {
+    if (!process_pattern || qos < 0 || qos >= FUSE_QOS_CLASS_COUNT) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    int idx = -1;
+    for (int i = 0; i < g_clients.rule_count; i++) {
+        if (strcmp(g_clients.rules[i].pattern, process_pattern) == 0) {
+            idx = i;
+            break;
         }
     }
 
-    int res = truncate(local, size);
-    free(local);
+    if (idx < 0) {
+        if (g_clients.rule_count >= FUSE_MAX_QOS_RULES) {
+            pthread_mutex_unlock(&g_clients.lock);
+            LOG_WARN("QoS rule table full (%d), cannot add: %s", FUSE_MAX_QOS_RULES, process_pattern);
+            return FUSE_WRAPPER_ERR_INVALID_ARG;
+        }
+        // New rules go first so they override the defaults
+        memmove(&g_clients.rules[1], &g_clients.rules[0], (size_t)g_clients.rule_count * sizeof(QosRule));
+        g_clients.rule_count++;
+        idx = 0;
+        memset(&g_clients.rules[0], 0, sizeof(QosRule));
+        strncpy(g_clients.rules[0].pattern, process_pattern, sizeof(g_clients.rules[0].pattern) - 1);
+    }
+    g_clients.rules[idx].qos = qos;
+    qos_reclassify_locked();
+    pthread_mutex_unlock(&g_clients.lock);
+
+    LOG_INFO("QoS rule: %s -> class %d", process_pattern, qos);
+    return FUSE_WRAPPER_OK;
+}
 
-    if (res == -1) {
-        return -errno;
-    }
+void fuse_wrapper_clear_qos_rules(void) {
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    g_clients.rule_count = 0;
+    qos_reclassify_locked();
+    pthread_mutex_unlock(&g_clients.lock);
+    LOG_INFO("QoS rules cleared");
+}
 
-    return 0;
+void fuse_wrapper_set_background_slots(int slots) {
+    if (slots < 1) slots = 1;
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    g_clients.background_slots = slots;
+    pthread_cond_broadcast(&g_clients.background_cond);
+    pthread_mutex_unlock(&g_clients.lock);
+    LOG_INFO("Background op slots: %d", slots);
 }
 
-// chmod: change permissions
-static int dmsa_chmod(const char *path, mode_t mode) {
-    LOG_DEBUG("chmod: %s, mode=%o", path, mode);
+static int client_stats_cmp(const void *a, const void *b) {
+    const FuseClientStats *ca = a;
+    const FuseClientStats *cb = b;
+    if (ca->ops == cb->ops) return 0;
+    return ca->ops < cb->ops ? 1 : -1;
+}
 
-    if (g_state.readonly) {
-        return -EROFS;
-    }
+int fuse_wrapper_get_client_stats(FuseClientStats *out, int max) {
+    if (!out || max <= 0) return 0;
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
-    }
+    FuseClientStats *all = calloc(FUSE_MAX_CLIENTS, sizeof(FuseClientStats));
+    if (!all) return 0;
 
-    int res = chmod(actual, mode);
-    int err = errno;
-    free(actual);
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    int n = g_clients.count;
+    memcpy(all, g_clients.clients, (size_t)n * sizeof(FuseClientStats));
+    pthread_mutex_unlock(&g_clients.lock);
 
-    if (res == -1) {
-        // VFS presents normalized permissions to users (644/755).
-        // The underlying file's actual permissions don't matter since Service runs as root.
-        // Ignore permission errors to allow Finder copy operations (ditto uses fchmod).
-        if (err == EPERM || err == EACCES) {
-            LOG_INFO("chmod: %s mode=%o -> EPERM/EACCES ignored", path, mode);
-            return 0;
-        }
-        LOG_WARN("chmod failed: %s, mode=%o, errno=%d (%s)", path, mode, err, strerror(err));
-        return -err;
-    }
+    qsort(all, (size_t)n, sizeof(FuseClientStats), client_stats_cmp);
+    if (n > max) n = max;
+    memcpy(out, all, (size_t)n * sizeof(FuseClientStats));
+    free(all);
+    return n;
+}
 
-    return 0;
+void fuse_wrapper_reset_client_stats(void) {
+    DMSA_LOCK(&g_clients.lock, FUSE_LOCK_CLIENTS);
+    g_clients.count = 0;
+    g_clients.rules_gen++;
+    pthread_mutex_unlock(&g_clients.lock);
 }
 
-// chown: change owner
-static int dmsa_chown(const char *path, uid_t uid, gid_t gid) {
-    LOG_DEBUG("chown: %s, uid=%d, gid=%d", path, uid, gid);
+// Log the busiest clients (shared by exit diagnostics and on-demand dump)
+#define CLIENT_LOG_TOP 10
+static void log_client_stats(void) {
+    static const char *qos_names[FUSE_QOS_CLASS_COUNT] = { "interactive", "background", "bulk" };
+
+    FuseClientStats *top = calloc(CLIENT_LOG_TOP, sizeof(FuseClientStats));
+    if (!top) return;
+
+    int n = fuse_wrapper_get_client_stats(top, CLIENT_LOG_TOP);
+    if (n > 0) {
+        LOG_INFO("Clients by ops (background slots: %d):", g_clients.background_slots);
+    }
+    for (int i = 0; i < n; i++) {
+        LOG_INFO("  %5d %-20s %-11s ops=%llu err=%llu bytes=%llu time=%.1fms throttled=%llu (%.1fms) copyup_denied=%llu",
+                 top[i].pid, top[i].name, qos_names[top[i].qos],
+                 (unsigned long long)top[i].ops,
+                 (unsigned long long)top[i].errors,
+                 (unsigned long long)top[i].bytes,
+                 (double)top[i].latency_ns / 1e6,
+                 (unsigned long long)top[i].throttled,
+                 (double)top[i].throttle_wait_ns / 1e6,
+                 (unsigned long long)top[i].copyups_denied);
+    }
+    free(top);
+}
 
-    if (g_state.readonly) {
-        return -EROFS;
-    }
+// ============================================================
+// Slow operation detector API implementation
+// ============================================================
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
-    }
+void fuse_wrapper_set_slow_op_threshold_ms(uint32_t threshold_ms) {
+    g_slow_ops.stats.threshold_ms = threshold_ms;
+    LOG_INFO("Slow-op threshold: %u ms%s", threshold_ms, threshold_ms == 0 ? " (disabled)" : "");
+}
 
-    int res = lchown(actual, uid, gid);
-    int err = errno;
-    free(actual);
+int fuse_wrapper_get_slow_ops(FuseSlowOp *out, int max) {
+    if (!out || max <= 0) return 0;
 
-    if (res == -1) {
-        // VFS presents all files as owned by the mount point owner.
-        // The underlying file's actual owner doesn't matter since Service runs as root.
-        // Ignore permission errors to allow Finder copy operations (ditto uses fchown).
-        if (err == EPERM || err == EACCES) {
-            LOG_INFO("chown: %s uid=%d gid=%d -> EPERM/EACCES ignored", path, uid, gid);
-            return 0;
-        }
-        LOG_WARN("chown failed: %s, uid=%d, gid=%d, errno=%d (%s)", path, uid, gid, err, strerror(err));
-        return -err;
+    DMSA_LOCK(&g_slow_ops.lock, FUSE_LOCK_SLOW_OPS);
+    int n = g_slow_ops.count < max ? g_slow_ops.count : max;
+    for (int i = 0; i < n; i++) {
+        int idx = (g_slow_ops.head - 1 - i + FUSE_SLOW_OP_RING_SIZE) % FUSE_SLOW_OP_RING_SIZE;
+        out[i] = g_slow_ops.ring[idx];
     }
+    pthread_mutex_unlock(&g_slow_ops.lock);
+    return n;
+}
 
-    return 0;
+void fuse_wrapper_get_slow_op_stats(FuseSlowOpStats *stats) {
+    if (!stats) return;
+    DMSA_LOCK(&g_slow_ops.lock, FUSE_LOCK_SLOW_OPS);
+    *stats = g_slow_ops.stats;
+    pthread_mutex_unlock(&g_slow_ops.lock);
 }
 
-// utimens: modify timestamps
-static int dmsa_utimens(const char *path, const struct timespec ts[2]) {
-    LOG_DEBUG("utimens: %s", path);
+const char* fuse_wrapper_phase_name(FusePhase phase) {
+    if (phase < 0 || phase >= FUSE_PHASE_COUNT) return "unknown";
+    return g_phase_names[phase];
+}
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
-    }
+// Log where slow ops spent their time (shared by exit diagnostics and on-demand dump)
+static void log_slow_op_stats(void) {
+    FuseSlowOpStats st;
+    fuse_wrapper_get_slow_op_stats(&st);
 
-    // Use utimensat (macOS 10.13+)
-    int res = utimensat(AT_FDCWD, actual, ts, AT_SYMLINK_NOFOLLOW);
-    int err = errno;
-    free(actual);
+    LOG_INFO("Slow ops (>= %u ms): %llu, log lines suppressed: %llu",
+             st.threshold_ms, (unsigned long long)st.slow_ops,
+             (unsigned long long)st.logs_suppressed);
+    if (st.slow_ops == 0) return;
 
-    if (res == -1) {
-        // Timestamp modification failure shouldn't block file copy operations.
-        // Ignore permission errors to allow Finder copy operations.
-        if (err == EPERM || err == EACCES) {
-            LOG_INFO("utimens: %s -> EPERM/EACCES ignored", path);
-            return 0;
-        }
-        LOG_WARN("utimens failed: %s, errno=%d (%s)", path, err, strerror(err));
-        return -err;
+    for (int i = 0; i < FUSE_PHASE_COUNT; i++) {
+        // Skip phases that never dominated and add up to under a millisecond
+        if (st.dominant[i] == 0 && st.phase_ns[i] < 1000000) continue;
+        LOG_INFO("  %-17s dominant in %llu, total %.1fms",
+                 g_phase_names[i], (unsigned long long)st.dominant[i],
+                 (double)st.phase_ns[i] / 1e6);
     }
-
-    return 0;
 }
 
-// statfs: filesystem statistics
-static int dmsa_statfs(const char *path, struct statvfs *stbuf) {
-    LOG_DEBUG("statfs: %s", path);
-    (void)path;
+// ============================================================
+// Shared-memory diagnostics API implementation
+// ============================================================
+// Single writer (the publisher thread, or an explicit publish under g_shm.lock)
+// and a seqlock, see fuse_shm.h. Gauges are read without taking the owning
+// locks so publishing never contends with FUSE threads; values are at worst
+// one update stale.
 
-    // Use local directory statistics
-    int res = statvfs(g_state.local_dir, stbuf);
-    if (res == -1) {
-        return -errno;
-    }
+#define DEFAULT_SHM_PUBLISH_INTERVAL_MS 500
 
-    return 0;
-}
+_Static_assert(FUSE_OP_COUNT <= FUSE_SHM_MAX_OPS, "FUSE_SHM_MAX_OPS too small");
+_Static_assert(FUSE_LOCK_COUNT <= FUSE_SHM_MAX_LOCKS, "FUSE_SHM_MAX_LOCKS too small");
+_Static_assert(FUSE_PHASE_COUNT <= FUSE_SHM_MAX_PHASES, "FUSE_SHM_MAX_PHASES too small");
 
-// readlink: read symbolic link
-static int dmsa_readlink(const char *path, char *buf, size_t size) {
-    int depth_err = check_path_depth(path);
-    if (depth_err) return depth_err;
+static struct {
+    FuseShmSegment *seg;
+    int fd;
+    uint32_t interval_ms;
+    pthread_t thread;
+    int running;
+    pthread_cond_t cond;
+    pthread_mutex_t lock;
+} g_shm = {
+    .seg = NULL,
+    .fd = -1,
+    .interval_ms = DEFAULT_SHM_PUBLISH_INTERVAL_MS,
+    .running = 0,
+    .cond = PTHREAD_COND_INITIALIZER,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    LOG_DEBUG("readlink: %s", path);
+static uint64_t wall_clock_ms(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000 + (uint64_t)tv.tv_usec / 1000;
+}
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
+// Fill the segment body (everything after seq) into a private copy
+static void shm_fill_body(FuseShmSegment *b) {
+    b->is_mounted = g_state.is_mounted;
+    b->is_loop_running = g_fuse_loop_running;
+    b->index_ready = g_state.index_ready;
+    b->readonly = g_state.readonly;
+    b->open_handles = g_open_count;
+    b->last_signal = (int32_t)g_last_signal;
+    b->total_ops = g_total_ops;
+    b->last_op_time = g_last_op_time;
+
+    b->cb_queued = g_cb_queued;
+    b->cb_processed = g_cb_processed;
+    b->cb_dropped = g_cb_dropped;
+    b->cb_pending = callback_queue_pending();
+    b->cb_capacity = g_callback_queue.capacity;
+
+    b->evicting = g_evicting.count;
+    b->pending_delete = g_pending_delete.count;
+    b->syncing_files = g_syncing_files.count;
+    b->background_inflight = g_clients.background_inflight;
+    b->background_slots = g_clients.background_slots;
+    b->clients = g_clients.count;
+
+    b->slow_op_threshold_ms = g_slow_ops.stats.threshold_ms;
+    b->lock_profiling = g_lock_profiling;
+    b->slow_ops = g_slow_ops.stats.slow_ops;
+    for (int i = 0; i < FUSE_PHASE_COUNT; i++) {
+        b->slow_phase_ns[i] = g_slow_ops.stats.phase_ns[i];
+    }
+
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        b->tiers[t].ops = g_tier_stats[t].ops;
+        b->tiers[t].errors = g_tier_stats[t].errors;
+        b->tiers[t].resolve_ns = g_tier_stats[t].resolve_ns;
+        b->tiers[t].last_error_ms = g_tier_stats[t].last_error_ms;
+    }
+    b->local_hits = g_local_hits;
+    b->local_misses = g_local_misses;
+    b->ext_reads_issued = g_ext_io.reads_issued;
+    b->ext_reads_merged = g_ext_io.reads_merged;
+    b->ext_timeouts = g_ext_io.timeouts;
+    b->ext_read_window_us = (uint32_t)(ext_io_merge_window_ns() / 1000);
+    b->ext_queued = g_ext_io.queued;
+    b->hash_lookups = g_hash_cache.stats.lookups;
+    b->hash_hits = g_hash_cache.stats.hits;
+    b->hash_entries = g_hash_cache.stats.entries;
+    b->hash_capacity = g_hash_cache.stats.capacity;
+
+    b->tiers[FUSE_SHM_TIER_LOCAL].online = g_state.local_dir != NULL;
+    b->tiers[FUSE_SHM_TIER_EXTERNAL].online = g_state.external_dir != NULL && !g_state.external_offline;
+
+    for (int op = 0; op < FUSE_OP_COUNT; op++) {
+        const OpStats *st = &g_op_stats[op];
+        FuseShmOpStats *o = &b->ops[op];
+        o->count = st->count;
+        o->errors = st->errors;
+        o->bytes = st->bytes;
+        o->total_ns = st->total_ns;
+        for (int i = 0; i < FUSE_SHM_HIST_BUCKETS; i++) {
+            o->hist[i] = st->hist[i];
+        }
     }
 
-    ssize_t res = readlink(actual, buf, size - 1);
-    free(actual);
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        const LockProfile *lp = &g_lock_profiles[id];
+        b->locks[id].acquisitions = lp->acquisitions;
+        b->locks[id].contended = lp->contended;
+        b->locks[id].wait_ns = lp->wait_ns;
+        b->locks[id].max_wait_ns = lp->max_wait_ns;
+    }
+}
 
-    if (res == -1) {
-        return -errno;
+// Caller holds g_shm.lock
+static void shm_publish_locked(void) {
+    FuseShmSegment *seg = g_shm.seg;
+    if (!seg) return;
+
+    // Build the body outside the write window so readers rarely retry
+    static FuseShmSegment body;
+    memcpy(&body, seg, sizeof(body));
+    shm_fill_body(&body);
+    body.publish_count = seg->publish_count + 1;
+    body.updated_ms = wall_clock_ms();
+
+    const size_t off = offsetof(FuseShmSegment, publish_count);
+    uint64_t seq = seg->seq;
+    seg->seq = seq + 1;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy((char *)seg + off, (const char *)&body + off, sizeof(body) - off);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    seg->seq = seq + 2;
+}
+
+static void* shm_publisher_thread(void *arg) {
+    (void)arg;
+    LOG_INFO("Shm publisher started (interval %u ms)", g_shm.interval_ms);
+
+    DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+    while (g_shm.running) {
+        shm_publish_locked();
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t nsec = (uint64_t)deadline.tv_nsec + (uint64_t)g_shm.interval_ms * 1000000ULL;
+        deadline.tv_sec += (time_t)(nsec / 1000000000ULL);
+        deadline.tv_nsec = (long)(nsec % 1000000000ULL);
+        pthread_cond_timedwait(&g_shm.cond, &g_shm.lock, &deadline);
     }
+    pthread_mutex_unlock(&g_shm.lock);
 
-    buf[res] = '\0';
-    return 0;
+    LOG_INFO("Shm publisher stopped");
+    return NULL;
 }
 
-// symlink: create symbolic link
-static int dmsa_symlink(const char *target, const char *linkpath) {
-    LOG_DEBUG("symlink: %s -> %s", linkpath, target);
+int fuse_wrapper_shm_open(const char *path, uint32_t interval_ms) {
+    if (!path) return FUSE_WRAPPER_ERR_INVALID_ARG;
 
-    if (g_state.readonly) {
-        return -EROFS;
+    fuse_wrapper_shm_close();
+
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Shm open failed: %s errno=%d (%s)", path, errno, strerror(errno));
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
     }
+    // Readable by the app even though the service runs as root
+    fchmod(fd, 0644);
 
-    char *local = get_local_path(linkpath);
-    if (!local) {
-        return -ENOMEM;
+    if (ftruncate(fd, sizeof(FuseShmSegment)) != 0) {
+        LOG_ERROR("Shm ftruncate failed: %s errno=%d (%s)", path, errno, strerror(errno));
+        close(fd);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
     }
 
-    ensure_parent_directory(local);
+    FuseShmSegment *seg = mmap(NULL, sizeof(FuseShmSegment), PROT_READ | PROT_WRITE,
+                               MAP_SHARED, fd, 0);
+    if (seg == MAP_FAILED) {
+        LOG_ERROR("Shm mmap failed: %s errno=%d (%s)", path, errno, strerror(errno));
+        close(fd);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    int res = symlink(target, local);
+    // Invalidate the magic first so readers never accept a half-written header
+    seg->magic = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset((char *)seg + sizeof(seg->magic), 0, sizeof(*seg) - sizeof(seg->magic));
 
-    if (res == -1) {
-        int err = errno;
-        free(local);
-        return -err;
+    seg->version = FUSE_SHM_VERSION;
+    seg->size = sizeof(FuseShmSegment);
+    seg->publish_interval_ms = interval_ms ? interval_ms : g_shm.interval_ms;
+    seg->writer_pid = getpid();
+    seg->op_count = FUSE_OP_COUNT;
+    seg->lock_count = FUSE_LOCK_COUNT;
+    seg->phase_count = FUSE_PHASE_COUNT;
+    seg->started_ms = wall_clock_ms();
+    for (int op = 0; op < FUSE_OP_COUNT; op++) {
+        snprintf(seg->ops[op].name, sizeof(seg->ops[op].name), "%s", g_op_names[op]);
+    }
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        snprintf(seg->locks[id].name, sizeof(seg->locks[id].name), "%s", g_lock_names[id]);
     }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    seg->magic = FUSE_SHM_MAGIC;
 
-    fix_ownership(local);
-    free(local);
+    DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+    g_shm.seg = seg;
+    g_shm.fd = fd;
+    g_shm.interval_ms = seg->publish_interval_ms;
+    g_shm.running = 1;
+    shm_publish_locked();
+    pthread_mutex_unlock(&g_shm.lock);
 
-    return 0;
-}
+    if (pthread_create(&g_shm.thread, NULL, shm_publisher_thread, NULL) != 0) {
+        LOG_ERROR("Failed to create shm publisher thread");
+        g_shm.running = 0;
+    }
 
-// access: check access permissions
-static int dmsa_access(const char *path, int mask) {
-    LOG_DEBUG("access: %s, mask=%d", path, mask);
+    LOG_INFO("Shm diagnostics segment: %s (%zu bytes)", path, sizeof(FuseShmSegment));
+    return FUSE_WRAPPER_OK;
+}
 
-    // Root directory: always allow
-    if (strcmp(path, "/") == 0) {
-        return 0;
+void fuse_wrapper_shm_close(void) {
+    DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+    if (!g_shm.seg) {
+        pthread_mutex_unlock(&g_shm.lock);
+        return;
     }
+    int was_running = g_shm.running;
+    g_shm.running = 0;
+    pthread_cond_signal(&g_shm.cond);
+    pthread_mutex_unlock(&g_shm.lock);
 
-    // Check if file exists
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
+    if (was_running) {
+        pthread_join(g_shm.thread, NULL);
     }
-    free(actual);
 
-    // VFS presents all files as owned by user with full permissions (mode 0644/0755)
-    // Since Service runs as root and handles actual file I/O, we always grant access
-    // to existing files. The underlying file permissions don't matter to VFS users.
-    //
-    // This fixes "permission denied" errors in Finder when copying files that have
-    // restrictive permissions (e.g., 600) on the underlying storage.
-    return 0;
+    DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+    shm_publish_locked();
+    g_shm.seg->writer_pid = 0;
+    munmap(g_shm.seg, sizeof(FuseShmSegment));
+    close(g_shm.fd);
+    g_shm.seg = NULL;
+    g_shm.fd = -1;
+    pthread_mutex_unlock(&g_shm.lock);
 }
 
-// getxattr: get extended attributes (macOS version)
-static int dmsa_getxattr(const char *path, const char *name, char *value, size_t size, uint32_t position) {
-    LOG_DEBUG("getxattr: %s, name=%s", path, name);
+void fuse_wrapper_shm_publish(void) {
+    DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+    shm_publish_locked();
+    pthread_mutex_unlock(&g_shm.lock);
+}
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
-    }
+// ============================================================
+// OpenMetrics exporter API implementation
+// ============================================================
+// One thread, one request per connection (HTTP/1.0 semantics). Each scrape
+// fills a private snapshot with shm_fill_body(), so scrapes take no locks on
+// the FUSE path and cost the same as one shm publish.
 
-    ssize_t res = getxattr(actual, name, value, size, position, XATTR_NOFOLLOW);
-    free(actual);
+#define METRICS_LISTEN_BACKLOG 8
+#define METRICS_IO_TIMEOUT_SEC 2
+#define METRICS_REQUEST_MAX 4096
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
 
-    if (res == -1) {
-        int err = errno;
-        // For permission errors on underlying storage, report "no such attribute"
-        // This allows Finder to proceed with copy operations
-        if (err == EPERM || err == EACCES) {
-            return -ENOATTR;
-        }
-        return -err;
-    }
+static struct {
+    char *socket_path;
+    int listen_fd;
+    int wake_pipe[2];               // Written by stop() to break poll()
+    pthread_t thread;
+    int running;
+    uint64_t scrapes;
+    pthread_mutex_t lock;
+} g_metrics = {
+    .socket_path = NULL,
+    .listen_fd = -1,
+    .wake_pipe = { -1, -1 },
+    .running = 0,
+    .scrapes = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
+};
 
-    return (int)res;
+// snprintf-style appender: keeps counting past the end so callers can size buffers
+typedef struct {
+    char *buf;
+    size_t size;
+    size_t len;
+} MetricsBuf;
+
+static void metrics_printf(MetricsBuf *mb, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void metrics_printf(MetricsBuf *mb, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    size_t avail = mb->len < mb->size ? mb->size - mb->len : 0;
+    int n = vsnprintf(avail ? mb->buf + mb->len : NULL, avail, fmt, ap);
+    va_end(ap);
+    if (n > 0) mb->len += (size_t)n;
 }
 
-// setxattr: set extended attributes (macOS version)
-static int dmsa_setxattr(const char *path, const char *name, const char *value,
-                         size_t size, int flags, uint32_t position) {
-    LOG_DEBUG("setxattr: %s, name=%s, size=%zu", path, name, size);
+static void metrics_family(MetricsBuf *mb, const char *name, const char *type,
+                           const char *unit, const char *help) {
+    metrics_printf(mb, "# TYPE %s %s\n", name, type);
+    if (unit) metrics_printf(mb, "# UNIT %s %s\n", name, unit);
+    metrics_printf(mb, "# HELP %s %s\n", name, help);
+}
 
-    if (g_state.readonly) {
-        return -EROFS;
-    }
+static void metrics_gauge(MetricsBuf *mb, const char *name, const char *help, double value) {
+    metrics_family(mb, name, "gauge", NULL, help);
+    metrics_printf(mb, "%s %.17g\n", name, value);
+}
 
-    // For Apple security-related xattrs that can't be set normally, fake success.
-    // These include: com.apple.macl (MAC label), com.apple.provenance,
-    // com.apple.quarantine, etc. The kernel or security framework manages these.
-    // Returning success allows cp/Finder copy to proceed without errors.
-    if (strncmp(name, "com.apple.", 10) == 0) {
-        // Try to set it, but ignore all errors for com.apple.* attrs
-        char *local = get_local_path(path);
-        if (local) {
-            int res = setxattr(local, name, value, size, position, flags | XATTR_NOFOLLOW);
-            if (res == -1) {
-                LOG_DEBUG("setxattr: %s name=%s -> ignored (com.apple.* attr)", path, name);
-            }
-            free(local);
+static void metrics_counter(MetricsBuf *mb, const char *name, const char *help, uint64_t value) {
+    metrics_family(mb, name, "counter", NULL, help);
+    metrics_printf(mb, "%s_total %llu\n", name, (unsigned long long)value);
+}
+
+static size_t metrics_render_snapshot(const FuseShmSegment *s, char *buf, size_t size) {
+    MetricsBuf mb = { buf, size, 0 };
+    static const char *tier_labels[FUSE_SHM_TIER_COUNT] = { "local", "external" };
+
+    metrics_gauge(&mb, "dmsa_vfs_mounted", "Filesystem is mounted", s->is_mounted);
+    metrics_gauge(&mb, "dmsa_vfs_loop_running", "FUSE event loop is running", s->is_loop_running);
+    metrics_gauge(&mb, "dmsa_vfs_index_ready", "File index is ready (access is blocked until then)", s->index_ready);
+    metrics_gauge(&mb, "dmsa_vfs_readonly", "Read-only mode", s->readonly);
+    metrics_gauge(&mb, "dmsa_vfs_open_handles", "Open file handles", s->open_handles);
+    metrics_gauge(&mb, "dmsa_vfs_last_op_timestamp_seconds", "Unix time of the last operation",
+                  (double)s->last_op_time);
+    metrics_counter(&mb, "dmsa_vfs_ops", "Operations since mount", s->total_ops);
+
+    // Callback queue
+    metrics_gauge(&mb, "dmsa_vfs_callback_queue_depth", "Callbacks waiting for the worker", s->cb_pending);
+    metrics_gauge(&mb, "dmsa_vfs_callback_queue_capacity", "Callback queue size", s->cb_capacity);
+    metrics_family(&mb, "dmsa_vfs_callbacks", "counter", NULL, "Callbacks by outcome");
+    metrics_printf(&mb, "dmsa_vfs_callbacks_total{state=\"queued\"} %llu\n", (unsigned long long)s->cb_queued);
+    metrics_printf(&mb, "dmsa_vfs_callbacks_total{state=\"processed\"} %llu\n", (unsigned long long)s->cb_processed);
+    metrics_printf(&mb, "dmsa_vfs_callbacks_total{state=\"dropped\"} %llu\n", (unsigned long long)s->cb_dropped);
+
+    // Path sets and QoS
+    metrics_gauge(&mb, "dmsa_vfs_evicting_paths", "Paths being evicted", s->evicting);
+    metrics_gauge(&mb, "dmsa_vfs_pending_delete_paths", "Deleted paths hidden until EXTERNAL is cleaned", s->pending_delete);
+    metrics_gauge(&mb, "dmsa_vfs_syncing_paths", "Paths locked for sync", s->syncing_files);
+    metrics_gauge(&mb, "dmsa_vfs_background_inflight", "Background/bulk ops holding a slot", s->background_inflight);
+    metrics_gauge(&mb, "dmsa_vfs_background_slots", "Background/bulk op slots", s->background_slots);
+    metrics_gauge(&mb, "dmsa_vfs_clients", "Client processes seen", s->clients);
+    metrics_counter(&mb, "dmsa_vfs_slow_ops", "Operations over the slow-op threshold", s->slow_ops);
+
+    // LOCAL as a cache of EXTERNAL
+    uint64_t lookups = s->local_hits + s->local_misses;
+    metrics_family(&mb, "dmsa_vfs_local_cache", "counter", NULL,
+                   "Ops served by LOCAL alone (hit) or needing EXTERNAL (miss)");
+    metrics_printf(&mb, "dmsa_vfs_local_cache_total{result=\"hit\"} %llu\n", (unsigned long long)s->local_hits);
+    metrics_printf(&mb, "dmsa_vfs_local_cache_total{result=\"miss\"} %llu\n", (unsigned long long)s->local_misses);
+    metrics_gauge(&mb, "dmsa_vfs_local_cache_hit_ratio", "Hit ratio since mount (0 when idle)",
+                  lookups ? (double)s->local_hits / (double)lookups : 0.0);
+
+    // EXTERNAL I/O executor
+    metrics_family(&mb, "dmsa_vfs_external_reads", "counter", NULL,
+                   "EXTERNAL preads issued to the drive, or merged into another one");
+    metrics_printf(&mb, "dmsa_vfs_external_reads_total{result=\"issued\"} %llu\n", (unsigned long long)s->ext_reads_issued);
+    metrics_printf(&mb, "dmsa_vfs_external_reads_total{result=\"merged\"} %llu\n", (unsigned long long)s->ext_reads_merged);
+    metrics_counter(&mb, "dmsa_vfs_external_timeouts", "EXTERNAL calls abandoned after external_timeout_ms", s->ext_timeouts);
+    metrics_gauge(&mb, "dmsa_vfs_external_queued", "EXTERNAL calls waiting for the executor", s->ext_queued);
+    metrics_gauge(&mb, "dmsa_vfs_external_read_window_seconds", "Current read coalescing window",
+                  (double)s->ext_read_window_us / 1e6);
+
+    // Content-hash cache
+    metrics_family(&mb, "dmsa_hash_cache_lookups", "counter", NULL,
+                   "Content-hash cache lookups answered from the table (hit) or needing a rehash (miss)");
+    metrics_printf(&mb, "dmsa_hash_cache_lookups_total{result=\"hit\"} %llu\n", (unsigned long long)s->hash_hits);
+    metrics_printf(&mb, "dmsa_hash_cache_lookups_total{result=\"miss\"} %llu\n",
+                   (unsigned long long)(s->hash_lookups - s->hash_hits));
+    metrics_gauge(&mb, "dmsa_hash_cache_entries", "Content-hash cache entries", s->hash_entries);
+    metrics_gauge(&mb, "dmsa_hash_cache_capacity", "Content-hash cache slots (0 when closed)", s->hash_capacity);
+
+    // Tier health
+    metrics_family(&mb, "dmsa_vfs_tier_online", "gauge", NULL, "Tier directory is available");
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        metrics_printf(&mb, "dmsa_vfs_tier_online{tier=\"%s\"} %d\n", tier_labels[t], s->tiers[t].online);
+    }
+    metrics_family(&mb, "dmsa_vfs_tier_ops", "counter", NULL, "Ops that touched the tier");
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        metrics_printf(&mb, "dmsa_vfs_tier_ops_total{tier=\"%s\"} %llu\n", tier_labels[t],
+                       (unsigned long long)s->tiers[t].ops);
+    }
+    metrics_family(&mb, "dmsa_vfs_tier_errors", "counter", NULL, "Failed ops that touched the tier (ENOENT excluded)");
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        metrics_printf(&mb, "dmsa_vfs_tier_errors_total{tier=\"%s\"} %llu\n", tier_labels[t],
+                       (unsigned long long)s->tiers[t].errors);
+    }
+    metrics_family(&mb, "dmsa_vfs_tier_resolve_seconds", "counter", "seconds", "Time spent resolving paths on the tier");
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        metrics_printf(&mb, "dmsa_vfs_tier_resolve_seconds_total{tier=\"%s\"} %.9f\n", tier_labels[t],
+                       (double)s->tiers[t].resolve_ns / 1e9);
+    }
+    metrics_family(&mb, "dmsa_vfs_tier_last_error_timestamp_seconds", "gauge", NULL,
+                   "Unix time of the last tier error (0 if none)");
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        metrics_printf(&mb, "dmsa_vfs_tier_last_error_timestamp_seconds{tier=\"%s\"} %.3f\n", tier_labels[t],
+                       (double)s->tiers[t].last_error_ms / 1e3);
+    }
+
+    // Per-op counters and latency histograms
+    metrics_family(&mb, "dmsa_vfs_op_requests", "counter", NULL, "Operations by type");
+    for (int op = 0; op < FUSE_OP_COUNT; op++) {
+        metrics_printf(&mb, "dmsa_vfs_op_requests_total{op=\"%s\"} %llu\n", g_op_names[op],
+                       (unsigned long long)s->ops[op].count);
+    }
+    metrics_family(&mb, "dmsa_vfs_op_errors", "counter", NULL, "Failed operations by type");
+    for (int op = 0; op < FUSE_OP_COUNT; op++) {
+        metrics_printf(&mb, "dmsa_vfs_op_errors_total{op=\"%s\"} %llu\n", g_op_names[op],
+                       (unsigned long long)s->ops[op].errors);
+    }
+    metrics_family(&mb, "dmsa_vfs_op_bytes", "counter", "bytes", "Bytes transferred by read/write");
+    metrics_printf(&mb, "dmsa_vfs_op_bytes_total{op=\"read\"} %llu\n", (unsigned long long)s->ops[FUSE_OP_READ].bytes);
+    metrics_printf(&mb, "dmsa_vfs_op_bytes_total{op=\"write\"} %llu\n", (unsigned long long)s->ops[FUSE_OP_WRITE].bytes);
+
+    metrics_family(&mb, "dmsa_vfs_op_duration_seconds", "histogram", "seconds", "Operation latency");
+    for (int op = 0; op < FUSE_OP_COUNT; op++) {
+        const FuseShmOpStats *o = &s->ops[op];
+        uint64_t cumulative = 0;
+        // Bucket i holds ops under 2^i us; the last bucket is open-ended (+Inf)
+        for (int i = 0; i < FUSE_SHM_HIST_BUCKETS - 1; i++) {
+            cumulative += o->hist[i];
+            metrics_printf(&mb, "dmsa_vfs_op_duration_seconds_bucket{op=\"%s\",le=\"%.9g\"} %llu\n",
+                           g_op_names[op], (double)(1ULL << i) / 1e6, (unsigned long long)cumulative);
         }
-        return 0;  // Always return success for com.apple.* attributes
+        metrics_printf(&mb, "dmsa_vfs_op_duration_seconds_bucket{op=\"%s\",le=\"+Inf\"} %llu\n",
+                       g_op_names[op], (unsigned long long)o->count);
+        metrics_printf(&mb, "dmsa_vfs_op_duration_seconds_count{op=\"%s\"} %llu\n",
+                       g_op_names[op], (unsigned long long)o->count);
+        metrics_printf(&mb, "dmsa_vfs_op_duration_seconds_sum{op=\"%s\"} %.9f\n",
+                       g_op_names[op], (double)o->total_ns / 1e9);
     }
 
-    char *local = get_local_path(path);
-    if (!local) {
-        return -ENOMEM;
+    // Lock contention (advances only while lock profiling is on)
+    metrics_gauge(&mb, "dmsa_vfs_lock_profiling", "Lock profiler enabled", s->lock_profiling);
+    metrics_family(&mb, "dmsa_vfs_lock_contended", "counter", NULL, "Contended lock acquisitions");
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        metrics_printf(&mb, "dmsa_vfs_lock_contended_total{lock=\"%s\"} %llu\n", g_lock_names[id],
+                       (unsigned long long)s->locks[id].contended);
+    }
+    metrics_family(&mb, "dmsa_vfs_lock_wait_seconds", "counter", "seconds", "Time blocked on contended locks");
+    for (int id = 0; id < FUSE_LOCK_COUNT; id++) {
+        metrics_printf(&mb, "dmsa_vfs_lock_wait_seconds_total{lock=\"%s\"} %.9f\n", g_lock_names[id],
+                       (double)s->locks[id].wait_ns / 1e9);
     }
 
-    int res = setxattr(local, name, value, size, position, flags | XATTR_NOFOLLOW);
-    int err = errno;
-    free(local);
+    metrics_printf(&mb, "# EOF\n");
+    return mb.len;
+}
 
-    if (res == -1) {
-        // Extended attribute setting failure shouldn't block file copy operations.
-        // Ignore permission errors to allow Finder copy operations (ditto sets xattrs).
-        if (err == EPERM || err == EACCES || err == EINVAL) {
-            LOG_DEBUG("setxattr: %s name=%s -> error %d ignored", path, name, err);
-            return 0;
+size_t fuse_wrapper_metrics_render(char *buf, size_t size) {
+    FuseShmSegment *snap = calloc(1, sizeof(*snap));
+    if (!snap) return 0;
+    shm_fill_body(snap);
+    size_t len = metrics_render_snapshot(snap, buf, size);
+    free(snap);
+    return len;
+}
+
+static int metrics_write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
         }
-        LOG_WARN("setxattr failed: %s, name=%s, errno=%d (%s)", path, name, err, strerror(err));
-        return -err;
+        data += n;
+        len -= (size_t)n;
     }
-
     return 0;
 }
 
-// listxattr: list extended attributes
-static int dmsa_listxattr(const char *path, char *list, size_t size) {
-    LOG_DEBUG("listxattr: %s", path);
+static void metrics_send_status(int fd, const char *status) {
+    char resp[256];
+    int n = snprintf(resp, sizeof(resp),
+                     "HTTP/1.0 %s\r\nContent-Type: text/plain\r\nContent-Length: %zu\r\n"
+                     "Connection: close\r\n\r\n%s\n", status, strlen(status) + 1, status);
+    metrics_write_all(fd, resp, (size_t)n);
+}
 
-    char *actual = resolve_actual_path(path);
-    if (!actual) {
-        return -ENOENT;
+static void metrics_serve_client(int fd, FuseShmSegment *snap) {
+    struct timeval tv = { .tv_sec = METRICS_IO_TIMEOUT_SEC, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+#ifdef SO_NOSIGPIPE
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+
+    // Read the request head (the body, if any, is ignored)
+    char req[METRICS_REQUEST_MAX + 1];
+    size_t len = 0;
+    while (len < METRICS_REQUEST_MAX) {
+        ssize_t n = read(fd, req + len, METRICS_REQUEST_MAX - len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        len += (size_t)n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    req[len] = '\0';
+
+    char method[8] = {0};
+    char target[256] = {0};
+    if (sscanf(req, "%7s %255s", method, target) != 2) {
+        metrics_send_status(fd, "400 Bad Request");
+        return;
+    }
+    if (strcmp(method, "GET") != 0 && strcmp(method, "HEAD") != 0) {
+        metrics_send_status(fd, "405 Method Not Allowed");
+        return;
+    }
+    char *query = strchr(target, '?');
+    if (query) *query = '\0';
+    if (strcmp(target, "/") != 0 && strcmp(target, "/metrics") != 0) {
+        metrics_send_status(fd, "404 Not Found");
+        return;
     }
 
-    ssize_t res = listxattr(actual, list, size, XATTR_NOFOLLOW);
-    free(actual);
+    memset(snap, 0, sizeof(*snap));
+    shm_fill_body(snap);
+    size_t body_len = metrics_render_snapshot(snap, NULL, 0);
+    char *body = malloc(body_len + 1);
+    if (!body) {
+        metrics_send_status(fd, "500 Internal Server Error");
+        return;
+    }
+    metrics_render_snapshot(snap, body, body_len + 1);
 
-    if (res == -1) {
-        int err = errno;
-        // For permission errors on underlying storage, report empty xattr list
-        // This allows Finder to proceed with copy operations
-        if (err == EPERM || err == EACCES) {
-            return 0;  // Empty list
+    char head[256];
+    int head_len = snprintf(head, sizeof(head),
+                            "HTTP/1.0 200 OK\r\nContent-Type: " METRICS_CONTENT_TYPE "\r\n"
+                            "Content-Length: %zu\r\nConnection: close\r\n\r\n", body_len);
+    if (metrics_write_all(fd, head, (size_t)head_len) == 0 && strcmp(method, "GET") == 0) {
+        metrics_write_all(fd, body, body_len);
+    }
+    free(body);
+    __sync_fetch_and_add(&g_metrics.scrapes, 1);
+}
+
+static void* metrics_exporter_thread(void *arg) {
+    (void)arg;
+    FuseShmSegment *snap = malloc(sizeof(*snap));
+    if (!snap) return NULL;
+
+    LOG_INFO("Metrics exporter listening on %s", g_metrics.socket_path);
+    while (g_metrics.running) {
+        struct pollfd fds[2] = {
+            { .fd = g_metrics.listen_fd, .events = POLLIN },
+            { .fd = g_metrics.wake_pipe[0], .events = POLLIN },
+        };
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("Metrics exporter poll failed: errno=%d (%s)", errno, strerror(errno));
+            break;
         }
-        return -err;
+        if (fds[1].revents) break;
+        if (!(fds[0].revents & POLLIN)) continue;
+
+        int client = accept(g_metrics.listen_fd, NULL, NULL);
+        if (client < 0) continue;
+        metrics_serve_client(client, snap);
+        close(client);
     }
 
-    return (int)res;
+    free(snap);
+    LOG_INFO("Metrics exporter stopped (%llu scrapes)", (unsigned long long)g_metrics.scrapes);
+    return NULL;
 }
 
-// removexattr: remove extended attributes
-static int dmsa_removexattr(const char *path, const char *name) {
-    LOG_DEBUG("removexattr: %s, name=%s", path, name);
+int fuse_wrapper_metrics_start(const char *socket_path) {
+    struct sockaddr_un addr;
+    if (!socket_path || strlen(socket_path) >= sizeof(addr.sun_path)) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    if (g_state.readonly) {
-        return -EROFS;
+    fuse_wrapper_metrics_stop();
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        LOG_ERROR("Metrics socket failed: errno=%d (%s)", errno, strerror(errno));
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
     }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
 
-    char *local = get_local_path(path);
-    if (!local) {
-        return -ENOMEM;
+    // Replace a stale socket left by a previous run
+    unlink(socket_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(fd, METRICS_LISTEN_BACKLOG) != 0) {
+        LOG_ERROR("Metrics bind/listen failed: %s errno=%d (%s)", socket_path, errno, strerror(errno));
+        close(fd);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
     }
+    // Collectors usually run as another user than the service
+    chmod(socket_path, 0666);
 
-    int res = removexattr(local, name, XATTR_NOFOLLOW);
-    free(local);
+    int wake[2];
+    if (pipe(wake) != 0) {
+        close(fd);
+        unlink(socket_path);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    if (res == -1) {
-        return -errno;
+    DMSA_LOCK(&g_metrics.lock, FUSE_LOCK_METRICS);
+    g_metrics.socket_path = strdup(socket_path);
+    g_metrics.listen_fd = fd;
+    g_metrics.wake_pipe[0] = wake[0];
+    g_metrics.wake_pipe[1] = wake[1];
+    g_metrics.scrapes = 0;
+    g_metrics.running = 1;
+    if (pthread_create(&g_metrics.thread, NULL, metrics_exporter_thread, NULL) != 0) {
+        LOG_ERROR("Failed to create metrics exporter thread");
+        g_metrics.running = 0;
     }
+    int running = g_metrics.running;
+    pthread_mutex_unlock(&g_metrics.lock);
 
-    return 0;
+    if (!running) {
+        fuse_wrapper_metrics_stop();
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+    return FUSE_WRAPPER_OK;
+}
+
+void fuse_wrapper_metrics_stop(void) {
+    DMSA_LOCK(&g_metrics.lock, FUSE_LOCK_METRICS);
+    if (g_metrics.listen_fd < 0) {
+        pthread_mutex_unlock(&g_metrics.lock);
+        return;
+    }
+    int was_running = g_metrics.running;
+    g_metrics.running = 0;
+    if (was_running && write(g_metrics.wake_pipe[1], "x", 1) < 0) {
+        LOG_WARN("Metrics exporter wake failed: errno=%d", errno);
+    }
+    pthread_mutex_unlock(&g_metrics.lock);
+
+    if (was_running) {
+        pthread_join(g_metrics.thread, NULL);
+    }
+
+    DMSA_LOCK(&g_metrics.lock, FUSE_LOCK_METRICS);
+    close(g_metrics.listen_fd);
+    close(g_metrics.wake_pipe[0]);
+    close(g_metrics.wake_pipe[1]);
+    unlink(g_metrics.socket_path);
+    free(g_metrics.socket_path);
+    g_metrics.socket_path = NULL;
+    g_metrics.listen_fd = -1;
+    g_metrics.wake_pipe[0] = g_metrics.wake_pipe[1] = -1;
+    pthread_mutex_unlock(&g_metrics.lock);
 }
 
 // ============================================================
-// FUSE operations table
+// Startup timeline API implementation
 // ============================================================
-static struct fuse_operations dmsa_oper = {
-    .getattr     = dmsa_getattr,
-    .readdir     = dmsa_readdir,
-    .open        = dmsa_open,
-    .read        = dmsa_read,
-    .write       = dmsa_write,
-    .release     = dmsa_release,
-    .create      = dmsa_create,
-    .unlink      = dmsa_unlink,
-    .mkdir       = dmsa_mkdir,
-    .rmdir       = dmsa_rmdir,
-    .rename      = dmsa_rename,
-    .truncate    = dmsa_truncate,
-    .chmod       = dmsa_chmod,
-    .chown       = dmsa_chown,
-    .utimens     = dmsa_utimens,
-    .statfs      = dmsa_statfs,
-    .readlink    = dmsa_readlink,
-    .symlink     = dmsa_symlink,
-    .access      = dmsa_access,
-    .getxattr    = dmsa_getxattr,
-    .setxattr    = dmsa_setxattr,
-    .listxattr   = dmsa_listxattr,
-    .removexattr = dmsa_removexattr,
+
+static struct {
+    FuseTimelinePhase phases[FUSE_TIMELINE_MAX_PHASES];
+    int count;
+    uint64_t origin_ns;             // Monotonic time of the first event (0 = unset)
+    pthread_mutex_t lock;
+} g_timeline = {
+    .count = 0,
+    .origin_ns = 0,
+    .lock = PTHREAD_MUTEX_INITIALIZER
 };
 
-// ============================================================
-// Public API implementation
-// ============================================================
+static uint64_t timeline_thread_id(void) {
+    uint64_t tid = 0;
+    pthread_threadid_np(NULL, &tid);
+    return tid;
+}
 
-int fuse_wrapper_mount(const char *mount_path, const char *local_dir, const char *external_dir) {
-    if (!mount_path || !local_dir) {
-        return FUSE_WRAPPER_ERR_INVALID_ARG;
-    }
+// Caller holds g_timeline.lock
+static int timeline_add_locked(const char *category, const char *name, int instant) {
+    if (g_timeline.count >= FUSE_TIMELINE_MAX_PHASES) return -1;
+
+    uint64_t now = monotonic_ns();
+    if (g_timeline.origin_ns == 0) g_timeline.origin_ns = now;
+
+    int id = g_timeline.count++;
+    FuseTimelinePhase *ph = &g_timeline.phases[id];
+    memset(ph, 0, sizeof(*ph));
+    snprintf(ph->name, sizeof(ph->name), "%s", name ? name : "?");
+    snprintf(ph->category, sizeof(ph->category), "%s", category ? category : "misc");
+    ph->start_ns = now - g_timeline.origin_ns;
+    ph->thread_id = timeline_thread_id();
+    ph->instant = instant;
+    if (instant) ph->end_ns = ph->start_ns;
+    return id;
+}
 
-    pthread_mutex_lock(&g_state.lock);
+int fuse_wrapper_timeline_begin(const char *category, const char *name) {
+    DMSA_LOCK(&g_timeline.lock, FUSE_LOCK_TIMELINE);
+    int id = timeline_add_locked(category, name, 0);
+    pthread_mutex_unlock(&g_timeline.lock);
+    return id;
+}
 
-    if (g_state.is_mounted) {
-        pthread_mutex_unlock(&g_state.lock);
-        return FUSE_WRAPPER_ERR_ALREADY_MOUNTED;
+void fuse_wrapper_timeline_end(int phase_id) {
+    if (phase_id < 0) return;
+    uint64_t now = monotonic_ns();
+    DMSA_LOCK(&g_timeline.lock, FUSE_LOCK_TIMELINE);
+    if (phase_id < g_timeline.count && g_timeline.phases[phase_id].end_ns == 0) {
+        uint64_t end = now - g_timeline.origin_ns;
+        FuseTimelinePhase *ph = &g_timeline.phases[phase_id];
+        // Keep end_ns non-zero so a phase shorter than 1ns still reads as closed
+        ph->end_ns = end > ph->start_ns ? end : ph->start_ns + 1;
+    }
+    pthread_mutex_unlock(&g_timeline.lock);
+}
+
+void fuse_wrapper_timeline_mark(const char *category, const char *name) {
+    DMSA_LOCK(&g_timeline.lock, FUSE_LOCK_TIMELINE);
+    timeline_add_locked(category, name, 1);
+    pthread_mutex_unlock(&g_timeline.lock);
+}
+
+void fuse_wrapper_timeline_reset(void) {
+    DMSA_LOCK(&g_timeline.lock, FUSE_LOCK_TIMELINE);
+    g_timeline.count = 0;
+    g_timeline.origin_ns = 0;
+    pthread_mutex_unlock(&g_timeline.lock);
+}
+
+int fuse_wrapper_timeline_get(FuseTimelinePhase *out, int max) {
+    if (!out || max <= 0) return 0;
+    DMSA_LOCK(&g_timeline.lock, FUSE_LOCK_TIMELINE);
+    int n = g_timeline.count < max ? g_timeline.count : max;
+    memcpy(out, g_timeline.phases, (size_t)n * sizeof(out[0]));
+    pthread_mutex_unlock(&g_timeline.lock);
+    return n;
+}
+
+void fuse_wrapper_timeline_log_summary(void) {
+    FuseTimelinePhase *phases = malloc(sizeof(FuseTimelinePhase) * FUSE_TIMELINE_MAX_PHASES);
+    if (!phases) return;
+    int n = fuse_wrapper_timeline_get(phases, FUSE_TIMELINE_MAX_PHASES);
+
+    uint64_t last_ns = 0;
+    for (int i = 0; i < n; i++) {
+        uint64_t t = phases[i].end_ns ? phases[i].end_ns : phases[i].start_ns;
+        if (t > last_ns) last_ns = t;
+    }
+
+    LOG_INFO("Startup timeline: %d events over %.1f ms (offset / duration / phase)", n, (double)last_ns / 1e6);
+    for (int i = 0; i < n; i++) {
+        const FuseTimelinePhase *ph = &phases[i];
+
+        // Nest under earlier phases on the same thread that contain this one
+        int depth = 0;
+        for (int j = 0; j < i; j++) {
+            const FuseTimelinePhase *outer = &phases[j];
+            if (outer->instant || outer->thread_id != ph->thread_id) continue;
+            if (outer->start_ns <= ph->start_ns &&
+                (outer->end_ns == 0 || outer->end_ns >= (ph->end_ns ? ph->end_ns : ph->start_ns))) {
+                depth++;
+            }
+        }
+
+        char dur[32];
+        if (ph->instant) snprintf(dur, sizeof(dur), "mark");
+        else if (ph->end_ns == 0) snprintf(dur, sizeof(dur), "open");
+        else snprintf(dur, sizeof(dur), "%.1f ms", (double)(ph->end_ns - ph->start_ns) / 1e6);
+
+        LOG_INFO("  +%9.1f ms %12s  %*s%s/%s", (double)ph->start_ns / 1e6, dur,
+                 depth * 2, "", ph->category, ph->name);
     }
+    free(phases);
+}
 
-    // Save paths
-    g_state.mount_path = strdup(mount_path);
-    g_state.local_dir = strdup(local_dir);
-    g_state.external_dir = external_dir ? strdup(external_dir) : NULL;
-    g_state.external_offline = (external_dir == NULL);
+// Write s as a JSON string body (quotes not included)
+static void json_write_escaped(FILE *f, const char *s) {
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') fprintf(f, "\\%c", c);
+        else if (c < 0x20) fprintf(f, "\\u%04x", c);
+        else fputc(c, f);
+    }
+}
 
-    // Extract user uid/gid from mount point path
-    // Mount point is typically /Users/{username}/... format
-    // We need to get the owner of the user directory
-    struct stat parent_stat;
-    char *parent_path = strdup(mount_path);
-    // Try to get mount point parent directory owner
-    char *last_slash = strrchr(parent_path, '/');
-    if (last_slash && last_slash != parent_path) {
-        *last_slash = '\0';
-        if (stat(parent_path, &parent_stat) == 0) {
-            g_state.owner_uid = parent_stat.st_uid;
-            g_state.owner_gid = parent_stat.st_gid;
-            LOG_INFO("Got owner from parent dir: uid=%d, gid=%d", g_state.owner_uid, g_state.owner_gid);
+int fuse_wrapper_timeline_write_chrome_trace(const char *path) {
+    if (!path) return FUSE_WRAPPER_ERR_INVALID_ARG;
+
+    FuseTimelinePhase *phases = malloc(sizeof(FuseTimelinePhase) * FUSE_TIMELINE_MAX_PHASES);
+    if (!phases) return FUSE_WRAPPER_ERR_INVALID_ARG;
+    int n = fuse_wrapper_timeline_get(phases, FUSE_TIMELINE_MAX_PHASES);
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        LOG_ERROR("Cannot write timeline trace %s: errno=%d (%s)", path, errno, strerror(errno));
+        free(phases);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+
+    // Trace event format: ts/dur in microseconds; open phases become "B" events
+    int pid = (int)getpid();
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int i = 0; i < n; i++) {
+        const FuseTimelinePhase *ph = &phases[i];
+        fprintf(f, "%s{\"name\":\"", i ? ",\n" : "");
+        json_write_escaped(f, ph->name);
+        fprintf(f, "\",\"cat\":\"");
+        json_write_escaped(f, ph->category);
+        fprintf(f, "\",\"pid\":%d,\"tid\":%llu,\"ts\":%.3f", pid,
+                (unsigned long long)ph->thread_id, (double)ph->start_ns / 1e3);
+        if (ph->instant) {
+            fprintf(f, ",\"ph\":\"i\",\"s\":\"p\"}");
+        } else if (ph->end_ns == 0) {
+            fprintf(f, ",\"ph\":\"B\"}");
         } else {
-            // Fall back to local_dir owner
-            struct stat local_stat;
-            if (stat(local_dir, &local_stat) == 0) {
-                g_state.owner_uid = local_stat.st_uid;
-                g_state.owner_gid = local_stat.st_gid;
-                LOG_INFO("Got owner from local dir: uid=%d, gid=%d", g_state.owner_uid, g_state.owner_gid);
-            }
+            fprintf(f, ",\"ph\":\"X\",\"dur\":%.3f}", (double)(ph->end_ns - ph->start_ns) / 1e3);
         }
     }
-    free(parent_path);
+    fprintf(f, "\n]}\n");
 
-    pthread_mutex_unlock(&g_state.lock);
+    int failed = ferror(f);
+    if (fclose(f) != 0) failed = 1;
+    free(phases);
+    if (failed) {
+        LOG_ERROR("Timeline trace write failed: %s", path);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+    LOG_INFO("Timeline trace written: %s (%d events)", path, n);
+    return FUSE_WRAPPER_OK;
+}
 
-    LOG_INFO("Mounting FUSE filesystem:");
-    LOG_INFO("  Mount point: %s", mount_path);
-    LOG_INFO("  Local dir: %s", local_dir);
-    LOG_INFO("  External dir: %s", external_dir ? external_dir : "(offline)");
+// ============================================================
+// Restart handoff API implementation
+// ============================================================
+// File layout (native endianness, same machine only):
+//   HandoffHeader, local_dir, external_dir, then per tombstone a uint32
+//   length followed by the path bytes. Strings are not NUL-terminated.
 
-    // Build FUSE arguments - using simpler parameter set
-    char *mount_path_copy = strdup(mount_path);
-    char *volname = basename(mount_path_copy);
+#define HANDOFF_MAGIC   0x46484D44u     // "DMHF" little-endian
+#define HANDOFF_VERSION 1
 
-    char volname_opt[256];
-    snprintf(volname_opt, sizeof(volname_opt), "volname=%s", volname);
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t saved_ms;
+    int32_t writer_pid;
+    uint32_t tombstone_count;
+    uint32_t local_len;
+    uint32_t external_len;
+} HandoffHeader;
+
+static int handoff_write_string(FILE *f, const char *s, int with_len) {
+    uint32_t len = s ? (uint32_t)strlen(s) : 0;
+    if (with_len && fwrite(&len, sizeof(len), 1, f) != 1) return -1;
+    return len == 0 || fwrite(s, 1, len, f) == len ? 0 : -1;
+}
 
-    // Build mount options
-    // auto_xattr: let kernel handle xattr via AppleDouble (._ files), bypassing our callbacks
-    //             This allows fcopyfile() to work properly for cp/Finder copy operations
-    // local: indicates local filesystem (enables Finder features)
-    // entry_timeout/attr_timeout/negative_timeout: cache directory entries and attributes
-    //             Reduces kernel<->userspace round trips under heavy load
-    // daemon_timeout=0: disable idle timeout (prevent FUSE from exiting when idle)
-    // Note: We still implement setxattr/getxattr callbacks for non-Apple xattrs
-    char mount_opts[1024];
-    snprintf(mount_opts, sizeof(mount_opts),
-             "%s,allow_other,default_permissions,auto_xattr,local,"
-             "daemon_timeout=0,entry_timeout=1,attr_timeout=1,negative_timeout=1",
-             volname_opt);
+// Read len bytes into a new NUL-terminated string; NULL on short read
+static char* handoff_read_string(FILE *f, uint32_t len) {
+    if (len > PATH_MAX) return NULL;
+    char *s = malloc(len + 1);
+    if (!s) return NULL;
+    if (len > 0 && fread(s, 1, len, f) != len) {
+        free(s);
+        return NULL;
+    }
+    s[len] = '\0';
+    return s;
+}
 
-    LOG_INFO("Mount options: %s", mount_opts);
+int fuse_wrapper_handoff_save(const char *path) {
+    if (!path) return FUSE_WRAPPER_ERR_INVALID_ARG;
 
-    // Use fuse_mount + fuse_new + fuse_loop instead of fuse_main
-    // This avoids some internal issues with fuse_main
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    if (!g_state.local_dir) {
+        pthread_mutex_unlock(&g_state.lock);
+        return FUSE_WRAPPER_ERR_NOT_MOUNTED;
+    }
+    char *local_dir = strdup(g_state.local_dir);
+    char *external_dir = g_state.external_dir ? strdup(g_state.external_dir) : NULL;
+    pthread_mutex_unlock(&g_state.lock);
 
-    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+    // Snapshot the set so file I/O happens without the lock
+    char *paths[PENDING_DELETE_SIZE];
+    int count = 0;
+    DMSA_LOCK(&g_pending_delete.lock, FUSE_LOCK_PENDING_DELETE);
+    for (int i = 0; i < g_pending_delete.count; i++) {
+        if (g_pending_delete.paths[i]) {
+            char *copy = strdup(g_pending_delete.paths[i]);
+            if (copy) paths[count++] = copy;
+        }
+    }
+    pthread_mutex_unlock(&g_pending_delete.lock);
 
-    // Add mount options
-    if (fuse_opt_add_arg(&args, "dmsa") == -1 ||
-        fuse_opt_add_arg(&args, "-o") == -1 ||
-        fuse_opt_add_arg(&args, mount_opts) == -1) {
-        LOG_ERROR("fuse_opt_add_arg failed");
-        free(mount_path_copy);
-        fuse_opt_free_args(&args);
-        return FUSE_WRAPPER_ERR_MOUNT_FAILED;
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    int failed = 0;
+    FILE *f = fopen(tmp_path, "wb");
+    if (!f) {
+        failed = 1;
+    } else {
+        HandoffHeader header = {
+            .magic = HANDOFF_MAGIC,
+            .version = HANDOFF_VERSION,
+            .saved_ms = wall_clock_ms(),
+            .writer_pid = (int32_t)getpid(),
+            .tombstone_count = (uint32_t)count,
+            .local_len = (uint32_t)strlen(local_dir),
+            .external_len = external_dir ? (uint32_t)strlen(external_dir) : 0,
+        };
+        if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+            handoff_write_string(f, local_dir, 0) != 0 ||
+            handoff_write_string(f, external_dir, 0) != 0) {
+            failed = 1;
+        }
+        for (int i = 0; i < count && !failed; i++) {
+            if (handoff_write_string(f, paths[i], 1) != 0) failed = 1;
+        }
+        if (ferror(f)) failed = 1;
+        if (fclose(f) != 0) failed = 1;
+        if (!failed && rename(tmp_path, path) != 0) failed = 1;
+        if (failed) unlink(tmp_path);
     }
 
-    LOG_INFO("Calling fuse_mount...");
+    for (int i = 0; i < count; i++) free(paths[i]);
+    free(local_dir);
+    free(external_dir);
 
-    // Mount
-    g_state.chan = fuse_mount(mount_path, &args);
-    if (!g_state.chan) {
-        LOG_ERROR("fuse_mount failed! errno=%d (%s)", errno, strerror(errno));
-        free(mount_path_copy);
-        fuse_opt_free_args(&args);
+    if (failed) {
+        LOG_ERROR("Handoff save failed: %s, errno=%d (%s)", path, errno, strerror(errno));
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+    LOG_INFO("Handoff saved: %s (%d tombstones)", path, count);
+    return count;
+}
 
-        pthread_mutex_lock(&g_state.lock);
-        free(g_state.mount_path);
-        free(g_state.local_dir);
-        if (g_state.external_dir) free(g_state.external_dir);
-        g_state.mount_path = NULL;
-        g_state.local_dir = NULL;
-        g_state.external_dir = NULL;
-        pthread_mutex_unlock(&g_state.lock);
+// Retry the EXTERNAL half of a delete; returns 1 if the tombstone is resolved
+static int handoff_retry_delete(const char *vpath, const char *local_dir, const char *external_dir) {
+    struct stat st;
 
-        return FUSE_WRAPPER_ERR_FUSE_MOUNT_FAILED;
+    // Re-created on LOCAL since the delete: the tombstone no longer applies
+    char *local = join_path(local_dir, vpath);
+    int local_exists = local && lstat(local, &st) == 0;
+    free(local);
+    if (local_exists) return 1;
+
+    if (!external_dir) return 0;
+    char *external = join_path(external_dir, vpath);
+    if (!external) return 0;
+
+    int resolved = 0;
+    if (lstat(external, &st) != 0) {
+        resolved = (errno == ENOENT);
+    } else {
+        int res = S_ISDIR(st.st_mode) ? rmdir(external) : unlink(external);
+        resolved = (res == 0 || errno == ENOENT);
+        if (!resolved) {
+            LOG_WARN("Handoff: EXTERNAL delete still failing: %s, errno=%d", external, errno);
+        }
     }
+    free(external);
+    return resolved;
+}
 
-    LOG_INFO("fuse_mount succeeded, calling fuse_new...");
+int fuse_wrapper_handoff_restore(const char *path, const char *local_dir, const char *external_dir) {
+    if (!path || !local_dir) return FUSE_WRAPPER_ERR_INVALID_ARG;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    // Consumed either way: a file that does not apply now never will
+    unlink(path);
+
+    HandoffHeader header;
+    char *saved_local = NULL;
+    char *saved_external = NULL;
+    int result = FUSE_WRAPPER_ERR_INVALID_ARG;
+
+    if (fread(&header, sizeof(header), 1, f) != 1 ||
+        header.magic != HANDOFF_MAGIC || header.version != HANDOFF_VERSION ||
+        header.tombstone_count > PENDING_DELETE_SIZE) {
+        LOG_WARN("Handoff file invalid, ignored: %s", path);
+        goto done;
+    }
+    saved_local = handoff_read_string(f, header.local_len);
+    saved_external = handoff_read_string(f, header.external_len);
+    if (!saved_local || !saved_external) {
+        LOG_WARN("Handoff file truncated, ignored: %s", path);
+        goto done;
+    }
+
+    // An empty saved EXTERNAL means it was offline; any EXTERNAL now is fine
+    if (strcmp(saved_local, local_dir) != 0 ||
+        (saved_external[0] && external_dir && strcmp(saved_external, external_dir) != 0)) {
+        LOG_WARN("Handoff file is for another mount (%s), ignored", saved_local);
+        goto done;
+    }
+
+    int pending = 0;
+    int resolved = 0;
+    for (uint32_t i = 0; i < header.tombstone_count; i++) {
+        uint32_t len;
+        char *vpath = NULL;
+        if (fread(&len, sizeof(len), 1, f) != 1 || !(vpath = handoff_read_string(f, len))) {
+            LOG_WARN("Handoff file truncated after %u tombstones", i);
+            break;
+        }
+        if (vpath[0] == '/' && handoff_retry_delete(vpath, local_dir, external_dir)) {
+            resolved++;
+        } else if (vpath[0] == '/') {
+            pending_delete_add(vpath);
+            pending++;
+        }
+        free(vpath);
+    }
 
-    // Create FUSE instance
-    g_state.fuse = fuse_new(g_state.chan, &args, &dmsa_oper, sizeof(dmsa_oper), NULL);
-    fuse_opt_free_args(&args);
+    LOG_INFO("Handoff restored from pid %d (saved %llums ago): %d tombstones resolved, %d still pending",
+             header.writer_pid, (unsigned long long)(wall_clock_ms() - header.saved_ms),
+             resolved, pending);
+    result = pending;
 
-    if (!g_state.fuse) {
-        LOG_ERROR("fuse_new failed! errno=%d (%s)", errno, strerror(errno));
-        fuse_unmount(mount_path, g_state.chan);
-        free(mount_path_copy);
+done:
+    free(saved_local);
+    free(saved_external);
+    fclose(f);
+    return result;
+}
 
-        pthread_mutex_lock(&g_state.lock);
-        g_state.chan = NULL;
-        free(g_state.mount_path);
-        free(g_state.local_dir);
-        if (g_state.external_dir) free(g_state.external_dir);
-        g_state.mount_path = NULL;
-        g_state.local_dir = NULL;
-        g_state.external_dir = NULL;
-        pthread_mutex_unlock(&g_state.lock);
+// ============================================================
+// Tier demotion (evict) API implementation
+// ============================================================
+// Per file: the sync lock blocks write/unlink/truncate, the evicting mark
+// sends resolution to EXTERNAL and refuses write opens (no copy-up can
+// slip in), then LOCAL is verified against EXTERNAL and unlinked. Files
+// with a handle open for writing are skipped: the descriptor would keep
+// writing to the unlinked inode.
 
-        return FUSE_WRAPPER_ERR_FUSE_NEW_FAILED;
+#define EVICT_BATCH 256
+
+// Demote one file; 0 with *freed set, or -errno
+static int evict_one(const char *path, int64_t *freed) {
+    *freed = 0;
+    if (path[0] != '/' || check_path_depth(path) != 0) return -EINVAL;
+    if (syncing_files_contains(path)) return -EBUSY;  // Sync or another eviction owns it
+
+    char *local = get_local_path(path);
+    char *external = get_external_path(path);
+    if (!local || !external) {
+        free(local);
+        free(external);
+        return local ? -EIO : -EINVAL;  // EXTERNAL offline
     }
 
-    pthread_mutex_lock(&g_state.lock);
-    g_state.is_mounted = 1;
-    pthread_mutex_unlock(&g_state.lock);
+    fuse_wrapper_sync_lock(path);
+    if (evicting_add(path) != 0) {
+        fuse_wrapper_sync_unlock(path);
+        free(local);
+        free(external);
+        return -EBUSY;
+    }
 
-    LOG_INFO("FUSE mount successful! Starting event loop...");
-    LOG_INFO("  File owner UID: %d, GID: %d", g_state.owner_uid, g_state.owner_gid);
+    struct stat lst, est;
+    int res = 0;
+    if (fuse_wrapper_is_open_for_write(path)) {
+        res = -EBUSY;
+    } else if (lstat(local, &lst) != 0) {
+        res = -errno;
+    } else if (!S_ISREG(lst.st_mode)) {
+        res = S_ISDIR(lst.st_mode) ? -EISDIR : -EINVAL;
+    } else if ((res = ext_stat(external, &est)) != 0) {
+        if (res == -ENOENT) res = -ESTALE;
+    } else if (!S_ISREG(est.st_mode) || est.st_size != lst.st_size ||
+               STAT_MTIME_NS(&est) < STAT_MTIME_NS(&lst)) {
+        // Not synced, or LOCAL changed after the last sync
+        res = -ESTALE;
+    } else {
+        // Partial residency: keep the head/tail before LOCAL goes away
+        int64_t stub_bytes = stub_create(path, local, &est);
+        if (stub_bytes < 0) {
+            LOG_WARN("evict: no stub for %s: %s", path, strerror((int)-stub_bytes));
+            stub_bytes = 0;
+        }
+        if (unlink(local) != 0) {
+            res = -errno;
+            stub_remove(path, 0);
+        } else {
+            *freed = (int64_t)lst.st_blocks * 512 - stub_bytes;
+        }
+    }
 
-    free(mount_path_copy);
+    fuse_wrapper_unmark_evicting(path);
+    fuse_wrapper_sync_unlock(path);
+    free(local);
+    free(external);
+    return res;
+}
 
-    // Install signal handlers for exit diagnostics
-    g_last_signal = 0;
-    g_total_ops = 0;
-    g_last_op_time = time(NULL);
-    install_signal_handlers();
+int fuse_wrapper_evict(const char *const *virtual_paths, int count,
+                       FuseEvictCallback callback, void *context) {
+    if ((!virtual_paths && count > 0) || count < 0) return FUSE_WRAPPER_ERR_INVALID_ARG;
+    if (!g_state.local_dir) return FUSE_WRAPPER_ERR_NOT_MOUNTED;
+
+    FuseEvictResult results[EVICT_BATCH];
+    int evicted = 0;
+    int64_t total_freed = 0;
+    uint64_t t0 = monotonic_ns();
+
+    for (int start = 0; start < count; start += EVICT_BATCH) {
+        int n = count - start < EVICT_BATCH ? count - start : EVICT_BATCH;
+        int64_t batch_freed = 0;
+        for (int i = 0; i < n; i++) {
+            const char *path = virtual_paths[start + i];
+            FuseEvictResult *r = &results[i];
+            r->virtual_path = path;
+            r->status = path ? evict_one(path, &r->freed_bytes) : -EINVAL;
+            if (!path) r->freed_bytes = 0;
+            if (r->status == 0) {
+                evicted++;
+                batch_freed += r->freed_bytes;
+            } else {
+                LOG_DEBUG("evict: skipped %s: %s", path ? path : "(null)", strerror(-r->status));
+            }
+        }
+        total_freed += batch_freed;
+        if (callback) callback(results, n, batch_freed, context);
+    }
 
-    // Start async callback worker thread
-    start_callback_worker();
+    LOG_INFO("Evicted %d/%d files, freed %lld bytes in %.1f ms", evicted, count,
+             (long long)total_freed, (double)(monotonic_ns() - t0) / 1e6);
+    return evicted;
+}
 
-    // Pre-loop diagnostics
-    LOG_INFO("FUSE pre-loop state:");
-    LOG_INFO("  macFUSE devices: %d", check_macfuse_device());
-    LOG_INFO("  Channel: %s", g_state.chan ? "valid" : "NULL");
-    LOG_INFO("  Async callback queue: enabled (size=%d)", CALLBACK_QUEUE_SIZE);
+int fuse_wrapper_set_stub_dir(const char *dir) {
+    char *copy = NULL;
+    if (dir) {
+        if (mkdir(dir, 0700) != 0 && errno != EEXIST) {
+            LOG_WARN("Stub directory unavailable: %s: %s", dir, strerror(errno));
+            return FUSE_WRAPPER_ERR_INVALID_ARG;
+        }
+        copy = strdup(dir);
+        if (!copy) return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    // Mark loop as running
-    g_fuse_loop_running = 1;
+    DMSA_LOCK(&g_stubs.lock, FUSE_LOCK_STUBS);
+    char *old = g_stubs.dir;
+    g_stubs.dir = copy;
+    pthread_mutex_unlock(&g_stubs.lock);
+    free(old);
 
-    // Run FUSE event loop in MULTI-THREADED mode
-    // Critical for handling symlinks pointing back to VFS mount point
-    // Single-threaded mode deadlocks when readdir encounters such symlinks
-    LOG_INFO("Starting fuse_loop_mt (multi-threaded)...");
-    int result = fuse_loop_mt(g_state.fuse);
-    int saved_errno = errno;
+    LOG_INFO("Stub directory: %s", dir ? dir : "(off)");
+    return FUSE_WRAPPER_OK;
+}
 
-    // Mark loop as stopped
-    g_fuse_loop_running = 0;
+// ============================================================
+// File layout API implementation
+// ============================================================
 
-    // Stop callback worker thread
-    stop_callback_worker();
+int fuse_wrapper_preallocate(int fd, int64_t size) {
+    return file_preallocate(fd, size);
+}
 
-    // ---- Comprehensive post-exit diagnostics ----
-    collect_exit_diagnostics(mount_path, result, saved_errno);
+int fuse_wrapper_count_extents(int fd) {
+    return file_count_extents(fd);
+}
 
-    // Cleanup
-    fuse_destroy(g_state.fuse);
-    fuse_unmount(mount_path, g_state.chan);
+// ============================================================
+// Content-hash cache API implementation
+// ============================================================
 
-    pthread_mutex_lock(&g_state.lock);
+int fuse_wrapper_hash_cache_open(const char *path, uint32_t max_entries) {
+    if (!path || !*path || strlen(path) + 8 > PATH_MAX) return FUSE_WRAPPER_ERR_INVALID_ARG;
 
-    free(g_state.mount_path);
-    free(g_state.local_dir);
-    if (g_state.external_dir) free(g_state.external_dir);
+    uint32_t limit = max_entries ? max_entries : DEFAULT_HASH_CACHE_MAX_ENTRIES;
+    if (limit < HASH_CACHE_MIN_SLOTS) limit = HASH_CACHE_MIN_SLOTS;
+    while (limit & (limit - 1)) limit &= limit - 1;
 
-    g_state.mount_path = NULL;
-    g_state.local_dir = NULL;
-    g_state.external_dir = NULL;
-    g_state.is_mounted = 0;
-    g_state.fuse = NULL;
-    g_state.chan = NULL;
+    DMSA_LOCK(&g_hash_cache.lock, FUSE_LOCK_HASH_CACHE);
+    if (g_hash_cache.header && strcmp(g_hash_cache.path, path) == 0) {
+        g_hash_cache.max_entries = limit;
+        pthread_mutex_unlock(&g_hash_cache.lock);
+        return FUSE_WRAPPER_OK;
+    }
+    hash_cache_unmap_locked();
+    free(g_hash_cache.path);
+    g_hash_cache.path = NULL;
 
-    pthread_mutex_unlock(&g_state.lock);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        pthread_mutex_unlock(&g_hash_cache.lock);
+        LOG_ERROR("Hash cache: cannot open %s, errno=%d (%s)", path, errno, strerror(errno));
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    LOG_INFO("FUSE cleanup complete");
+    // Reuse the file only if its header matches its size exactly
+    HashCacheHeader existing;
+    struct stat st;
+    int reuse = fstat(fd, &st) == 0 &&
+                pread(fd, &existing, sizeof(existing), 0) == (ssize_t)sizeof(existing) &&
+                existing.magic == HASH_CACHE_MAGIC && existing.version == HASH_CACHE_VERSION &&
+                existing.slot_size == sizeof(HashCacheSlot) &&
+                existing.capacity >= HASH_CACHE_MIN_SLOTS &&
+                (existing.capacity & (existing.capacity - 1)) == 0 &&
+                (uint64_t)st.st_size == HASH_CACHE_HEADER_SIZE + (uint64_t)existing.capacity * sizeof(HashCacheSlot);
+    if (!reuse && st.st_size > 0) {
+        LOG_WARN("Hash cache: %s has an unknown layout, starting over", path);
+    }
+
+    size_t map_size = 0;
+    HashCacheHeader *header = hash_cache_map(fd, reuse ? existing.capacity : HASH_CACHE_MIN_SLOTS, !reuse, &map_size);
+    g_hash_cache.path = header ? strdup(path) : NULL;
+    if (!header || !g_hash_cache.path) {
+        LOG_ERROR("Hash cache: cannot map %s, errno=%d (%s)", path, errno, strerror(errno));
+        if (header) munmap(header, map_size);
+        close(fd);
+        pthread_mutex_unlock(&g_hash_cache.lock);
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    return result == 0 ? FUSE_WRAPPER_OK : FUSE_WRAPPER_ERR_MOUNT_FAILED;
+    g_hash_cache.fd = fd;
+    g_hash_cache.header = header;
+    g_hash_cache.slots = (HashCacheSlot *)((char *)header + HASH_CACHE_HEADER_SIZE);
+    g_hash_cache.map_size = map_size;
+    g_hash_cache.max_entries = limit;
+    memset(&g_hash_cache.stats, 0, sizeof(g_hash_cache.stats));
+    g_hash_cache.stats.entries = header->entries;
+    g_hash_cache.stats.capacity = header->capacity;
+    pthread_mutex_unlock(&g_hash_cache.lock);
+
+    LOG_INFO("Hash cache: %s (%u/%u entries, limit %u)", path, header->entries, header->capacity, limit);
+    return FUSE_WRAPPER_OK;
 }
 
-int fuse_wrapper_unmount(void) {
-    pthread_mutex_lock(&g_state.lock);
+void fuse_wrapper_hash_cache_close(void) {
+    DMSA_LOCK(&g_hash_cache.lock, FUSE_LOCK_HASH_CACHE);
+    if (g_hash_cache.header) log_hash_cache_stats();
+    hash_cache_unmap_locked();
+    free(g_hash_cache.path);
+    g_hash_cache.path = NULL;
+    pthread_mutex_unlock(&g_hash_cache.lock);
+}
 
-    if (!g_state.is_mounted || !g_state.mount_path) {
-        pthread_mutex_unlock(&g_state.lock);
-        return FUSE_WRAPPER_ERR_NOT_MOUNTED;
+int fuse_wrapper_file_identity(int fd, FuseFileIdentity *out) {
+    struct stat st;
+    if (fd < 0 || !out || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
     }
+    out->dev = (uint64_t)st.st_dev;
+    out->ino = (uint64_t)st.st_ino;
+    out->size = (int64_t)st.st_size;
+    out->mtime_ns = STAT_MTIME_NS(&st);
+    out->ctime_ns = STAT_CTIME_NS(&st);
+    return FUSE_WRAPPER_OK;
+}
 
-    char *mount_path = strdup(g_state.mount_path);
-    pthread_mutex_unlock(&g_state.lock);
+int fuse_wrapper_hash_cache_lookup(const FuseFileIdentity *id, int algorithm, uint8_t *digest, int size) {
+    if (!id || algorithm < 1 || algorithm > 255 || !digest || size <= 0) return FUSE_WRAPPER_ERR_INVALID_ARG;
+
+    int len = 0;
+    DMSA_LOCK(&g_hash_cache.lock, FUSE_LOCK_HASH_CACHE);
+    if (g_hash_cache.header) {
+        g_hash_cache.stats.lookups++;
+        uint32_t capacity = g_hash_cache.header->capacity;
+        uint32_t home = hash_cache_home(id->dev, id->ino, capacity);
+        for (uint32_t i = 0; i < HASH_CACHE_PROBE; i++) {
+            const HashCacheSlot *s = &g_hash_cache.slots[(home + i) & (capacity - 1)];
+            if (!hash_cache_slot_valid(s) || s->dev != id->dev || s->ino != id->ino ||
+                s->algorithm != algorithm) {
+                continue;
+            }
+            // At most one entry per file; a different identity means it changed
+            if (s->size == id->size && s->mtime_ns == id->mtime_ns && s->ctime_ns == id->ctime_ns &&
+                s->digest_len <= size) {
+                memcpy(digest, s->digest, s->digest_len);
+                len = s->digest_len;
+                g_hash_cache.stats.hits++;
+            }
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_hash_cache.lock);
+    return len;
+}
 
-    LOG_INFO("Unmounting FUSE: %s", mount_path);
+int fuse_wrapper_hash_cache_store(const FuseFileIdentity *id, int algorithm, const uint8_t *digest, int len) {
+    if (!id || algorithm < 1 || algorithm > 255 || !digest || len < 1 || len > FUSE_HASH_MAX_DIGEST) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    // Clear pending delete set
-    pending_delete_clear();
+    uint64_t now_ms = wall_clock_ms();
+    int64_t changed_ns = id->mtime_ns > id->ctime_ns ? id->mtime_ns : id->ctime_ns;
+    int racy = (int64_t)now_ms * 1000000LL - changed_ns < HASH_CACHE_RACY_NS;
 
-    // Clear syncing files set
-    syncing_files_clear();
+    DMSA_LOCK(&g_hash_cache.lock, FUSE_LOCK_HASH_CACHE);
+    if (!g_hash_cache.header || racy) {
+        if (racy) g_hash_cache.stats.racy++;
+        pthread_mutex_unlock(&g_hash_cache.lock);
+        return 0;
+    }
 
-    // Use umount command to unmount
-    char cmd[1024];
-    snprintf(cmd, sizeof(cmd), "/sbin/umount '%s'", mount_path);
-    int result = system(cmd);
+    HashCacheHeader *header = g_hash_cache.header;
+    if (header->entries >= header->capacity / 4 * 3 && header->capacity < g_hash_cache.max_entries) {
+        hash_cache_grow_locked();
+        header = g_hash_cache.header;
+    }
 
-    free(mount_path);
+    int replaced;
+    HashCacheSlot *s = hash_cache_find_slot(g_hash_cache.slots, header->capacity, id->dev, id->ino,
+                                            (uint8_t)algorithm, &replaced);
+    if (replaced) {
+        g_hash_cache.stats.replaced++;
+    } else if (!hash_cache_slot_valid(s)) {
+        header->entries++;
+    }
 
-    return result == 0 ? FUSE_WRAPPER_OK : FUSE_WRAPPER_ERR_MOUNT_FAILED;
+    HashCacheSlot slot = {
+        .dev = id->dev,
+        .ino = id->ino,
+        .size = id->size,
+        .mtime_ns = id->mtime_ns,
+        .ctime_ns = id->ctime_ns,
+        .stored_min = (uint32_t)(now_ms / 60000),
+        .algorithm = (uint8_t)algorithm,
+        .digest_len = (uint8_t)len,
+    };
+    memcpy(slot.digest, digest, (size_t)len);
+    slot.check = hash_cache_check(&slot);
+    *s = slot;
+
+    g_hash_cache.stats.stores++;
+    g_hash_cache.stats.entries = header->entries;
+    pthread_mutex_unlock(&g_hash_cache.lock);
+    return 1;
 }
 
-int fuse_wrapper_is_mounted(void) {
-    pthread_mutex_lock(&g_state.lock);
-    int result = g_state.is_mounted;
-    pthread_mutex_unlock(&g_state.lock);
-    return result;
+void fuse_wrapper_get_hash_cache_stats(FuseHashCacheStats *stats) {
+    if (!stats) return;
+    DMSA_LOCK(&g_hash_cache.lock, FUSE_LOCK_HASH_CACHE);
+    *stats = g_hash_cache.stats;
+    pthread_mutex_unlock(&g_hash_cache.lock);
 }
 
-void fuse_wrapper_update_external_dir(const char *external_dir) {
-    pthread_mutex_lock(&g_state.lock);
+// ============================================================
+// Runtime tunables API implementation
+// ============================================================
 
-    if (g_state.external_dir) {
-        free(g_state.external_dir);
+static const struct {
+    const char *name;
+    int64_t default_value;
+    int64_t min_value;
+    int64_t max_value;
+} g_tunable_defs[FUSE_TUNABLE_COUNT] = {
+    [FUSE_TUNABLE_MAX_OPEN_FILES]       = { "max_open_files", DEFAULT_MAX_CONCURRENT_OPENS, 16, 65536 },
+    [FUSE_TUNABLE_CALLBACK_QUEUE_SIZE]  = { "callback_queue_size", CALLBACK_QUEUE_SIZE, 64, 32768 },
+    [FUSE_TUNABLE_READDIR_MAX_ENTRIES]  = { "readdir_max_entries", DEFAULT_READDIR_MAX_ENTRIES, 256, 1048576 },
+    [FUSE_TUNABLE_BACKGROUND_SLOTS]     = { "background_slots", DEFAULT_BACKGROUND_SLOTS, 1, 256 },
+    [FUSE_TUNABLE_SLOW_OP_THRESHOLD_MS] = { "slow_op_threshold_ms", DEFAULT_SLOW_OP_THRESHOLD_MS, 0, 600000 },
+    [FUSE_TUNABLE_SHM_INTERVAL_MS]      = { "shm_interval_ms", DEFAULT_SHM_PUBLISH_INTERVAL_MS, 50, 60000 },
+    [FUSE_TUNABLE_WRITE_BUFFER_SIZE]    = { "write_buffer_size", DEFAULT_WRITE_BUFFER_SIZE, 0, 1024 * 1024 },
+    [FUSE_TUNABLE_STREAM_MIN_SIZE]      = { "stream_min_size", DEFAULT_STREAM_MIN_SIZE, 0, 1LL << 50 },
+    [FUSE_TUNABLE_EXTERNAL_IO_DEPTH]    = { "external_io_depth", DEFAULT_EXT_IO_DEPTH, 0, EXT_IO_THREADS },
+    [FUSE_TUNABLE_EXTERNAL_TIMEOUT_MS]  = { "external_timeout_ms", DEFAULT_EXT_IO_TIMEOUT_MS, 0, 600000 },
+    [FUSE_TUNABLE_STUB_HEAD_SIZE]       = { "stub_head_size", 0, 0, 64 * 1024 * 1024 },
+    [FUSE_TUNABLE_STUB_TAIL_SIZE]       = { "stub_tail_size", 0, 0, 64 * 1024 * 1024 },
+    [FUSE_TUNABLE_STUB_MIN_SIZE]        = { "stub_min_size", DEFAULT_STUB_MIN_SIZE, 0, 1LL << 50 },
+    [FUSE_TUNABLE_PLACEMENT_MAX_LOCAL_SIZE] = { "placement_max_local_size", 0, 0, 1LL << 50 },
+    [FUSE_TUNABLE_PLACEMENT_MIN_LOCAL_FREE] = { "placement_min_local_free", 0, 0, 1LL << 50 },
+};
+
+// Reallocate the callback ring, keeping the newest pending items that fit
+static int callback_queue_resize(int capacity) {
+    CallbackItem *items = calloc((size_t)capacity, sizeof(CallbackItem));
+    if (!items) return -1;
+
+    DMSA_LOCK(&g_callback_queue.lock, FUSE_LOCK_CALLBACK_QUEUE);
+    CallbackItem *old = g_callback_queue.items;
+    int old_capacity = g_callback_queue.capacity;
+    int pending = old ? callback_queue_pending() : 0;
+    int keep = pending < capacity - 1 ? pending : capacity - 1;
+    int dropped = pending - keep;
+    for (int i = 0; i < keep; i++) {
+        items[i] = old[(g_callback_queue.tail + dropped + i) % old_capacity];
+    }
+    g_callback_queue.items = items;
+    g_callback_queue.capacity = capacity;
+    g_callback_queue.tail = 0;
+    g_callback_queue.head = keep;
+    if (dropped > 0) __sync_fetch_and_add(&g_cb_dropped, (uint64_t)dropped);
+    pthread_mutex_unlock(&g_callback_queue.lock);
+
+    free(old);
+    if (dropped > 0) {
+        LOG_WARN("Callback queue shrunk to %d, dropped %d oldest pending callbacks", capacity, dropped);
     }
+    return 0;
+}
 
-    g_state.external_dir = external_dir ? strdup(external_dir) : NULL;
-    g_state.external_offline = (external_dir == NULL);
+int fuse_wrapper_set_tunable(FuseTunable tunable, int64_t value) {
+    if (tunable < 0 || tunable >= FUSE_TUNABLE_COUNT ||
+        value < g_tunable_defs[tunable].min_value || value > g_tunable_defs[tunable].max_value) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    pthread_mutex_unlock(&g_state.lock);
+    switch (tunable) {
+        case FUSE_TUNABLE_MAX_OPEN_FILES:
+            g_max_open_files = (int)value;
+            break;
+        case FUSE_TUNABLE_CALLBACK_QUEUE_SIZE:
+            if (value != g_callback_queue.capacity && callback_queue_resize((int)value) != 0) {
+                return FUSE_WRAPPER_ERR_INVALID_ARG;
+            }
+            break;
+        case FUSE_TUNABLE_READDIR_MAX_ENTRIES:
+            g_readdir_max_entries = (int)value;
+            break;
+        case FUSE_TUNABLE_BACKGROUND_SLOTS:
+            fuse_wrapper_set_background_slots((int)value);
+            return FUSE_WRAPPER_OK;
+        case FUSE_TUNABLE_SLOW_OP_THRESHOLD_MS:
+            fuse_wrapper_set_slow_op_threshold_ms((uint32_t)value);
+            return FUSE_WRAPPER_OK;
+        case FUSE_TUNABLE_SHM_INTERVAL_MS:
+            DMSA_LOCK(&g_shm.lock, FUSE_LOCK_SHM);
+            g_shm.interval_ms = (uint32_t)value;
+            if (g_shm.seg) g_shm.seg->publish_interval_ms = (uint32_t)value;
+            pthread_cond_signal(&g_shm.cond);  // Re-arm the publisher's wait
+            pthread_mutex_unlock(&g_shm.lock);
+            break;
+        case FUSE_TUNABLE_WRITE_BUFFER_SIZE:
+            // Handles pick up the new size once their current buffer drains
+            g_write_buffer_size = (int)value;
+            break;
+        case FUSE_TUNABLE_STREAM_MIN_SIZE:
+            g_stream_min_size = value;
+            break;
+        case FUSE_TUNABLE_EXTERNAL_IO_DEPTH:
+            DMSA_LOCK(&g_ext_io.lock, FUSE_LOCK_EXT_IO);
+            g_ext_io_depth = (int)value;
+            pthread_cond_broadcast(&g_ext_io.work);  // Raised depth or bypass: idle workers may start
+            pthread_mutex_unlock(&g_ext_io.lock);
+            break;
+        case FUSE_TUNABLE_EXTERNAL_TIMEOUT_MS:
+            g_ext_io_timeout_ms = (int)value;
+            break;
+        case FUSE_TUNABLE_STUB_HEAD_SIZE:
+            g_stub_head_size = value;
+            break;
+        case FUSE_TUNABLE_STUB_TAIL_SIZE:
+            g_stub_tail_size = value;
+            break;
+        case FUSE_TUNABLE_STUB_MIN_SIZE:
+            g_stub_min_size = value;
+            break;
+        case FUSE_TUNABLE_PLACEMENT_MAX_LOCAL_SIZE:
+            // Files already created keep the policy they were created under
+            g_place_max_local_size = value;
+            break;
+        case FUSE_TUNABLE_PLACEMENT_MIN_LOCAL_FREE:
+            g_place_min_local_free = value;
+            g_place.local_free_ns = 0;  // Resample on the next write
+            break;
+        default:
+            return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    LOG_INFO("External dir updated: %s", external_dir ? external_dir : "(offline)");
+    LOG_INFO("Tunable %s = %lld", g_tunable_defs[tunable].name, (long long)value);
+    return FUSE_WRAPPER_OK;
 }
 
-void fuse_wrapper_set_external_offline(bool offline) {
-    pthread_mutex_lock(&g_state.lock);
-    g_state.external_offline = offline;
-    pthread_mutex_unlock(&g_state.lock);
-
-    LOG_INFO("External storage state: %s", offline ? "offline" : "online");
+int64_t fuse_wrapper_get_tunable(FuseTunable tunable) {
+    switch (tunable) {
+        case FUSE_TUNABLE_MAX_OPEN_FILES:       return g_max_open_files;
+        case FUSE_TUNABLE_CALLBACK_QUEUE_SIZE:  return g_callback_queue.capacity;
+        case FUSE_TUNABLE_READDIR_MAX_ENTRIES:  return g_readdir_max_entries;
+        case FUSE_TUNABLE_BACKGROUND_SLOTS:     return g_clients.background_slots;
+        case FUSE_TUNABLE_SLOW_OP_THRESHOLD_MS: return g_slow_ops.stats.threshold_ms;
+        case FUSE_TUNABLE_SHM_INTERVAL_MS:      return g_shm.interval_ms;
+        case FUSE_TUNABLE_WRITE_BUFFER_SIZE:    return g_write_buffer_size;
+        case FUSE_TUNABLE_STREAM_MIN_SIZE:      return g_stream_min_size;
+        case FUSE_TUNABLE_EXTERNAL_IO_DEPTH:    return g_ext_io_depth;
+        case FUSE_TUNABLE_EXTERNAL_TIMEOUT_MS:  return g_ext_io_timeout_ms;
+        case FUSE_TUNABLE_STUB_HEAD_SIZE:       return g_stub_head_size;
+        case FUSE_TUNABLE_STUB_TAIL_SIZE:       return g_stub_tail_size;
+        case FUSE_TUNABLE_STUB_MIN_SIZE:        return g_stub_min_size;
+        case FUSE_TUNABLE_PLACEMENT_MAX_LOCAL_SIZE: return g_place_max_local_size;
+        case FUSE_TUNABLE_PLACEMENT_MIN_LOCAL_FREE: return g_place_min_local_free;
+        default:                                return -1;
+    }
 }
 
-void fuse_wrapper_set_readonly(bool readonly) {
-    pthread_mutex_lock(&g_state.lock);
-    g_state.readonly = readonly;
-    pthread_mutex_unlock(&g_state.lock);
+int fuse_wrapper_get_tunable_info(FuseTunable tunable, FuseTunableInfo *out) {
+    if (!out || tunable < 0 || tunable >= FUSE_TUNABLE_COUNT) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
+    out->name = g_tunable_defs[tunable].name;
+    out->value = fuse_wrapper_get_tunable(tunable);
+    out->default_value = g_tunable_defs[tunable].default_value;
+    out->min_value = g_tunable_defs[tunable].min_value;
+    out->max_value = g_tunable_defs[tunable].max_value;
+    return FUSE_WRAPPER_OK;
+}
 
-    LOG_INFO("Read-only mode: %s", readonly ? "yes" : "no");
+int fuse_wrapper_tunable_from_name(const char *name) {
+    if (!name) return -1;
+    for (int i = 0; i < FUSE_TUNABLE_COUNT; i++) {
+        if (strcmp(g_tunable_defs[i].name, name) == 0) return i;
+    }
+    return -1;
 }
 
-void fuse_wrapper_set_index_ready(bool ready) {
-    pthread_mutex_lock(&g_state.lock);
-    int was_ready = g_state.index_ready;
-    g_state.index_ready = ready;
-    pthread_mutex_unlock(&g_state.lock);
+int fuse_wrapper_set_exclude_patterns(const char *const *patterns, int count) {
+    if (!patterns || count < 0) count = 0;
+    if (count > MAX_EXCLUDE_PATTERNS) {
+        LOG_WARN("Exclude patterns: %d given, keeping the first %d", count, MAX_EXCLUDE_PATTERNS);
+        count = MAX_EXCLUDE_PATTERNS;
+    }
 
-    // Reset log flag to allow printing on next state change
-    if (ready && !was_ready) {
-        index_not_ready_logged = 0;
-        LOG_INFO("*** Index ready, VFS access open ***");
-    } else if (!ready && was_ready) {
-        LOG_INFO("Index marked not ready, VFS blocking access");
+    DMSA_LOCK(&g_exclude.lock, FUSE_LOCK_EXCLUDE);
+    for (int i = 0; i < g_exclude.count; i++) {
+        free(g_exclude.patterns[i]);
+        g_exclude.patterns[i] = NULL;
     }
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (patterns[i] && patterns[i][0] && (g_exclude.patterns[n] = strdup(patterns[i]))) n++;
+    }
+    g_exclude.count = n;
+    pthread_mutex_unlock(&g_exclude.lock);
+
+    LOG_INFO("Exclude patterns: %d installed", n);
+    return n;
 }
 
-int fuse_wrapper_is_index_ready(void) {
-    pthread_mutex_lock(&g_state.lock);
-    int result = g_state.index_ready;
-    pthread_mutex_unlock(&g_state.lock);
-    return result;
+int fuse_wrapper_set_write_through_dirs(const char *const *dirs, int count) {
+    if (!dirs || count < 0) count = 0;
+    if (count > MAX_TEE_DIRS) {
+        LOG_WARN("Write-through dirs: %d given, keeping the first %d", count, MAX_TEE_DIRS);
+        count = MAX_TEE_DIRS;
+    }
+
+    DMSA_LOCK(&g_tee_dirs.lock, FUSE_LOCK_TEE);
+    for (int i = 0; i < g_tee_dirs.count; i++) {
+        free(g_tee_dirs.dirs[i]);
+        g_tee_dirs.dirs[i] = NULL;
+    }
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        if (!dirs[i] || dirs[i][0] != '/') continue;
+        size_t len = strlen(dirs[i]);
+        while (len > 1 && dirs[i][len - 1] == '/') len--;
+        if ((g_tee_dirs.dirs[n] = strndup(dirs[i], len))) n++;
+    }
+    g_tee_dirs.count = n;
+    pthread_mutex_unlock(&g_tee_dirs.lock);
+
+    LOG_INFO("Write-through dirs: %d installed", n);
+    return n;
 }
 
-const char* fuse_wrapper_error_string(int error) {
-    switch (error) {
-        case FUSE_WRAPPER_OK:
-            return "Success";
-        case FUSE_WRAPPER_ERR_INVALID_ARG:
-            return "Invalid argument";
-        case FUSE_WRAPPER_ERR_ALREADY_MOUNTED:
-            return "Already mounted";
-        case FUSE_WRAPPER_ERR_NOT_MOUNTED:
-            return "Not mounted";
-        case FUSE_WRAPPER_ERR_MOUNT_FAILED:
-            return "Mount failed";
-        case FUSE_WRAPPER_ERR_FUSE_NEW_FAILED:
-            return "fuse_new failed";
-        case FUSE_WRAPPER_ERR_FUSE_MOUNT_FAILED:
-            return "fuse_mount failed";
-        default:
-            return "Unknown error";
+// Log current tunable values, flagging changed ones (shared by exit diagnostics and on-demand dump)
+static void log_tunables(void) {
+    for (int i = 0; i < FUSE_TUNABLE_COUNT; i++) {
+        int64_t value = fuse_wrapper_get_tunable((FuseTunable)i);
+        LOG_INFO("  tunable %-22s %lld%s", g_tunable_defs[i].name, (long long)value,
+                 value == g_tunable_defs[i].default_value ? "" : " (changed)");
+    }
+    if (g_exclude.count > 0) {
+        LOG_INFO("  extra exclude patterns: %d", g_exclude.count);
     }
 }
 
+#ifdef DMSA_FUSE_TEST_HOOKS
 // ============================================================
-// Diagnostics API implementation
+// Test hooks - drive handlers in-process without a kernel mount
 // ============================================================
 
-void fuse_wrapper_get_diagnostics(FuseDiagnostics *diag) {
-    if (!diag) return;
+int fuse_wrapper_test_attach(const char *local_dir, const char *external_dir) {
+    if (!local_dir) {
+        return FUSE_WRAPPER_ERR_INVALID_ARG;
+    }
 
-    pthread_mutex_lock(&g_state.lock);
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
 
-    diag->is_mounted = g_state.is_mounted;
-    diag->is_loop_running = g_fuse_loop_running;
-    diag->channel_fd = g_state.chan ? 1 : -1;  // 1 means valid channel, -1 means NULL
-    diag->total_ops = g_total_ops;
-    diag->last_op_time = g_last_op_time;
-    diag->last_signal = (int)g_last_signal;
+    if (g_state.is_mounted || g_state.local_dir) {
+        pthread_mutex_unlock(&g_state.lock);
+        return FUSE_WRAPPER_ERR_ALREADY_MOUNTED;
+    }
+
+    g_state.local_dir = strdup(local_dir);
+    g_state.external_dir = external_dir ? strdup(external_dir) : NULL;
+    g_state.external_offline = (external_dir == NULL);
+    g_state.owner_uid = getuid();
+    g_state.owner_gid = getgid();
 
     pthread_mutex_unlock(&g_state.lock);
 
-    // Callback queue statistics
-    diag->cb_queued = g_cb_queued;
-    diag->cb_processed = g_cb_processed;
-    diag->cb_dropped = g_cb_dropped;
-    diag->cb_pending = (g_callback_queue.head - g_callback_queue.tail + CALLBACK_QUEUE_SIZE) % CALLBACK_QUEUE_SIZE;
+    g_total_ops = 0;
+    g_last_op_time = time(NULL);
+    fuse_wrapper_reset_hot_stats();
+    fuse_wrapper_reset_client_stats();
+    slow_ops_reset();
+    op_stats_reset();
+    start_callback_worker();
 
-    // Check macFUSE device count (outside lock to avoid blocking)
-    diag->macfuse_dev_count = check_macfuse_device();
+    LOG_INFO("Test attach: local=%s, external=%s", local_dir, external_dir ? external_dir : "(offline)");
+    return FUSE_WRAPPER_OK;
 }
 
-int fuse_wrapper_is_loop_running(void) {
-    return g_fuse_loop_running;
+void fuse_wrapper_test_detach(void) {
+    // Placement workers outlive release and still use the tier dirs
+    while (__sync_fetch_and_add(&g_place.running, 0) > 0) usleep(1000);
+    stop_callback_worker();
+
+    pending_delete_clear();
+    syncing_files_clear();
+    fuse_wrapper_clear_evicting();
+    fuse_wrapper_reset_hot_stats();
+    fuse_wrapper_reset_client_stats();
+    slow_ops_reset();
+    op_stats_reset();
+
+    DMSA_LOCK(&g_state.lock, FUSE_LOCK_STATE);
+    free(g_state.local_dir);
+    if (g_state.external_dir) free(g_state.external_dir);
+    g_state.local_dir = NULL;
+    g_state.external_dir = NULL;
+    g_state.index_ready = 0;
+    pthread_mutex_unlock(&g_state.lock);
+
+    LOG_INFO("Test detach complete");
+}
+
+const struct fuse_operations *fuse_wrapper_test_operations(void) {
+    return &dmsa_oper;
 }
+#endif /* DMSA_FUSE_TEST_HOOKS */
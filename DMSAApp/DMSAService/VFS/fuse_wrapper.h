@@ -19,6 +19,8 @@
 #include <stdbool.h>
 #include <sys/stat.h>
 
+#include "fuse_shm.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -142,6 +144,16 @@ void fuse_wrapper_unmark_evicting(const char *virtual_path);
  */
 void fuse_wrapper_clear_evicting(void);
 
+/**
+ * Check whether any handle has a virtual path open for writing.
+ * Anything that replaces the LOCAL file (rather than writing into it) must
+ * skip open files: their descriptors would keep writing to the old inode.
+ *
+ * @param virtual_path Virtual path (e.g. "/folder/file.txt")
+ * @return 1 if open for writing, 0 if not
+ */
+int fuse_wrapper_is_open_for_write(const char *virtual_path);
+
 // ============================================================
 // Logging control API
 // ============================================================
@@ -207,6 +219,784 @@ void fuse_wrapper_get_diagnostics(FuseDiagnostics *diag);
  */
 int fuse_wrapper_is_loop_running(void);
 
+// ============================================================
+// Lock contention profiling API
+// ============================================================
+
+/**
+ * Global mutexes instrumented by the lock profiler
+ */
+typedef enum {
+    FUSE_LOCK_LOG = 0,            // g_log_mutex
+    FUSE_LOCK_EVICTING,           // g_evicting.lock
+    FUSE_LOCK_OPEN,               // g_open_mutex
+    FUSE_LOCK_STATE,              // g_state.lock
+    FUSE_LOCK_CALLBACK_QUEUE,     // g_callback_queue.lock
+    FUSE_LOCK_PENDING_DELETE,     // g_pending_delete.lock
+    FUSE_LOCK_SYNCING_FILES,      // g_syncing_files.lock
+    FUSE_LOCK_HOT,                // g_hot.lock
+    FUSE_LOCK_CLIENTS,            // g_clients.lock
+    FUSE_LOCK_SLOW_OPS,           // g_slow_ops.lock
+    FUSE_LOCK_SHM,                // g_shm.lock
+    FUSE_LOCK_METRICS,            // g_metrics.lock
+    FUSE_LOCK_TIMELINE,           // g_timeline.lock
+    FUSE_LOCK_EXCLUDE,            // g_exclude.lock
+    FUSE_LOCK_HANDLES,            // g_handles.lock and per-handle write buffer locks
+    FUSE_LOCK_CACHE_POLICY,       // g_cache_policy.lock
+    FUSE_LOCK_FLIGHT,             // g_flight.lock (single-flight table)
+    FUSE_LOCK_EXT_IO,             // g_ext_io.lock (EXTERNAL I/O executor)
+    FUSE_LOCK_STUBS,              // g_stubs.lock (partial residency stub directory)
+    FUSE_LOCK_TEE,                // g_tee_dirs.lock (write-through directories)
+    FUSE_LOCK_HASH_CACHE,         // g_hash_cache.lock (content-hash cache table)
+    FUSE_LOCK_COUNT
+} FuseLockId;
+
+#define FUSE_LOCK_TOP_SITES 4
+
+/**
+ * Per-lock contention statistics
+ */
+typedef struct {
+    char name[32];                // Lock name (e.g. "g_evicting")
+    uint64_t acquisitions;        // Total acquisitions while profiling
+    uint64_t contended;           // Acquisitions that had to wait
+    uint64_t total_wait_ns;       // Total time blocked
+    uint64_t max_wait_ns;         // Longest single wait
+    struct {
+        char site[48];            // Waiting function (empty if unused)
+        uint64_t waits;           // Contended acquisitions from this site
+        uint64_t wait_ns;         // Time blocked at this site
+    } top_sites[FUSE_LOCK_TOP_SITES];  // Sorted by wait_ns, descending
+} FuseLockStats;
+
+/**
+ * Extended diagnostics - base counters plus lock contention
+ */
+typedef struct {
+    FuseDiagnostics base;
+    int lock_profiling;           // 1 if the lock profiler is enabled
+    FuseLockStats locks[FUSE_LOCK_COUNT];
+} FuseDiagnosticsEx;
+
+/**
+ * Enable/disable lock contention profiling at runtime.
+ * Off by default; when off each lock costs one extra flag check.
+ *
+ * @param enabled 1 to enable, 0 to disable
+ */
+void fuse_wrapper_set_lock_profiling(int enabled);
+
+/**
+ * Reset all lock contention counters.
+ */
+void fuse_wrapper_reset_lock_stats(void);
+
+/**
+ * Get extended diagnostics (base counters + per-lock contention)
+ * Can be called from any thread.
+ *
+ * @param diag Pointer to extended diagnostics structure to fill
+ */
+void fuse_wrapper_get_diagnostics_ex(FuseDiagnosticsEx *diag);
+
+/**
+ * Write full diagnostics (counters, callback queue, lock contention, hot paths,
+ * clients, slow ops) to the log.
+ * Use when the mount appears stalled.
+ */
+void fuse_wrapper_dump_diagnostics(void);
+
+// ============================================================
+// Hot path profiler API - top-K paths/directories by traffic
+// ============================================================
+
+/**
+ * FUSE operation types (used by the per-op tracing layer)
+ */
+typedef enum {
+    FUSE_OP_GETATTR = 0,
+    FUSE_OP_READDIR,
+    FUSE_OP_OPEN,
+    FUSE_OP_READ,
+    FUSE_OP_WRITE,
+    FUSE_OP_RELEASE,
+    FUSE_OP_CREATE,
+    FUSE_OP_UNLINK,
+    FUSE_OP_MKDIR,
+    FUSE_OP_RMDIR,
+    FUSE_OP_RENAME,
+    FUSE_OP_TRUNCATE,
+    FUSE_OP_CHMOD,
+    FUSE_OP_CHOWN,
+    FUSE_OP_UTIMENS,
+    FUSE_OP_STATFS,
+    FUSE_OP_READLINK,
+    FUSE_OP_SYMLINK,
+    FUSE_OP_ACCESS,
+    FUSE_OP_GETXATTR,
+    FUSE_OP_SETXATTR,
+    FUSE_OP_LISTXATTR,
+    FUSE_OP_REMOVEXATTR,
+    FUSE_OP_FLUSH,
+    FUSE_OP_FSYNC,
+    FUSE_OP_COUNT
+} FuseOpType;
+
+/**
+ * Hot key kind - individual virtual paths or their parent directories
+ */
+typedef enum {
+    FUSE_HOT_PATHS = 0,
+    FUSE_HOT_DIRS,
+    FUSE_HOT_KIND_COUNT
+} FuseHotKind;
+
+/**
+ * Ranking metric. Each metric has its own Space-Saving sketch, so a path
+ * with few but huge reads still surfaces under FUSE_HOT_BY_BYTES.
+ */
+typedef enum {
+    FUSE_HOT_BY_OPS = 0,          // Operation count
+    FUSE_HOT_BY_BYTES,            // Bytes read + written
+    FUSE_HOT_BY_LATENCY,          // Cumulative handler time
+    FUSE_HOT_METRIC_COUNT
+} FuseHotMetric;
+
+#define FUSE_HOT_TOP_K 64         // Entries kept per sketch
+
+/**
+ * One heavy hitter. `weight` is the ranking metric's estimate; the true value
+ * lies in [weight - error, weight]. ops/bytes/latency_ns are exact totals
+ * since the key entered the sketch.
+ */
+typedef struct {
+    char path[1024];              // Virtual path or directory
+    uint64_t weight;              // Estimated metric value (upper bound)
+    uint64_t error;               // Maximum overestimation
+    uint64_t ops;                 // Operations while tracked
+    uint64_t bytes;               // Bytes read + written while tracked
+    uint64_t latency_ns;          // Handler time while tracked
+    uint64_t op_mask;             // Bit (1 << FuseOpType) for each op type seen
+} FuseHotEntry;
+
+/**
+ * Enable/disable hot path tracking. Off by default: while enabled, every
+ * operation updates the sketches under one global lock.
+ *
+ * @param enabled 1 to enable, 0 to disable
+ */
+void fuse_wrapper_set_hot_tracking(int enabled);
+
+/**
+ * Clear all hot path sketches.
+ */
+void fuse_wrapper_reset_hot_stats(void);
+
+/**
+ * Get the current heavy hitters, sorted by weight descending.
+ * Can be called from any thread.
+ *
+ * @param kind Paths or directories
+ * @param metric Ranking metric
+ * @param out Output array
+ * @param max Capacity of out (at most FUSE_HOT_TOP_K entries are returned)
+ * @return Number of entries written
+ */
+int fuse_wrapper_get_hot_paths(FuseHotKind kind, FuseHotMetric metric, FuseHotEntry *out, int max);
+
+/**
+ * Get the name of an operation type (e.g. "getattr").
+ */
+const char* fuse_wrapper_op_name(FuseOpType op);
+
+// ============================================================
+// Per-client accounting and QoS API
+// ============================================================
+
+/**
+ * QoS class assigned to a client process by name
+ */
+typedef enum {
+    FUSE_QOS_INTERACTIVE = 0,     // Default - no limits
+    FUSE_QOS_BACKGROUND,          // Shares a small pool of concurrent op slots
+    FUSE_QOS_BULK,                // BACKGROUND + may not copy EXTERNAL files into LOCAL
+    FUSE_QOS_CLASS_COUNT
+} FuseQosClass;
+
+#define FUSE_MAX_CLIENTS 128      // Client table size (least recently seen is recycled)
+#define FUSE_MAX_QOS_RULES 32
+
+/**
+ * Accounting for one client process (fuse_get_context()->pid)
+ */
+typedef struct {
+    int32_t pid;                  // Calling process (0 = kernel)
+    char name[64];                // Process name (cached)
+    FuseQosClass qos;             // Class from the matching QoS rule
+    uint64_t ops;                 // Completed operations
+    uint64_t errors;              // Operations that returned an error
+    uint64_t bytes;               // Bytes read + written
+    uint64_t latency_ns;          // Handler time (includes throttle wait)
+    uint64_t throttled;           // Ops that waited for a background slot
+    uint64_t throttle_wait_ns;    // Time spent waiting for background slots
+    uint64_t copyups_denied;      // Copy-ups refused by FUSE_QOS_BULK
+    uint64_t last_seen;           // Unix time of last operation
+} FuseClientStats;
+
+/**
+ * Add or replace a QoS rule. Patterns are fnmatch() globs on the process
+ * name (e.g. "mdworker*"); the first matching rule wins and new rules take
+ * precedence over existing ones. Unmatched clients are FUSE_QOS_INTERACTIVE.
+ * A default set covers Spotlight, Time Machine and media analysis daemons.
+ *
+ * @param process_pattern Process name glob
+ * @param qos QoS class for matching clients
+ * @return FUSE_WRAPPER_OK, or FUSE_WRAPPER_ERR_INVALID_ARG if the table is full
+ */
+int fuse_wrapper_set_qos_rule(const char *process_pattern, FuseQosClass qos);
+
+/**
+ * Remove all QoS rules (including defaults). All clients become interactive.
+ */
+void fuse_wrapper_clear_qos_rules(void);
+
+/**
+ * Set how many operations BACKGROUND/BULK clients may run concurrently.
+ * Further ops from those clients wait, leaving FUSE threads and the
+ * external drive to interactive clients. Default 4.
+ *
+ * @param slots Concurrent background ops (>= 1)
+ */
+void fuse_wrapper_set_background_slots(int slots);
+
+/**
+ * Get per-client accounting, sorted by ops descending.
+ * Can be called from any thread.
+ *
+ * @param out Output array
+ * @param max Capacity of out
+ * @return Number of entries written
+ */
+int fuse_wrapper_get_client_stats(FuseClientStats *out, int max);
+
+/**
+ * Clear the client table.
+ */
+void fuse_wrapper_reset_client_stats(void);
+
+// ============================================================
+// Slow operation detector API - per-phase timing breakdown
+// ============================================================
+
+/**
+ * Phases an operation's time is split into
+ */
+typedef enum {
+    FUSE_PHASE_LOCK_WAIT = 0,     // Blocked on global mutexes
+    FUSE_PHASE_THROTTLE,          // Waiting for a QoS background slot
+    FUSE_PHASE_RESOLVE_LOCAL,     // Lookups on LOCAL (stat, opendir)
+    FUSE_PHASE_RESOLVE_EXTERNAL,  // Lookups on EXTERNAL (stat, opendir)
+    FUSE_PHASE_COPY_UP,           // Copying an EXTERNAL file into LOCAL
+    FUSE_PHASE_BACKEND,           // Data/metadata syscalls on the resolved file
+    FUSE_PHASE_CALLBACK,          // Enqueueing Swift callbacks
+    FUSE_PHASE_OTHER,             // Unattributed (total minus the phases above)
+    FUSE_PHASE_COUNT
+} FusePhase;
+
+/**
+ * Storage tiers touched by an operation (bit mask)
+ */
+typedef enum {
+    FUSE_TIER_NONE = 0,
+    FUSE_TIER_LOCAL = 1 << 0,
+    FUSE_TIER_EXTERNAL = 1 << 1,
+} FuseTier;
+
+#define FUSE_SLOW_OP_RING_SIZE 64
+
+/**
+ * One operation that exceeded the slow-op threshold
+ */
+typedef struct {
+    uint64_t timestamp_ms;        // Completion time (Unix time, ms)
+    FuseOpType op;
+    int result;                   // Handler return value (negative errno on failure)
+    int tier;                     // FuseTier bits
+    int32_t pid;                  // Calling process
+    uint64_t total_ns;
+    uint64_t phase_ns[FUSE_PHASE_COUNT];
+    char path[1024];
+} FuseSlowOp;
+
+/**
+ * Slow-op counters since mount
+ */
+typedef struct {
+    uint32_t threshold_ms;        // Current threshold (0 = detector off)
+    uint64_t slow_ops;            // Ops over the threshold
+    uint64_t logs_suppressed;     // Slow-op log lines dropped by the rate limit
+    uint64_t dominant[FUSE_PHASE_COUNT];  // Slow ops where this phase took the most time
+    uint64_t phase_ns[FUSE_PHASE_COUNT];  // Time per phase summed over slow ops
+} FuseSlowOpStats;
+
+/**
+ * Set the slow-op threshold. Default 1000 ms; 0 disables the detector.
+ *
+ * @param threshold_ms Threshold in milliseconds
+ */
+void fuse_wrapper_set_slow_op_threshold_ms(uint32_t threshold_ms);
+
+/**
+ * Get the most recent slow ops, newest first.
+ *
+ * @param out Output array
+ * @param max Capacity of out (at most FUSE_SLOW_OP_RING_SIZE entries are kept)
+ * @return Number of entries written
+ */
+int fuse_wrapper_get_slow_ops(FuseSlowOp *out, int max);
+
+/**
+ * Get slow-op counters.
+ *
+ * @param stats Pointer to stats structure to fill
+ */
+void fuse_wrapper_get_slow_op_stats(FuseSlowOpStats *stats);
+
+/**
+ * Get the name of a phase (e.g. "resolve_external").
+ */
+const char* fuse_wrapper_phase_name(FusePhase phase);
+
+// ============================================================
+// Shared-memory diagnostics API
+// ============================================================
+
+/**
+ * Start publishing live metrics into a memory-mapped file (layout in fuse_shm.h).
+ * A background thread refreshes the segment every interval; readers map the
+ * file and use fuse_shm_read_snapshot() without calling into the service.
+ * Call before fuse_wrapper_mount(); publishing outlives unmount until closed.
+ *
+ * @param path Segment file path (created 0644, e.g. ServiceData/vfs_metrics.shm)
+ * @param interval_ms Publish interval (0 = default 500 ms)
+ * @return FUSE_WRAPPER_OK on success, FUSE_WRAPPER_ERR_INVALID_ARG on bad args or I/O error
+ */
+int fuse_wrapper_shm_open(const char *path, uint32_t interval_ms);
+
+/**
+ * Publish a final snapshot, stop the publisher and unmap the segment.
+ * The file is kept; writer_pid is cleared so readers know it is stale.
+ */
+void fuse_wrapper_shm_close(void);
+
+/**
+ * Publish a snapshot immediately (no-op if no segment is open).
+ */
+void fuse_wrapper_shm_publish(void);
+
+// ============================================================
+// OpenMetrics exporter API
+// ============================================================
+
+/**
+ * Serve metrics in OpenMetrics text format over a Unix domain socket.
+ * A single exporter thread answers HTTP GET / and /metrics, one request per
+ * connection, from the same lock-free snapshot the shm segment uses:
+ *
+ *   curl --unix-socket /path/to/vfs_metrics.sock http://localhost/metrics
+ *
+ * @param socket_path Socket path (an existing socket file is replaced; created 0666)
+ * @return FUSE_WRAPPER_OK on success, FUSE_WRAPPER_ERR_INVALID_ARG on bad path or socket error
+ */
+int fuse_wrapper_metrics_start(const char *socket_path);
+
+/**
+ * Stop the exporter thread and remove the socket file.
+ */
+void fuse_wrapper_metrics_stop(void);
+
+/**
+ * Render the current metrics in OpenMetrics text format (ends with "# EOF").
+ *
+ * @param buf Output buffer (may be NULL when size is 0)
+ * @param size Buffer size
+ * @return Length of the full exposition, excluding the terminating NUL;
+ *         output was truncated if the return value is >= size
+ */
+size_t fuse_wrapper_metrics_render(char *buf, size_t size);
+
+// ============================================================
+// Startup timeline API
+// ============================================================
+// Named phases recorded from both C and Swift into one process-wide timeline,
+// so mount-to-usable time can be broken down and compared across releases.
+
+#define FUSE_TIMELINE_MAX_PHASES 128
+
+/**
+ * One timeline phase (or instant mark). Times are monotonic, relative to
+ * the first event recorded after a reset.
+ */
+typedef struct {
+    char name[64];                // e.g. "fuse_mount", "build_index 1a2b3c4d"
+    char category[16];            // e.g. "startup", "vfs", "fuse", "index", "db"
+    uint64_t start_ns;
+    uint64_t end_ns;              // 0 while the phase is still open
+    uint64_t thread_id;
+    int instant;                  // 1 for marks (end_ns == start_ns)
+} FuseTimelinePhase;
+
+/**
+ * Start a phase.
+ *
+ * @return Phase id for fuse_wrapper_timeline_end(), or -1 if the timeline is full
+ */
+int fuse_wrapper_timeline_begin(const char *category, const char *name);
+
+/**
+ * End a phase started with fuse_wrapper_timeline_begin() (ignores -1).
+ */
+void fuse_wrapper_timeline_end(int phase_id);
+
+/**
+ * Record an instant event (e.g. "index_ready").
+ */
+void fuse_wrapper_timeline_mark(const char *category, const char *name);
+
+/**
+ * Clear the timeline; the next event becomes the new origin.
+ */
+void fuse_wrapper_timeline_reset(void);
+
+/**
+ * Copy the recorded phases in recording order.
+ *
+ * @param out Output array
+ * @param max Capacity of out
+ * @return Number of entries written
+ */
+int fuse_wrapper_timeline_get(FuseTimelinePhase *out, int max);
+
+/**
+ * Log the timeline as one summary block (offset, duration, nesting) to the C layer log.
+ */
+void fuse_wrapper_timeline_log_summary(void);
+
+/**
+ * Write the timeline as Chrome trace JSON (chrome://tracing, Perfetto).
+ *
+ * @param path Output file path (overwritten)
+ * @return FUSE_WRAPPER_OK on success, FUSE_WRAPPER_ERR_INVALID_ARG on bad path or I/O error
+ */
+int fuse_wrapper_timeline_write_chrome_trace(const char *path);
+
+// ============================================================
+// Restart handoff API
+// ============================================================
+// Carries delete tombstones (the pending delete set) from one service
+// instance to the next, so a delete whose EXTERNAL half had not completed
+// does not come back as a ghost file after an upgrade or restart.
+//
+// The FUSE session itself cannot be handed over: macFUSE's libfuse2 has no
+// API to rebuild a session from an inherited device fd, and the volume is
+// torn down when the daemon that mounted it exits. Open handles and sync
+// locks die with the old mount, so only tombstones are carried.
+
+/**
+ * Write the current tombstones to a handoff file (atomic replace).
+ * Call while mounted, before fuse_wrapper_unmount() clears the set.
+ *
+ * @param path Handoff file path
+ * @return Number of tombstones written (>= 0), or
+ *         FUSE_WRAPPER_ERR_NOT_MOUNTED / FUSE_WRAPPER_ERR_INVALID_ARG
+ */
+int fuse_wrapper_handoff_save(const char *path);
+
+/**
+ * Consume a handoff file written by a previous instance.
+ * Call before fuse_wrapper_mount(). The file is removed once read; it is
+ * ignored if it was written for different LOCAL/EXTERNAL directories.
+ *
+ * For each tombstone the EXTERNAL delete is retried; entries that still
+ * cannot be deleted stay hidden from readdir. A tombstone whose LOCAL copy
+ * exists again is dropped (the path was re-created).
+ *
+ * @param path Handoff file path
+ * @param local_dir LOCAL directory of the mount about to start
+ * @param external_dir EXTERNAL directory, or NULL if offline
+ * @return Number of tombstones still pending (>= 0), 0 if there was no file,
+ *         or FUSE_WRAPPER_ERR_INVALID_ARG for an unreadable or mismatched file
+ */
+int fuse_wrapper_handoff_restore(const char *path, const char *local_dir, const char *external_dir);
+
+// ============================================================
+// Tier demotion (evict) API
+// ============================================================
+// Removes LOCAL copies of files that EXTERNAL already holds, in one call
+// for many files. Each file is sync-locked and marked evicting while it is
+// checked and unlinked, so no open, write or copy-up can race the switch
+// to EXTERNAL. The caller updates its index from the reported results.
+
+/**
+ * Outcome for one path
+ * status: 0 evicted, or
+ *   -EBUSY    open for writing, being synced, or exclude list full
+ *   -ESTALE   EXTERNAL missing, or differs (size, or LOCAL modified later)
+ *   -ENOENT   no LOCAL copy
+ *   -EISDIR / -EINVAL  not a regular file, or a bad path
+ *   -EIO      EXTERNAL offline or not answering
+ */
+typedef struct {
+    const char *virtual_path;     // The caller's string
+    int status;
+    int64_t freed_bytes;          // LOCAL allocated bytes released
+} FuseEvictResult;
+
+/**
+ * Called once per batch of up to 256 results, on the calling thread.
+ * results is only valid during the call.
+ */
+typedef void (*FuseEvictCallback)(const FuseEvictResult *results, int count,
+                                  int64_t batch_freed_bytes, void *context);
+
+/**
+ * Evict files from LOCAL.
+ * A file is evicted only if EXTERNAL has a regular file of the same size
+ * that is not older than the LOCAL copy.
+ *
+ * @param virtual_paths Virtual paths (e.g. "/folder/file.txt")
+ * @param count Number of paths
+ * @param callback Per-batch results (may be NULL)
+ * @param context Passed to callback
+ * @return Number of files evicted (>= 0), or
+ *         FUSE_WRAPPER_ERR_NOT_MOUNTED / FUSE_WRAPPER_ERR_INVALID_ARG
+ */
+int fuse_wrapper_evict(const char *const *virtual_paths, int count,
+                       FuseEvictCallback callback, void *context);
+
+/**
+ * Set the directory for partial residency stubs.
+ * With stub_head_size/stub_tail_size set, eviction of a file of at least
+ * stub_min_size keeps its head and tail in a stub here; read-only opens
+ * serve those ranges locally and open EXTERNAL only for other reads.
+ * Stubs are dropped once EXTERNAL changes size or mtime.
+ * Keep the directory outside LOCAL so sync never sees it.
+ *
+ * @param dir Stub directory (created if missing), or NULL to stop using stubs
+ * @return FUSE_WRAPPER_OK, or FUSE_WRAPPER_ERR_INVALID_ARG if it cannot be created
+ */
+int fuse_wrapper_set_stub_dir(const char *dir);
+
+// ============================================================
+// File layout API
+// ============================================================
+// Keeps large files written to EXTERNAL in as few extents as the
+// filesystem allows, and measures how many they ended up with. Used by the
+// sync copier; placement preallocates its EXTERNAL copies the same way.
+
+/**
+ * Preallocation outcome
+ */
+typedef enum {
+    FUSE_PREALLOC_NONE = 0,         // Not supported or no space; writes allocate as they go
+    FUSE_PREALLOC_ALLOCATED = 1,    // Space reserved, possibly in several extents
+    FUSE_PREALLOC_CONTIGUOUS = 2    // Space reserved in one contiguous run
+} FusePreallocResult;
+
+/**
+ * Reserve size bytes for a new (empty) open file without changing its size.
+ * Tries a contiguous allocation first (F_ALLOCATECONTIG), then any
+ * allocation (F_PREALLOCATE).
+ *
+ * @return FusePreallocResult (best effort, never an error)
+ */
+int fuse_wrapper_preallocate(int fd, int64_t size);
+
+/**
+ * Count the extents holding an open file's data (F_LOG2PHYS_EXT).
+ * Stops counting at 100000 extents.
+ *
+ * @return Extent count (0 for an empty file), or -1 if the filesystem cannot report it
+ */
+int fuse_wrapper_count_extents(int fd);
+
+// ============================================================
+// Content-hash cache API
+// ============================================================
+// Persistent content digests keyed by file identity, so sync runs only
+// rehash files that changed. A digest is returned only for the exact
+// identity it was stored with: any write, truncate, replace or attribute
+// change misses. The table is a memory-mapped file shared by every sync
+// pair and the VFS in the process; it works with or without a mount.
+
+#define FUSE_HASH_MAX_DIGEST 32
+
+/**
+ * File identity a digest is valid for
+ * dev is st_dev from fuse_wrapper_file_identity(); callers may substitute a
+ * stable volume id, since removable volumes get a new st_dev on each mount.
+ */
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;
+    int64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+} FuseFileIdentity;
+
+/**
+ * Hash cache counters (since the table was opened)
+ */
+typedef struct {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t stores;
+    uint64_t racy;              // Stores skipped: file changed within the last 2 s
+    uint64_t replaced;          // Other files' entries overwritten in a full slot window
+    uint32_t entries;
+    uint32_t capacity;          // 0 when no table is open
+} FuseHashCacheStats;
+
+/**
+ * Open (or create) the hash cache table. Reopening the same path is a no-op;
+ * a file with another layout is discarded and started over.
+ *
+ * @param path Table file (created 0600, e.g. ServiceData/hash_cache.db)
+ * @param max_entries Growth limit, rounded down to a power of two (0 = default 1M, ~80 MB)
+ * @return FUSE_WRAPPER_OK, or FUSE_WRAPPER_ERR_INVALID_ARG on bad args or I/O error
+ */
+int fuse_wrapper_hash_cache_open(const char *path, uint32_t max_entries);
+
+/**
+ * Flush and unmap the table. Lookups miss and stores are dropped until reopened.
+ */
+void fuse_wrapper_hash_cache_close(void);
+
+/**
+ * Read the identity of an open regular file.
+ * Take it before hashing and again after; store only if both match.
+ *
+ * @return FUSE_WRAPPER_OK, or FUSE_WRAPPER_ERR_INVALID_ARG if fstat fails or fd is not a regular file
+ */
+int fuse_wrapper_file_identity(int fd, FuseFileIdentity *out);
+
+/**
+ * Look up a digest.
+ *
+ * @param id File identity
+ * @param algorithm Caller-defined algorithm id, 1-255
+ * @param digest Output buffer
+ * @param size Buffer size
+ * @return Digest length on a hit, 0 on a miss (or no table), FUSE_WRAPPER_ERR_INVALID_ARG on bad args
+ */
+int fuse_wrapper_hash_cache_lookup(const FuseFileIdentity *id, int algorithm, uint8_t *digest, int size);
+
+/**
+ * Store a digest for an identity (replaces the file's previous entry).
+ * Files changed within the last 2 seconds are not stored: a further change
+ * inside the filesystem's timestamp granularity would keep the same identity.
+ *
+ * @param len Digest length, 1-FUSE_HASH_MAX_DIGEST
+ * @return 1 if stored, 0 if skipped (racy or no table), FUSE_WRAPPER_ERR_INVALID_ARG on bad args
+ */
+int fuse_wrapper_hash_cache_store(const FuseFileIdentity *id, int algorithm, const uint8_t *digest, int len);
+
+/**
+ * Get hash cache counters.
+ */
+void fuse_wrapper_get_hash_cache_stats(FuseHashCacheStats *stats);
+
+// ============================================================
+// Runtime tunables API
+// ============================================================
+// Limits and intervals that can be changed while mounted. Kernel-side mount
+// options (entry/attr timeouts, volume flags) are fixed by fuse_new() in
+// libfuse2 and are not tunables.
+
+/**
+ * Tunable identifiers
+ */
+typedef enum {
+    FUSE_TUNABLE_MAX_OPEN_FILES = 0,    // Concurrent open handles before EMFILE
+    FUSE_TUNABLE_CALLBACK_QUEUE_SIZE,   // Swift callback queue capacity (resize keeps pending items)
+    FUSE_TUNABLE_READDIR_MAX_ENTRIES,   // Names merged/deduplicated per readdir
+    FUSE_TUNABLE_BACKGROUND_SLOTS,      // Concurrent ops shared by BACKGROUND/BULK clients
+    FUSE_TUNABLE_SLOW_OP_THRESHOLD_MS,  // Slow-op detector threshold (0 = off)
+    FUSE_TUNABLE_SHM_INTERVAL_MS,       // Metrics segment publish interval
+    FUSE_TUNABLE_WRITE_BUFFER_SIZE,     // Per-handle write-behind buffer bytes (0 = write through)
+    FUSE_TUNABLE_STREAM_MIN_SIZE,       // Read-only streams this large open with direct_io (0 = off, the
+                                        // default: macFUSE cannot mmap a direct_io handle, so QuickLook,
+                                        // AVFoundation and disk images fail on them). Streams of 256 MiB+
+                                        // get a nocache backing fd either way.
+    FUSE_TUNABLE_EXTERNAL_IO_DEPTH,     // Concurrent EXTERNAL calls (0 = call inline, no executor)
+    FUSE_TUNABLE_EXTERNAL_TIMEOUT_MS,   // Fail an EXTERNAL call with EIO after this long (0 = wait forever)
+    FUSE_TUNABLE_STUB_HEAD_SIZE,        // Head bytes an evicted file keeps in its stub (0 and tail 0 = no stubs)
+    FUSE_TUNABLE_STUB_TAIL_SIZE,        // Tail bytes kept in the stub (MP4 moov, zip central directory)
+    FUSE_TUNABLE_STUB_MIN_SIZE,         // Smallest file that gets a stub
+    FUSE_TUNABLE_PLACEMENT_MAX_LOCAL_SIZE, // New files move to EXTERNAL once this large (0 = off)
+    FUSE_TUNABLE_PLACEMENT_MIN_LOCAL_FREE, // New files move to EXTERNAL while LOCAL has less free (0 = off)
+    FUSE_TUNABLE_COUNT
+} FuseTunable;
+
+/**
+ * Tunable description and current value
+ */
+typedef struct {
+    const char *name;             // Stable config key, e.g. "max_open_files"
+    int64_t value;
+    int64_t default_value;
+    int64_t min_value;
+    int64_t max_value;
+} FuseTunableInfo;
+
+/**
+ * Set a tunable; takes effect for the next operation that consults it.
+ *
+ * @return FUSE_WRAPPER_OK, or FUSE_WRAPPER_ERR_INVALID_ARG if the id is
+ *         unknown or value is outside [min_value, max_value]
+ */
+int fuse_wrapper_set_tunable(FuseTunable tunable, int64_t value);
+
+/**
+ * Current value of a tunable, or -1 for an unknown id.
+ */
+int64_t fuse_wrapper_get_tunable(FuseTunable tunable);
+
+/**
+ * Describe a tunable.
+ *
+ * @return FUSE_WRAPPER_OK or FUSE_WRAPPER_ERR_INVALID_ARG
+ */
+int fuse_wrapper_get_tunable_info(FuseTunable tunable, FuseTunableInfo *out);
+
+/**
+ * Look up a tunable by config key.
+ *
+ * @return Tunable id, or -1 if the name is unknown
+ */
+int fuse_wrapper_tunable_from_name(const char *name);
+
+/**
+ * Replace the extra readdir exclude patterns (fnmatch, matched against
+ * entry names). The built-in names (.DS_Store, ._*, ...) always apply.
+ *
+ * @param patterns Pattern array (may be NULL when count is 0)
+ * @param count Number of patterns (at most 64 are kept)
+ * @return Number of patterns installed
+ */
+int fuse_wrapper_set_exclude_patterns(const char *const *patterns, int count);
+
+/**
+ * Replace the write-through directories. Files under them that are written
+ * from scratch (created, or opened with O_TRUNC) are copied to EXTERNAL as
+ * they are written and are in sync at close (on_file_synced).
+ *
+ * @param dirs Virtual directory paths, e.g. "/Documents/Invoices" (may be NULL when count is 0)
+ * @param count Number of directories (at most 64 are kept)
+ * @return Number of directories installed
+ */
+int fuse_wrapper_set_write_through_dirs(const char *const *dirs, int count);
+
 // ============================================================
 // Sync lock API - block write/delete during sync
 // ============================================================
@@ -246,6 +1036,13 @@ typedef void (*fuse_callback_file_deleted)(const char *virtual_path, int is_dire
 typedef void (*fuse_callback_file_written)(const char *virtual_path);
 typedef void (*fuse_callback_file_read)(const char *virtual_path);
 typedef void (*fuse_callback_file_renamed)(const char *from_path, const char *to_path, int is_directory);
+// A file written through the mount was moved to EXTERNAL by the placement
+// policy; sent at release instead of file_written. LOCAL has no copy.
+typedef void (*fuse_callback_file_placed)(const char *virtual_path);
+// A file written through the mount was mirrored to EXTERNAL as it was
+// written (write-through directory); sent at release instead of
+// file_written. Both tiers hold the same data, nothing is left to sync.
+typedef void (*fuse_callback_file_synced)(const char *virtual_path);
 
 /**
  * Callback structure
@@ -256,6 +1053,8 @@ typedef struct {
     fuse_callback_file_written on_file_written;
     fuse_callback_file_read    on_file_read;
     fuse_callback_file_renamed on_file_renamed;
+    fuse_callback_file_placed  on_file_placed;
+    fuse_callback_file_synced  on_file_synced;
 } FuseCallbacks;
 
 /**
@@ -266,6 +1065,39 @@ typedef struct {
  */
 void fuse_wrapper_set_callbacks(const FuseCallbacks *callbacks);
 
+// ============================================================
+// Test hooks - only compiled with -DDMSA_FUSE_TEST_HOOKS
+// Used by tools/vfs_bench to drive handlers without a kernel mount
+// ============================================================
+#ifdef DMSA_FUSE_TEST_HOOKS
+
+struct fuse_operations;
+
+/**
+ * Attach handlers to local/external directories without mounting.
+ * Starts the callback worker and marks the index ready state as-is
+ * (call fuse_wrapper_set_index_ready(true) before driving handlers).
+ *
+ * @param local_dir Local directory path
+ * @param external_dir External directory path (can be NULL for offline)
+ * @return FUSE_WRAPPER_OK on success, FUSE_WRAPPER_ERR_ALREADY_MOUNTED if attached/mounted
+ */
+int fuse_wrapper_test_attach(const char *local_dir, const char *external_dir);
+
+/**
+ * Detach from directories and stop the callback worker.
+ */
+void fuse_wrapper_test_detach(void);
+
+/**
+ * Get the handler table used by fuse_new() (dmsa_oper).
+ *
+ * @return Pointer to the static FUSE operations table
+ */
+const struct fuse_operations *fuse_wrapper_test_operations(void);
+
+#endif /* DMSA_FUSE_TEST_HOOKS */
+
 #ifdef __cplusplus
 }
 #endif
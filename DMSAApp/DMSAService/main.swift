@@ -141,7 +141,10 @@ func setupSignalHandlers() {
 
 // 0. Run preflight checks (root privileges, environment variables, macFUSE, etc.)
 // Reference: SERVICE_FLOW/17_Checklist.md
-let preflightReport = StartupChecker.runPreflightChecks()
+// The first timeline event is the origin of the startup trace
+let preflightReport = StartupTimeline.measure("service", "preflight") {
+    StartupChecker.runPreflightChecks()
+}
 
 // Check for critical failures
 if !preflightReport.criticalFailures.isEmpty {
@@ -199,9 +202,11 @@ Task {
     // Wait for App to connect and call setUserHome via XPC
     // This blocks until userHome is set (timeout 120s)
     logger.info("Waiting for setUserHome from App...")
-    let gotUserHome = await Task.detached {
-        UserPathManager.shared.waitForUserHome(timeout: 120)
-    }.value
+    let gotUserHome = await StartupTimeline.measure("service", "wait_user_home") {
+        await Task.detached {
+            UserPathManager.shared.waitForUserHome(timeout: 120)
+        }.value
+    }
 
     if !gotUserHome {
         logger.error("Timeout waiting for setUserHome, using fallback path")
@@ -220,7 +225,9 @@ Task {
 
     // Start sync scheduler first to ensure SyncManager has configuration
     // This way syncNow requests during autoMount can be handled properly
-    await delegate.startScheduler()
+    await StartupTimeline.measure("service", "start_scheduler") {
+        await delegate.startScheduler()
+    }
 
     // Auto-mount VFS
     // Note: VFSManager.mount() internally will:
@@ -228,7 +235,9 @@ Task {
     // 2. Build index
     // 3. Set READY state and send stateChanged notification
     // 4. Send indexReady notification
-    await delegate.autoMount()
+    await StartupTimeline.measure("service", "auto_mount") {
+        await delegate.autoMount()
+    }
 
     // After autoMount completes, VFSManager has already set READY state
     // If no sync pairs need mounting, manually set READY state
@@ -239,6 +248,9 @@ Task {
     } else {
         logger.info("VFSManager has already set READY state")
     }
+
+    StartupTimeline.mark("service", "ready")
+    StartupTimeline.emitSummary()
 }
 
 // 6. Run main event loop
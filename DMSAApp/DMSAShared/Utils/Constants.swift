@@ -126,6 +126,31 @@ public enum Constants {
             appSupport.appendingPathComponent("SharedData")
         }
 
+        /// Service data directory (database, tree versions, live metrics)
+        public static var serviceData: URL {
+            appSupport.appendingPathComponent("ServiceData")
+        }
+
+        /// VFS live metrics segment (memory-mapped, written by the service, read by App/CLI)
+        public static var vfsMetrics: URL {
+            serviceData.appendingPathComponent("vfs_metrics.shm")
+        }
+
+        /// VFS restart handoff state for one sync pair (written on unmount, consumed on mount)
+        public static func vfsHandoff(syncPairId: String) -> URL {
+            serviceData.appendingPathComponent("vfs_handoff_\(syncPairId).state")
+        }
+
+        /// Content-hash cache table (digests keyed by file identity, memory-mapped by the service)
+        public static var hashCache: URL {
+            serviceData.appendingPathComponent("hash_cache.db")
+        }
+
+        /// Head/tail stubs of evicted files for one sync pair (kept outside LOCAL)
+        public static func vfsStubs(syncPairId: String) -> URL {
+            serviceData.appendingPathComponent("vfs_stubs_\(syncPairId)")
+        }
+
         /// Config file
         public static var config: URL {
             appSupport.appendingPathComponent("config.json")
@@ -203,6 +228,13 @@ public enum Constants {
         public static let healthCheckInterval: TimeInterval = 60.0
     }
 
+    /// Temp files the VFS and eviction write beside real files (copy-up,
+    /// placement, write-through, compression; see the *_SUFFIX defines in
+    /// fuse_wrapper.c). Always excluded, even with custom exclude patterns.
+    public static let internalTempPatterns: [String] = [
+        "*.dmsa_copyup", "*.dmsa_place", "*.dmsa_tee", "*.dmsa_compress"
+    ]
+
     /// Exclude file patterns
     public static let defaultExcludePatterns: [String] = [
         ".DS_Store", ".Trash", ".Spotlight-V100", ".fseventsd",
@@ -211,7 +243,7 @@ public enum Constants {
         "Thumbs.db", "desktop.ini",
         "*.part", "*.crdownload", "*.download", "*.partial",
         ".FUSE"  // Version file directory
-    ]
+    ] + internalTempPatterns
 
     /// Path safety whitelist
     /// Uses computed property to correctly resolve user path under root
@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# DMSA VFS bench tools build script
+# Usage: tools/vfs_bench/build.sh [--tsan] [tool...]
+#
+# Tools:
+#   slow_external   Slow/flaky external drive emulator (passthrough FUSE)
+#   stress          Multi-threaded stress/scaling harness (links fuse_wrapper.c)
+#   microbench      In-process handler microbenchmarks (includes fuse_wrapper.c)
+#   vfsstat         Live metrics viewer for the shared-memory segment (no FUSE needed)
+#
+# Options:
+#   --tsan          Build with ThreadSanitizer (binaries get a _tsan suffix)
+#
+# Environment:
+#   FUSE_CFLAGS / FUSE_LIBS   Override macFUSE include/link flags
+#   OUT_DIR                   Output directory (default: tools/vfs_bench/bin)
+#
+
+set -euo pipefail
+
+# ─── Config ──────────────────────────────────────────────────────────
+BENCH_DIR="$(cd "$(dirname "$0")" && pwd)"
+VFS_DIR="$(cd "$BENCH_DIR/../../DMSAApp/DMSAService/VFS" && pwd)"
+OUT_DIR="${OUT_DIR:-$BENCH_DIR/bin}"
+CC="${CC:-cc}"
+FUSE_CFLAGS="${FUSE_CFLAGS:--I/usr/local/include -D_FILE_OFFSET_BITS=64}"
+FUSE_LIBS="${FUSE_LIBS:--L/usr/local/lib -lfuse}"
+CFLAGS_COMMON="-std=gnu11 -O2 -g -Wall -Wextra -Wno-unused-parameter"
+
+GREEN='\033[0;32m'
+RED='\033[0;31m'
+NC='\033[0m'
+
+log()   { echo -e "${GREEN}[✓]${NC} $1"; }
+err()   { echo -e "${RED}[✗]${NC} $1"; exit 1; }
+
+SUFFIX=""
+if [ "${1:-}" = "--tsan" ]; then
+    shift
+    CFLAGS_COMMON="$CFLAGS_COMMON -O1 -fsanitize=thread -fno-omit-frame-pointer"
+    SUFFIX="_tsan"
+fi
+
+# fuse_wrapper.c built with test hooks (lock stats come from the core profiler)
+CORE_CFLAGS="-DDMSA_FUSE_TEST_HOOKS -I$VFS_DIR -I$BENCH_DIR"
+CORE_SOURCES="$VFS_DIR/fuse_wrapper.c"
+
+build_core_tool() {
+    local name="$1"
+    local main_src="$2"
+    local objdir
+    objdir="$(mktemp -d)"
+    $CC $CFLAGS_COMMON $FUSE_CFLAGS $CORE_CFLAGS \
+        -c "$CORE_SOURCES" -o "$objdir/fuse_wrapper.o"
+    $CC $CFLAGS_COMMON $FUSE_CFLAGS $CORE_CFLAGS -o "$OUT_DIR/$name$SUFFIX" \
+        "$main_src" "$objdir/fuse_wrapper.o" $FUSE_LIBS -lm -lpthread
+    rm -rf "$objdir"
+    log "$name -> $OUT_DIR/$name$SUFFIX"
+}
+
+# ─── Targets ─────────────────────────────────────────────────────────
+build_slow_external() {
+    $CC $CFLAGS_COMMON $FUSE_CFLAGS -o "$OUT_DIR/slow_external$SUFFIX" \
+        "$BENCH_DIR/slow_external.c" $FUSE_LIBS -lm -lpthread
+    log "slow_external -> $OUT_DIR/slow_external$SUFFIX"
+}
+
+build_stress() {
+    build_core_tool dmsa_stress "$BENCH_DIR/stress.c"
+}
+
+build_microbench() {
+    # Unity build: microbench.c includes fuse_wrapper.c to reach static helpers
+    $CC $CFLAGS_COMMON $FUSE_CFLAGS -I"$VFS_DIR" -o "$OUT_DIR/dmsa_microbench$SUFFIX" \
+        "$BENCH_DIR/microbench.c" $FUSE_LIBS -lm -lpthread
+    log "microbench -> $OUT_DIR/dmsa_microbench$SUFFIX"
+}
+
+build_vfsstat() {
+    $CC $CFLAGS_COMMON -I"$VFS_DIR" -o "$OUT_DIR/dmsa_vfsstat$SUFFIX" "$BENCH_DIR/vfsstat.c"
+    log "vfsstat -> $OUT_DIR/dmsa_vfsstat$SUFFIX"
+}
+
+ALL_TOOLS="slow_external stress microbench vfsstat"
+
+mkdir -p "$OUT_DIR"
+TOOLS="${*:-$ALL_TOOLS}"
+for tool in $TOOLS; do
+    case "$tool" in
+        slow_external) build_slow_external ;;
+        stress)        build_stress ;;
+        microbench)    build_microbench ;;
+        vfsstat)       build_vfsstat ;;
+        *) err "Unknown tool: $tool (available: $ALL_TOOLS)" ;;
+    esac
+done
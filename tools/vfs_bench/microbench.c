@@ -0,0 +1,548 @@
+/*
+ * microbench.c
+ * DMSA - In-process handler microbenchmarks (no kernel round-trips)
+ *
+ * Compiles fuse_wrapper.c into this translation unit (unity build) so static hot-path
+ * helpers (resolve_actual_path, should_exclude, queue_callback) can be called
+ * directly next to the dmsa_oper handlers. Before the include, allocation and
+ * syscall functions are wrapped in counting macros, so the numbers only reflect
+ * work done inside the core.
+ *
+ * Reports per benchmark: ns/op, allocations/op, syscalls/op.
+ *
+ * Build:
+ *   tools/vfs_bench/build.sh microbench
+ *
+ * Usage:
+ *   dmsa_microbench [--filter SUBSTR] [--min-time-ms MS] [--entries N]
+ *                   [--csv] [--compare BASELINE.csv] [--tolerance PCT]
+ *
+ *   --filter        Only run benchmarks whose name contains SUBSTR
+ *   --min-time-ms   Minimum measured time per benchmark (default 300)
+ *   --entries       Entries per tier in the readdir merge directory (default 500)
+ *   --csv           Print name,ns_per_op,allocs_per_op,syscalls_per_op
+ *   --compare       Compare with a previous --csv run; exit 1 on regression
+ *   --tolerance     Allowed ns/op slowdown in percent for --compare (default 15)
+ *
+ * Allocation and syscall counts are deterministic, so --compare treats any
+ * increase in allocs/op or syscalls/op as a regression.
+ */
+
+#define _DARWIN_USE_64_BIT_INODE 1
+#define FUSE_USE_VERSION 26
+#define DMSA_FUSE_TEST_HOOKS 1
+
+#include <fuse/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <time.h>
+#include <pthread.h>
+#include <libgen.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/xattr.h>
+#include <sys/time.h>
+#include <sys/mount.h>
+#include <sys/statvfs.h>
+
+// ============================================================
+// Counting macros - applied only to the core included below
+// ============================================================
+
+static __thread uint64_t t_allocs = 0;
+static __thread uint64_t t_frees = 0;
+static __thread uint64_t t_syscalls = 0;
+
+#define BENCH_ALLOC(call)   (t_allocs++, call)
+#define BENCH_SYSCALL(call) (t_syscalls++, call)
+
+#define malloc(...)      BENCH_ALLOC(malloc(__VA_ARGS__))
+#define calloc(...)      BENCH_ALLOC(calloc(__VA_ARGS__))
+#define realloc(...)     BENCH_ALLOC(realloc(__VA_ARGS__))
+#define strdup(...)      BENCH_ALLOC(strdup(__VA_ARGS__))
+#define free(...)        (t_frees++, free(__VA_ARGS__))
+
+#define stat(...)        BENCH_SYSCALL(stat(__VA_ARGS__))
+#define lstat(...)       BENCH_SYSCALL(lstat(__VA_ARGS__))
+#define fstat(...)       BENCH_SYSCALL(fstat(__VA_ARGS__))
+#define open(...)        BENCH_SYSCALL(open(__VA_ARGS__))
+#define close(...)       BENCH_SYSCALL(close(__VA_ARGS__))
+#define read(...)        BENCH_SYSCALL(read(__VA_ARGS__))
+#define write(...)       BENCH_SYSCALL(write(__VA_ARGS__))
+#define pread(...)       BENCH_SYSCALL(pread(__VA_ARGS__))
+#define pwrite(...)      BENCH_SYSCALL(pwrite(__VA_ARGS__))
+#define opendir(...)     BENCH_SYSCALL(opendir(__VA_ARGS__))
+#define readdir(...)     BENCH_SYSCALL(readdir(__VA_ARGS__))
+#define closedir(...)    BENCH_SYSCALL(closedir(__VA_ARGS__))
+#define unlink(...)      BENCH_SYSCALL(unlink(__VA_ARGS__))
+#define mkdir(...)       BENCH_SYSCALL(mkdir(__VA_ARGS__))
+#define rmdir(...)       BENCH_SYSCALL(rmdir(__VA_ARGS__))
+#define rename(...)      BENCH_SYSCALL(rename(__VA_ARGS__))
+#define truncate(...)    BENCH_SYSCALL(truncate(__VA_ARGS__))
+#define chmod(...)       BENCH_SYSCALL(chmod(__VA_ARGS__))
+#define lchown(...)      BENCH_SYSCALL(lchown(__VA_ARGS__))
+#define utimensat(...)   BENCH_SYSCALL(utimensat(__VA_ARGS__))
+#define statvfs(...)     BENCH_SYSCALL(statvfs(__VA_ARGS__))
+#define readlink(...)    BENCH_SYSCALL(readlink(__VA_ARGS__))
+#define symlink(...)     BENCH_SYSCALL(symlink(__VA_ARGS__))
+#define getxattr(...)    BENCH_SYSCALL(getxattr(__VA_ARGS__))
+#define setxattr(...)    BENCH_SYSCALL(setxattr(__VA_ARGS__))
+#define listxattr(...)   BENCH_SYSCALL(listxattr(__VA_ARGS__))
+#define removexattr(...) BENCH_SYSCALL(removexattr(__VA_ARGS__))
+
+#include "fuse_wrapper.c"
+
+#undef malloc
+#undef calloc
+#undef realloc
+#undef strdup
+#undef free
+#undef stat
+#undef lstat
+#undef fstat
+#undef open
+#undef close
+#undef read
+#undef write
+#undef pread
+#undef pwrite
+#undef opendir
+#undef readdir
+#undef closedir
+#undef unlink
+#undef mkdir
+#undef rmdir
+#undef rename
+#undef truncate
+#undef chmod
+#undef lchown
+#undef utimensat
+#undef statvfs
+#undef readlink
+#undef symlink
+#undef getxattr
+#undef setxattr
+#undef listxattr
+#undef removexattr
+
+#define BENCH_PREFIX "[MICROBENCH] "
+
+// ============================================================
+// Benchmark framework
+// ============================================================
+
+typedef struct {
+    const char *name;
+    void (*run)(void);      // One operation
+    void (*setup)(void);    // Optional, before measurement
+    void (*teardown)(void); // Optional, after measurement
+} Bench;
+
+typedef struct {
+    const char *name;
+    double ns_per_op;
+    double allocs_per_op;
+    double frees_per_op;
+    double syscalls_per_op;
+} BenchResult;
+
+static struct {
+    const char *filter;
+    int min_time_ms;
+    int entries;
+    int csv;
+    const char *compare;
+    double tolerance;
+    char *local_dir;
+    char *external_dir;
+} g_bench = {
+    .min_time_ms = 300,
+    .entries = 500,
+    .tolerance = 15.0,
+};
+
+static uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static BenchResult run_bench(const Bench *b) {
+    if (b->setup) b->setup();
+
+    // Warm up (also primes the dentry/inode caches of the backing fs)
+    for (int i = 0; i < 100; i++) b->run();
+
+    // Calibrate: double iterations until the batch takes >= min_time
+    uint64_t iters = 64;
+    uint64_t elapsed = 0;
+    uint64_t allocs = 0, frees = 0, syscalls = 0;
+    for (;;) {
+        t_allocs = t_frees = t_syscalls = 0;
+        uint64_t t0 = bench_now_ns();
+        for (uint64_t i = 0; i < iters; i++) b->run();
+        elapsed = bench_now_ns() - t0;
+        allocs = t_allocs;
+        frees = t_frees;
+        syscalls = t_syscalls;
+        if (elapsed >= (uint64_t)g_bench.min_time_ms * 1000000ULL || iters >= (1ULL << 30)) break;
+        iters *= 2;
+    }
+
+    if (b->teardown) b->teardown();
+
+    BenchResult r = {
+        .name = b->name,
+        .ns_per_op = (double)elapsed / (double)iters,
+        .allocs_per_op = (double)allocs / (double)iters,
+        .frees_per_op = (double)frees / (double)iters,
+        .syscalls_per_op = (double)syscalls / (double)iters,
+    };
+    return r;
+}
+
+// ============================================================
+// Fixture - LOCAL/EXTERNAL trees with synthetic paths
+// ============================================================
+
+static int bench_write_file(const char *path, size_t size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd == -1) return -errno;
+    char chunk[4096];
+    memset(chunk, 'b', sizeof(chunk));
+    while (size > 0) {
+        size_t n = size < sizeof(chunk) ? size : sizeof(chunk);
+        if (write(fd, chunk, n) != (ssize_t)n) break;
+        size -= n;
+    }
+    close(fd);
+    return 0;
+}
+
+static int setup_fixture(void) {
+    char tmpl_local[] = "/tmp/dmsa_micro_local_XXXXXX";
+    char tmpl_ext[] = "/tmp/dmsa_micro_external_XXXXXX";
+    if (!mkdtemp(tmpl_local) || !mkdtemp(tmpl_ext)) return -errno;
+    g_bench.local_dir = strdup(tmpl_local);
+    g_bench.external_dir = strdup(tmpl_ext);
+
+    char path[4096];
+    const char *roots[2] = {g_bench.local_dir, g_bench.external_dir};
+    for (int r = 0; r < 2; r++) {
+        snprintf(path, sizeof(path), "%s/docs", roots[r]);
+        mkdir(path, 0755);
+        snprintf(path, sizeof(path), "%s/merge", roots[r]);
+        mkdir(path, 0755);
+    }
+
+    snprintf(path, sizeof(path), "%s/docs/local.txt", g_bench.local_dir);
+    bench_write_file(path, 65536);
+    snprintf(path, sizeof(path), "%s/docs/external.txt", g_bench.external_dir);
+    bench_write_file(path, 65536);
+
+    // Merge directory: `entries` per tier, half of them present in both tiers
+    for (int i = 0; i < g_bench.entries; i++) {
+        snprintf(path, sizeof(path), "%s/merge/file_%05d", g_bench.local_dir, i);
+        bench_write_file(path, 0);
+        snprintf(path, sizeof(path), "%s/merge/file_%05d", g_bench.external_dir,
+                 i + g_bench.entries / 2);
+        bench_write_file(path, 0);
+    }
+    return 0;
+}
+
+// ============================================================
+// Benchmarks
+// ============================================================
+
+static const struct fuse_operations *g_ops_table = NULL;
+static char g_io_buf[4096];
+static struct fuse_file_info g_fi;
+static uint64_t g_seq = 0;
+
+static int counting_filler(void *buf, const char *name, const struct stat *st, off_t off) {
+    (void)name;
+    (void)st;
+    (void)off;
+    (*(int *)buf)++;
+    return 0;
+}
+
+static void bench_should_exclude_hit(void) {
+    volatile int r = should_exclude("._photo.jpg");
+    (void)r;
+}
+
+static void bench_should_exclude_miss(void) {
+    volatile int r = should_exclude("quarterly-report-final.pdf");
+    (void)r;
+}
+
+static void bench_resolve_local(void) {
+    char *p = resolve_actual_path("/docs/local.txt");
+    free(p);
+}
+
+static void bench_resolve_external(void) {
+    char *p = resolve_actual_path("/docs/external.txt");
+    free(p);
+}
+
+static void bench_resolve_miss(void) {
+    char *p = resolve_actual_path("/docs/missing.txt");
+    free(p);
+}
+
+static void bench_queue_callback(void) {
+    queue_callback(CB_TYPE_READ, "/docs/local.txt", NULL, 0);
+}
+
+static void bench_getattr_local(void) {
+    struct stat st;
+    g_ops_table->getattr("/docs/local.txt", &st);
+}
+
+static void bench_getattr_external(void) {
+    struct stat st;
+    g_ops_table->getattr("/docs/external.txt", &st);
+}
+
+static void bench_getattr_miss(void) {
+    struct stat st;
+    g_ops_table->getattr("/docs/missing.txt", &st);
+}
+
+static void bench_readdir_merge(void) {
+    int entries = 0;
+    g_ops_table->readdir("/merge", &entries, counting_filler, 0, NULL);
+}
+
+static void bench_access(void) {
+    g_ops_table->access("/docs/local.txt", R_OK);
+}
+
+static void bench_open_release_local(void) {
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    fi.flags = O_RDONLY;
+    if (g_ops_table->open("/docs/local.txt", &fi) == 0) {
+        g_ops_table->release("/docs/local.txt", &fi);
+    }
+}
+
+static void bench_open_release_external(void) {
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    fi.flags = O_RDONLY;
+    if (g_ops_table->open("/docs/external.txt", &fi) == 0) {
+        g_ops_table->release("/docs/external.txt", &fi);
+    }
+}
+
+static void open_bench_handle(int flags) {
+    memset(&g_fi, 0, sizeof(g_fi));
+    g_fi.flags = flags;
+    g_ops_table->open("/docs/local.txt", &g_fi);
+}
+
+static void release_bench_handle(void) {
+    g_ops_table->release("/docs/local.txt", &g_fi);
+}
+
+static void setup_read(void) { open_bench_handle(O_RDONLY); }
+static void setup_write(void) { open_bench_handle(O_WRONLY); }
+
+static void bench_read_4k(void) {
+    off_t off = (off_t)((g_seq++ % 15) * sizeof(g_io_buf));
+    g_ops_table->read("/docs/local.txt", g_io_buf, sizeof(g_io_buf), off, &g_fi);
+}
+
+static void bench_write_4k(void) {
+    off_t off = (off_t)((g_seq++ % 15) * sizeof(g_io_buf));
+    g_ops_table->write("/docs/local.txt", g_io_buf, sizeof(g_io_buf), off, &g_fi);
+}
+
+// Sequential 1k appends over a 1 MB window (what cp/tar/editors emit through the kernel)
+static void bench_write_1k_seq(void) {
+    off_t off = (off_t)((g_seq++ % 1024) * 1024);
+    g_ops_table->write("/docs/local.txt", g_io_buf, 1024, off, &g_fi);
+}
+
+static void setup_write_unbuffered(void) {
+    fuse_wrapper_set_tunable(FUSE_TUNABLE_WRITE_BUFFER_SIZE, 0);
+    open_bench_handle(O_WRONLY);
+}
+
+static void release_write_unbuffered(void) {
+    release_bench_handle();
+    fuse_wrapper_set_tunable(FUSE_TUNABLE_WRITE_BUFFER_SIZE,
+                             g_tunable_defs[FUSE_TUNABLE_WRITE_BUFFER_SIZE].default_value);
+}
+
+static void bench_create_unlink(void) {
+    struct fuse_file_info fi;
+    memset(&fi, 0, sizeof(fi));
+    fi.flags = O_CREAT | O_WRONLY | O_TRUNC;
+    if (g_ops_table->create("/docs/scratch.tmp", 0644, &fi) == 0) {
+        g_ops_table->release("/docs/scratch.tmp", &fi);
+    }
+    g_ops_table->unlink("/docs/scratch.tmp");
+}
+
+static void setup_rename(void) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/docs/rename_a", g_bench.local_dir);
+    bench_write_file(path, 0);
+}
+
+static void bench_rename_pair(void) {
+    g_ops_table->rename("/docs/rename_a", "/docs/rename_b");
+    g_ops_table->rename("/docs/rename_b", "/docs/rename_a");
+}
+
+static const Bench g_benches[] = {
+    {"should_exclude/hit",         bench_should_exclude_hit,    NULL,         NULL},
+    {"should_exclude/miss",        bench_should_exclude_miss,   NULL,         NULL},
+    {"resolve_actual_path/local",  bench_resolve_local,         NULL,         NULL},
+    {"resolve_actual_path/external", bench_resolve_external,    NULL,         NULL},
+    {"resolve_actual_path/miss",   bench_resolve_miss,          NULL,         NULL},
+    {"queue_callback",             bench_queue_callback,        NULL,         NULL},
+    {"getattr/local",              bench_getattr_local,         NULL,         NULL},
+    {"getattr/external",           bench_getattr_external,      NULL,         NULL},
+    {"getattr/miss",               bench_getattr_miss,          NULL,         NULL},
+    {"readdir/merge",              bench_readdir_merge,         NULL,         NULL},
+    {"access",                     bench_access,                NULL,         NULL},
+    {"open+release/local",         bench_open_release_local,    NULL,         NULL},
+    {"open+release/external",      bench_open_release_external, NULL,         NULL},
+    {"read/4k",                    bench_read_4k,               setup_read,   release_bench_handle},
+    {"write/4k",                   bench_write_4k,              setup_write,  release_bench_handle},
+    {"write/1k-seq",               bench_write_1k_seq,          setup_write,  release_bench_handle},
+    {"write/1k-seq-unbuffered",    bench_write_1k_seq,          setup_write_unbuffered, release_write_unbuffered},
+    {"create+unlink",              bench_create_unlink,         NULL,         NULL},
+    {"rename/pair",                bench_rename_pair,           setup_rename, NULL},
+};
+
+// ============================================================
+// Baseline comparison
+// ============================================================
+
+static int compare_with_baseline(const BenchResult *results, int count) {
+    FILE *f = fopen(g_bench.compare, "r");
+    if (!f) {
+        fprintf(stderr, BENCH_PREFIX "Cannot open baseline %s: %s\n", g_bench.compare, strerror(errno));
+        return 2;
+    }
+
+    int regressions = 0;
+    char line[512];
+    while (fgets(line, sizeof(line), f)) {
+        char name[256];
+        double ns, allocs, syscalls;
+        if (sscanf(line, "%255[^,],%lf,%lf,%lf", name, &ns, &allocs, &syscalls) != 4) continue;
+
+        for (int i = 0; i < count; i++) {
+            if (strcmp(results[i].name, name) != 0) continue;
+            const BenchResult *r = &results[i];
+            double slowdown = ns > 0 ? 100.0 * (r->ns_per_op - ns) / ns : 0;
+            int bad = 0;
+            if (slowdown > g_bench.tolerance) bad = 1;
+            if (r->allocs_per_op > allocs + 0.01) bad = 1;
+            if (r->syscalls_per_op > syscalls + 0.01) bad = 1;
+            if (bad) {
+                regressions++;
+                fprintf(stderr, BENCH_PREFIX "REGRESSION %s: ns/op %.1f -> %.1f (%+.1f%%), "
+                        "allocs/op %.2f -> %.2f, syscalls/op %.2f -> %.2f\n",
+                        name, ns, r->ns_per_op, slowdown, allocs, r->allocs_per_op,
+                        syscalls, r->syscalls_per_op);
+            }
+        }
+    }
+    fclose(f);
+
+    if (regressions == 0) {
+        fprintf(stderr, BENCH_PREFIX "No regressions against %s (tolerance %.0f%%)\n",
+                g_bench.compare, g_bench.tolerance);
+    }
+    return regressions ? 1 : 0;
+}
+
+// ============================================================
+// Main
+// ============================================================
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--csv") == 0) {
+            g_bench.csv = 1;
+        } else if (strcmp(a, "--filter") == 0 && v) {
+            g_bench.filter = v;
+            i++;
+        } else if (strcmp(a, "--min-time-ms") == 0 && v) {
+            g_bench.min_time_ms = atoi(v) > 0 ? atoi(v) : 1;
+            i++;
+        } else if (strcmp(a, "--entries") == 0 && v) {
+            g_bench.entries = atoi(v) > 0 ? atoi(v) : 1;
+            i++;
+        } else if (strcmp(a, "--compare") == 0 && v) {
+            g_bench.compare = v;
+            i++;
+        } else if (strcmp(a, "--tolerance") == 0 && v) {
+            g_bench.tolerance = atof(v);
+            i++;
+        } else {
+            fprintf(stderr, "Usage: %s [--filter S] [--min-time-ms MS] [--entries N] [--csv]\n"
+                            "          [--compare BASELINE.csv] [--tolerance PCT]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (setup_fixture() != 0) {
+        fprintf(stderr, BENCH_PREFIX "Fixture setup failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    // Keep the core quiet; logging cost is not what we measure
+    fuse_wrapper_set_log_path("/dev/null");
+
+    if (fuse_wrapper_test_attach(g_bench.local_dir, g_bench.external_dir) != FUSE_WRAPPER_OK) {
+        fprintf(stderr, BENCH_PREFIX "fuse_wrapper_test_attach failed\n");
+        return 1;
+    }
+    fuse_wrapper_set_index_ready(true);
+    g_ops_table = fuse_wrapper_test_operations();
+    memset(g_io_buf, 'w', sizeof(g_io_buf));
+
+    int count = (int)(sizeof(g_benches) / sizeof(g_benches[0]));
+    BenchResult results[sizeof(g_benches) / sizeof(g_benches[0])];
+    int ran = 0;
+
+    if (!g_bench.csv) {
+        printf("%-32s %12s %10s %10s %12s\n", "benchmark", "ns/op", "allocs/op", "frees/op", "syscalls/op");
+    }
+    for (int i = 0; i < count; i++) {
+        if (g_bench.filter && !strstr(g_benches[i].name, g_bench.filter)) continue;
+        BenchResult r = run_bench(&g_benches[i]);
+        results[ran++] = r;
+        if (g_bench.csv) {
+            printf("%s,%.1f,%.2f,%.2f\n", r.name, r.ns_per_op, r.allocs_per_op, r.syscalls_per_op);
+        } else {
+            printf("%-32s %12.1f %10.2f %10.2f %12.2f\n",
+                   r.name, r.ns_per_op, r.allocs_per_op, r.frees_per_op, r.syscalls_per_op);
+        }
+        fflush(stdout);
+    }
+
+    fuse_wrapper_test_detach();
+
+    return g_bench.compare ? compare_with_baseline(results, ran) : 0;
+}
@@ -0,0 +1,723 @@
+/*
+ * slow_external.c
+ * DMSA - Slow/flaky external drive emulator
+ *
+ * Passthrough FUSE filesystem that stands in for the EXTERNAL tier (a USB HDD)
+ * during development and benchmarking. Every operation is forwarded to a backing
+ * directory after injecting configurable faults:
+ *
+ *   - per-op latency distributions (fixed / uniform / exponential / normal)
+ *   - spin-up delay on the first operation after an idle period
+ *   - read/write bandwidth cap (token bucket)
+ *   - EIO bursts (probability to start a burst, burst length in ops)
+ *   - sudden disappearance (all ops fail with ENODEV/ENXIO) after N ops,
+ *     after T seconds, or on SIGUSR1 (toggle)
+ *
+ * All randomness comes from a seeded PRNG, so a single-threaded workload run with
+ * the same --seed sees exactly the same delays and failures. Point DMSA's
+ * EXTERNAL_DIR (or the stress/microbench --external option) at the mount point.
+ *
+ * Build (macFUSE):
+ *   tools/vfs_bench/build.sh slow_external
+ *
+ * Usage:
+ *   slow_external [options] <backing_dir> <mount_point>
+ *
+ *   --seed N                 PRNG seed (default 1)
+ *   --latency DIST           Default latency for every op
+ *   --op-latency OP=DIST     Per-op override (getattr, readdir, open, read, write,
+ *                            create, unlink, mkdir, rmdir, rename, truncate, meta)
+ *   --spinup-ms MS           Delay for the first op after the drive spun down
+ *   --spindown-s S           Idle seconds before the drive spins down (default 30)
+ *   --bandwidth-mbps N       Cap read+write throughput to N MB/s (0 = unlimited)
+ *   --eio-rate P             Probability [0..1] that an op starts an EIO burst
+ *   --eio-burst N            Ops that fail in each burst (default 1)
+ *   --vanish-after-ops N     Disappear after N operations
+ *   --vanish-after-s S       Disappear S seconds after mount
+ *   --vanish-errno NAME      ENODEV (default) or ENXIO
+ *   --stats-interval S       Print counters to stderr every S seconds (0 = off)
+ *   -f / -d                  Passed through to FUSE (foreground / debug)
+ *
+ * DIST syntax:
+ *   fixed:MS | uniform:MIN_MS:MAX_MS | exp:MEAN_MS | normal:MEAN_MS:STDDEV_MS
+ *
+ * Signals:
+ *   SIGUSR1  toggle disappearance (drive unplugged / plugged back)
+ *   SIGUSR2  force an immediate spin-down (next op pays --spinup-ms)
+ *
+ * Example (HDD-like profile):
+ *   slow_external --seed 7 --latency exp:8 --op-latency read=normal:12:4 \
+ *       --spinup-ms 3000 --spindown-s 20 --bandwidth-mbps 80 \
+ *       --eio-rate 0.001 --eio-burst 5 /tmp/ext_backing /tmp/ext_mount
+ */
+
+#define _DARWIN_USE_64_BIT_INODE 1
+#define FUSE_USE_VERSION 26
+
+#include <fuse/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/statvfs.h>
+
+#define LOG_PREFIX "[SLOW-EXT] "
+
+// ============================================================
+// Fault model configuration
+// ============================================================
+
+typedef enum {
+    DIST_NONE = 0,
+    DIST_FIXED,
+    DIST_UNIFORM,
+    DIST_EXP,
+    DIST_NORMAL
+} DistKind;
+
+typedef struct {
+    DistKind kind;
+    double a;   // fixed value / min / mean
+    double b;   // max / stddev
+} LatencyDist;
+
+typedef enum {
+    SOP_GETATTR,
+    SOP_READDIR,
+    SOP_OPEN,
+    SOP_READ,
+    SOP_WRITE,
+    SOP_CREATE,
+    SOP_UNLINK,
+    SOP_MKDIR,
+    SOP_RMDIR,
+    SOP_RENAME,
+    SOP_TRUNCATE,
+    SOP_META,       // chmod/chown/utimens/statfs/readlink/symlink/access/release/fsync
+    SOP_COUNT
+} SlowOp;
+
+static const char *g_op_names[SOP_COUNT] = {
+    "getattr", "readdir", "open", "read", "write", "create",
+    "unlink", "mkdir", "rmdir", "rename", "truncate", "meta"
+};
+
+static struct {
+    char *backing_dir;
+    uint64_t seed;
+    LatencyDist default_latency;
+    LatencyDist op_latency[SOP_COUNT];
+    int spinup_ms;
+    int spindown_s;
+    double bandwidth_bps;       // 0 = unlimited
+    double eio_rate;
+    int eio_burst;
+    uint64_t vanish_after_ops;  // 0 = never
+    int vanish_after_s;         // 0 = never
+    int vanish_errno;
+    int stats_interval;
+} g_cfg = {
+    .seed = 1,
+    .spindown_s = 30,
+    .eio_burst = 1,
+    .vanish_errno = ENODEV,
+};
+
+// ============================================================
+// Runtime fault state
+// ============================================================
+
+static struct {
+    pthread_mutex_t lock;
+    uint64_t rng;               // xorshift64* state
+    uint64_t op_count;
+    int eio_remaining;          // ops left in the current EIO burst
+    time_t last_op_time;        // for spin-down detection
+    int spun_down;
+    time_t mount_time;
+    // Token bucket for bandwidth cap
+    double tokens;
+    uint64_t last_refill_ns;
+} g_fault = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .spun_down = 1,             // Drive starts asleep: first op pays spin-up
+};
+
+static volatile sig_atomic_t g_vanished = 0;
+static volatile sig_atomic_t g_force_spindown = 0;
+
+// Counters (reported on exit / every --stats-interval seconds)
+static volatile uint64_t g_stat_ops[SOP_COUNT];
+static volatile uint64_t g_stat_delay_us = 0;
+static volatile uint64_t g_stat_spinups = 0;
+static volatile uint64_t g_stat_eio = 0;
+static volatile uint64_t g_stat_vanished = 0;
+static volatile uint64_t g_stat_bytes = 0;
+static volatile uint64_t g_stat_throttle_us = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_us(uint64_t us) {
+    if (us == 0) return;
+    struct timespec ts = {
+        .tv_sec = (time_t)(us / 1000000),
+        .tv_nsec = (long)((us % 1000000) * 1000)
+    };
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {
+        // Resume remaining sleep after signal
+    }
+}
+
+// xorshift64* - called with g_fault.lock held
+static double rng_next_unit_locked(void) {
+    uint64_t x = g_fault.rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    g_fault.rng = x;
+    return (double)((x * 0x2545F4914F6CDD1DULL) >> 11) / (double)(1ULL << 53);
+}
+
+// Sample a latency in microseconds (called with g_fault.lock held)
+static uint64_t sample_latency_us_locked(const LatencyDist *d) {
+    double ms = 0;
+    switch (d->kind) {
+        case DIST_NONE:
+            return 0;
+        case DIST_FIXED:
+            ms = d->a;
+            break;
+        case DIST_UNIFORM:
+            ms = d->a + (d->b - d->a) * rng_next_unit_locked();
+            break;
+        case DIST_EXP: {
+            double u = rng_next_unit_locked();
+            if (u < 1e-12) u = 1e-12;
+            ms = -d->a * log(u);
+            break;
+        }
+        case DIST_NORMAL: {
+            // Box-Muller
+            double u1 = rng_next_unit_locked();
+            double u2 = rng_next_unit_locked();
+            if (u1 < 1e-12) u1 = 1e-12;
+            ms = d->a + d->b * sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+            break;
+        }
+    }
+    if (ms < 0) ms = 0;
+    return (uint64_t)(ms * 1000.0);
+}
+
+// Core fault injection - called at the start of every operation.
+// Returns 0 to proceed, or a negative errno to fail the operation.
+static int inject_faults(SlowOp op) {
+    __sync_fetch_and_add(&g_stat_ops[op], 1);
+
+    uint64_t delay_us = 0;
+    int result = 0;
+
+    pthread_mutex_lock(&g_fault.lock);
+
+    g_fault.op_count++;
+    time_t now = time(NULL);
+
+    // Disappearance triggers (sticky until SIGUSR1 toggles it back)
+    if (!g_vanished) {
+        if (g_cfg.vanish_after_ops && g_fault.op_count > g_cfg.vanish_after_ops) {
+            g_vanished = 1;
+            fprintf(stderr, LOG_PREFIX "Drive vanished after %llu ops\n",
+                    (unsigned long long)g_cfg.vanish_after_ops);
+        } else if (g_cfg.vanish_after_s && now - g_fault.mount_time >= g_cfg.vanish_after_s) {
+            g_vanished = 1;
+            fprintf(stderr, LOG_PREFIX "Drive vanished after %d seconds\n", g_cfg.vanish_after_s);
+        }
+    }
+    if (g_vanished) {
+        pthread_mutex_unlock(&g_fault.lock);
+        __sync_fetch_and_add(&g_stat_vanished, 1);
+        return -g_cfg.vanish_errno;
+    }
+
+    // Spin-down after idle, spin-up on next access
+    if (g_force_spindown ||
+        (g_cfg.spindown_s > 0 && g_fault.last_op_time > 0 &&
+         now - g_fault.last_op_time >= g_cfg.spindown_s)) {
+        g_fault.spun_down = 1;
+        g_force_spindown = 0;
+    }
+    if (g_fault.spun_down) {
+        g_fault.spun_down = 0;
+        delay_us += (uint64_t)g_cfg.spinup_ms * 1000;
+        __sync_fetch_and_add(&g_stat_spinups, 1);
+    }
+    g_fault.last_op_time = now;
+
+    // EIO bursts
+    if (g_fault.eio_remaining > 0) {
+        g_fault.eio_remaining--;
+        result = -EIO;
+    } else if (g_cfg.eio_rate > 0 && rng_next_unit_locked() < g_cfg.eio_rate) {
+        g_fault.eio_remaining = g_cfg.eio_burst - 1;
+        result = -EIO;
+    }
+
+    // Per-op latency
+    const LatencyDist *dist = g_cfg.op_latency[op].kind != DIST_NONE
+        ? &g_cfg.op_latency[op] : &g_cfg.default_latency;
+    delay_us += sample_latency_us_locked(dist);
+
+    pthread_mutex_unlock(&g_fault.lock);
+
+    // Sleep outside the lock so concurrent ops overlap like on a real device queue
+    sleep_us(delay_us);
+    __sync_fetch_and_add(&g_stat_delay_us, delay_us);
+
+    if (result) {
+        __sync_fetch_and_add(&g_stat_eio, 1);
+    }
+    return result;
+}
+
+// Bandwidth cap: block until `bytes` tokens are available
+static void throttle_bytes(size_t bytes) {
+    __sync_fetch_and_add(&g_stat_bytes, bytes);
+    if (g_cfg.bandwidth_bps <= 0 || bytes == 0) return;
+
+    pthread_mutex_lock(&g_fault.lock);
+    uint64_t t = now_ns();
+    if (g_fault.last_refill_ns == 0) {
+        g_fault.last_refill_ns = t;
+        g_fault.tokens = g_cfg.bandwidth_bps / 10.0;  // 100ms burst allowance
+    }
+    g_fault.tokens += (double)(t - g_fault.last_refill_ns) * g_cfg.bandwidth_bps / 1e9;
+    if (g_fault.tokens > g_cfg.bandwidth_bps / 10.0) {
+        g_fault.tokens = g_cfg.bandwidth_bps / 10.0;
+    }
+    g_fault.last_refill_ns = t;
+
+    // Reserve tokens now (may go negative), sleep off the debt outside the lock
+    g_fault.tokens -= (double)bytes;
+    uint64_t wait_us = 0;
+    if (g_fault.tokens < 0) {
+        wait_us = (uint64_t)(-g_fault.tokens * 1e6 / g_cfg.bandwidth_bps);
+    }
+    pthread_mutex_unlock(&g_fault.lock);
+
+    sleep_us(wait_us);
+    __sync_fetch_and_add(&g_stat_throttle_us, wait_us);
+}
+
+// ============================================================
+// Path helpers
+// ============================================================
+
+static int backing_path(char *out, size_t out_size, const char *path) {
+    while (*path == '/') path++;
+    int n = snprintf(out, out_size, "%s/%s", g_cfg.backing_dir, path);
+    if (n < 0 || (size_t)n >= out_size) return -ENAMETOOLONG;
+    return 0;
+}
+
+#define FAULT_OR_RETURN(op) do { \
+    int _f = inject_faults(op); \
+    if (_f) return _f; \
+} while (0)
+
+#define BACKING_OR_RETURN(var, path) \
+    char var[4096]; \
+    do { \
+        int _r = backing_path(var, sizeof(var), path); \
+        if (_r) return _r; \
+    } while (0)
+
+// ============================================================
+// FUSE callback functions (passthrough)
+// ============================================================
+
+static int slow_getattr(const char *path, struct stat *stbuf) {
+    FAULT_OR_RETURN(SOP_GETATTR);
+    BACKING_OR_RETURN(bp, path);
+    return lstat(bp, stbuf) == -1 ? -errno : 0;
+}
+
+static int slow_readdir(const char *path, void *buf, fuse_fill_dir_t filler,
+                        off_t offset, struct fuse_file_info *fi) {
+    (void)offset;
+    (void)fi;
+    FAULT_OR_RETURN(SOP_READDIR);
+    BACKING_OR_RETURN(bp, path);
+
+    DIR *dp = opendir(bp);
+    if (!dp) return -errno;
+
+    struct dirent *de;
+    while ((de = readdir(dp)) != NULL) {
+        if (filler(buf, de->d_name, NULL, 0)) break;
+    }
+    closedir(dp);
+    return 0;
+}
+
+static int slow_open(const char *path, struct fuse_file_info *fi) {
+    FAULT_OR_RETURN(SOP_OPEN);
+    BACKING_OR_RETURN(bp, path);
+    int fd = open(bp, fi->flags);
+    if (fd == -1) return -errno;
+    fi->fh = fd;
+    // Never let the kernel cache hide the emulated device latency
+    fi->direct_io = 1;
+    return 0;
+}
+
+static int slow_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    FAULT_OR_RETURN(SOP_CREATE);
+    BACKING_OR_RETURN(bp, path);
+    int fd = open(bp, fi->flags | O_CREAT, mode);
+    if (fd == -1) return -errno;
+    fi->fh = fd;
+    fi->direct_io = 1;
+    return 0;
+}
+
+static int slow_read(const char *path, char *buf, size_t size, off_t offset,
+                     struct fuse_file_info *fi) {
+    (void)path;
+    FAULT_OR_RETURN(SOP_READ);
+    ssize_t res = pread((int)fi->fh, buf, size, offset);
+    if (res == -1) return -errno;
+    throttle_bytes((size_t)res);
+    return (int)res;
+}
+
+static int slow_write(const char *path, const char *buf, size_t size, off_t offset,
+                      struct fuse_file_info *fi) {
+    (void)path;
+    FAULT_OR_RETURN(SOP_WRITE);
+    throttle_bytes(size);
+    ssize_t res = pwrite((int)fi->fh, buf, size, offset);
+    return res == -1 ? -errno : (int)res;
+}
+
+static int slow_release(const char *path, struct fuse_file_info *fi) {
+    (void)path;
+    // Never fail release - the kernel ignores the result and the fd must be closed
+    close((int)fi->fh);
+    return 0;
+}
+
+static int slow_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    (void)path;
+    (void)datasync;
+    FAULT_OR_RETURN(SOP_META);
+    return fsync((int)fi->fh) == -1 ? -errno : 0;
+}
+
+static int slow_unlink(const char *path) {
+    FAULT_OR_RETURN(SOP_UNLINK);
+    BACKING_OR_RETURN(bp, path);
+    return unlink(bp) == -1 ? -errno : 0;
+}
+
+static int slow_mkdir(const char *path, mode_t mode) {
+    FAULT_OR_RETURN(SOP_MKDIR);
+    BACKING_OR_RETURN(bp, path);
+    return mkdir(bp, mode) == -1 ? -errno : 0;
+}
+
+static int slow_rmdir(const char *path) {
+    FAULT_OR_RETURN(SOP_RMDIR);
+    BACKING_OR_RETURN(bp, path);
+    return rmdir(bp) == -1 ? -errno : 0;
+}
+
+static int slow_rename(const char *from, const char *to) {
+    FAULT_OR_RETURN(SOP_RENAME);
+    BACKING_OR_RETURN(bp_from, from);
+    BACKING_OR_RETURN(bp_to, to);
+    return rename(bp_from, bp_to) == -1 ? -errno : 0;
+}
+
+static int slow_truncate(const char *path, off_t size) {
+    FAULT_OR_RETURN(SOP_TRUNCATE);
+    BACKING_OR_RETURN(bp, path);
+    return truncate(bp, size) == -1 ? -errno : 0;
+}
+
+static int slow_chmod(const char *path, mode_t mode) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, path);
+    return chmod(bp, mode) == -1 ? -errno : 0;
+}
+
+static int slow_chown(const char *path, uid_t uid, gid_t gid) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, path);
+    return lchown(bp, uid, gid) == -1 ? -errno : 0;
+}
+
+static int slow_utimens(const char *path, const struct timespec ts[2]) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, path);
+    return utimensat(AT_FDCWD, bp, ts, AT_SYMLINK_NOFOLLOW) == -1 ? -errno : 0;
+}
+
+static int slow_statfs(const char *path, struct statvfs *stbuf) {
+    (void)path;
+    FAULT_OR_RETURN(SOP_META);
+    return statvfs(g_cfg.backing_dir, stbuf) == -1 ? -errno : 0;
+}
+
+static int slow_readlink(const char *path, char *buf, size_t size) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, path);
+    ssize_t res = readlink(bp, buf, size - 1);
+    if (res == -1) return -errno;
+    buf[res] = '\0';
+    return 0;
+}
+
+static int slow_symlink(const char *target, const char *linkpath) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, linkpath);
+    return symlink(target, bp) == -1 ? -errno : 0;
+}
+
+static int slow_access(const char *path, int mask) {
+    FAULT_OR_RETURN(SOP_META);
+    BACKING_OR_RETURN(bp, path);
+    return access(bp, mask) == -1 ? -errno : 0;
+}
+
+static struct fuse_operations slow_oper = {
+    .getattr  = slow_getattr,
+    .readdir  = slow_readdir,
+    .open     = slow_open,
+    .create   = slow_create,
+    .read     = slow_read,
+    .write    = slow_write,
+    .release  = slow_release,
+    .fsync    = slow_fsync,
+    .unlink   = slow_unlink,
+    .mkdir    = slow_mkdir,
+    .rmdir    = slow_rmdir,
+    .rename   = slow_rename,
+    .truncate = slow_truncate,
+    .chmod    = slow_chmod,
+    .chown    = slow_chown,
+    .utimens  = slow_utimens,
+    .statfs   = slow_statfs,
+    .readlink = slow_readlink,
+    .symlink  = slow_symlink,
+    .access   = slow_access,
+};
+
+// ============================================================
+// Statistics and signals
+// ============================================================
+
+static void print_stats(void) {
+    fprintf(stderr, LOG_PREFIX "ops:");
+    for (int i = 0; i < SOP_COUNT; i++) {
+        fprintf(stderr, " %s=%llu", g_op_names[i], (unsigned long long)g_stat_ops[i]);
+    }
+    fprintf(stderr, "\n" LOG_PREFIX "injected: delay=%.1fs spinups=%llu eio=%llu vanished=%llu "
+            "throttle=%.1fs bytes=%llu\n",
+            (double)g_stat_delay_us / 1e6,
+            (unsigned long long)g_stat_spinups,
+            (unsigned long long)g_stat_eio,
+            (unsigned long long)g_stat_vanished,
+            (double)g_stat_throttle_us / 1e6,
+            (unsigned long long)g_stat_bytes);
+}
+
+static void* stats_thread(void *arg) {
+    (void)arg;
+    for (;;) {
+        sleep((unsigned)g_cfg.stats_interval);
+        print_stats();
+    }
+    return NULL;
+}
+
+static void control_signal_handler(int sig) {
+    if (sig == SIGUSR1) {
+        g_vanished = !g_vanished;
+    } else if (sig == SIGUSR2) {
+        g_force_spindown = 1;
+    }
+}
+
+// ============================================================
+// Argument parsing
+// ============================================================
+
+static int parse_dist(const char *s, LatencyDist *out) {
+    memset(out, 0, sizeof(*out));
+    if (strncmp(s, "fixed:", 6) == 0) {
+        out->kind = DIST_FIXED;
+        return sscanf(s + 6, "%lf", &out->a) == 1 ? 0 : -1;
+    }
+    if (strncmp(s, "uniform:", 8) == 0) {
+        out->kind = DIST_UNIFORM;
+        return sscanf(s + 8, "%lf:%lf", &out->a, &out->b) == 2 && out->b >= out->a ? 0 : -1;
+    }
+    if (strncmp(s, "exp:", 4) == 0) {
+        out->kind = DIST_EXP;
+        return sscanf(s + 4, "%lf", &out->a) == 1 ? 0 : -1;
+    }
+    if (strncmp(s, "normal:", 7) == 0) {
+        out->kind = DIST_NORMAL;
+        return sscanf(s + 7, "%lf:%lf", &out->a, &out->b) == 2 ? 0 : -1;
+    }
+    return -1;
+}
+
+static int parse_op_latency(const char *s) {
+    const char *eq = strchr(s, '=');
+    if (!eq) return -1;
+    for (int i = 0; i < SOP_COUNT; i++) {
+        size_t len = strlen(g_op_names[i]);
+        if ((size_t)(eq - s) == len && strncmp(s, g_op_names[i], len) == 0) {
+            return parse_dist(eq + 1, &g_cfg.op_latency[i]);
+        }
+    }
+    return -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [options] <backing_dir> <mount_point>\n"
+            "  --seed N  --latency DIST  --op-latency OP=DIST\n"
+            "  --spinup-ms MS  --spindown-s S  --bandwidth-mbps N\n"
+            "  --eio-rate P  --eio-burst N\n"
+            "  --vanish-after-ops N  --vanish-after-s S  --vanish-errno ENODEV|ENXIO\n"
+            "  --stats-interval S  -f  -d\n"
+            "DIST: fixed:MS | uniform:MIN:MAX | exp:MEAN | normal:MEAN:STDDEV\n",
+            prog);
+}
+
+int main(int argc, char *argv[]) {
+    struct fuse_args args = FUSE_ARGS_INIT(0, NULL);
+    fuse_opt_add_arg(&args, argv[0]);
+
+    const char *positional[2] = {NULL, NULL};
+    int npos = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        int bad = 0;
+
+        if (strcmp(a, "-f") == 0 || strcmp(a, "-d") == 0 || strcmp(a, "-s") == 0) {
+            fuse_opt_add_arg(&args, a);
+            continue;
+        }
+        if (strcmp(a, "-o") == 0 && v) {
+            fuse_opt_add_arg(&args, a);
+            fuse_opt_add_arg(&args, v);
+            i++;
+            continue;
+        }
+        if (strncmp(a, "--", 2) != 0) {
+            if (npos < 2) positional[npos++] = a;
+            continue;
+        }
+        if (!v) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (strcmp(a, "--seed") == 0) {
+            g_cfg.seed = strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--latency") == 0) {
+            bad = parse_dist(v, &g_cfg.default_latency);
+        } else if (strcmp(a, "--op-latency") == 0) {
+            bad = parse_op_latency(v);
+        } else if (strcmp(a, "--spinup-ms") == 0) {
+            g_cfg.spinup_ms = atoi(v);
+        } else if (strcmp(a, "--spindown-s") == 0) {
+            g_cfg.spindown_s = atoi(v);
+        } else if (strcmp(a, "--bandwidth-mbps") == 0) {
+            g_cfg.bandwidth_bps = atof(v) * 1024.0 * 1024.0;
+        } else if (strcmp(a, "--eio-rate") == 0) {
+            g_cfg.eio_rate = atof(v);
+        } else if (strcmp(a, "--eio-burst") == 0) {
+            g_cfg.eio_burst = atoi(v) > 0 ? atoi(v) : 1;
+        } else if (strcmp(a, "--vanish-after-ops") == 0) {
+            g_cfg.vanish_after_ops = strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--vanish-after-s") == 0) {
+            g_cfg.vanish_after_s = atoi(v);
+        } else if (strcmp(a, "--vanish-errno") == 0) {
+            if (strcmp(v, "ENODEV") == 0) g_cfg.vanish_errno = ENODEV;
+            else if (strcmp(v, "ENXIO") == 0) g_cfg.vanish_errno = ENXIO;
+            else bad = 1;
+        } else if (strcmp(a, "--stats-interval") == 0) {
+            g_cfg.stats_interval = atoi(v);
+        } else {
+            bad = 1;
+        }
+
+        if (bad) {
+            fprintf(stderr, LOG_PREFIX "Invalid option: %s %s\n", a, v);
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (npos != 2) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    g_cfg.backing_dir = realpath(positional[0], NULL);
+    if (!g_cfg.backing_dir) {
+        fprintf(stderr, LOG_PREFIX "Backing dir not found: %s (errno=%d)\n", positional[0], errno);
+        return 1;
+    }
+    fuse_opt_add_arg(&args, positional[1]);
+
+    g_fault.rng = g_cfg.seed ? g_cfg.seed : 0x9E3779B97F4A7C15ULL;
+    g_fault.mount_time = time(NULL);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = control_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+    sigaction(SIGUSR2, &sa, NULL);
+
+    if (g_cfg.stats_interval > 0) {
+        pthread_t t;
+        pthread_create(&t, NULL, stats_thread, NULL);
+        pthread_detach(t);
+    }
+
+    fprintf(stderr, LOG_PREFIX "Serving %s at %s (seed=%llu, spinup=%dms, bw=%.0fB/s, eio=%.4f x%d)\n",
+            g_cfg.backing_dir, positional[1], (unsigned long long)g_cfg.seed,
+            g_cfg.spinup_ms, g_cfg.bandwidth_bps, g_cfg.eio_rate, g_cfg.eio_burst);
+
+    int res = fuse_main(args.argc, args.argv, &slow_oper, NULL);
+
+    print_stats();
+    fuse_opt_free_args(&args);
+    free(g_cfg.backing_dir);
+    return res;
+}
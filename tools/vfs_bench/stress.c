@@ -0,0 +1,842 @@
+/*
+ * stress.c
+ * DMSA - Multi-threaded stress and scaling harness for the FUSE handlers
+ *
+ * Drives the dmsa_* operations concurrently with a weighted mixed workload at
+ * increasing thread counts (1..64) and reports throughput scaling, latency and
+ * per-mutex contention. Two modes:
+ *
+ *   inproc  Calls the handler table directly (fuse_wrapper_test_operations()),
+ *           no kernel involved. Lock wait times come from the core
+ *           lock profiler (fuse_wrapper_get_diagnostics_ex()).
+ *   mount   Issues POSIX syscalls against a live DMSA mount point.
+ *
+ * Build:
+ *   tools/vfs_bench/build.sh stress        # optimized
+ *   tools/vfs_bench/build.sh --tsan stress # ThreadSanitizer configuration
+ *
+ * Usage:
+ *   dmsa_stress [options]
+ *
+ *   --mode inproc|mount      Default inproc
+ *   --threads LIST           Thread counts, default 1,2,4,8,16,32,64
+ *   --duration S             Seconds per thread count (default 5)
+ *   --files N                Dataset size (default 2000)
+ *   --dirs N                 Directories the dataset is spread over (default 20)
+ *   --file-size BYTES        Size of each dataset file (default 65536)
+ *   --io-size BYTES          read/write request size (default 4096)
+ *   --place-size BYTES       Bytes written by each place op (default 4 MiB)
+ *   --mix SPEC               Weighted op mix, default
+ *                            getattr=40,read=20,readdir=10,write=10,create=10,unlink=5,rename=5
+ *                            (place=0: create a scratch file and write --place-size
+ *                            bytes to it in --io-size requests)
+ *   --local DIR              inproc: LOCAL dir (default: fresh temp dir)
+ *   --external DIR           inproc: EXTERNAL dir (default: fresh temp dir; may be a
+ *                            slow_external mount)
+ *   --mount DIR              mount: path inside a mounted DMSA volume
+ *   --qos CLASS              inproc: run as interactive|background|bulk client
+ *                            (measures QoS throttling and copy-up denial)
+ *   --shm FILE               inproc: publish live metrics to FILE (watch with dmsa_vfsstat)
+ *   --metrics-socket PATH    inproc: serve OpenMetrics on a Unix socket
+ *                            (curl --unix-socket PATH http://localhost/metrics)
+ *   --set NAME=VALUE         inproc: set a runtime tunable before the run (repeatable),
+ *                            e.g. --set max_open_files=1024 --set background_slots=8
+ *   --csv                    Machine-readable output
+ *
+ * Placement scenario (inproc): large new files migrating to EXTERNAL while the
+ * rest of the mix runs, with unlink/rename hitting files mid-migration:
+ *   slow_external --latency exp:8 /tmp/ext_backing /tmp/slow &
+ *   dmsa_stress --external /tmp/slow --mix getattr=40,read=20,place=10,unlink=5,rename=5 \
+ *       --set placement_max_local_size=1048576
+ * The getattr/read p99 then shows whether a slow EXTERNAL stalls the write path.
+ *
+ * Dataset layout (inproc): files d###/f##### spread over the tiers - even indices
+ * LOCAL only, odd indices EXTERNAL only, every 5th in both - so resolve, readdir
+ * merging and copy-up all get exercised.
+ */
+
+#define _DARWIN_USE_64_BIT_INODE 1
+#define FUSE_USE_VERSION 26
+#define DMSA_FUSE_TEST_HOOKS 1
+
+#include <fuse/fuse.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "fuse_wrapper.h"
+
+#define LOG_PREFIX "[STRESS] "
+#define MAX_THREADS 64
+#define MAX_STEPS 16
+#define SCRATCH_RING 64
+#define OP_PATH_MAX 256
+#define HIST_BUCKETS 64
+
+// ============================================================
+// Workload definition
+// ============================================================
+
+typedef enum {
+    W_GETATTR,
+    W_READ,
+    W_READDIR,
+    W_WRITE,
+    W_CREATE,
+    W_UNLINK,
+    W_RENAME,
+    W_PLACE,
+    W_COUNT
+} WorkOp;
+
+static const char *g_work_names[W_COUNT] = {
+    "getattr", "read", "readdir", "write", "create", "unlink", "rename", "place"
+};
+
+static struct {
+    int mode_mount;
+    int thread_counts[MAX_STEPS];
+    int step_count;
+    int duration;
+    int files;
+    int dirs;
+    size_t file_size;
+    size_t io_size;
+    size_t place_size;
+    int mix[W_COUNT];
+    int mix_total;
+    char *local_dir;
+    char *external_dir;
+    char *mount_dir;
+    char *shm_path;
+    char *metrics_socket;
+    char *tunables[FUSE_TUNABLE_COUNT];
+    int tunable_count;
+    int qos;
+    int csv;
+} g_opt = {
+    .duration = 5,
+    .files = 2000,
+    .dirs = 20,
+    .file_size = 65536,
+    .io_size = 4096,
+    .place_size = 4 * 1024 * 1024,
+    .mix = {40, 20, 10, 10, 10, 5, 5, 0},
+};
+
+static volatile int g_stop = 0;
+static const struct fuse_operations *g_ops = NULL;
+
+// ============================================================
+// Backends - in-process handler calls or syscalls on a mount
+// ============================================================
+
+static int noop_filler(void *buf, const char *name, const struct stat *st, off_t off) {
+    (void)name;
+    (void)st;
+    (void)off;
+    (*(int *)buf)++;
+    return 0;
+}
+
+static int inproc_run(WorkOp op, const char *path, const char *path2, char *buf, off_t off) {
+    struct stat st;
+    struct fuse_file_info fi;
+    int res;
+
+    switch (op) {
+        case W_GETATTR:
+            return g_ops->getattr(path, &st);
+        case W_READDIR: {
+            int entries = 0;
+            return g_ops->readdir(path, &entries, noop_filler, 0, NULL);
+        }
+        case W_READ:
+            memset(&fi, 0, sizeof(fi));
+            fi.flags = O_RDONLY;
+            res = g_ops->open(path, &fi);
+            if (res != 0) return res;
+            res = g_ops->read(path, buf, g_opt.io_size, off, &fi);
+            g_ops->release(path, &fi);
+            return res < 0 ? res : 0;
+        case W_WRITE:
+            memset(&fi, 0, sizeof(fi));
+            fi.flags = O_WRONLY;
+            res = g_ops->open(path, &fi);
+            if (res != 0) return res;
+            res = g_ops->write(path, buf, g_opt.io_size, off, &fi);
+            g_ops->release(path, &fi);
+            return res < 0 ? res : 0;
+        case W_CREATE:
+            memset(&fi, 0, sizeof(fi));
+            fi.flags = O_CREAT | O_WRONLY | O_TRUNC;
+            res = g_ops->create(path, 0644, &fi);
+            if (res != 0) return res;
+            g_ops->write(path, buf, g_opt.io_size, 0, &fi);
+            g_ops->release(path, &fi);
+            return 0;
+        case W_PLACE:
+            memset(&fi, 0, sizeof(fi));
+            fi.flags = O_CREAT | O_WRONLY | O_TRUNC;
+            res = g_ops->create(path, 0644, &fi);
+            if (res != 0) return res;
+            for (size_t done = 0; done < g_opt.place_size && res >= 0; done += g_opt.io_size) {
+                res = g_ops->write(path, buf, g_opt.io_size, (off_t)done, &fi);
+            }
+            g_ops->release(path, &fi);
+            return res < 0 ? res : 0;
+        case W_UNLINK:
+            return g_ops->unlink(path);
+        case W_RENAME:
+            return g_ops->rename(path, path2);
+        default:
+            return -EINVAL;
+    }
+}
+
+static int mount_run(WorkOp op, const char *path, const char *path2, char *buf, off_t off) {
+    char full[4096], full2[4096];
+    snprintf(full, sizeof(full), "%s%s", g_opt.mount_dir, path);
+    if (path2) snprintf(full2, sizeof(full2), "%s%s", g_opt.mount_dir, path2);
+
+    struct stat st;
+    int fd;
+    ssize_t n;
+
+    switch (op) {
+        case W_GETATTR:
+            return stat(full, &st) == 0 ? 0 : -errno;
+        case W_READDIR: {
+            DIR *dp = opendir(full);
+            if (!dp) return -errno;
+            while (readdir(dp) != NULL) {
+            }
+            closedir(dp);
+            return 0;
+        }
+        case W_READ:
+            fd = open(full, O_RDONLY);
+            if (fd == -1) return -errno;
+            n = pread(fd, buf, g_opt.io_size, off);
+            close(fd);
+            return n < 0 ? -errno : 0;
+        case W_WRITE:
+            fd = open(full, O_WRONLY);
+            if (fd == -1) return -errno;
+            n = pwrite(fd, buf, g_opt.io_size, off);
+            close(fd);
+            return n < 0 ? -errno : 0;
+        case W_CREATE:
+            fd = open(full, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if (fd == -1) return -errno;
+            n = write(fd, buf, g_opt.io_size);
+            close(fd);
+            return 0;
+        case W_PLACE:
+            fd = open(full, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+            if (fd == -1) return -errno;
+            n = 0;
+            for (size_t done = 0; done < g_opt.place_size && n >= 0; done += g_opt.io_size) {
+                n = write(fd, buf, g_opt.io_size);
+            }
+            close(fd);
+            return n < 0 ? -errno : 0;
+        case W_UNLINK:
+            return unlink(full) == 0 ? 0 : -errno;
+        case W_RENAME:
+            return rename(full, full2) == 0 ? 0 : -errno;
+        default:
+            return -EINVAL;
+    }
+}
+
+static int run_op(WorkOp op, const char *path, const char *path2, char *buf, off_t off) {
+    return g_opt.mode_mount
+        ? mount_run(op, path, path2, buf, off)
+        : inproc_run(op, path, path2, buf, off);
+}
+
+// ============================================================
+// Worker threads
+// ============================================================
+
+typedef struct {
+    int id;
+    uint64_t rng;
+    uint64_t ops[W_COUNT];
+    uint64_t errors;
+    uint64_t hist[HIST_BUCKETS];    // log2(ns) latency histogram
+    char scratch[SCRATCH_RING][OP_PATH_MAX]; // thread-private created files
+    int scratch_head;
+    int scratch_count;
+    uint64_t scratch_seq;
+} Worker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t rng_next(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static int log2_bucket(uint64_t v) {
+    int b = 0;
+    while (v > 1 && b < HIST_BUCKETS - 1) {
+        v >>= 1;
+        b++;
+    }
+    return b;
+}
+
+static WorkOp pick_op(Worker *w) {
+    int r = (int)(rng_next(&w->rng) % (uint64_t)g_opt.mix_total);
+    for (int i = 0; i < W_COUNT; i++) {
+        if (r < g_opt.mix[i]) return (WorkOp)i;
+        r -= g_opt.mix[i];
+    }
+    return W_GETATTR;
+}
+
+static void dataset_path(char *out, size_t size, int index) {
+    snprintf(out, size, "/d%03d/f%05d", index % g_opt.dirs, index);
+}
+
+static void* worker_main(void *arg) {
+    Worker *w = arg;
+    char *buf = malloc(g_opt.io_size);
+    memset(buf, 'a' + (w->id % 26), g_opt.io_size);
+
+    char path[OP_PATH_MAX], path2[OP_PATH_MAX];
+    while (!__atomic_load_n(&g_stop, __ATOMIC_RELAXED)) {
+        WorkOp op = pick_op(w);
+        int index = (int)(rng_next(&w->rng) % (uint64_t)g_opt.files);
+        off_t off = 0;
+        const char *p2 = NULL;
+
+        switch (op) {
+            case W_READDIR:
+                snprintf(path, sizeof(path), "/d%03d", index % g_opt.dirs);
+                break;
+            case W_READ:
+            case W_WRITE:
+                dataset_path(path, sizeof(path), index);
+                if (g_opt.file_size > g_opt.io_size) {
+                    off = (off_t)(rng_next(&w->rng) % (g_opt.file_size - g_opt.io_size));
+                }
+                break;
+            case W_CREATE:
+            case W_PLACE: {
+                int slot = (w->scratch_head + w->scratch_count) % SCRATCH_RING;
+                if (w->scratch_count == SCRATCH_RING) {
+                    op = W_UNLINK;  // Ring full, recycle oldest first
+                    snprintf(path, sizeof(path), "%s", w->scratch[w->scratch_head]);
+                    w->scratch_head = (w->scratch_head + 1) % SCRATCH_RING;
+                    w->scratch_count--;
+                    break;
+                }
+                snprintf(w->scratch[slot], sizeof(w->scratch[slot]), "/d%03d/t%02d_%06llu",
+                         index % g_opt.dirs, w->id, (unsigned long long)w->scratch_seq++);
+                snprintf(path, sizeof(path), "%s", w->scratch[slot]);
+                w->scratch_count++;
+                break;
+            }
+            case W_UNLINK:
+            case W_RENAME:
+                if (w->scratch_count == 0) {
+                    op = W_GETATTR;
+                    dataset_path(path, sizeof(path), index);
+                    break;
+                }
+                snprintf(path, sizeof(path), "%s", w->scratch[w->scratch_head]);
+                if (op == W_UNLINK) {
+                    w->scratch_head = (w->scratch_head + 1) % SCRATCH_RING;
+                    w->scratch_count--;
+                } else {
+                    snprintf(path2, sizeof(path2), "/d%03d/t%02d_%06llu",
+                             index % g_opt.dirs, w->id, (unsigned long long)w->scratch_seq++);
+                    snprintf(w->scratch[w->scratch_head], sizeof(w->scratch[0]), "%s", path2);
+                    p2 = path2;
+                }
+                break;
+            default:
+                dataset_path(path, sizeof(path), index);
+                break;
+        }
+
+        uint64_t t0 = now_ns();
+        int res = run_op(op, path, p2, buf, off);
+        uint64_t dt = now_ns() - t0;
+
+        w->ops[op]++;
+        w->hist[log2_bucket(dt)]++;
+        if (res < 0) w->errors++;
+    }
+
+    // Leave the dataset as we found it
+    while (w->scratch_count > 0) {
+        run_op(W_UNLINK, w->scratch[w->scratch_head], NULL, buf, 0);
+        w->scratch_head = (w->scratch_head + 1) % SCRATCH_RING;
+        w->scratch_count--;
+    }
+
+    free(buf);
+    return NULL;
+}
+
+// ============================================================
+// Dataset setup
+// ============================================================
+
+static int write_file(const char *path, size_t size) {
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd == -1) return -errno;
+    char chunk[8192];
+    memset(chunk, 'x', sizeof(chunk));
+    size_t left = size;
+    while (left > 0) {
+        size_t n = left < sizeof(chunk) ? left : sizeof(chunk);
+        if (write(fd, chunk, n) != (ssize_t)n) {
+            int err = errno;
+            close(fd);
+            return -err;
+        }
+        left -= n;
+    }
+    close(fd);
+    return 0;
+}
+
+static int populate_tier(const char *root, int want_local) {
+    char path[4096];
+    for (int d = 0; d < g_opt.dirs; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d", root, d);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -errno;
+    }
+    for (int i = 0; i < g_opt.files; i++) {
+        int on_local = (i % 2 == 0) || (i % 5 == 0);
+        int on_external = (i % 2 == 1) || (i % 5 == 0);
+        if ((want_local && !on_local) || (!want_local && !on_external)) continue;
+        snprintf(path, sizeof(path), "%s/d%03d/f%05d", root, i % g_opt.dirs, i);
+        int res = write_file(path, g_opt.file_size);
+        if (res != 0) return res;
+    }
+    return 0;
+}
+
+static int populate_mount(void) {
+    char path[4096];
+    for (int d = 0; d < g_opt.dirs; d++) {
+        snprintf(path, sizeof(path), "%s/d%03d", g_opt.mount_dir, d);
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) return -errno;
+    }
+    for (int i = 0; i < g_opt.files; i++) {
+        snprintf(path, sizeof(path), "%s/d%03d/f%05d", g_opt.mount_dir, i % g_opt.dirs, i);
+        struct stat st;
+        if (stat(path, &st) == 0 && (size_t)st.st_size >= g_opt.file_size) continue;
+        int res = write_file(path, g_opt.file_size);
+        if (res != 0) return res;
+    }
+    return 0;
+}
+
+// ============================================================
+// Reporting
+// ============================================================
+
+typedef struct {
+    int threads;
+    double ops_per_sec;
+    uint64_t total_ops;
+    uint64_t errors;
+    double p50_us;
+    double p99_us;
+} StepResult;
+
+static double hist_percentile_us(const uint64_t *hist, uint64_t total, double pct) {
+    uint64_t target = (uint64_t)((double)total * pct);
+    uint64_t acc = 0;
+    for (int b = 0; b < HIST_BUCKETS; b++) {
+        acc += hist[b];
+        if (acc > target) {
+            // Report the bucket's upper bound
+            return (double)(1ULL << (b + 1)) / 1000.0;
+        }
+    }
+    return 0;
+}
+
+static void print_locks(int threads, uint64_t total_ops) {
+    static FuseDiagnosticsEx diag;
+    fuse_wrapper_get_diagnostics_ex(&diag);
+    if (!diag.lock_profiling) return;
+
+    if (g_opt.csv) {
+        for (int i = 0; i < FUSE_LOCK_COUNT; i++) {
+            const FuseLockStats *st = &diag.locks[i];
+            printf("lock,%d,%s,%llu,%llu,%.3f,%.3f\n", threads, st->name,
+                   (unsigned long long)st->acquisitions,
+                   (unsigned long long)st->contended,
+                   (double)st->total_wait_ns / 1e6,
+                   (double)st->max_wait_ns / 1e3);
+        }
+        return;
+    }
+
+    printf("  Lock contention @ %d threads:\n", threads);
+    printf("    %-26s %12s %10s %8s %10s %12s %10s\n",
+           "lock", "acquisitions", "contended", "cont%", "wait_ms", "max_wait_us", "wait/op_ns");
+    for (int i = 0; i < FUSE_LOCK_COUNT; i++) {
+        const FuseLockStats *st = &diag.locks[i];
+        if (st->acquisitions == 0) continue;
+        double pct = 100.0 * (double)st->contended / (double)st->acquisitions;
+        printf("    %-26s %12llu %10llu %7.2f%% %10.2f %12.1f %10.1f\n",
+               st->name,
+               (unsigned long long)st->acquisitions,
+               (unsigned long long)st->contended,
+               pct,
+               (double)st->total_wait_ns / 1e6,
+               (double)st->max_wait_ns / 1e3,
+               total_ops ? (double)st->total_wait_ns / (double)total_ops : 0);
+        for (int k = 0; k < FUSE_LOCK_TOP_SITES && st->top_sites[k].site[0]; k++) {
+            printf("      <- %-23s %10llu waits %10.2f ms\n",
+                   st->top_sites[k].site,
+                   (unsigned long long)st->top_sites[k].waits,
+                   (double)st->top_sites[k].wait_ns / 1e6);
+        }
+    }
+}
+
+// Directories the workload hit hardest, from the core hot path profiler
+static void print_hot_dirs(void) {
+    FuseHotEntry top[5];
+    int n = fuse_wrapper_get_hot_paths(FUSE_HOT_DIRS, FUSE_HOT_BY_LATENCY, top, 5);
+    if (n == 0) return;
+
+    printf("\nHot directories by handler time (all steps):\n");
+    for (int i = 0; i < n; i++) {
+        printf("  %-24s %10llu ops %10.1f ms %12llu bytes\n", top[i].path,
+               (unsigned long long)top[i].ops,
+               (double)top[i].latency_ns / 1e6,
+               (unsigned long long)top[i].bytes);
+    }
+}
+
+// Per-client accounting from the core (in-process: this process only)
+static void print_clients(void) {
+    FuseClientStats clients[4];
+    int n = fuse_wrapper_get_client_stats(clients, 4);
+    if (n == 0) return;
+
+    printf("\nClients (all steps):\n");
+    for (int i = 0; i < n; i++) {
+        printf("  %6d %-16s qos=%d %10llu ops %8llu err %8llu throttled (%.1f ms) %6llu copyup_denied\n",
+               clients[i].pid, clients[i].name, (int)clients[i].qos,
+               (unsigned long long)clients[i].ops,
+               (unsigned long long)clients[i].errors,
+               (unsigned long long)clients[i].throttled,
+               (double)clients[i].throttle_wait_ns / 1e6,
+               (unsigned long long)clients[i].copyups_denied);
+    }
+}
+
+static StepResult run_step(int threads) {
+    static Worker workers[MAX_THREADS];
+    pthread_t tids[MAX_THREADS];
+
+    memset(workers, 0, sizeof(workers));
+    fuse_wrapper_reset_lock_stats();
+    g_stop = 0;
+
+    for (int i = 0; i < threads; i++) {
+        workers[i].id = i;
+        workers[i].rng = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)(i + 1) * 0xBF58476D1CE4E5B9ULL);
+        pthread_create(&tids[i], NULL, worker_main, &workers[i]);
+    }
+
+    uint64_t t0 = now_ns();
+    sleep((unsigned)g_opt.duration);
+    __atomic_store_n(&g_stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < threads; i++) {
+        pthread_join(tids[i], NULL);
+    }
+    double elapsed = (double)(now_ns() - t0) / 1e9;
+
+    StepResult r = {.threads = threads};
+    uint64_t hist[HIST_BUCKETS] = {0};
+    for (int i = 0; i < threads; i++) {
+        for (int op = 0; op < W_COUNT; op++) r.total_ops += workers[i].ops[op];
+        r.errors += workers[i].errors;
+        for (int b = 0; b < HIST_BUCKETS; b++) hist[b] += workers[i].hist[b];
+    }
+    r.ops_per_sec = (double)r.total_ops / elapsed;
+    r.p50_us = hist_percentile_us(hist, r.total_ops, 0.50);
+    r.p99_us = hist_percentile_us(hist, r.total_ops, 0.99);
+
+    if (!g_opt.mode_mount) {
+        print_locks(threads, r.total_ops);
+    }
+    return r;
+}
+
+// ============================================================
+// Argument parsing
+// ============================================================
+
+static int parse_mix(const char *spec) {
+    int mix[W_COUNT] = {0};
+    char *copy = strdup(spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(tok, '=');
+        if (!eq) {
+            free(copy);
+            return -1;
+        }
+        *eq = '\0';
+        int found = 0;
+        for (int i = 0; i < W_COUNT; i++) {
+            if (strcmp(tok, g_work_names[i]) == 0) {
+                mix[i] = atoi(eq + 1);
+                found = 1;
+            }
+        }
+        if (!found) {
+            free(copy);
+            return -1;
+        }
+    }
+    free(copy);
+    memcpy(g_opt.mix, mix, sizeof(mix));
+    return 0;
+}
+
+static int parse_threads(const char *spec) {
+    g_opt.step_count = 0;
+    char *copy = strdup(spec);
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok && g_opt.step_count < MAX_STEPS;
+         tok = strtok_r(NULL, ",", &save)) {
+        int t = atoi(tok);
+        if (t < 1 || t > MAX_THREADS) {
+            free(copy);
+            return -1;
+        }
+        g_opt.thread_counts[g_opt.step_count++] = t;
+    }
+    free(copy);
+    return g_opt.step_count > 0 ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--mode inproc|mount] [--threads 1,2,4,...] [--duration S]\n"
+            "          [--files N] [--dirs N] [--file-size B] [--io-size B] [--place-size B]\n"
+            "          [--mix SPEC] [--local DIR] [--external DIR] [--mount DIR]\n"
+            "          [--qos interactive|background|bulk] [--shm FILE]\n"
+            "          [--metrics-socket PATH] [--set NAME=VALUE] [--csv]\n",
+            prog);
+}
+
+static char* make_temp_dir(const char *tag) {
+    char tmpl[256];
+    snprintf(tmpl, sizeof(tmpl), "/tmp/dmsa_stress_%s_XXXXXX", tag);
+    char *dir = mkdtemp(tmpl);
+    return dir ? strdup(dir) : NULL;
+}
+
+int main(int argc, char *argv[]) {
+    parse_threads("1,2,4,8,16,32,64");
+
+    for (int i = 1; i < argc; i++) {
+        const char *a = argv[i];
+        const char *v = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(a, "--csv") == 0) {
+            g_opt.csv = 1;
+            continue;
+        }
+        if (!v) {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+        int bad = 0;
+        if (strcmp(a, "--mode") == 0) {
+            if (strcmp(v, "mount") == 0) g_opt.mode_mount = 1;
+            else if (strcmp(v, "inproc") != 0) bad = 1;
+        } else if (strcmp(a, "--threads") == 0) {
+            bad = parse_threads(v);
+        } else if (strcmp(a, "--duration") == 0) {
+            g_opt.duration = atoi(v) > 0 ? atoi(v) : 1;
+        } else if (strcmp(a, "--files") == 0) {
+            g_opt.files = atoi(v) > 0 ? atoi(v) : 1;
+        } else if (strcmp(a, "--dirs") == 0) {
+            g_opt.dirs = atoi(v) > 0 ? atoi(v) : 1;
+        } else if (strcmp(a, "--file-size") == 0) {
+            g_opt.file_size = (size_t)strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--io-size") == 0) {
+            g_opt.io_size = (size_t)strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--place-size") == 0) {
+            g_opt.place_size = (size_t)strtoull(v, NULL, 10);
+        } else if (strcmp(a, "--mix") == 0) {
+            bad = parse_mix(v);
+        } else if (strcmp(a, "--local") == 0) {
+            g_opt.local_dir = strdup(v);
+        } else if (strcmp(a, "--external") == 0) {
+            g_opt.external_dir = strdup(v);
+        } else if (strcmp(a, "--mount") == 0) {
+            g_opt.mount_dir = strdup(v);
+        } else if (strcmp(a, "--shm") == 0) {
+            g_opt.shm_path = strdup(v);
+        } else if (strcmp(a, "--metrics-socket") == 0) {
+            g_opt.metrics_socket = strdup(v);
+        } else if (strcmp(a, "--set") == 0) {
+            if (g_opt.tunable_count < FUSE_TUNABLE_COUNT && strchr(v, '=')) {
+                g_opt.tunables[g_opt.tunable_count++] = strdup(v);
+            } else {
+                bad = 1;
+            }
+        } else if (strcmp(a, "--qos") == 0) {
+            if (strcmp(v, "interactive") == 0) g_opt.qos = FUSE_QOS_INTERACTIVE;
+            else if (strcmp(v, "background") == 0) g_opt.qos = FUSE_QOS_BACKGROUND;
+            else if (strcmp(v, "bulk") == 0) g_opt.qos = FUSE_QOS_BULK;
+            else bad = 1;
+        } else {
+            bad = 1;
+        }
+        if (bad) {
+            fprintf(stderr, LOG_PREFIX "Invalid option: %s %s\n", a, v);
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    g_opt.mix_total = 0;
+    for (int i = 0; i < W_COUNT; i++) g_opt.mix_total += g_opt.mix[i];
+    if (g_opt.mix_total <= 0 || g_opt.io_size == 0) {
+        fprintf(stderr, LOG_PREFIX "Empty workload mix\n");
+        return 2;
+    }
+
+    if (g_opt.mode_mount) {
+        if (!g_opt.mount_dir) {
+            fprintf(stderr, LOG_PREFIX "--mode mount requires --mount DIR\n");
+            return 2;
+        }
+        int res = populate_mount();
+        if (res != 0) {
+            fprintf(stderr, LOG_PREFIX "Dataset setup on mount failed: %s\n", strerror(-res));
+            return 1;
+        }
+    } else {
+        if (!g_opt.local_dir) g_opt.local_dir = make_temp_dir("local");
+        if (!g_opt.external_dir) g_opt.external_dir = make_temp_dir("external");
+        if (!g_opt.local_dir || !g_opt.external_dir) {
+            fprintf(stderr, LOG_PREFIX "Failed to create temp dirs: %s\n", strerror(errno));
+            return 1;
+        }
+        int res = populate_tier(g_opt.local_dir, 1);
+        if (res == 0) res = populate_tier(g_opt.external_dir, 0);
+        if (res != 0) {
+            fprintf(stderr, LOG_PREFIX "Dataset setup failed: %s\n", strerror(-res));
+            return 1;
+        }
+        if (fuse_wrapper_test_attach(g_opt.local_dir, g_opt.external_dir) != FUSE_WRAPPER_OK) {
+            fprintf(stderr, LOG_PREFIX "fuse_wrapper_test_attach failed\n");
+            return 1;
+        }
+        fuse_wrapper_set_index_ready(true);
+        fuse_wrapper_set_lock_profiling(1);
+        fuse_wrapper_set_hot_tracking(1);
+        for (int i = 0; i < g_opt.tunable_count; i++) {
+            char *eq = strchr(g_opt.tunables[i], '=');
+            *eq = '\0';
+            int id = fuse_wrapper_tunable_from_name(g_opt.tunables[i]);
+            if (id < 0 || fuse_wrapper_set_tunable((FuseTunable)id, strtoll(eq + 1, NULL, 10)) != FUSE_WRAPPER_OK) {
+                fprintf(stderr, LOG_PREFIX "Invalid tunable: %s=%s\n", g_opt.tunables[i], eq + 1);
+                return 2;
+            }
+        }
+        if (g_opt.shm_path && fuse_wrapper_shm_open(g_opt.shm_path, 0) != FUSE_WRAPPER_OK) {
+            fprintf(stderr, LOG_PREFIX "Cannot open shm segment %s\n", g_opt.shm_path);
+            return 1;
+        }
+        if (g_opt.metrics_socket && fuse_wrapper_metrics_start(g_opt.metrics_socket) != FUSE_WRAPPER_OK) {
+            fprintf(stderr, LOG_PREFIX "Cannot serve metrics on %s\n", g_opt.metrics_socket);
+            return 1;
+        }
+        if (g_opt.qos != FUSE_QOS_INTERACTIVE) {
+            // In-process ops are attributed to this process
+            const char *self = strrchr(argv[0], '/');
+            fuse_wrapper_set_qos_rule(self ? self + 1 : argv[0], (FuseQosClass)g_opt.qos);
+        }
+        g_ops = fuse_wrapper_test_operations();
+    }
+
+    if (g_opt.csv) {
+        printf("scaling,threads,ops_per_sec,speedup,efficiency,p50_us,p99_us,errors\n");
+        printf("lock,threads,name,acquisitions,contended,wait_ms,max_wait_us\n");
+    } else {
+        printf("mode=%s duration=%ds files=%d dirs=%d file_size=%zu io_size=%zu\n",
+               g_opt.mode_mount ? "mount" : "inproc", g_opt.duration, g_opt.files,
+               g_opt.dirs, g_opt.file_size, g_opt.io_size);
+        printf("mix:");
+        for (int i = 0; i < W_COUNT; i++) printf(" %s=%d", g_work_names[i], g_opt.mix[i]);
+        printf("\n\n");
+    }
+
+    StepResult results[MAX_STEPS] = {{0}};
+    for (int s = 0; s < g_opt.step_count; s++) {
+        results[s] = run_step(g_opt.thread_counts[s]);
+        fflush(stdout);
+    }
+
+    double base = results[0].ops_per_sec / results[0].threads;
+    if (g_opt.csv) {
+        for (int s = 0; s < g_opt.step_count; s++) {
+            double speedup = base > 0 ? results[s].ops_per_sec / base : 0;
+            printf("scaling,%d,%.1f,%.2f,%.3f,%.1f,%.1f,%llu\n",
+                   results[s].threads, results[s].ops_per_sec, speedup,
+                   speedup / results[s].threads, results[s].p50_us, results[s].p99_us,
+                   (unsigned long long)results[s].errors);
+        }
+    } else {
+        printf("\nScaling (speedup relative to single-thread throughput):\n");
+        printf("  %7s %12s %8s %10s %9s %9s %8s\n",
+               "threads", "ops/s", "speedup", "efficiency", "p50_us", "p99_us", "errors");
+        for (int s = 0; s < g_opt.step_count; s++) {
+            double speedup = base > 0 ? results[s].ops_per_sec / base : 0;
+            printf("  %7d %12.1f %7.2fx %9.1f%% %9.1f %9.1f %8llu\n",
+                   results[s].threads, results[s].ops_per_sec, speedup,
+                   100.0 * speedup / results[s].threads, results[s].p50_us,
+                   results[s].p99_us, (unsigned long long)results[s].errors);
+        }
+    }
+
+    if (!g_opt.mode_mount) {
+        if (!g_opt.csv) {
+            print_hot_dirs();
+            print_clients();
+        }
+        fuse_wrapper_metrics_stop();
+        fuse_wrapper_shm_close();
+        fuse_wrapper_test_detach();
+    }
+    return 0;
+}
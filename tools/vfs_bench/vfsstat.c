@@ -0,0 +1,235 @@
+/*
+ * vfsstat.c
+ * DMSA - Live VFS metrics from the shared-memory diagnostics segment
+ *
+ * Maps the segment the service publishes (fuse_shm.h) read-only and prints
+ * mount/tier health, queue depths and per-op throughput and latency. Never
+ * talks to the service, so it is safe to run at any refresh rate.
+ *
+ * Build:
+ *   tools/vfs_bench/build.sh vfsstat
+ *
+ * Usage:
+ *   dmsa_vfsstat [options] [FILE]
+ *
+ *   FILE                     Segment path (default:
+ *                            ~/Library/Application Support/DMSA/ServiceData/vfs_metrics.shm)
+ *   --interval S             Refresh every S seconds and show rates (default: one snapshot)
+ *   --count N                Stop after N refreshes
+ *
+ * With --interval, op counts are per-second rates and latency percentiles
+ * cover only the ops completed during the interval.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "fuse_shm.h"
+
+#define LOG_PREFIX "[VFSSTAT] "
+#define SNAPSHOT_RETRIES 1000
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int sig) {
+    (void)sig;
+    g_stop = 1;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+// Latency (us) at quantile q from a log2 histogram; reports the bucket upper bound
+static double hist_quantile_us(const uint64_t *hist, uint64_t total, double q) {
+    if (total == 0) return 0;
+    uint64_t target = (uint64_t)(q * (double)total);
+    uint64_t seen = 0;
+    for (int i = 0; i < FUSE_SHM_HIST_BUCKETS; i++) {
+        seen += hist[i];
+        if (seen > target) return (double)(1ULL << i);
+    }
+    return (double)(1ULL << (FUSE_SHM_HIST_BUCKETS - 1));
+}
+
+static void print_snapshot(const FuseShmSegment *cur, const FuseShmSegment *prev) {
+    double secs = prev ? (double)(cur->updated_ms - prev->updated_ms) / 1000.0 : 0;
+    if (prev && secs <= 0) secs = 1;
+    // Counters reset on mount; start the deltas over
+    if (prev && cur->total_ops < prev->total_ops) prev = NULL;
+
+    uint64_t age_ms = now_ms() - cur->updated_ms;
+    printf("writer=%d%s published=%llu age=%llums mounted=%d loop=%d index_ready=%d readonly=%d\n",
+           cur->writer_pid, cur->writer_pid ? "" : " (stopped)",
+           (unsigned long long)cur->publish_count, (unsigned long long)age_ms,
+           cur->is_mounted, cur->is_loop_running, cur->index_ready, cur->readonly);
+    printf("ops=%llu open_handles=%d clients=%d background=%d/%d slow_ops=%llu (>= %u ms)\n",
+           (unsigned long long)cur->total_ops, cur->open_handles, cur->clients,
+           cur->background_inflight, cur->background_slots,
+           (unsigned long long)cur->slow_ops, cur->slow_op_threshold_ms);
+    printf("callbacks: pending=%d/%d queued=%llu processed=%llu dropped=%llu\n",
+           cur->cb_pending, cur->cb_capacity, (unsigned long long)cur->cb_queued,
+           (unsigned long long)cur->cb_processed, (unsigned long long)cur->cb_dropped);
+    printf("sets: evicting=%d pending_delete=%d syncing=%d\n",
+           cur->evicting, cur->pending_delete, cur->syncing_files);
+    uint64_t hits = cur->local_hits - (prev ? prev->local_hits : 0);
+    uint64_t misses = cur->local_misses - (prev ? prev->local_misses : 0);
+    printf("local cache: hits=%llu misses=%llu hit_ratio=%.1f%%\n",
+           (unsigned long long)hits, (unsigned long long)misses,
+           hits + misses ? 100.0 * (double)hits / (double)(hits + misses) : 0.0);
+    uint64_t issued = cur->ext_reads_issued - (prev ? prev->ext_reads_issued : 0);
+    uint64_t merged = cur->ext_reads_merged - (prev ? prev->ext_reads_merged : 0);
+    printf("external io: queued=%d reads_issued=%llu merged=%llu window=%uus timeouts=%llu\n",
+           cur->ext_queued, (unsigned long long)issued, (unsigned long long)merged,
+           cur->ext_read_window_us,
+           (unsigned long long)(cur->ext_timeouts - (prev ? prev->ext_timeouts : 0)));
+
+    if (cur->hash_capacity) {
+        uint64_t lookups = cur->hash_lookups - (prev ? prev->hash_lookups : 0);
+        uint64_t hash_hits = cur->hash_hits - (prev ? prev->hash_hits : 0);
+        printf("hash cache: entries=%u/%u lookups=%llu hit_ratio=%.1f%%\n",
+               cur->hash_entries, cur->hash_capacity, (unsigned long long)lookups,
+               lookups ? 100.0 * (double)hash_hits / (double)lookups : 0.0);
+    }
+
+    static const char *tier_names[FUSE_SHM_TIER_COUNT] = { "local", "external" };
+    for (int t = 0; t < FUSE_SHM_TIER_COUNT; t++) {
+        const FuseShmTierStats *ts = &cur->tiers[t];
+        uint64_t ops = ts->ops - (prev ? prev->tiers[t].ops : 0);
+        uint64_t errs = ts->errors - (prev ? prev->tiers[t].errors : 0);
+        uint64_t rns = ts->resolve_ns - (prev ? prev->tiers[t].resolve_ns : 0);
+        printf("tier %-8s %-7s ops=%llu errors=%llu avg_resolve=%.1fus last_error=%s\n",
+               tier_names[t], ts->online ? "online" : "OFFLINE",
+               (unsigned long long)ops, (unsigned long long)errs,
+               ops ? (double)rns / (double)ops / 1000.0 : 0.0,
+               ts->last_error_ms ? "yes" : "never");
+    }
+
+    printf("\n  %-12s %12s %8s %10s %9s %9s %9s\n",
+           "op", prev ? "ops/s" : "ops", "errors", prev ? "MB/s" : "MB", "avg_us", "p50_us", "p99_us");
+    uint32_t n = cur->op_count < FUSE_SHM_MAX_OPS ? cur->op_count : FUSE_SHM_MAX_OPS;
+    for (uint32_t op = 0; op < n; op++) {
+        const FuseShmOpStats *o = &cur->ops[op];
+        const FuseShmOpStats *p = prev ? &prev->ops[op] : NULL;
+        uint64_t count = o->count - (p ? p->count : 0);
+        if (count == 0) continue;
+
+        uint64_t hist[FUSE_SHM_HIST_BUCKETS];
+        for (int i = 0; i < FUSE_SHM_HIST_BUCKETS; i++) {
+            hist[i] = o->hist[i] - (p ? p->hist[i] : 0);
+        }
+        uint64_t errors = o->errors - (p ? p->errors : 0);
+        double mb = (double)(o->bytes - (p ? p->bytes : 0)) / (1024.0 * 1024.0);
+        double avg_us = (double)(o->total_ns - (p ? p->total_ns : 0)) / (double)count / 1000.0;
+        printf("  %-12s %12.1f %8llu %10.2f %9.1f %9.0f %9.0f\n",
+               o->name, p ? (double)count / secs : (double)count,
+               (unsigned long long)errors, p ? mb / secs : mb, avg_us,
+               hist_quantile_us(hist, count, 0.50), hist_quantile_us(hist, count, 0.99));
+    }
+
+    if (cur->lock_profiling) {
+        int header = 0;
+        uint32_t nl = cur->lock_count < FUSE_SHM_MAX_LOCKS ? cur->lock_count : FUSE_SHM_MAX_LOCKS;
+        for (uint32_t id = 0; id < nl; id++) {
+            const FuseShmLockStats *l = &cur->locks[id];
+            uint64_t contended = l->contended - (prev ? prev->locks[id].contended : 0);
+            if (contended == 0) continue;
+            if (!header) {
+                printf("\n  %-18s %12s %10s %10s\n", "lock", "contended", "wait_ms", "max_us");
+                header = 1;
+            }
+            printf("  %-18s %12llu %10.3f %10.1f\n", l->name, (unsigned long long)contended,
+                   (double)(l->wait_ns - (prev ? prev->locks[id].wait_ns : 0)) / 1e6,
+                   (double)l->max_wait_ns / 1e3);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--interval S] [--count N] [FILE]\n", prog);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = NULL;
+    int interval = 0;
+    int count = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+            count = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+
+    char default_path[1024];
+    if (!path) {
+        const char *home = getenv("HOME");
+        snprintf(default_path, sizeof(default_path),
+                 "%s/Library/Application Support/DMSA/ServiceData/" FUSE_SHM_FILE_NAME,
+                 home ? home : "");
+        path = default_path;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, LOG_PREFIX "Cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FuseShmSegment)) {
+        fprintf(stderr, LOG_PREFIX "%s is not a metrics segment (size %lld)\n",
+                path, (long long)st.st_size);
+        close(fd);
+        return 1;
+    }
+    const FuseShmSegment *seg = mmap(NULL, sizeof(FuseShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (seg == MAP_FAILED) {
+        fprintf(stderr, LOG_PREFIX "mmap failed: %s\n", strerror(errno));
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    static FuseShmSegment snaps[2];
+    int cur = 0;
+    int have_prev = 0;
+    for (int n = 0; !g_stop && (count == 0 || n < count); n++) {
+        int res = fuse_shm_read_snapshot(seg, &snaps[cur], SNAPSHOT_RETRIES);
+        if (res == -1) {
+            fprintf(stderr, LOG_PREFIX "Segment header invalid (magic/version %08x/%u, expected v%d)\n",
+                    seg->magic, seg->version, FUSE_SHM_VERSION);
+            return 1;
+        }
+        if (res == 0) {
+            print_snapshot(&snaps[cur], have_prev ? &snaps[cur ^ 1] : NULL);
+            have_prev = 1;
+            cur ^= 1;
+        }
+        if (interval <= 0) break;
+        sleep((unsigned)interval);
+    }
+
+    munmap((void *)seg, sizeof(FuseShmSegment));
+    return 0;
+}